@@ -18,6 +18,8 @@ static inline CHBinaryTreeNode* singleRotation(CHBinaryTreeNode *node, u_int32_t
     CHBinaryTreeNode *save = node->link[!dir];
     node->link[!dir] = save->link[dir];
     save->link[dir] = node;
+	save->size = node->size;
+	CHUpdateSubtreeSize(node);
 	return save;
 }
 
@@ -31,6 +33,9 @@ static inline CHBinaryTreeNode* doubleRotation(CHBinaryTreeNode *node, u_int32_t
     save = node->link[!dir];
     node->link[!dir] = save->link[dir];
     save->link[dir] = node;
+	save->size = node->size;
+	CHUpdateSubtreeSize(node);
+	CHUpdateSubtreeSize(save->link[!dir]);
     return save;
 }
 
@@ -62,10 +67,14 @@ static inline void adjustBalance(CHBinaryTreeNode *root, u_int32_t dir, int32_t
 	CHBinaryTreeStack * stack;
 	stack = [[CHBinaryTreeStack alloc] init];
 	
+	// Every node on the path changes (if only its size), so none may be shared.
+	// Rotations only involve nodes on the path, so no others need to be copied.
 	sentinel->object = anObject; // Assure that we find a spot to insert
 	NSComparisonResult comparison;
-	while (comparison = [current->object compare:anObject]) {
+	while (comparison = CHSearchTreeCompare(comparator, current->object, anObject)) {
 		[stack push:current];
+		++(current->size); // Assume the object is new; undo below if not.
+		CHUnshareBinaryTreeNode(nodePool, &current->link[comparison == NSOrderedAscending], sentinel);
 		if (current == header)
 			save = current->right;
 		else if (current->balance != 0)
@@ -79,17 +88,19 @@ static inline void adjustBalance(CHBinaryTreeNode *root, u_int32_t dir, int32_t
 		// Replace the existing object with the new object.
 		[current->object release];
 		current->object = anObject;
+		while (current = [stack pop])
+			--(current->size);
 		// No need to rebalance up the path since we didn't modify the structure
 		goto done;
 	} else {
-		current = CHCreateBinaryTreeNodeWithObject(anObject);
+		current = CHCreateBinaryTreeNodeFromPool(nodePool, anObject);
 		current->left   = sentinel;
 		current->right  = sentinel;
 		++count;
 		// Link from parent as the proper child, based on last comparison
 		parent = [stack pop];
 		NSAssert(parent != nil, @"Illegal state, parent should never be nil!");
-		comparison = [parent->object compare:anObject];
+		comparison = CHSearchTreeCompare(comparator, parent->object, anObject);
 		parent->link[comparison == NSOrderedAscending] = current; // R if YES
 	}
 	
@@ -125,7 +136,7 @@ static inline void adjustBalance(CHBinaryTreeNode *root, u_int32_t dir, int32_t
 		parent = [stack pop];
 		NSAssert(parent != nil, @"Illegal state, parent should never be nil!");
 		// Link from parent as the proper child, based on last comparison
-		comparison = [parent->object compare:current->object];
+		comparison = CHSearchTreeCompare(comparator, parent->object, current->object);
 		parent->link[comparison == NSOrderedAscending] = current; // R if YES
 	}
 done:
@@ -136,6 +147,9 @@ done:
 	if (count == 0 || anObject == nil)
 		return;
 	++mutations;
+	// Don't copy any nodes shared with a snapshot unless the object is there to remove.
+	if (CHSearchTreeMayShareNodes() && [self member:anObject] == nil)
+		return;
 
 	CHBinaryTreeNode *parent, *current = header;
 	CHBinaryTreeStack * stack;
@@ -144,12 +158,15 @@ done:
 	sentinel->object = anObject; // Assure that we stop at a leaf if not found.
 	NSComparisonResult comparison;
 	// Search down the node for the tree and save the path
-	while (comparison = [current->object compare:anObject]) {
+	while (comparison = CHSearchTreeCompare(comparator, current->object, anObject)) {
 		[stack push:current];
-		current = current->link[comparison == NSOrderedAscending]; // R on YES
+		--(current->size); // Assume the object is present; undo below if not.
+		current = CHUnshareBinaryTreeNode(nodePool, &current->link[comparison == NSOrderedAscending], sentinel); // R on YES
 	}
 	// Exit if the specified node was not found in the tree.
 	if (current == sentinel) {
+		while (current = [stack pop])
+			++(current->size);
 		goto done;
 	}
 	
@@ -164,23 +181,23 @@ done:
 		NSAssert(parent != nil, @"Illegal state, parent should never be nil!");
 		isRightChild = (parent->right == current);
 		parent->link[isRightChild] = replacement;
-		if (kCHGarbageCollectionNotEnabled)
-			free(current);
+		CHRecycleBinaryTreeNode(nodePool, current);
 	} else {
 		// Two child case -- replace with minimum object in right subtree
 		[stack push:current]; // Need to start here when rebalancing
-		replacement = current->right;
+		--(current->size);
+		replacement = CHUnshareBinaryTreeNode(nodePool, &current->right, sentinel);
 		while (replacement->left != sentinel) {
 			[stack push:replacement];
-			replacement = replacement->left;
+			--(replacement->size);
+			replacement = CHUnshareBinaryTreeNode(nodePool, &replacement->left, sentinel);
 		}
 		// Grab object from replacement node, steal its right child, deallocate
 		current->object = replacement->object;
 		parent = [stack pop];
 		isRightChild = (parent->right == replacement);
 		parent->link[isRightChild] = replacement->right;
-		if (kCHGarbageCollectionNotEnabled)
-			free(replacement);
+		CHRecycleBinaryTreeNode(nodePool, replacement);
 	}
 	
 	// Trace back up the search path, rebalancing as we go until we're done
@@ -193,8 +210,11 @@ done:
 			parent->balance++;
 		// If the subtree heights differ by more than 1, rebalance them
 		if (parent->balance > 1 || parent->balance < -1) {
-			CHBinaryTreeNode *node = parent->link[!isRightChild];
+			// The sibling subtree is rotated up, so its nodes which move can't be shared.
+			CHBinaryTreeNode *node = CHUnshareBinaryTreeNode(nodePool, &parent->link[!isRightChild], sentinel);
 			int32_t bal = (isRightChild) ? +1 : -1;
+			if (node->balance == bal)
+				CHUnshareBinaryTreeNode(nodePool, &node->link[isRightChild], sentinel);
 			if (node->balance == -bal) {
 				parent->balance = node->balance = 0;
 				parent = singleRotation(parent, isRightChild);
@@ -209,7 +229,7 @@ done:
 				parent = singleRotation(parent, isRightChild);
 				done = YES;
 			}
-			comparison = [[stack top]->object compare:parent->object];
+			comparison = CHSearchTreeCompare(comparator, [stack top]->object, parent->object);
 			[stack top]->link[comparison == NSOrderedAscending] = parent;
 		}
 		else if (parent->balance != 0)
@@ -223,6 +243,22 @@ done:
 	[stack release];
 }
 
+// Bulk-loaded subtrees have minimal height, and the right is never smaller.
+- (void) prepareBulkLoadedNode:(CHBinaryTreeNode*)node
+                          size:(NSUInteger)size
+                         depth:(NSUInteger)depth
+                      maxDepth:(NSUInteger)maxDepth
+{
+	// A subtree of n nodes with minimal height is floor(log2(n))+1 levels tall.
+	NSUInteger leftSize = (size - 1) / 2, rightSize = size - 1 - leftSize;
+	NSUInteger leftHeight = 0, rightHeight = 0;
+	for (; leftSize > 0; leftSize >>= 1)
+		leftHeight++;
+	for (; rightSize > 0; rightSize >>= 1)
+		rightHeight++;
+	node->balance = (int32_t) (rightHeight - leftHeight);
+}
+
 - (NSString*) debugDescriptionForNode:(CHBinaryTreeNode*)node {
 	return [NSString stringWithFormat:@"[%2d]\t\"%@\"",
 			node->balance, node->object];
@@ -37,6 +37,7 @@
             u_int32_t level;     // Used by CHAnderssonTree
             u_int32_t priority;  // Used by CHTreap
         };
+        u_int32_t size;
     } CHBinaryTreeNode;</pre>
  
  The nested anonymous union and structs are to provide flexibility for dealing with various types of trees and access. (For those not familiar, a <a href="http://en.wikipedia.org/wiki/Union_(computer_science)">union</a> is a data structure in which all members are stored at the same memory location, and can take on the value of any of its fields. A union occupies only as much space as the largest member, whereas a struct requires space equal to at least the sum of the size of its members.)
@@ -45,6 +46,12 @@
  - The second union allows balanced trees to store extra data at each node, while using the field name and type that makes sense for its algorithms. This allows for generic reuse while promoting meaningful semantics and preserving space. These fields use 32-bit-only types since we don't need extra space in 64-bit mode.
  
  Since CHUnbalancedTree doesn't store any extra data, the second union is essentially 4 bytes of pure overhead per node. However, since unbalanced trees are generally not a good choice for sorting large data sets anyway, this is largely a moot point.
+ 
+ The @a size field records the number of nodes in the subtree rooted at a node (including the node itself), and is maintained by all subclasses through insertions, removals and rotations. This makes it possible to find an object by its rank (or the rank of an object) in O(log n) time. The size of the sentinel node is always 0. In 64-bit mode, the field occupies space that would otherwise be padding, so nodes do not get any larger (32 bytes either way). In 32-bit mode (including iOS) there is no such padding, so the field makes each node 4 bytes larger, growing it from 16 to 20 bytes.
+ 
+ A node may be shared by a tree and its \link CHAbstractBinarySearchTree#snapshot snapshots\endlink. A tree never modifies a node that is shared; it copies the node first, along with every node above it which is also shared, so a modification copies little more than the path from the root to the nodes it changes. The links to shared nodes are counted in a table kept with the nodes of the tree (only once a snapshot has been taken) rather than in each node, so trees which are never shared don't pay for the count.
+ 
+ Red-black color and AVL balance would fit in the low bits of the child pointers, since nodes are always at least 8-byte aligned, but in 64-bit mode that would not make nodes any smaller: the object, the two child pointers and the @a size field take 28 bytes, which are padded to 32 regardless, so a 24-byte node would require giving up rank queries. In 32-bit mode, red-black and AVL nodes would shrink from 20 to 16 bytes; the other trees need more bits than the pointers have spare (a treap priority takes all 32), so the layout of a node would have to depend on the subclass. Tagged child pointers would also hide the links from the garbage collector and add a mask to every step of every search. (The per-object footprint of each tree is reported by BenchmarkSearchTree.)
  */
 typedef struct CHBinaryTreeNode {
 	id object;                        ///< The object stored in the node.
@@ -61,9 +68,27 @@ typedef struct CHBinaryTreeNode {
 		u_int32_t level;     // Used by CHAnderssonTree
 		u_int32_t priority;  // Used by CHTreap
 	};
+	u_int32_t size;                   ///< The number of nodes in this subtree.
 } CHBinaryTreeNode;
 // NOTE: If the compiler issues "Declaration does not declare anthing" warnings for this struct, change the C Language Dialect in your Xcode build settings to GNU99; anonymous structs and unions are not properly supported by the C99 standard.
 
+// Opaque storage for tree nodes; defined in CHAbstractBinarySearchTree_Internal.h
+struct CHBinaryTreeNodePool;
+
+// Opaque comparison state; defined in CHAbstractBinarySearchTree_Internal.h
+struct CHSearchTreeComparator;
+
+@class CHSearchTreeCursor;
+
+/**
+ A function which determines the order of objects in a search tree. The function must return @c NSOrderedAscending if @a object1 should precede @a object2, @c NSOrderedDescending if it should follow @a object2, or @c NSOrderedSame if the objects are equivalent. The ordering must be consistent for any pair of objects, and every object must compare as @c NSOrderedSame with itself. The signature is the same as the functions used by \link NSArray#sortedArrayUsingFunction:context: -[NSArray sortedArrayUsingFunction:context:]\endlink, so existing functions can be reused.
+ 
+ @param object1 The first object to be compared.
+ @param object2 The second object to be compared.
+ @param context The context pointer which was provided when the tree was created.
+ */
+typedef NSInteger (*CHComparisonFunction)(id object1, id object2, void *context);
+
 /**
  An abstract CHSearchTree with many default method implementations. Methods for search, size, and enumeration are implemented in this class, as are methods for NSCoding, NSCopying, and NSFastEnumeration. (This works since all child classes use the CHBinaryTreeNode struct.) Any subclass @b must implement \link #addObject: -addObject:\endlink and \link #removeObject: -removeObject:\endlink according to the inner workings of that specific tree.
  
@@ -75,10 +100,154 @@ typedef struct CHBinaryTreeNode {
 {
 	__strong CHBinaryTreeNode *header; // Dummy header; no more checks for root.
 	__strong CHBinaryTreeNode *sentinel; // Dummy leaf; no more checks for NULL.
+	__strong struct CHBinaryTreeNodePool *nodePool; // Slabs of nodes for objects.
+	__strong struct CHSearchTreeComparator *comparator; // Orders the objects.
 	NSUInteger count; // The number of objects currently in the tree.
 	unsigned long mutations; // Tracks mutations for NSFastEnumeration.
 }
 
+/**
+ Initializes a search tree which orders objects using a comparison function, rather than sending them @c -compare: messages. This avoids dynamic message dispatch at each level of the tree, and allows objects to be ordered in a way other than their natural order.
+ 
+ @param function The function used to compare objects; must not be @c NULL.
+ @param context An arbitrary pointer which is passed to @a function with each comparison. It is not retained, and must remain valid for the lifetime of the tree (and any copies or subsets of it).
+ @return An initialized search tree which orders objects using @a function.
+ 
+ @attention Only the objects in a tree can be archived, not its comparison function. A tree decoded with @c -initWithCoder: orders objects with @c -compare: instead.
+ 
+ @throw NSInvalidArgumentException If @a function is @c NULL.
+ */
+- (id) initWithComparisonFunction:(CHComparisonFunction)function context:(void*)context;
+
+#if NS_BLOCKS_AVAILABLE
+/**
+ Initializes a search tree which orders objects using a comparator block, rather than sending them @c -compare: messages. The block is copied, and the same caveats apply as for #initWithComparisonFunction:context:.
+ 
+ @param cmptr The block used to compare objects; must not be @c nil.
+ @return An initialized search tree which orders objects using @a cmptr.
+ 
+ @throw NSInvalidArgumentException If @a cmptr is @c nil.
+ */
+- (id) initWithComparator:(NSComparator)cmptr;
+#endif
+
+#pragma mark Order Statistics
+
+/**
+ Returns the object with a given rank (the zero-based index of the object in ascending order) in O(log n) time.
+ 
+ @param rank The rank of the object to return.
+ @return The object at position @a rank in ascending order.
+ 
+ @throw NSRangeException If @a rank is greater than or equal to the number of objects in the receiver.
+ 
+ @see rankOfObject:
+ */
+- (id) objectAtRank:(NSUInteger)rank;
+
+/**
+ Returns the rank of a given object (the number of objects in the receiver that are less than it) in O(log n) time.
+ 
+ @param anObject The object to search for in the receiver.
+ @return The zero-based position of @a anObject in ascending order, or @c NSNotFound if no object in the receiver is equal to @a anObject.
+ 
+ @see objectAtRank:
+ */
+- (NSUInteger) rankOfObject:(id)anObject;
+
+/**
+ Returns the number of objects in a range of the receiver in O(log n) time, without enumerating them. The range is interpreted exactly as by \link CHSortedSet#subsetFromObject:toObject:options: -subsetFromObject:toObject:options:\endlink with no options, so the result is equal to the count of the subset that method would return.
+ 
+ @param start The low endpoint of the range, or @c nil to count from the first object.
+ @param end The high endpoint of the range, or @c nil to count through the last object.
+ @return The number of objects in the receiver which fall within the specified range.
+ */
+- (NSUInteger) countOfObjectsFromObject:(id)start toObject:(id)end;
+
+#pragma mark Set Operations
+
+/**
+ Adds each object in another sorted set to the receiver, if not already present. Where both sets contain equal objects, the object from @a otherSortedSet replaces the one in the receiver, just as with \link #addObject: -addObject:\endlink.
+ 
+ If @a otherSortedSet is much smaller than the receiver, its objects are simply added one at a time in O(m log n) time. Otherwise, the objects in both sets are merged in order and the receiver is rebuilt as a balanced tree in O(n + m) time. The sets can only be merged if @a otherSortedSet is a tree, B+ tree, skip list or frozen set ordered exactly like the receiver (by @c -compare:, or the same function and context, or the same block); otherwise, its objects are always added one at a time.
+ 
+ @param otherSortedSet The sorted set of objects to add to the receiver.
+ 
+ @see intersectWithSortedSet:
+ @see minusSortedSet:
+ */
+- (void) unionWithSortedSet:(id<CHSortedSet>)otherSortedSet;
+
+/**
+ Removes from the receiver each object that is not also in another sorted set. The objects which remain are those which were in the receiver.
+ 
+ If either set is much smaller than the other, each object in the smaller set is looked up in the larger one in O(m log n) time. Otherwise, the objects in both sets are merged in order in O(n + m) time. Either way, the receiver is then rebuilt as a balanced tree from the remaining objects. If @a otherSortedSet is not ordered exactly like the receiver (see #unionWithSortedSet:), the objects are never merged; each object in the smaller set is looked up in the other instead.
+ 
+ @param otherSortedSet The sorted set of objects with which to intersect the receiver.
+ 
+ @see minusSortedSet:
+ @see unionWithSortedSet:
+ */
+- (void) intersectWithSortedSet:(id<CHSortedSet>)otherSortedSet;
+
+/**
+ Removes from the receiver each object that is also in another sorted set.
+ 
+ If @a otherSortedSet is much smaller than the receiver, its objects are simply removed one at a time in O(m log n) time. If the receiver is much smaller, each of its objects is looked up in @a otherSortedSet instead. Otherwise, the objects in both sets are merged in order in O(n + m) time, unless @a otherSortedSet is not ordered exactly like the receiver (see #unionWithSortedSet:), in which case the objects in the smaller set are removed or looked up one at a time. When the receiver's objects are looked up or merged, the receiver is then rebuilt as a balanced tree from the remaining objects.
+ 
+ @param otherSortedSet The sorted set of objects to remove from the receiver.
+ 
+ @see intersectWithSortedSet:
+ @see unionWithSortedSet:
+ */
+- (void) minusSortedSet:(id<CHSortedSet>)otherSortedSet;
+
+#pragma mark Snapshots
+
+/**
+ Returns an immutable view of the objects currently in the receiver, in O(1) time. The snapshot shares the nodes of the receiver rather than copying them, and does not change when the receiver is modified. Any attempt to modify the snapshot raises an exception; a copy of a snapshot is the snapshot itself, and an archived snapshot is decoded as a tree of the same class as the receiver.
+ 
+ When the receiver is modified after a snapshot is taken, it first copies the nodes it changes which the snapshot still uses, along with the path above them (typically O(log n) nodes for a balanced tree), so the snapshot is not affected; nothing is copied if the modification turns out to change nothing, such as removing an object which isn't there. Each node is freed when neither the receiver nor any snapshot uses it. This makes it cheap to take a snapshot of a tree that is mostly read, to take many snapshots between modifications, or to keep a snapshot while the receiver goes on changing.
+ 
+ A snapshot may be read from any thread without locking, even while the receiver is being modified on another thread. (Taking the snapshot must still be synchronized with modifications of the receiver, such as by using the lock of the receiver.)
+ 
+ @return An immutable snapshot of the receiver, which supports all the methods for reading a search tree (including order statistics, subsets and cursors).
+ */
+- (CHAbstractBinarySearchTree*) snapshot;
+
+/**
+ Moves the nodes of the receiver into a single contiguous block of memory, in O(n) time with no comparisons. The nodes are laid out in level order, so the top levels of the tree (which every search visits) share a few cache lines, and the children of each node are adjacent. The shape of the tree is not changed, and neither are its contents.
+ 
+ A tree which is built all at once (such as by \link #initWithArray: -initWithArray:\endlink or \link NSCopying#copyWithZone: -copy\endlink) already has contiguous nodes, in the order they were created. After many insertions and removals, however, the nodes are spread across many smaller blocks, with gaps left by removed objects. Compacting a tree which will mostly be searched from then on restores the locality of its nodes, and frees the memory left in the gaps.
+ 
+ Any enumerators or cursors on the receiver are invalidated. If the receiver shares its nodes with a snapshot, the snapshot keeps the original nodes.
+ */
+- (void) compact;
+
+#pragma mark Cursors
+
+/**
+ Returns a cursor positioned at the object in the receiver which is equal to a given object, from which neighboring objects can be visited in either direction. Finding the object takes O(log n) time; thereafter each step takes O(1) amortized time.
+ 
+ @param anObject The object at which to position the cursor.
+ @return A cursor positioned at the object in the receiver which is equal to @a anObject, or @c nil if there is no such object.
+ 
+ @see cursorAtFirstGreaterOrEqual:
+ */
+- (CHSearchTreeCursor*) cursorAtObject:(id)anObject;
+
+/**
+ Returns a cursor positioned at the smallest object in the receiver which is not less than a given object, from which neighboring objects can be visited in either direction. This is typically the starting point for scanning the objects in a range. Finding the object takes O(log n) time; thereafter each step takes O(1) amortized time.
+ 
+ @param anObject The object at which to position the cursor, or @c nil to position it at the first object in the receiver.
+ @return A cursor positioned at the first object in the receiver which is greater than or equal to @a anObject. If there is no such object, the cursor is positioned past the last object, so \link CHSearchTreeCursor#object -object\endlink returns @c nil and \link CHSearchTreeCursor#previous -previous\endlink returns the last object.
+ 
+ @see cursorAtObject:
+ */
+- (CHSearchTreeCursor*) cursorAtFirstGreaterOrEqual:(id)anObject;
+
+#pragma mark Debugging
+
 /**
  Produces a representation of the receiver that can be useful for debugging.
  
@@ -104,3 +273,55 @@ typedef struct CHBinaryTreeNode {
 - (NSString*) dotGraphString;
 
 @end
+
+#pragma mark -
+
+/**
+ A position within a CHAbstractBinarySearchTree, which can be moved forward and backward through the objects of the tree in ascending order. Cursors are created by \link CHAbstractBinarySearchTree#cursorAtObject: -cursorAtObject:\endlink and \link CHAbstractBinarySearchTree#cursorAtFirstGreaterOrEqual: -cursorAtFirstGreaterOrEqual:\endlink.
+ 
+ Since tree nodes do not have parent links, a cursor records the path from the root of the tree to its current node. Stepping to an adjacent object either descends from the current node or climbs back up this path, so a sequence of steps takes O(1) amortized time each, and a cursor may be kept and resumed at any time without searching the tree again.
+ 
+ Unlike an enumerator, a cursor remains usable if its tree is modified. The cursor retains its current object, and the next step after a modification searches the tree again (in O(log n) time) for the object which follows or precedes it, whether or not the current object is still in the tree.
+ */
+@interface CHSearchTreeCursor : NSObject
+{
+	__strong CHAbstractBinarySearchTree *searchTree; // The tree being traversed.
+	__strong CHBinaryTreeNode *headerNode; // Header node in the tree.
+	__strong CHBinaryTreeNode *sentinelNode; // Sentinel node in the tree.
+	__strong CHBinaryTreeNode **sentinelPointer; // Where the tree keeps it.
+	__strong struct CHSearchTreeComparator *comparator; // Orders the objects.
+	__strong CHBinaryTreeNode **path; // Nodes from the root to the current node.
+	NSUInteger pathSize; // The number of nodes in the path; 0 if off either end.
+	NSUInteger pathCapacity; // The number of nodes that fit in the path array.
+	id object; // The object in the current node (retained), or nil.
+	BOOL beforeFirst; // Whether the cursor has moved before the first object.
+	unsigned long mutationCount; // The tree's mutation count at the last step.
+	unsigned long *mutationPtr; // Pointer for checking changes in mutation.
+}
+
+/**
+ Returns the object at the current position of the receiver.
+ 
+ @return The object at the current position of the receiver, or @c nil if it has moved past either end of the tree.
+ */
+- (id) object;
+
+/**
+ Moves the receiver to the next object in ascending order, and returns that object. If the receiver is positioned before the first object, it moves to the first object.
+ 
+ @return The object at the new position of the receiver, or @c nil if it has moved past the last object.
+ 
+ @see previous
+ */
+- (id) next;
+
+/**
+ Moves the receiver to the previous object in ascending order, and returns that object. If the receiver is positioned past the last object, it moves to the last object.
+ 
+ @return The object at the new position of the receiver, or @c nil if it has moved before the first object.
+ 
+ @see next
+ */
+- (id) previous;
+
+@end
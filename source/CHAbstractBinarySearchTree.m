@@ -165,7 +165,6 @@ static CHSearchTreeHeaderObject *headerObject = nil;
 			current = root;
 		}
 	}
-	sentinel->object = nil;
 	sentinelNode = sentinel;
 	mutationCount = *mutations;
 	mutationPtr = mutations;
@@ -292,21 +291,766 @@ static CHSearchTreeHeaderObject *headerObject = nil;
 
 #pragma mark -
 
+@interface CHSearchTreeCursor ()
+
+/**
+ Create a cursor for a given tree. The cursor has no position until #seekObject:ascending:orEqual: is called.
+ 
+ @param tree The tree through which the cursor moves. The tree is retained by the cursor.
+ @param header The header node of @a tree, whose right child is the root.
+ @param sentinel A pointer to the sentinel value used at the leaves of @a tree. (A tree that shares its nodes with a snapshot gets a new sentinel when it is emptied or compacted.)
+ @param treeComparator The comparison state which orders the objects in @a tree.
+ @param mutations A pointer to the tree's mutation count, for detecting changes.
+ @return An initialized cursor which moves through the objects in @a tree.
+ */
+- (id) initWithTree:(CHAbstractBinarySearchTree*)tree
+             header:(CHBinaryTreeNode*)header
+           sentinel:(CHBinaryTreeNode**)sentinel
+         comparator:(CHSearchTreeComparator*)treeComparator
+    mutationPointer:(unsigned long*)mutations;
+
+/**
+ Positions the receiver by searching the tree from the root, in O(log n) time.
+ 
+ @param anObject The object to search for, or @c nil to find the first (or last) object.
+ @param ascending If @c YES, find the first object greater than @a anObject; otherwise, find the last object less than @a anObject.
+ @param orEqual Whether an object equal to @a anObject is also acceptable.
+ @return The object at the new position of the receiver, or @c nil if there is no such object, in which case the receiver moves past the last object (if @a ascending) or before the first object.
+ */
+- (id) seekObject:(id)anObject ascending:(BOOL)ascending orEqual:(BOOL)orEqual;
+
+@end
+
+// Appends a node to the path of a cursor, growing the path array if necessary.
+#define CHCursorPathPush(node) { \
+	if (pathSize == pathCapacity) { \
+		pathCapacity *= 2; \
+		path = NSReallocateCollectable(path, kCHPointerSize*pathCapacity, NSScannedOption); \
+	} \
+	path[pathSize++] = (node); \
+}
+
+// Makes the object in the last node of the path (if any) the current object.
+#define CHCursorUpdateObject() { \
+	id newObject = (pathSize > 0) ? path[pathSize-1]->object : nil; \
+	[newObject retain]; \
+	[object release]; \
+	object = newObject; \
+	mutationCount = *mutationPtr; \
+}
+
+@implementation CHSearchTreeCursor
+
+- (id) initWithTree:(CHAbstractBinarySearchTree*)tree
+             header:(CHBinaryTreeNode*)header
+           sentinel:(CHBinaryTreeNode**)sentinel
+         comparator:(CHSearchTreeComparator*)treeComparator
+    mutationPointer:(unsigned long*)mutations
+{
+	if ((self = [super init]) == nil) return nil;
+	searchTree = [tree retain];
+	headerNode = header;
+	sentinelPointer = sentinel;
+	sentinelNode = *sentinel;
+	comparator = treeComparator;
+	pathCapacity = 32; // Deep enough for any balanced tree of practical size
+	path = NSAllocateCollectable(kCHPointerSize*pathCapacity, NSScannedOption);
+	pathSize = 0;
+	mutationPtr = mutations;
+	mutationCount = *mutations;
+	return self;
+}
+
+- (void) dealloc {
+	[searchTree release];
+	[object release];
+	if (kCHGarbageCollectionNotEnabled)
+		free(path);
+	[super dealloc];
+}
+
+- (id) object {
+	return object;
+}
+
+- (id) next {
+	if (object == nil) // Either before the first object or past the last
+		return beforeFirst ? [self seekObject:nil ascending:YES orEqual:YES] : nil;
+	if (mutationCount != *mutationPtr)
+		return [self seekObject:object ascending:YES orEqual:NO];
+	CHBinaryTreeNode *current = path[pathSize-1]->right;
+	if (current != sentinelNode) {
+		// The successor is the leftmost node in the right subtree
+		do {
+			CHCursorPathPush(current);
+			current = current->left;
+		} while (current != sentinelNode);
+	}
+	else {
+		// The successor is the nearest ancestor reached from its left subtree
+		do {
+			current = path[--pathSize];
+		} while (pathSize > 0 && path[pathSize-1]->right == current);
+	}
+	beforeFirst = NO;
+	CHCursorUpdateObject();
+	return object;
+}
+
+- (id) previous {
+	if (object == nil) // Either before the first object or past the last
+		return beforeFirst ? nil : [self seekObject:nil ascending:NO orEqual:YES];
+	if (mutationCount != *mutationPtr)
+		return [self seekObject:object ascending:NO orEqual:NO];
+	CHBinaryTreeNode *current = path[pathSize-1]->left;
+	if (current != sentinelNode) {
+		// The predecessor is the rightmost node in the left subtree
+		do {
+			CHCursorPathPush(current);
+			current = current->right;
+		} while (current != sentinelNode);
+	}
+	else {
+		// The predecessor is the nearest ancestor reached from its right subtree
+		do {
+			current = path[--pathSize];
+		} while (pathSize > 0 && path[pathSize-1]->left == current);
+	}
+	beforeFirst = YES;
+	CHCursorUpdateObject();
+	return object;
+}
+
+- (id) seekObject:(id)anObject ascending:(BOOL)ascending orEqual:(BOOL)orEqual {
+	// A nil object acts as if it were beyond the end of the tree being sought
+	NSComparisonResult wanted = ascending ? NSOrderedDescending : NSOrderedAscending;
+	NSComparisonResult comparison = wanted;
+	NSUInteger foundSize = 0;
+	CHSearchTreeComparator localComparator = *comparator;
+	pathSize = 0;
+	sentinelNode = *sentinelPointer;
+	CHBinaryTreeNode *current = headerNode->right;
+	while (current != sentinelNode) {
+		CHCursorPathPush(current);
+		if (anObject != nil)
+			comparison = CHSearchTreeCompare(&localComparator, current->object, anObject);
+		if (comparison == NSOrderedSame && orEqual) {
+			foundSize = pathSize;
+			break;
+		}
+		// Remember each acceptable node, then look for a closer one below it
+		if (comparison == wanted) {
+			foundSize = pathSize;
+			current = current->link[!ascending];
+		}
+		else
+			current = current->link[ascending];
+	}
+	pathSize = foundSize;
+	beforeFirst = !ascending;
+	CHCursorUpdateObject();
+	return object;
+}
+
+@end
+
+#pragma mark -
+
+/**
+ An immutable view of the objects in a search tree at the moment it was created by \link CHAbstractBinarySearchTree#snapshot -snapshot\endlink. A snapshot shares the nodes of the tree, which copies any shared node before modifying it, so the snapshot keeps the original. Any attempt to modify a snapshot raises an exception.
+ */
+@interface CHSearchTreeSnapshot : CHAbstractBinarySearchTree
+{
+	Class treeClass; // The class of the tree, used for archives and subsets.
+}
+
+@end
+
+#pragma mark -
+
 CHBinaryTreeNode* CHCreateBinaryTreeNodeWithObject(id anObject) {
 	CHBinaryTreeNode *node;
 	// NSScannedOption tells the garbage collector to scan object and children.
 	node = NSAllocateCollectable(kCHBinaryTreeNodeSize, NSScannedOption);
 	node->object = anObject;
 	node->balance = 0; // Affects balancing info for any subclass (anon. union)
+	node->size = 0; // Only used for the header and sentinel nodes
+	return node;
+}
+
+CHBinaryTreeNodePool* CHBinaryTreeNodePoolCreate(void) {
+	CHBinaryTreeNodePool *pool;
+	pool = NSAllocateCollectable(sizeof(CHBinaryTreeNodePool), NSScannedOption);
+	pool->slabs = NULL;
+	pool->freeList = NULL;
+	pool->returnedNodes = NULL;
+	pool->slabCapacity = kCHBinaryTreeNodeSlabMinimum;
+	pool->ownerCount = 1;
+	pool->partitioned = NO;
+	pool->linkCounts = NULL;
+	pool->linkCountLock = OS_SPINLOCK_INIT;
+	return pool;
+}
+
+CHBinaryTreeNode* CHBinaryTreeNodePoolNextNode(CHBinaryTreeNodePool *pool) {
+	if (pool->slabCapacity == 0)
+		return NSAllocateCollectable(kCHBinaryTreeNodeSize, NSScannedOption);
+	CHBinaryTreeNode *node;
+	while ((node = pool->returnedNodes) != NULL) {
+		if (OSAtomicCompareAndSwapPtrBarrier(node, NULL, (void* volatile*)&pool->returnedNodes)) {
+			pool->freeList = node->right;
+			return node;
+		}
+	}
+	CHBinaryTreeNodeSlab *slab = pool->slabs;
+	if (slab == NULL || slab->used == slab->capacity) {
+		// Start a new slab, doubling the size each time (up to a limit).
+		slab = NSAllocateCollectable(sizeof(CHBinaryTreeNodeSlab) +
+		                             pool->slabCapacity * kCHBinaryTreeNodeSize,
+		                             NSScannedOption);
+		slab->next = pool->slabs;
+		slab->capacity = pool->slabCapacity;
+		slab->used = 0;
+		pool->slabs = slab;
+		if (pool->slabCapacity < kCHBinaryTreeNodeSlabMaximum)
+			pool->slabCapacity *= 2;
+	}
+	return &(slab->nodes[slab->used++]);
+}
+
+void CHBinaryTreeNodePoolReserve(CHBinaryTreeNodePool *pool, NSUInteger capacity) {
+	if (pool->slabCapacity == 0 || capacity == 0)
+		return;
+	CHBinaryTreeNodeSlab *slab = pool->slabs;
+	if (slab != NULL && slab->capacity - slab->used >= capacity)
+		return;
+	// Any room left in the current slab is abandoned; the sweep only visits used nodes.
+	slab = NSAllocateCollectable(sizeof(CHBinaryTreeNodeSlab) +
+	                             capacity * kCHBinaryTreeNodeSize, NSScannedOption);
+	slab->next = pool->slabs;
+	slab->capacity = capacity;
+	slab->used = 0;
+	pool->slabs = slab;
+}
+
+void CHBinaryTreeNodePoolDrain(CHBinaryTreeNodePool *pool) {
+	CHBinaryTreeNodeSlab *slab = pool->slabs, *next;
+	while (slab != NULL) {
+		next = slab->next;
+		if (kCHGarbageCollectionNotEnabled) {
+			// Recycled nodes have a nil object, so messaging them is harmless.
+			for (NSUInteger i = 0; i < slab->used; i++)
+				[slab->nodes[i].object release];
+			free(slab);
+		}
+		slab = next;
+	}
+	pool->slabs = NULL; // With GC, this is sufficient to unroot the slabs.
+	pool->freeList = NULL;
+	pool->returnedNodes = NULL;
+	if (pool->slabCapacity != 0)
+		pool->slabCapacity = kCHBinaryTreeNodeSlabMinimum;
+}
+
+void CHBinaryTreeNodePoolFree(CHBinaryTreeNodePool *pool) {
+	CHBinaryTreeNodePoolDrain(pool);
+	if (kCHGarbageCollectionNotEnabled) {
+		if (pool->linkCounts != NULL)
+			CFRelease(pool->linkCounts);
+		free(pool);
+	}
+}
+
+#pragma mark Comparison
+
+CHSearchTreeComparator* CHSearchTreeComparatorCreate(id headerObject) {
+	CHSearchTreeComparator *comparator;
+	comparator = NSAllocateCollectable(sizeof(CHSearchTreeComparator), NSScannedOption);
+	comparator->function = NULL;
+	comparator->context = NULL;
+	comparator->block = nil;
+	comparator->headerObject = headerObject;
+	comparator->cachedClass = Nil;
+	comparator->cachedIMP = NULL;
+	return comparator;
+}
+
+void CHSearchTreeComparatorCopy(CHSearchTreeComparator *destination,
+                                CHSearchTreeComparator *source)
+{
+	[source->block retain];
+	[destination->block release];
+	*destination = *source;
+}
+
+void CHSearchTreeComparatorFree(CHSearchTreeComparator *comparator) {
+	if (kCHGarbageCollectionNotEnabled) {
+		[comparator->block release];
+		free(comparator);
+	}
+}
+
+#if NS_BLOCKS_AVAILABLE
+NSInteger CHCompareObjectsUsingBlock(id object1, id object2, void *context) {
+	return ((NSComparator) context)(object1, object2);
+}
+#endif
+
+#pragma mark Bulk Loading
+
+/**
+ Prepares an array of objects for building a tree in linear time, if possible.
+ 
+ @param comparator The comparison state of the tree into which the objects will be loaded.
+ @param objects A C array of objects; it is modified in place. If the objects are in descending order, they are reversed. If equal objects are present, only the last one (in the original order) is kept, just as repeated calls to @c -addObject: would leave it in the tree.
+ @param objectCount The number of objects in @a objects.
+ @return The number of objects remaining in @a objects, which are now in strictly ascending order, or 0 if the objects were not sorted to begin with.
+ */
+static NSUInteger prepareSortedObjects(CHSearchTreeComparator *comparator,
+                                       id *objects, NSUInteger objectCount)
+{
+	NSComparisonResult order = NSOrderedSame, comparison;
+	BOOL hasDuplicates = NO;
+	NSUInteger i, j;
+	for (i = 1; i < objectCount; i++) {
+		comparison = CHSearchTreeCompare(comparator, objects[i-1], objects[i]);
+		if (comparison == NSOrderedSame)
+			hasDuplicates = YES;
+		else if (order == NSOrderedSame)
+			order = comparison;
+		else if (comparison != order)
+			return 0; // Give up as soon as a pair is out of order.
+	}
+	if (hasDuplicates) {
+		for (i = j = 0; i < objectCount; i++) {
+			if (i+1 < objectCount &&
+			    CHSearchTreeCompare(comparator, objects[i], objects[i+1]) == NSOrderedSame)
+				continue;
+			objects[j++] = objects[i];
+		}
+		objectCount = j;
+	}
+	if (order == NSOrderedDescending) {
+		id temp;
+		for (i = 0, j = objectCount-1; i < j; i++, j--) {
+			temp = objects[i];
+			objects[i] = objects[j];
+			objects[j] = temp;
+		}
+	}
+	return objectCount;
+}
+
+// Everything needed to build a balanced subtree, to keep the recursion lean.
+typedef struct CHBulkLoadContext {
+	CHAbstractBinarySearchTree *tree;
+	CHBinaryTreeNodePool *pool;
+	CHBinaryTreeNode *sentinel;
+	SEL selector;
+	void (*prepare)(id, SEL, CHBinaryTreeNode*, NSUInteger, NSUInteger, NSUInteger);
+	NSUInteger maxDepth;
+} CHBulkLoadContext;
+
+// Recursively builds a subtree by making the median object the root. With the smaller half always on the left, the tree has minimal height, and every sentinel leaf is at one of the two lowest levels.
+static CHBinaryTreeNode* buildBalancedSubtree(CHBulkLoadContext *context,
+                                              id *objects, NSUInteger size,
+                                              NSUInteger depth)
+{
+	if (size == 0)
+		return context->sentinel;
+	NSUInteger leftSize = (size - 1) / 2;
+	CHBinaryTreeNode *node;
+	node = CHCreateBinaryTreeNodeFromPool(context->pool, [objects[leftSize] retain]);
+	node->left  = buildBalancedSubtree(context, objects, leftSize, depth+1);
+	node->right = buildBalancedSubtree(context, objects + leftSize + 1,
+	                                   size - leftSize - 1, depth+1);
+	node->size = (u_int32_t) size;
+	context->prepare(context->tree, context->selector, node,
+	                 size, depth, context->maxDepth);
 	return node;
 }
 
+#pragma mark Copying
+
+// Copies the nodes in a subtree into a pool, preserving its shape and the extra field used by each balancing algorithm (as well as subtree sizes), so the copy needs no comparisons or rebalancing. Each object is retained by the copy. The traversal is iterative since an unbalanced tree may be very deep. Returns the root of the copy, which uses 'newSentinel' for its leaves.
+static CHBinaryTreeNode* copySubtree(CHBinaryTreeNodePool *pool,
+                                     CHBinaryTreeNode *root, CHBinaryTreeNode *sentinel,
+                                     CHBinaryTreeNode *newSentinel)
+{
+	if (root == sentinel)
+		return newSentinel;
+	CHBinaryTreeNode *node, *copy, *newRoot;
+	CHBinaryTreeNodePoolReserve(pool, root->size);
+	newRoot = CHCreateBinaryTreeNodeFromPool(pool, [root->object retain]);
+	newRoot->balance = root->balance;
+	newRoot->size = root->size;
+	// Each node to be copied is pushed along with its copy, whose links are unset
+	CHEnumerationStack stack;
+	CHEnumerationStackInit(&stack);
+	CHEnumerationStackPush(&stack, root);
+	CHEnumerationStackPush(&stack, newRoot);
+	while (stack.size > 0) {
+		copy = stack.nodes[--stack.size];
+		node = stack.nodes[--stack.size];
+		for (int dir = 0; dir <= 1; dir++) {
+			if (node->link[dir] == sentinel) {
+				copy->link[dir] = newSentinel;
+				continue;
+			}
+			copy->link[dir] = CHCreateBinaryTreeNodeFromPool(pool, [node->link[dir]->object retain]);
+			copy->link[dir]->balance = node->link[dir]->balance;
+			copy->link[dir]->size = node->link[dir]->size;
+			CHEnumerationStackPush(&stack, node->link[dir]);
+			CHEnumerationStackPush(&stack, copy->link[dir]);
+		}
+	}
+	CHEnumerationStackFree(&stack);
+	return newRoot;
+}
+
+// Copies the nodes in a subtree just like copySubtree(), but in level order, so the copies of the top levels (which every search passes through) are packed together at the start of a single slab, and siblings are always adjacent. The queue of nodes to be copied is just the originals of the copies made so far, so it needs no more than one pointer per node.
+static CHBinaryTreeNode* copySubtreeInLevelOrder(CHBinaryTreeNodePool *pool,
+                                                 CHBinaryTreeNode *root, CHBinaryTreeNode *sentinel,
+                                                 CHBinaryTreeNode *newSentinel)
+{
+	if (root == sentinel)
+		return newSentinel;
+	NSUInteger size = root->size, head = 0, tail = 0;
+	CHBinaryTreeNodePoolReserve(pool, size);
+	// The nodes are always reachable from one tree or the other, so the queues need not be scanned.
+	CHBinaryTreeNode **originals = malloc(size * sizeof(CHBinaryTreeNode*));
+	CHBinaryTreeNode **copies = malloc(size * sizeof(CHBinaryTreeNode*));
+	CHBinaryTreeNode *node, *copy;
+	originals[tail] = root;
+	copies[tail++] = CHCreateBinaryTreeNodeFromPool(pool, [root->object retain]);
+	while (head < tail) {
+		node = originals[head];
+		copy = copies[head++];
+		copy->balance = node->balance;
+		copy->size = node->size;
+		for (int dir = 0; dir <= 1; dir++) {
+			if (node->link[dir] == sentinel) {
+				copy->link[dir] = newSentinel;
+				continue;
+			}
+			copy->link[dir] = CHCreateBinaryTreeNodeFromPool(pool, [node->link[dir]->object retain]);
+			originals[tail] = node->link[dir];
+			copies[tail++] = copy->link[dir];
+		}
+	}
+	copy = copies[0];
+	free(originals);
+	free(copies);
+	return copy;
+}
+
+// Creates an empty pool which allocates nodes the same way (from slabs or not) as another.
+static CHBinaryTreeNodePool* createPoolLike(CHBinaryTreeNodePool *pool) {
+	CHBinaryTreeNodePool *newPool = CHBinaryTreeNodePoolCreate();
+	if (pool->slabCapacity == 0)
+		newPool->slabCapacity = 0;
+	return newPool;
+}
+
+// Creates a sentinel with the same balancing info as another (such as being black in a red-black tree), since subclasses only set it up once, in -init.
+static CHBinaryTreeNode* createSentinelLike(CHBinaryTreeNode *sentinel) {
+	CHBinaryTreeNode *newSentinel = CHCreateBinaryTreeNodeWithObject(nil);
+	newSentinel->left = newSentinel;
+	newSentinel->right = newSentinel;
+	newSentinel->balance = sentinel->balance;
+	return newSentinel;
+}
+
+// Releases the object in each node of a subtree and returns the nodes to their pool, using pre-order (depth-first) traversal for simplicity and performance.
+static void releaseSubtree(CHBinaryTreeNodePool *pool,
+                           CHBinaryTreeNode *root, CHBinaryTreeNode *sentinel)
+{
+	if (root == sentinel)
+		return;
+	CHEnumerationStack stack;
+	CHEnumerationStackInit(&stack);
+	CHEnumerationStackPush(&stack, root);
+	CHBinaryTreeNode *current;
+	while (stack.size > 0) {
+		current = stack.nodes[--stack.size];
+		if (current->right != sentinel)
+			CHEnumerationStackPush(&stack, current->right);
+		if (current->left != sentinel)
+			CHEnumerationStackPush(&stack, current->left);
+		[current->object release];
+		CHRecycleBinaryTreeNode(pool, current);
+	}
+	CHEnumerationStackFree(&stack);
+}
+
+// Returns a node which is no longer linked from any tree to its pool. This may be done by a snapshot on one thread while the tree obtains nodes from the pool on another, so the node is pushed onto a list of its own rather than the free list (see CHBinaryTreeNodePool).
+static void returnNode(CHBinaryTreeNodePool *pool, CHBinaryTreeNode *node) {
+	node->object = nil; // The node is no longer live when the pool is drained.
+	if (pool->slabCapacity != 0) {
+		CHBinaryTreeNode *head;
+		do {
+			head = pool->returnedNodes;
+			node->right = head;
+		} while (!OSAtomicCompareAndSwapPtrBarrier(head, node, (void* volatile*)&pool->returnedNodes));
+	}
+	else if (kCHGarbageCollectionNotEnabled)
+		free(node);
+}
+
+// Creates the table of link counts for a pool, which is about to be shared with a snapshot.
+static void createLinkCounts(CHBinaryTreeNodePool *pool) {
+	// The keys are nodes, which are compared by address and always reachable from a tree.
+	pool->linkCounts = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+	CFMakeCollectable(pool->linkCounts);
+}
+
+// Adds a link to a node of a shared pool.
+static void addLinkToNode(CHBinaryTreeNodePool *pool, CHBinaryTreeNode *node) {
+	OSSpinLockLock(&pool->linkCountLock);
+	CFIndex links = (CFIndex) CFDictionaryGetValue(pool->linkCounts, node);
+	CFDictionarySetValue(pool->linkCounts, node, (void*) ((links != 0) ? links + 1 : 2));
+	OSSpinLockUnlock(&pool->linkCountLock);
+}
+
+// Removes a link to a node of a shared pool, and returns the number of links left. A node is taken out of the table once it has only one link, so the table only holds the nodes which are shared.
+static CFIndex removeLinkToNode(CHBinaryTreeNodePool *pool, CHBinaryTreeNode *node) {
+	OSSpinLockLock(&pool->linkCountLock);
+	CFIndex links = (CFIndex) CFDictionaryGetValue(pool->linkCounts, node);
+	if (links > 2)
+		CFDictionarySetValue(pool->linkCounts, node, (void*) (links - 1));
+	else if (links == 2)
+		CFDictionaryRemoveValue(pool->linkCounts, node);
+	OSSpinLockUnlock(&pool->linkCountLock);
+	return (links != 0) ? links - 1 : 0;
+}
+
+// Gives up one link to a node. If it was the last one, the object in the node is released, the node is returned to its pool, and its links to its children are given up in turn; the subtree of a node which is still linked elsewhere is left alone, so only the nodes which are freed are visited.
+static void releaseSharedNode(CHBinaryTreeNodePool *pool,
+                              CHBinaryTreeNode *node, CHBinaryTreeNode *sentinel)
+{
+	if (node == sentinel || removeLinkToNode(pool, node) > 0)
+		return;
+	CHEnumerationStack stack;
+	CHEnumerationStackInit(&stack);
+	CHEnumerationStackPush(&stack, node);
+	while (stack.size > 0) {
+		node = stack.nodes[--stack.size];
+		for (int dir = 0; dir <= 1; dir++) {
+			if (node->link[dir] != sentinel && removeLinkToNode(pool, node->link[dir]) == 0)
+				CHEnumerationStackPush(&stack, node->link[dir]);
+		}
+		[node->object release];
+		returnNode(pool, node);
+	}
+	CHEnumerationStackFree(&stack);
+}
+
+CHBinaryTreeNode* CHCopySharedBinaryTreeNode(CHBinaryTreeNodePool *pool,
+                                             CHBinaryTreeNode *node,
+                                             CHBinaryTreeNode *sentinel)
+{
+	CHBinaryTreeNode *copy = CHCreateBinaryTreeNodeFromPool(pool, [node->object retain]);
+	copy->left = node->left;
+	copy->right = node->right;
+	copy->balance = node->balance;
+	copy->size = node->size;
+	// The children must gain their new links before the old node can be freed.
+	for (int dir = 0; dir <= 1; dir++) {
+		if (node->link[dir] != sentinel)
+			addLinkToNode(pool, node->link[dir]);
+	}
+	releaseSharedNode(pool, node, sentinel);
+	return copy;
+}
+
+// Releases the object in each node of a tree and returns the nodes to their pool.
+static void releaseNodes(CHBinaryTreeNodePool *pool,
+                         CHBinaryTreeNode *root, CHBinaryTreeNode *sentinel)
+{
+	if (pool->slabCapacity != 0) {
+		// Every node lives in a slab, so sweep the slabs instead of the tree.
+		CHBinaryTreeNodePoolDrain(pool);
+	}
+	else if (kCHGarbageCollectionNotEnabled) {
+		// Only deal with memory management if garbage collection is NOT enabled.
+		releaseSubtree(pool, root, sentinel);
+	}
+}
+
+// Gives up a tree's claim on its pool, nodes and sentinel, which may be shared with snapshots. While other trees use the pool, only the nodes which no other tree links to are released (all of them, if the pool is partitioned); whichever tree gives up the pool last releases the objects in the rest and frees everything.
+static void relinquishNodes(CHBinaryTreeNodePool *pool,
+                            CHBinaryTreeNode *root, CHBinaryTreeNode *sentinel)
+{
+	if (pool->ownerCount > 1) {
+		if (pool->partitioned)
+			releaseSubtree(pool, root, sentinel);
+		else
+			releaseSharedNode(pool, root, sentinel);
+		root = sentinel;
+	}
+	if (OSAtomicDecrement32Barrier(&pool->ownerCount) > 0)
+		return;
+	releaseNodes(pool, root, sentinel);
+	CHBinaryTreeNodePoolFree(pool);
+	if (kCHGarbageCollectionNotEnabled)
+		free(sentinel);
+}
+
+#pragma mark Order Statistics
+
+// Returns the number of objects in a tree which are less than a given object (or equal to it, if 'orEqual' is YES) by accumulating the sizes of left subtrees.
+static NSUInteger countOfObjectsBelow(CHSearchTreeComparator *comparator,
+                                      CHBinaryTreeNode *root, CHBinaryTreeNode *sentinel,
+                                      id anObject, BOOL orEqual)
+{
+	NSUInteger rank = 0;
+	NSComparisonResult comparison;
+	CHBinaryTreeNode *current = root;
+	while (current != sentinel) {
+		comparison = CHSearchTreeCompare(comparator, current->object, anObject);
+		if (comparison == NSOrderedAscending) {
+			rank += current->left->size + 1;
+			current = current->right;
+		}
+		else if (comparison == NSOrderedDescending)
+			current = current->left;
+		else
+			return rank + current->left->size + (orEqual ? 1 : 0);
+	}
+	return rank;
+}
+
+// Finds the least object greater than (or equal to) anObject if 'greater' is YES, otherwise the greatest object less than (or equal to) it, with a single descent from the root. Each node on the desired side of anObject is a candidate, and the descent continues toward anObject to find a closer one. Returns nil if there is no such object. (Like -member:, this doesn't store anObject in the sentinel.)
+static id boundingObject(CHSearchTreeComparator *comparator,
+                         CHBinaryTreeNode *root, CHBinaryTreeNode *sentinel,
+                         id anObject, BOOL greater, BOOL orEqual)
+{
+	NSComparisonResult wanted = greater ? NSOrderedDescending : NSOrderedAscending;
+	NSComparisonResult comparison;
+	CHBinaryTreeNode *current = root, *bound = sentinel;
+	while (current != sentinel &&
+	       (comparison = CHSearchTreeCompare(comparator, current->object, anObject))) { // while not equal
+		if (comparison == wanted)
+			bound = current;
+		current = current->link[comparison == NSOrderedAscending]; // R on YES
+	}
+	if (current != sentinel) {
+		if (orEqual)
+			return current->object;
+		// The closest object is at the inner extreme of the subtree on the desired side, if any
+		current = current->link[greater];
+		if (current != sentinel) {
+			while (current->link[!greater] != sentinel)
+				current = current->link[!greater];
+			bound = current;
+		}
+	}
+	return (bound != sentinel) ? bound->object : nil;
+}
+
+// Copies a run of consecutive objects (in ascending order) into a C array, starting with the first object which is greater than (or equal to, if 'orEqual' is YES) a given object, or with the first object in the tree if 'start' is nil. The caller must ensure that at least 'objectCount' objects remain. Only the nodes on the path to the first object and the nodes being copied are visited, so this takes O(log n + k) time.
+static void copyObjectsFromObject(CHSearchTreeComparator *comparator,
+                                  CHBinaryTreeNode *root, CHBinaryTreeNode *sentinel,
+                                  id start, BOOL orEqual,
+                                  id *objects, NSUInteger objectCount)
+{
+	if (objectCount == 0)
+		return;
+	CHBinaryTreeStack *stack = [[CHBinaryTreeStack alloc] init];
+	NSComparisonResult comparison;
+	CHBinaryTreeNode *current = root;
+	// Push each node on the search path that is in range, since those are the ones still to be visited in order after their left subtrees.
+	while (current != sentinel) {
+		if (start != nil) {
+			comparison = CHSearchTreeCompare(comparator, current->object, start);
+			if (comparison == NSOrderedAscending || (comparison == NSOrderedSame && !orEqual)) {
+				current = current->right;
+				continue;
+			}
+		}
+		[stack push:current];
+		current = current->left;
+	}
+	// Everything after the first node is known to be in range; no comparisons.
+	for (NSUInteger i = 0; i < objectCount; i++) {
+		current = [stack pop];
+		objects[i] = current->object;
+		for (current = current->right; current != sentinel; current = current->left)
+			[stack push:current];
+	}
+	[stack release];
+}
+
+#pragma mark Set Operations
+
+// The kinds of merges performed by mergeSortedObjects().
+typedef enum {
+	CHMergeUnion,
+	CHMergeIntersection,
+	CHMergeDifference
+} CHMergeOperation;
+
+// Merges two C arrays of objects in strictly ascending order into a third array (which must have room for the objects in both), and returns the number of objects in the result. Where equal objects appear in both arrays, the one from 'b' is used for a union (just as -addObject: replaces an equal object) and the one from 'a' for an intersection.
+static NSUInteger mergeSortedObjects(CHSearchTreeComparator *comparator,
+                                     CHMergeOperation operation,
+                                     id *a, NSUInteger aCount,
+                                     id *b, NSUInteger bCount,
+                                     id *result)
+{
+	NSUInteger i = 0, j = 0, k = 0;
+	NSComparisonResult comparison;
+	while (i < aCount && j < bCount) {
+		comparison = CHSearchTreeCompare(comparator, a[i], b[j]);
+		if (comparison == NSOrderedAscending) {
+			if (operation != CHMergeIntersection)
+				result[k++] = a[i];
+			i++;
+		}
+		else if (comparison == NSOrderedDescending) {
+			if (operation == CHMergeUnion)
+				result[k++] = b[j];
+			j++;
+		}
+		else {
+			if (operation == CHMergeUnion)
+				result[k++] = b[j];
+			else if (operation == CHMergeIntersection)
+				result[k++] = a[i];
+			i++;
+			j++;
+		}
+	}
+	// Whatever remains of one array is greater than everything in the other.
+	if (operation != CHMergeIntersection)
+		while (i < aCount)
+			result[k++] = a[i++];
+	if (operation == CHMergeUnion)
+		while (j < bCount)
+			result[k++] = b[j++];
+	return k;
+}
+
+// Whether the objects in a sorted set are in the same order as in a tree with the given comparison state, so the two can be merged. Sets ordered any other way (or whose ordering is unknown) must be handled one object at a time.
+static BOOL isOrderedLike(CHSearchTreeComparator *comparator, id<CHSortedSet> aSet) {
+	return ([aSet respondsToSelector:@selector(searchTreeComparator)] &&
+	        CHSearchTreeComparatorsMatch(comparator,
+	                                     [(id<CHSearchTreeOrdering>)aSet searchTreeComparator]));
+}
+
+// Whether looking up each of a small number of objects in a tree (with about log2(n) comparisons each) is cheaper than merging every object in both sets.
+static BOOL shouldProbe(NSUInteger probeCount, NSUInteger treeCount) {
+	NSUInteger depth = 1;
+	for (NSUInteger i = treeCount; i > 1; i >>= 1)
+		depth++;
+	return (probeCount * depth < probeCount + treeCount);
+}
+
 @implementation CHAbstractBinarySearchTree
 
 - (void) dealloc {
-	[self removeAllObjects];
+	relinquishNodes(nodePool, header->right, sentinel);
+	CHSearchTreeComparatorFree(comparator);
 	free(header);
-	free(sentinel);
 	[super dealloc];
 }
 
@@ -322,6 +1066,8 @@ CHBinaryTreeNode* CHCreateBinaryTreeNodeWithObject(id anObject) {
 	header = CHCreateBinaryTreeNodeWithObject([CHSearchTreeHeaderObject object]);
 	header->right = sentinel;
 	header->left = sentinel;
+	nodePool = CHBinaryTreeNodePoolCreate();
+	comparator = CHSearchTreeComparatorCreate(header->object);
 	return self;
 }
 
@@ -333,94 +1079,144 @@ CHBinaryTreeNode* CHCreateBinaryTreeNodeWithObject(id anObject) {
 	return self;
 }
 
+- (id) initWithComparisonFunction:(CHComparisonFunction)function context:(void*)context {
+	if ([self init] == nil) return nil;
+	if (function == NULL)
+		CHInvalidArgumentException([self class], _cmd, @"Invalid comparison function.");
+	comparator->function = function;
+	comparator->context = context;
+	return self;
+}
+
+#if NS_BLOCKS_AVAILABLE
+- (id) initWithComparator:(NSComparator)cmptr {
+	if ([self init] == nil) return nil;
+	if (cmptr == nil)
+		CHNilArgumentException([self class], _cmd);
+	// The block is its own context, so a copy or subset only has to retain it.
+	comparator->block = [cmptr copy];
+	comparator->function = CHCompareObjectsUsingBlock;
+	comparator->context = comparator->block;
+	return self;
+}
+#endif
+
 #pragma mark <NSCoding>
 
+// Since the objects are normally encoded in ascending order, -initWithArray: can build a balanced tree from them in O(n) time. (Archives with objects in another order, such as level order, are still decoded correctly.)
 - (id) initWithCoder:(NSCoder*)decoder {
 	// Decode the array of objects and use it to initialize the tree's contents.
 	return [self initWithArray:[decoder decodeObjectForKey:@"objects"]];
 }
 
 - (void) encodeWithCoder:(NSCoder*)encoder {
-	[encoder encodeObject:[self allObjectsWithTraversalOrder:CHTraverseLevelOrder]
-	               forKey:@"objects"];
+	[encoder encodeObject:[self allObjects] forKey:@"objects"];
 }
 
 #pragma mark <NSCopying> methods
 
+// Copies the structure of the tree directly in O(n) time, rather than inserting each object into the new tree.
 - (id) copyWithZone:(NSZone*)zone {
-	id<CHSearchTree> newTree = [[[self class] allocWithZone:zone] init];
-	// No point in using fast enumeration here until rdar://6296108 is addressed.
-	NSEnumerator *e = [self objectEnumeratorWithTraversalOrder:CHTraverseLevelOrder];
-	id anObject;
-	while (anObject = [e nextObject]) {
-		[newTree addObject:anObject];
-	}
+	CHAbstractBinarySearchTree *newTree = [[[self class] allocWithZone:zone] init];
+	CHSearchTreeComparatorCopy(newTree->comparator, comparator);
+	newTree->header->right = copySubtree(newTree->nodePool, header->right, sentinel,
+	                                     newTree->sentinel);
+	newTree->count = count;
 	return newTree;
 }
 
 #pragma mark <NSFastEnumeration>
 
+/*
+ The enumeration state is simply the rank of the next object to be returned. Each call finds that object by its rank in O(log n) time, then walks forward in order using a stack which lives on the C stack for the duration of the call. Nothing is allocated on the heap (except for an unusually deep path) and nothing is carried between calls, so there is nothing to clean up when a loop exits early.
+ */
 - (NSUInteger) countByEnumeratingWithState:(NSFastEnumerationState*)state
                                    objects:(id*)stackbuf
                                      count:(NSUInteger)len
 {
-	CHBinaryTreeNode *current;
-	CHBinaryTreeStack * stack;
+	state->itemsPtr = stackbuf;
+	state->mutationsPtr = &mutations;
+	NSUInteger rank = state->state;
+	if (rank >= count)
+		return 0;
+	NSUInteger batchCount = MIN(len, count - rank);
 	
-	// For the first call, start at leftmost node, otherwise the last saved node
-	if (state->state == 0) {
-		state->itemsPtr = stackbuf;
-		state->mutationsPtr = &mutations;
-		current = header->right;
-		stack = [[CHBinaryTreeStack alloc] init];
-	}
-	else if (state->state == 1) {
-		return 0;		
-	}
-	else {
-		current = (CHBinaryTreeNode*) state->state;
-//		stack = (CHBinaryTreeNode**) state->extra[0];
-		stack = (CHBinaryTreeStack *) state->extra[0];
-//		stackCapacity = (NSUInteger) state->extra[1];
-//		stackSize = (NSUInteger) state->extra[2];
-	}
-	NSAssert(current != nil, @"Illegal state, current should never be nil!");
-	
-	// Accumulate objects from the tree until we reach all nodes or the maximum
-	NSUInteger batchCount = 0;
-	while ( (current != sentinel || [stack stackSize] > 0) && batchCount < len) {
-		while (current != sentinel) {
-			[stack push:current];
+	CHEnumerationStack stack;
+	CHEnumerationStackInit(&stack);
+	// Find the next node, saving the ancestors which come after it in order.
+	CHBinaryTreeNode *current = header->right;
+	NSUInteger leftSize;
+	while (rank != (leftSize = current->left->size)) {
+		if (rank < leftSize) {
+			CHEnumerationStackPush(&stack, current);
 			current = current->left;
 		}
-		current = [stack pop]; // Save top node for return value
-		NSAssert(current != nil, @"Illegal state, current should never be nil!");
-		stackbuf[batchCount] = current->object;
-		current = current->right;
-		batchCount++;
-	}
-	
-	if (current == sentinel && [stack stackSize] == 0) {
-		[stack release];
-		state->state = 1; // used as a termination flag
+		else {
+			rank -= leftSize + 1;
+			current = current->right;
+		}
 	}
-	else {
-		state->state    = (unsigned long) current;
-		state->extra[0] = (unsigned long) stack;
-//		state->extra[1] = (unsigned long) stackCapacity;
-//		state->extra[2] = (unsigned long) stackSize;
+	// Accumulate objects from the tree until the batch is full
+	for (NSUInteger i = 0; i < batchCount; i++) {
+		if (i > 0) {
+			for (current = current->right; current != sentinel; current = current->left)
+				CHEnumerationStackPush(&stack, current);
+			current = stack.nodes[--stack.size];
+		}
+		stackbuf[i] = current->object;
 	}
+	CHEnumerationStackFree(&stack);
+	state->state += batchCount;
 	return batchCount;
 }
 
 #pragma mark Concrete Implementations
 
+/*
+ If the receiver is empty and the objects in the array are already sorted (in either ascending or descending order), the tree is built directly in O(n) time, rather than inserting the objects one at a time in O(n log n) time. The detection stops at the first pair of objects that are out of order, so unsorted input costs very little extra.
+ */
 - (void) addObjectsFromArray:(NSArray*)anArray {
+	NSUInteger arrayCount = [anArray count];
+	if (count == 0 && arrayCount > 1) {
+		id *objects = NSAllocateCollectable(arrayCount * kCHPointerSize, NSScannedOption);
+		[anArray getObjects:objects];
+		NSUInteger sortedCount = prepareSortedObjects(comparator, objects, arrayCount);
+		if (sortedCount > 0)
+			[self buildTreeFromSortedObjects:objects count:sortedCount];
+		if (kCHGarbageCollectionNotEnabled)
+			free(objects);
+		if (sortedCount > 0)
+			return;
+	}
 	for (id anObject in anArray) {
 		[self addObject:anObject];
 	}
 }
 
+// Replaces the (empty) tree with a perfectly balanced tree of sorted objects.
+- (void) buildTreeFromSortedObjects:(id*)objects count:(NSUInteger)objectCount {
+	NSAssert(count == 0, @"Can only bulk load objects into an empty tree.");
+	++mutations;
+	CHBulkLoadContext context;
+	context.tree = self;
+	context.pool = nodePool;
+	context.sentinel = sentinel;
+	context.selector = @selector(prepareBulkLoadedNode:size:depth:maxDepth:);
+	context.prepare = (void(*)(id,SEL,CHBinaryTreeNode*,NSUInteger,NSUInteger,NSUInteger))
+		[self methodForSelector:context.selector];
+	context.maxDepth = 0;
+	CHBinaryTreeNodePoolReserve(nodePool, objectCount);
+	for (NSUInteger i = objectCount; i > 1; i >>= 1)
+		context.maxDepth++; // floor(log2(count))
+	header->right = buildBalancedSubtree(&context, objects, objectCount, 0);
+	count = objectCount;
+}
+
+- (void) prepareBulkLoadedNode:(CHBinaryTreeNode*)node
+                          size:(NSUInteger)size
+                         depth:(NSUInteger)depth
+                      maxDepth:(NSUInteger)maxDepth {}
+
 - (NSArray*) allObjects {
 	return [self allObjectsWithTraversalOrder:CHTraverseAscending];
 }
@@ -443,18 +1239,59 @@ CHBinaryTreeNode* CHCreateBinaryTreeNodeWithObject(id anObject) {
 	return count;
 }
 
+- (NSUInteger) countOfObjectsFromObject:(id)start toObject:(id)end {
+	CHSearchTreeComparator localComparator = *comparator;
+	CHBinaryTreeNode *root = header->right;
+	NSUInteger atOrBelowEnd = (end == nil)
+		? count : countOfObjectsBelow(&localComparator, root, sentinel, end, YES);
+	NSUInteger belowStart = (start == nil)
+		? 0 : countOfObjectsBelow(&localComparator, root, sentinel, start, NO);
+	if (start == nil || end == nil || CHSearchTreeCompare(&localComparator, start, end) != NSOrderedDescending)
+		return (atOrBelowEnd > belowStart) ? atOrBelowEnd - belowStart : 0;
+	else
+		// Objects NOT between the parameters (as for -subsetFromObject:...)
+		return atOrBelowEnd + (count - belowStart);
+}
+
+- (CHSearchTreeCursor*) cursorAtFirstGreaterOrEqual:(id)anObject {
+	CHSearchTreeCursor *cursor = [[CHSearchTreeCursor alloc] initWithTree:self
+	                                                               header:header
+	                                                             sentinel:&sentinel
+	                                                           comparator:comparator
+	                                                      mutationPointer:&mutations];
+	[cursor seekObject:anObject ascending:YES orEqual:YES];
+	return [cursor autorelease];
+}
+
+- (CHSearchTreeCursor*) cursorAtObject:(id)anObject {
+	if (anObject == nil)
+		return nil;
+	CHSearchTreeCursor *cursor = [self cursorAtFirstGreaterOrEqual:anObject];
+	id found = [cursor object];
+	CHSearchTreeComparator localComparator = *comparator;
+	if (found == nil || CHSearchTreeCompare(&localComparator, found, anObject) != NSOrderedSame)
+		return nil;
+	return cursor;
+}
+
 - (NSString*) description {
 	return [[self allObjectsWithTraversalOrder:CHTraverseAscending] description];
 }
 
 - (id) firstObject {
-	sentinel->object = nil;
+	if (count == 0)
+		return nil;
 	CHBinaryTreeNode *current = header->right;
 	while (current->left != sentinel)
 		current = current->left;
 	return current->object;
 }
 
+- (CHFrozenSortedSet*) freeze {
+	return [[[CHFrozenSortedSet alloc] initWithSortedObjects:[self allObjects]
+	                                              comparator:comparator] autorelease];
+}
+
 - (NSUInteger) hash {
 	return hashOfCountAndObjects(count, [self firstObject], [self lastObject]);
 }
@@ -475,24 +1312,43 @@ CHBinaryTreeNode* CHCreateBinaryTreeNodeWithObject(id anObject) {
 }
 
 - (id) lastObject {
-	sentinel->object = nil;
+	if (count == 0)
+		return nil;
 	CHBinaryTreeNode *current = header->right;
 	while (current->right != sentinel)
 		current = current->right;
 	return current->object;
 }
 
+// Searches that don't modify the tree don't store the target in the sentinel, since it is shared with any snapshots, and a snapshot may be searched on another thread while the tree is being modified. For the same reason, they compare objects with a copy of the comparison state, so the cached -compare: method is not updated by several threads at once.
 - (id) member:(id)anObject {
 	if (anObject == nil)
 		return nil;
-	sentinel->object = anObject; // Make sure the target value is always "found"
+	CHSearchTreeComparator localComparator = *comparator;
 	CHBinaryTreeNode *current = header->right;
 	NSComparisonResult comparison;
-	while (comparison = [current->object compare:anObject]) // while not equal
+	while (current != sentinel &&
+	       (comparison = CHSearchTreeCompare(&localComparator, current->object, anObject))) // while not equal
 		current = current->link[comparison == NSOrderedAscending]; // R on YES
 	return (current != sentinel) ? current->object : nil;
 }
 
+- (id) objectAtRank:(NSUInteger)rank {
+	if (rank >= count)
+		CHIndexOutOfRangeException([self class], _cmd, rank, count);
+	CHBinaryTreeNode *current = header->right;
+	NSUInteger leftSize;
+	while (rank != (leftSize = current->left->size)) {
+		if (rank < leftSize)
+			current = current->left;
+		else {
+			rank -= leftSize + 1;
+			current = current->right;
+		}
+	}
+	return current->object;
+}
+
 - (NSEnumerator*) objectEnumerator {
 	return [self objectEnumeratorWithTraversalOrder:CHTraverseAscending];
 }
@@ -506,6 +1362,53 @@ CHBinaryTreeNode* CHCreateBinaryTreeNodeWithObject(id anObject) {
 	      mutationPointer:&mutations] autorelease];
 }
 
+- (id) objectGreaterThan:(id)anObject {
+	if (anObject == nil)
+		return nil;
+	CHSearchTreeComparator localComparator = *comparator;
+	return boundingObject(&localComparator, header->right, sentinel, anObject, YES, NO);
+}
+
+- (id) objectGreaterThanOrEqualTo:(id)anObject {
+	if (anObject == nil)
+		return nil;
+	CHSearchTreeComparator localComparator = *comparator;
+	return boundingObject(&localComparator, header->right, sentinel, anObject, YES, YES);
+}
+
+- (id) objectLessThan:(id)anObject {
+	if (anObject == nil)
+		return nil;
+	CHSearchTreeComparator localComparator = *comparator;
+	return boundingObject(&localComparator, header->right, sentinel, anObject, NO, NO);
+}
+
+- (id) objectLessThanOrEqualTo:(id)anObject {
+	if (anObject == nil)
+		return nil;
+	CHSearchTreeComparator localComparator = *comparator;
+	return boundingObject(&localComparator, header->right, sentinel, anObject, NO, YES);
+}
+
+- (NSUInteger) rankOfObject:(id)anObject {
+	if (anObject == nil)
+		return NSNotFound;
+	CHSearchTreeComparator localComparator = *comparator;
+	CHBinaryTreeNode *current = header->right;
+	NSUInteger rank = 0;
+	NSComparisonResult comparison;
+	while (current != sentinel &&
+	       (comparison = CHSearchTreeCompare(&localComparator, current->object, anObject))) { // while not equal
+		if (comparison == NSOrderedAscending) {
+			rank += current->left->size + 1;
+			current = current->right;
+		}
+		else
+			current = current->left;
+	}
+	return (current != sentinel) ? rank + current->left->size : NSNotFound;
+}
+
 // Doesn't call -[NSGarbageCollector collectIfNeeded] -- lets the sender choose.
 - (void) removeAllObjects {
 	if (count == 0)
@@ -513,25 +1416,16 @@ CHBinaryTreeNode* CHCreateBinaryTreeNodeWithObject(id anObject) {
 	++mutations;
 	count = 0;
 	
-	if (kCHGarbageCollectionNotEnabled) {
-		// Only deal with memory management if garbage collection is NOT enabled.
-		// Remove each node from the tree and release the object it points to.
-		// Use pre-order (depth-first) traversal for simplicity and performance.
-		CHBinaryTreeStack * stack;
-		stack = [[CHBinaryTreeStack alloc] init];
-		[stack push:header->right];
-
-		CHBinaryTreeNode *current;
-		while (current = [stack pop]) {
-			if (current->right != sentinel)
-				[stack push:current->right];
-			if (current->left != sentinel)
-				[stack push:current->left];
-			[current->object release];
-			free(current);
-		}
-		[stack release];
+	if (nodePool->ownerCount > 1) {
+		// The nodes may be shared with a snapshot, so only free those it doesn't use (and leave it the sentinel).
+		CHBinaryTreeNodePool *sharedPool = nodePool;
+		CHBinaryTreeNode *sharedSentinel = sentinel;
+		nodePool = createPoolLike(sharedPool);
+		sentinel = createSentinelLike(sharedSentinel);
+		relinquishNodes(sharedPool, header->right, sharedSentinel);
 	}
+	else
+		releaseNodes(nodePool, header->right, sentinel);
 	header->right = sentinel; // With GC, this is sufficient to unroot the tree.
 	sentinel->object = nil; // Make sure we don't accidentally retain an object.
 }
@@ -550,6 +1444,10 @@ CHBinaryTreeNode* CHCreateBinaryTreeNodeWithObject(id anObject) {
 	return [self objectEnumeratorWithTraversalOrder:CHTraverseDescending];
 }
 
+- (CHSearchTreeComparator*) searchTreeComparator {
+	return comparator;
+}
+
 - (NSSet*) set {
 	NSMutableSet *set = [NSMutableSet new];
 	NSEnumerator *e = [self objectEnumeratorWithTraversalOrder:CHTraversePreOrder];
@@ -567,71 +1465,293 @@ CHBinaryTreeNode* CHCreateBinaryTreeNodeWithObject(id anObject) {
  
  \link    CHSortedSet#subsetFromObject:toObject: \endlink
  
- \attention This implementation tests objects for membership in the subset according to their sorted order. This worst-case input causes more work for self-balancing trees, and subsets of unbalanced trees will always degenerate to linked lists.
+ \attention This implementation uses the subtree sizes to count the objects in the subset in O(log n) time, copies them into a temporary array by visiting only the nodes in the range (and those on the paths leading to it), and builds a balanced subset directly from the sorted objects. The total cost is O(log n + k) for a subset of k objects, regardless of the kind of tree.
  */
 - (id<CHSortedSet>) subsetFromObject:(id)start
                             toObject:(id)end
                              options:(CHSubsetConstructionOptions)options
 {
-	// If both parameters are nil, return a copy containing all the objects.
-	if (start == nil && end == nil)
+	// If both parameters are nil, return a copy containing all the objects. (A copy of a snapshot is the snapshot itself, but its subsets are ordinary trees.)
+	Class subsetClass = [self treeClass];
+	if (start == nil && end == nil && subsetClass == [self class])
 		return [[self copy] autorelease];
 	
-	id<CHSortedSet> subset = [[[[self class] alloc] init] autorelease];
+	CHAbstractBinarySearchTree *subset = [[[subsetClass alloc] init] autorelease];
+	CHSearchTreeComparatorCopy(subset->comparator, comparator);
 	if (count == 0)
 		return subset;
 	
-	NSEnumerator *e;
-	id anObject;
+	BOOL includeStart = !(options & CHSubsetExcludeLowEndpoint);
+	BOOL includeEnd = !(options & CHSubsetExcludeHighEndpoint);
+	CHSearchTreeComparator localComparator = *comparator;
+	CHBinaryTreeNode *root = header->right;
+	// The number of objects before the range, and up to the end of the range.
+	NSUInteger beforeStart = (start == nil)
+		? 0 : countOfObjectsBelow(&localComparator, root, sentinel, start, !includeStart);
+	NSUInteger throughEnd = (end == nil)
+		? count : countOfObjectsBelow(&localComparator, root, sentinel, end, includeEnd);
+	NSUInteger lowCount, highCount; // Sizes of the (at most two) runs to copy.
+	id lowStart; // Where the first run starts; the second always starts at start.
+	
+	if (start == nil || end == nil || CHSearchTreeCompare(&localComparator, start, end) != NSOrderedDescending) {
+		// Include subset of objects between the range parameters.
+		lowCount = (throughEnd > beforeStart) ? throughEnd - beforeStart : 0;
+		highCount = 0;
+		lowStart = start;
+	}
+	else {
+		// Include subset of objects NOT between the range parameters. The ones up to the end come first, since they are all less than the ones after start.
+		lowCount = throughEnd;
+		highCount = count - beforeStart;
+		lowStart = nil;
+	}
+	if (lowCount + highCount == 0)
+		return subset;
 	
-	if (start == nil) {
-		// Start from the first object and add until we pass the end parameter.
-		e = [self objectEnumeratorWithTraversalOrder:CHTraverseAscending];
-		while ((anObject = [e nextObject]) &&
-			   [anObject compare:end] != NSOrderedDescending) {
-			[subset addObject:anObject];
+	id *objects = NSAllocateCollectable((lowCount + highCount) * kCHPointerSize,
+	                                    NSScannedOption);
+	copyObjectsFromObject(&localComparator, root, sentinel, lowStart, includeStart, objects, lowCount);
+	copyObjectsFromObject(&localComparator, root, sentinel, start, includeStart,
+	                      objects + lowCount, highCount);
+	[subset buildTreeFromSortedObjects:objects count:lowCount + highCount];
+	if (kCHGarbageCollectionNotEnabled)
+		free(objects);
+	return subset;
+}
+
+- (Class) treeClass {
+	return [self class];
+}
+
+#pragma mark Set Operations
+
+- (void) intersectWithSortedSet:(id<CHSortedSet>)otherSortedSet {
+	if (otherSortedSet == self || count == 0)
+		return;
+	NSUInteger otherCount = [otherSortedSet count];
+	if (otherCount == 0) {
+		[self removeAllObjects];
+		return;
+	}
+	BOOL sameOrder = isOrderedLike(comparator, otherSortedSet);
+	id *objects, *otherObjects;
+	NSUInteger objectCount, resultCount = 0, i;
+	if (shouldProbe(otherCount, count) || (!sameOrder && otherCount < count)) {
+		// Keep the receiver's object that matches each of the other objects. If the other set grows while it is being enumerated, stop when the array is full.
+		objects = NSAllocateCollectable(otherCount * kCHPointerSize, NSScannedOption);
+		id match;
+		for (id anObject in otherSortedSet) {
+			if ((match = [self member:anObject]) != nil) {
+				objects[resultCount++] = match;
+				if (resultCount == otherCount)
+					break;
+			}
+		}
+		if (!sameOrder) {
+			// The matches are in the other set's order, so add them back one at a time.
+			for (i = 0; i < resultCount; i++)
+				[objects[i] retain];
+			[self removeAllObjects];
+			for (i = 0; i < resultCount; i++) {
+				[self addObject:objects[i]];
+				[objects[i] release];
+			}
+			if (kCHGarbageCollectionNotEnabled)
+				free(objects);
+			return;
 		}
 	}
-	else if (end == nil) {
-		// Start from the last object and add until we pass the start parameter.
-		e = [self objectEnumeratorWithTraversalOrder:CHTraverseDescending];
-		while ((anObject = [e nextObject]) &&
-			   [anObject compare:start] != NSOrderedAscending) {
-			[subset addObject:anObject];
+	else if (!sameOrder || shouldProbe(count, otherCount)) {
+		objects = [self copySortedObjectsOfSet:self count:&objectCount];
+		for (i = 0; i < objectCount; i++) {
+			if ([otherSortedSet containsObject:objects[i]])
+				objects[resultCount++] = objects[i];
 		}
 	}
 	else {
-		if ([start compare:end] == NSOrderedAscending) {
-			// Include subset of objects between the range parameters.
-			e = [self objectEnumeratorWithTraversalOrder:CHTraverseAscending];
-			while ((anObject = [e nextObject]) &&
-				   [anObject compare:start] == NSOrderedAscending)
-				;
-			do {
-				[subset addObject:anObject];
-			} while ((anObject = [e nextObject]) &&
-					 [anObject compare:end] != NSOrderedDescending);
+		// An intersection is no larger than the receiver, so merge in place.
+		objects = [self copySortedObjectsOfSet:self count:&objectCount];
+		otherObjects = [self copySortedObjectsOfSet:otherSortedSet count:&otherCount];
+		resultCount = mergeSortedObjects(comparator, CHMergeIntersection, objects, objectCount,
+		                                 otherObjects, otherCount, objects);
+		if (kCHGarbageCollectionNotEnabled)
+			free(otherObjects);
+	}
+	[self replaceAllObjectsWithSortedObjects:objects count:resultCount];
+	if (kCHGarbageCollectionNotEnabled)
+		free(objects);
+}
+
+- (void) minusSortedSet:(id<CHSortedSet>)otherSortedSet {
+	if (count == 0)
+		return;
+	if (otherSortedSet == self) {
+		[self removeAllObjects];
+		return;
+	}
+	NSUInteger otherCount = [otherSortedSet count];
+	if (otherCount == 0)
+		return;
+	BOOL sameOrder = isOrderedLike(comparator, otherSortedSet);
+	if (shouldProbe(otherCount, count) || (!sameOrder && otherCount < count)) {
+		for (id anObject in otherSortedSet)
+			[self removeObject:anObject];
+		return;
+	}
+	NSUInteger objectCount, resultCount = 0;
+	id *objects = [self copySortedObjectsOfSet:self count:&objectCount], *otherObjects;
+	if (!sameOrder || shouldProbe(count, otherCount)) {
+		for (NSUInteger i = 0; i < objectCount; i++) {
+			if (![otherSortedSet containsObject:objects[i]])
+				objects[resultCount++] = objects[i];
 		}
-		else {
-			// Include subset of objects NOT between the range parameters.
-			e = [self objectEnumeratorWithTraversalOrder:CHTraverseDescending];
-			while ((anObject = [e nextObject]) &&
-				   [anObject compare:start] != NSOrderedAscending)
-				[subset addObject:anObject];
-			e = [self objectEnumeratorWithTraversalOrder:CHTraverseAscending];
-			while ((anObject = [e nextObject]) &&
-				   [anObject compare:end] != NSOrderedDescending)
-				[subset addObject:anObject];
-		}
-	}
-	// If the start and/or end value is to be excluded, remove before returning.
-	if (options & CHSubsetExcludeLowEndpoint)
-		[subset removeObject:start];
-	if (options & CHSubsetExcludeHighEndpoint)
-		[subset removeObject:end];
-	return subset;
+	}
+	else {
+		// A difference is no larger than the receiver, so merge in place.
+		otherObjects = [self copySortedObjectsOfSet:otherSortedSet count:&otherCount];
+		resultCount = mergeSortedObjects(comparator, CHMergeDifference, objects, objectCount,
+		                                 otherObjects, otherCount, objects);
+		if (kCHGarbageCollectionNotEnabled)
+			free(otherObjects);
+	}
+	if (resultCount < objectCount)
+		[self replaceAllObjectsWithSortedObjects:objects count:resultCount];
+	if (kCHGarbageCollectionNotEnabled)
+		free(objects);
+}
+
+- (void) unionWithSortedSet:(id<CHSortedSet>)otherSortedSet {
+	if (otherSortedSet == self)
+		return;
+	NSUInteger otherCount = [otherSortedSet count];
+	if (otherCount == 0)
+		return;
+	if (shouldProbe(otherCount, count) || !isOrderedLike(comparator, otherSortedSet)) {
+		for (id anObject in otherSortedSet)
+			[self addObject:anObject];
+		return;
+	}
+	NSUInteger objectCount;
+	id *objects = [self copySortedObjectsOfSet:self count:&objectCount];
+	id *otherObjects = [self copySortedObjectsOfSet:otherSortedSet count:&otherCount];
+	id *result = NSAllocateCollectable((objectCount + otherCount) * kCHPointerSize,
+	                                   NSScannedOption);
+	NSUInteger resultCount = mergeSortedObjects(comparator, CHMergeUnion, objects, objectCount,
+	                                            otherObjects, otherCount, result);
+	[self replaceAllObjectsWithSortedObjects:result count:resultCount];
+	if (kCHGarbageCollectionNotEnabled) {
+		free(objects);
+		free(otherObjects);
+		free(result);
+	}
 }
 
+#pragma mark Snapshots
+
+- (void) compact {
+	if (count == 0)
+		return;
+	++mutations; // Enumerators may be holding nodes which are about to be given up.
+	CHBinaryTreeNodePool *oldPool = nodePool;
+	CHBinaryTreeNode *oldRoot = header->right, *oldSentinel = sentinel;
+	nodePool = createPoolLike(oldPool);
+	sentinel = createSentinelLike(oldSentinel);
+	header->right = copySubtreeInLevelOrder(nodePool, oldRoot, oldSentinel, sentinel);
+	relinquishNodes(oldPool, oldRoot, oldSentinel);
+}
+
+- (CHAbstractBinarySearchTree*) snapshot {
+	CHSearchTreeSnapshot *snapshot = [[CHSearchTreeSnapshot alloc] init];
+	snapshot->treeClass = [self class];
+	CHSearchTreeComparatorCopy(snapshot->comparator, comparator);
+	if (count > 0) {
+		// A pool can't be both partitioned and shared with snapshots.
+		if (nodePool->partitioned) {
+			if (nodePool->ownerCount > 1)
+				[self compact];
+			else
+				nodePool->partitioned = NO;
+		}
+		// Adopt the receiver's nodes and sentinel in place of the snapshot's own.
+		if (nodePool->linkCounts == NULL)
+			createLinkCounts(nodePool);
+		addLinkToNode(nodePool, header->right);
+		OSAtomicIncrement32Barrier(&nodePool->ownerCount);
+		relinquishNodes(snapshot->nodePool, snapshot->header->right, snapshot->sentinel);
+		snapshot->nodePool = nodePool;
+		snapshot->sentinel = sentinel;
+		snapshot->header->right = header->right;
+		snapshot->count = count;
+	}
+	return [snapshot autorelease];
+}
+
+- (void) partitionNodesWithTree:(CHAbstractBinarySearchTree*)otherTree {
+	NSAssert(count == 0, @"Only an empty tree may share another tree's nodes.");
+	if (otherTree->nodePool->ownerCount > 1 && !otherTree->nodePool->partitioned)
+		[otherTree compact];
+	relinquishNodes(nodePool, header->right, sentinel);
+	nodePool = otherTree->nodePool;
+	sentinel = otherTree->sentinel;
+	header->right = sentinel;
+	nodePool->partitioned = YES;
+	OSAtomicIncrement32Barrier(&nodePool->ownerCount);
+}
+
+- (CHBinaryTreeNode*) takeNodesOfTree:(CHAbstractBinarySearchTree*)otherTree {
+	CHBinaryTreeNode *root = otherTree->header->right;
+	if (root == otherTree->sentinel)
+		return sentinel;
+	if (otherTree->nodePool == nodePool && nodePool->partitioned) {
+		++(otherTree->mutations);
+		otherTree->header->right = otherTree->sentinel;
+		otherTree->count = 0;
+		return root;
+	}
+	root = copySubtree(nodePool, root, otherTree->sentinel, sentinel);
+	[otherTree removeAllObjects];
+	return root;
+}
+
+- (id*) copySortedObjectsOfSet:(id<CHSortedSet>)aSet count:(NSUInteger*)objectCount {
+	NSUInteger setCount = [aSet count], i = 0;
+	id *objects = NSAllocateCollectable(setCount * kCHPointerSize, NSScannedOption);
+	if ([aSet isKindOfClass:[CHAbstractBinarySearchTree class]]) {
+		CHAbstractBinarySearchTree *tree = (CHAbstractBinarySearchTree*) aSet;
+		copyObjectsFromObject(comparator, tree->header->right, tree->sentinel, nil, NO,
+		                      objects, setCount);
+		i = setCount;
+	}
+	else {
+		// The set may be changing on another thread (as a CHConcurrentSkipListSet may), so its count and contents can disagree; copy no more than there is room for.
+		for (id anObject in aSet) {
+			if (i == setCount)
+				break;
+			objects[i++] = anObject;
+		}
+	}
+	*objectCount = i;
+	return objects;
+}
+
+- (void) replaceAllObjectsWithSortedObjects:(id*)objects count:(NSUInteger)objectCount {
+	CHBinaryTreeNode *oldRoot = header->right, *oldSentinel = sentinel;
+	CHBinaryTreeNodePool *oldPool = nodePool;
+	nodePool = createPoolLike(oldPool); // Allocate nodes the same way as before.
+	// If the old nodes are shared with a snapshot, so is the sentinel.
+	if (oldPool->ownerCount > 1)
+		sentinel = createSentinelLike(oldSentinel);
+	header->right = sentinel;
+	count = 0;
+	[self buildTreeFromSortedObjects:objects count:objectCount];
+	if (sentinel != oldSentinel)
+		relinquishNodes(oldPool, oldRoot, oldSentinel);
+	else {
+		releaseNodes(oldPool, oldRoot, sentinel);
+		CHBinaryTreeNodePoolFree(oldPool);
+		sentinel->object = nil; // Make sure we don't accidentally retain an object.
+	}
+}
 
 - (NSString*) debugDescription {
 	NSMutableString *description = [NSMutableString stringWithFormat:
@@ -640,7 +1760,7 @@ CHBinaryTreeNode* CHCreateBinaryTreeNodeWithObject(id anObject) {
 	CHBinaryTreeStack * stack;
 	stack = [[CHBinaryTreeStack alloc] init];
 	
-	sentinel->object = nil;
+	// The sentinel may be shared with a snapshot, so its object is left alone.
 	if (header->right != sentinel)
 		[stack push:header->right];	
 	while (current = [stack pop]) {
@@ -651,7 +1771,8 @@ CHBinaryTreeNode* CHCreateBinaryTreeNodeWithObject(id anObject) {
 		// Append entry for the current node, including children
 		[description appendFormat:@"\t%@ -> \"%@\" and \"%@\"\n",
 		 [self debugDescriptionForNode:current],
-		 current->left->object, current->right->object];
+		 (current->left != sentinel) ? current->left->object : nil,
+		 (current->right != sentinel) ? current->right->object : nil];
 	}
 	[stack release];
 	[description appendString:@"}"];
@@ -672,7 +1793,6 @@ CHBinaryTreeNode* CHCreateBinaryTreeNodeWithObject(id anObject) {
 	} else {
 		NSString *leftChild, *rightChild;
 		NSUInteger sentinelCount = 0;
-		sentinel->object = nil;
 		
 		CHBinaryTreeNode *current;
 		CHBinaryTreeStack * stack;
@@ -687,10 +1807,10 @@ CHBinaryTreeNode* CHCreateBinaryTreeNodeWithObject(id anObject) {
 			// Append entry for node with any subclass-specific customizations.
 			[graph appendString:[self dotGraphStringForNode:current]];
 			// Append entry for edges from current node to both its children.
-			leftChild = (current->left->object == nil)
+			leftChild = (current->left == sentinel)
 				? [NSString stringWithFormat:@"nil%lu", ++sentinelCount]
 				: [NSString stringWithFormat:@"\"%@\"", current->left->object];
-			rightChild = (current->right->object == nil)
+			rightChild = (current->right == sentinel)
 				? [NSString stringWithFormat:@"nil%lu", ++sentinelCount]
 				: [NSString stringWithFormat:@"\"%@\"", current->right->object];
 			[graph appendFormat:@"  \"%@\" -> {%@;%@};\n",
@@ -722,3 +1842,53 @@ CHBinaryTreeNode* CHCreateBinaryTreeNodeWithObject(id anObject) {
 }
 
 @end
+
+#pragma mark -
+
+@implementation CHSearchTreeSnapshot
+
+// Since the snapshot never changes, copies can simply share it.
+- (id) copyWithZone:(NSZone*)zone {
+	return [self retain];
+}
+
+- (CHAbstractBinarySearchTree*) snapshot {
+	return [[self retain] autorelease];
+}
+
+// Archive a snapshot as the kind of tree it came from, so it is mutable once decoded.
+- (Class) classForKeyedArchiver {
+	return treeClass;
+}
+
+- (Class) treeClass {
+	return treeClass;
+}
+
+#pragma mark Unsupported Implementations
+
+- (void) addObjectsFromArray:(NSArray*)anArray {
+	CHUnsupportedOperationException([self class], _cmd);
+}
+
+- (void) compact {
+	CHUnsupportedOperationException([self class], _cmd);
+}
+
+- (void) intersectWithSortedSet:(id<CHSortedSet>)otherSortedSet {
+	CHUnsupportedOperationException([self class], _cmd);
+}
+
+- (void) minusSortedSet:(id<CHSortedSet>)otherSortedSet {
+	CHUnsupportedOperationException([self class], _cmd);
+}
+
+- (void) removeAllObjects {
+	CHUnsupportedOperationException([self class], _cmd);
+}
+
+- (void) unionWithSortedSet:(id<CHSortedSet>)otherSortedSet {
+	CHUnsupportedOperationException([self class], _cmd);
+}
+
+@end
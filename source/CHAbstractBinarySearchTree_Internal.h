@@ -11,10 +11,12 @@
  */
 
 #import "CHAbstractBinarySearchTree.h"
+#import <libkern/OSAtomic.h>
+#import <objc/runtime.h>
 
 /**
  @file CHAbstractBinarySearchTree_Internal.h
- Contains \#defines for performing various traversals of binary search trees.
+ Contains \#defines for performing various traversals of binary search trees, and functions for allocating the nodes of a tree and comparing the objects in it.
  
  This file is a private header that is only used by internal implementations, and is not included in the the compiled framework. The macros and variables are to be considered private and unsupported.
  
@@ -31,8 +33,38 @@
 // This method determines the appearance of nodes in the graph produced by -dotGraphString, and may be overriden by subclasses. The default implementation creates an oval containing the value returned by -description for the object in the node.
 - (NSString*) dotGraphStringForNode:(CHBinaryTreeNode*)node;
 
+// Builds a perfectly balanced tree from a C array of objects in strictly ascending order in O(n) time, calling -prepareBulkLoadedNode:size:depth:maxDepth: for each node. The receiver must be empty. Each object is retained by the tree.
+- (void) buildTreeFromSortedObjects:(id*)objects count:(NSUInteger)objectCount;
+
+// This method is called for each node when a perfectly balanced tree is built directly from sorted objects (see -addObjectsFromArray:), and should be overridden by subclasses to set the extra field used by their balancing algorithm. Both subtrees of the node are complete when it is called. The 'size' is the number of nodes in the subtree rooted at 'node' (the left subtree has (size-1)/2 nodes, the right has the rest), 'depth' is 0 for the root, and 'maxDepth' is the depth of the deepest nodes in the tree. The default implementation does nothing.
+- (void) prepareBulkLoadedNode:(CHBinaryTreeNode*)node
+                          size:(NSUInteger)size
+                         depth:(NSUInteger)depth
+                      maxDepth:(NSUInteger)maxDepth;
+
+// Replaces the contents of the receiver with a balanced tree built from a C array of objects in strictly ascending order, any of which may already be in the receiver. The new tree is built in a fresh node pool before the old nodes (and the objects they contain) are released, so objects in both are never deallocated prematurely.
+- (void) replaceAllObjectsWithSortedObjects:(id*)objects count:(NSUInteger)objectCount;
+
+// Returns the class of the trees created by -subsetFromObject:toObject:options:. This is the class of the receiver, except for a snapshot, whose subsets are ordinary trees of the class it was taken from, with that class's balancing data, so they can be modified and archived.
+- (Class) treeClass;
+
+// Makes an empty receiver use the node pool and sentinel of another tree of the same class, so that nodes can be moved between the two in O(1) time (see -takeNodesOfTree:). Unlike snapshots, the trees hold separate nodes, so each may modify its own; since they share a free list, however, they must not be modified (or deallocated) at the same time on different threads. If the other tree shares its nodes with a snapshot, it is compacted first, since a pool can't be both.
+- (void) partitionNodesWithTree:(CHAbstractBinarySearchTree*)otherTree;
+
+// Empties another tree (of the same class and ordering) and returns the root of an equivalent subtree which uses the receiver's pool and sentinel, for the receiver to link into its own tree. If the trees partition the same pool, the nodes themselves are moved in O(1) time; otherwise they are copied in O(n) time and the originals released.
+- (CHBinaryTreeNode*) takeNodesOfTree:(CHAbstractBinarySearchTree*)otherTree;
+
+// Returns a C array (which the caller must free) containing the objects in a sorted set in the set's own order, and stores the number of objects copied in 'objectCount'; this is never more than the set's -count when the copy began, even if the set is changed on another thread meanwhile. The objects are not retained. If the set is a binary search tree, its nodes are walked directly instead of using an enumerator. The set must be ordered the same way as the receiver if the objects are to be merged with the receiver's.
+- (id*) copySortedObjectsOfSet:(id<CHSortedSet>)aSet count:(NSUInteger*)objectCount;
+
 @end
 
+/**
+ Whether the nodes of a tree may be shared with a snapshot. Even so, a node can only be shared if it has more than one link (see CHBinaryTreeNodeIsShared()), so this is only a hint: a tree uses it to check that a removal will change something before copying any nodes on the way to it.
+ */
+#define CHSearchTreeMayShareNodes() \
+	(nodePool->ownerCount > 1 && !nodePool->partitioned)
+
 #pragma mark -
 
 /**
@@ -46,5 +78,303 @@ HIDDEN CHBinaryTreeNode* CHCreateBinaryTreeNodeWithObject(id anObject);
 // These are used by subclasses; marked as HIDDEN to reduce external visibility.
 HIDDEN OBJC_EXPORT size_t kCHBinaryTreeNodeSize;
 
+/**
+ Recomputes the size of a node's subtree from the sizes of its children. Since a rotation doesn't change the size of the subtree being rotated, the node that moves up can take the old size of the subtree root; only the node(s) that move down need to be updated with this function (lowest node first).
+ */
+static inline void CHUpdateSubtreeSize(CHBinaryTreeNode *node) {
+	node->size = node->left->size + node->right->size + 1;
+}
+
+#pragma mark Comparison
+
+/**
+ The state a tree uses to compare objects. If @a function is @c NULL, objects are compared by sending them a @c -compare: message. Since the objects in a tree are nearly always of the same class, the implementation of that method is cached, so the message is only looked up again when the class of the receiver changes.
+ */
+typedef struct CHSearchTreeComparator {
+	CHComparisonFunction function; ///< The comparison function, or @c NULL.
+	void *context;                 ///< Passed to @a function for each comparison.
+	__strong id block;             ///< A comparator block (retained), or @c nil.
+	id headerObject;               ///< The object in the tree's header node.
+	Class cachedClass;             ///< The last class to receive @c -compare:.
+	IMP cachedIMP;                 ///< The @c -compare: method of @a cachedClass.
+} CHSearchTreeComparator;
+
+#if NS_BLOCKS_AVAILABLE
+/**
+ Adapts a comparator block (passed as the context) to a comparison function, so a tree, skip list or B+ tree ordered by a block can store it in the @a function and @a context of its comparison state.
+ */
+HIDDEN NSInteger CHCompareObjectsUsingBlock(id object1, id object2, void *context);
+#endif
+
+/**
+ Allocates comparison state which sends @c -compare: messages, given the object in the header node of a tree.
+ 
+ @return A struct allocated with @c NSAllocateCollectable() and @c NSScannedOption.
+ */
+HIDDEN CHSearchTreeComparator* CHSearchTreeComparatorCreate(id headerObject);
+
+/**
+ Makes one tree's comparison state match another's (e.g. for a copy or subset). The block, if any, is retained rather than copied.
+ */
+HIDDEN void CHSearchTreeComparatorCopy(CHSearchTreeComparator *destination, CHSearchTreeComparator *source);
+
+/**
+ Releases the block (if any) in comparison state and frees the struct.
+ */
+HIDDEN void CHSearchTreeComparatorFree(CHSearchTreeComparator *comparator);
+
+/**
+ Returns whether two sets of comparison state order objects identically, because they use the same function and context (or the same block), or both send @c -compare: messages. Sorted objects can only be merged from one set into another if this is true; two functions which happen to produce the same order are not recognized.
+ */
+static inline BOOL CHSearchTreeComparatorsMatch(CHSearchTreeComparator *comparator1,
+                                                CHSearchTreeComparator *comparator2)
+{
+	return (comparator1->function == comparator2->function &&
+	        comparator1->context == comparator2->context &&
+	        comparator1->block == comparator2->block);
+}
+
+/**
+ Adopted (informally) by every sorted set in the framework which orders its objects with comparison state, so that a tree can find out whether another set is ordered the same way. Other sorted sets are assumed to be ordered differently.
+ */
+@protocol CHSearchTreeOrdering
+- (CHSearchTreeComparator*) searchTreeComparator;
+@end
+
+/**
+ Compares two objects according to the ordering of a tree. This must be used instead of sending @c -compare: directly, and the same rules apply: the header object may only be passed as @a object1, in which case the result is always @c NSOrderedAscending, so the sentinel and header tricks work regardless of how the tree is ordered.
+ 
+ Since this updates the cached method in @a comparator, which is not synchronized, methods which only read a collection (and so may be called from several threads at once, as on a snapshot) must pass a copy of the comparison state on the stack instead: <code>CHSearchTreeComparator localComparator = *comparator;</code>
+ 
+ @param comparator The comparison state of the tree.
+ @param object1 The first object to be compared.
+ @param object2 The second object to be compared.
+ @return The order of the two objects.
+ */
+static inline NSComparisonResult CHSearchTreeCompare(CHSearchTreeComparator *comparator,
+                                                     id object1, id object2)
+{
+	if (object1 == comparator->headerObject)
+		return NSOrderedAscending;
+	if (comparator->function != NULL)
+		return (NSComparisonResult) comparator->function(object1, object2,
+		                                                 comparator->context);
+	Class objectClass = object_getClass(object1);
+	if (objectClass != comparator->cachedClass) {
+		comparator->cachedIMP = class_getMethodImplementation(objectClass,
+		                                                      @selector(compare:));
+		comparator->cachedClass = objectClass;
+	}
+	return ((NSComparisonResult(*)(id,SEL,id)) comparator->cachedIMP)
+		(object1, @selector(compare:), object2);
+}
+
+#pragma mark Node Pools
+
+/**
+ A contiguous block of nodes carved out in order by a CHBinaryTreeNodePool. Slabs are chained together (most recent first) so they can all be released at once.
+ */
+typedef struct CHBinaryTreeNodeSlab {
+	__strong struct CHBinaryTreeNodeSlab *next; ///< The slab allocated before this one.
+	NSUInteger capacity; ///< The number of nodes in this slab.
+	NSUInteger used;     ///< The number of nodes carved out of this slab so far.
+	CHBinaryTreeNode nodes[]; ///< Storage for the nodes themselves.
+} CHBinaryTreeNodeSlab;
+
+/**
+ Per-tree storage for the nodes that hold objects. Rather than calling @c malloc() and @c free() for each insertion and removal, nodes are carved out of progressively larger slabs and recycled through a free list (linked by the @a right field). Besides being cheaper to allocate, nodes created together are close together in memory, and @c -removeAllObjects can release every object with a linear sweep of the slabs instead of a tree traversal.
+ 
+ Header and sentinel nodes are not drawn from the pool. Every node handed out by the pool has a non-nil @a object until it is recycled, at which point the @a object field is cleared; this allows a sweep to distinguish live nodes from recycled ones.
+ 
+ If @a slabCapacity is 0, each node is allocated and freed individually instead. The mode may only be changed while no nodes from the pool are in use.
+ 
+ A tree may share its nodes (and its sentinel) with snapshots created by \link CHAbstractBinarySearchTree#snapshot -snapshot\endlink, in which case @a ownerCount is greater than 1. The links to each node are counted in @a linkCounts, which the first snapshot creates, so trees which are never shared don't pay for the counts in every node. Only nodes with more than one link are entered, so the table holds little more than the nodes along the paths that have been copied since each snapshot was taken; a node which isn't entered has exactly one link. The tree copies any node with more than one link before modifying it (see CHUnshareBinaryTreeNode()), and a node is freed when its last link is given up. Only the tree obtains nodes from the pool, but a snapshot may give up nodes on any thread, so those nodes are pushed onto @a returnedNodes with an atomic compare-and-swap, and the tree takes the whole list over (in one swap, so nodes never move in the other direction) when its free list runs out. The pool itself is freed by whichever tree gives it up last.
+ 
+ Alternatively, several trees may be @a partitioned, sharing the pool and sentinel but each holding separate nodes (such as the halves of a split CHTreap). Each tree may then modify its own nodes, and releases them itself when it gives up the pool. A pool is never partitioned and shared with snapshots at the same time.
+ */
+typedef struct CHBinaryTreeNodePool {
+	__strong CHBinaryTreeNodeSlab *slabs; ///< The slab currently being carved, followed by older slabs.
+	__strong CHBinaryTreeNode *freeList;  ///< Recycled nodes, linked by their right child pointer.
+	CHBinaryTreeNode * volatile returnedNodes; ///< Nodes freed by snapshots, linked the same way.
+	NSUInteger slabCapacity;              ///< Number of nodes in the next slab; 0 disables slabs.
+	volatile int32_t ownerCount;          ///< The number of trees using the nodes in the pool.
+	BOOL partitioned;                     ///< Whether the trees using the pool hold separate nodes.
+	__strong CFMutableDictionaryRef linkCounts; ///< Nodes with more than one link, and how many; NULL until the first snapshot.
+	OSSpinLock linkCountLock;             ///< Guards @a linkCounts, which snapshots change on any thread.
+} CHBinaryTreeNodePool;
+
+// The number of nodes in the first slab, and the cap for repeated doubling.
+#define kCHBinaryTreeNodeSlabMinimum 16
+#define kCHBinaryTreeNodeSlabMaximum 2048
+
+/**
+ Allocates an empty node pool with slabs enabled.
+ 
+ @return A pool allocated with @c NSAllocateCollectable() and @c NSScannedOption.
+ */
+HIDDEN CHBinaryTreeNodePool* CHBinaryTreeNodePoolCreate(void);
+
+/**
+ Returns a node given back by a snapshot (taking over the rest of @a returnedNodes as the free list) if there are any, or else one that has never been used, either from the current slab, a new slab, or (if slabs are disabled) an individual allocation. This is the slow path of CHCreateBinaryTreeNodeFromPool(), and should not be called directly.
+ */
+HIDDEN CHBinaryTreeNode* CHBinaryTreeNodePoolNextNode(CHBinaryTreeNodePool *pool);
+
+/**
+ Ensures that the next @a capacity nodes which have never been used are carved out of a single slab, by starting a new slab of exactly that size if the current one does not have room. Used before building or copying a whole tree, so its nodes are contiguous in memory rather than spread across many small slabs. The usual growth of later slabs is not affected, and if slabs are disabled there is no effect.
+ 
+ @param pool The pool from which the nodes will be obtained.
+ @param capacity The number of nodes about to be obtained.
+ */
+HIDDEN void CHBinaryTreeNodePoolReserve(CHBinaryTreeNodePool *pool, NSUInteger capacity);
+
+/**
+ Releases the object in each live node (if garbage collection is not enabled) and frees every slab in the pool, leaving it empty but still usable. Has no effect on individually-allocated nodes.
+ */
+HIDDEN void CHBinaryTreeNodePoolDrain(CHBinaryTreeNodePool *pool);
+
+/**
+ Drains a pool (see CHBinaryTreeNodePoolDrain()) and frees the pool itself.
+ */
+HIDDEN void CHBinaryTreeNodePoolFree(CHBinaryTreeNodePool *pool);
+
+/**
+ Obtains a node from a pool, reusing a recycled node if one is available. Sets the object and the "extra" field just like CHCreateBinaryTreeNodeWithObject(), and the size to 1; the child links are left for the caller to set.
+ 
+ @param pool The pool for the tree into which the node will be inserted.
+ @param anObject The object to be stored in the @a object field of the struct; must not be @c nil.
+ @return A node which belongs to @a pool, and should be returned via CHRecycleBinaryTreeNode().
+ */
+static inline CHBinaryTreeNode* CHCreateBinaryTreeNodeFromPool(CHBinaryTreeNodePool *pool, id anObject) {
+	CHBinaryTreeNode *node = pool->freeList;
+	if (node != NULL)
+		pool->freeList = node->right;
+	else
+		node = CHBinaryTreeNodePoolNextNode(pool);
+	node->object = anObject;
+	node->balance = 0; // Affects balancing info for any subclass (anon. union)
+	node->size = 1;
+	return node;
+}
+
+/**
+ Returns a node which is no longer part of the tree to its pool. The caller is responsible for releasing the object in the node (if appropriate) beforehand. The node must not be shared with a snapshot, and this must only be called by the tree which obtains nodes from the pool.
+ 
+ @param pool The pool from which @a node was obtained.
+ @param node The node to recycle; its @a object field is cleared.
+ */
+static inline void CHRecycleBinaryTreeNode(CHBinaryTreeNodePool *pool, CHBinaryTreeNode *node) {
+	node->object = nil;
+	if (pool->slabCapacity != 0) {
+		node->right = pool->freeList;
+		pool->freeList = node;
+	}
+	else if (kCHGarbageCollectionNotEnabled)
+		free(node);
+}
+
+/**
+ Returns the number of links to a node from the trees which share a pool: 1 unless the node is shared with a snapshot. (The header and sentinel are never counted, so this returns 1 for them too.)
+ */
+static inline CFIndex CHBinaryTreeNodeLinkCount(CHBinaryTreeNodePool *pool, CHBinaryTreeNode *node) {
+	if (pool->linkCounts == NULL)
+		return 1;
+	OSSpinLockLock(&pool->linkCountLock);
+	CFIndex links = (CFIndex) CFDictionaryGetValue(pool->linkCounts, node);
+	OSSpinLockUnlock(&pool->linkCountLock);
+	return (links != 0) ? links : 1;
+}
+
+/**
+ Returns whether a node is shared with a snapshot. While the pool is not shared, this is a test of two fields of the pool, so trees without snapshots never look up the count.
+ */
+static inline BOOL CHBinaryTreeNodeIsShared(CHBinaryTreeNodePool *pool, CHBinaryTreeNode *node) {
+	return (pool->ownerCount > 1 && !pool->partitioned &&
+	        CHBinaryTreeNodeLinkCount(pool, node) > 1);
+}
+
+/**
+ Replaces a node which is shared with a snapshot with a copy that only the tree uses, and returns the copy. This is the slow path of CHUnshareBinaryTreeNode(), and should not be called directly.
+ 
+ The copy has the same object (retained again), children, balancing info and size as @a node, and the children gain a link from the copy; the link to @a node which the copy replaces is given up, and @a node is freed if that was the last one.
+ */
+HIDDEN CHBinaryTreeNode* CHCopySharedBinaryTreeNode(CHBinaryTreeNodePool *pool,
+                                                    CHBinaryTreeNode *node,
+                                                    CHBinaryTreeNode *sentinel);
+
+/**
+ Must be used on each node a tree is about to modify in any way (including its links, balancing info, size or object), unless the tree has just created the node itself. If the node is shared with a snapshot, it is replaced by a copy, which is stored in the link it was reached through; otherwise, this is a test of the pool (see CHBinaryTreeNodeIsShared()). Since copying a node also shares its children, nodes must be unshared from the top down, and the node containing @a link must not be shared itself. (The header never is, and the sentinel, which is always shared, is left as it is; a tree only ever sets its @a object.)
+ 
+ @param pool The pool of the tree, from which any copy is obtained.
+ @param link The link to the node from its parent (or from the header), such as <code>&current->left</code>.
+ @param sentinel The sentinel of the tree.
+ @return The node which is now linked at @a link, which the tree may modify.
+ */
+static inline CHBinaryTreeNode* CHUnshareBinaryTreeNode(CHBinaryTreeNodePool *pool,
+                                                        CHBinaryTreeNode **link,
+                                                        CHBinaryTreeNode *sentinel)
+{
+	if (CHBinaryTreeNodeIsShared(pool, *link))
+		*link = CHCopySharedBinaryTreeNode(pool, *link, sentinel);
+	return *link;
+}
+
+#pragma mark Enumeration Stacks
+
+// The number of nodes an enumeration stack can hold before it moves to the heap. Since subtree sizes are 32 bits, this exceeds the height of any red-black tree, AVL tree or AA-tree (and nearly any treap); only a very unbalanced tree can be deeper.
+#define kCHEnumerationStackInlineCapacity 64
+
+/**
+ A stack of nodes for short-lived traversals, such as a single call to @c -countByEnumeratingWithState:objects:count:. It is meant to be declared as a local variable, so the nodes are kept in a fixed-size array on the C stack unless the path is unusually deep. The nodes are always reachable from the tree, so the heap storage (if any) need not be scanned by the garbage collector.
+ */
+typedef struct CHEnumerationStack {
+	CHBinaryTreeNode **nodes; ///< Either @a inlineNodes or a malloc'd array.
+	NSUInteger size;          ///< The number of nodes in the stack.
+	NSUInteger capacity;      ///< The number of nodes that fit in @a nodes.
+	CHBinaryTreeNode *inlineNodes[kCHEnumerationStackInlineCapacity];
+} CHEnumerationStack;
+
+static inline void CHEnumerationStackInit(CHEnumerationStack *stack) {
+	stack->nodes = stack->inlineNodes;
+	stack->size = 0;
+	stack->capacity = kCHEnumerationStackInlineCapacity;
+}
+
+static inline void CHEnumerationStackPush(CHEnumerationStack *stack, CHBinaryTreeNode *node) {
+	if (stack->size == stack->capacity) {
+		stack->capacity *= 2;
+		if (stack->nodes == stack->inlineNodes) {
+			stack->nodes = malloc(stack->capacity * sizeof(CHBinaryTreeNode*));
+			memcpy(stack->nodes, stack->inlineNodes, stack->size * sizeof(CHBinaryTreeNode*));
+		}
+		else
+			stack->nodes = realloc(stack->nodes, stack->capacity * sizeof(CHBinaryTreeNode*));
+	}
+	stack->nodes[stack->size++] = node;
+}
+
+// Must be called before the stack goes out of scope, in case it moved to the heap.
+static inline void CHEnumerationStackFree(CHEnumerationStack *stack) {
+	if (stack->nodes != stack->inlineNodes)
+		free(stack->nodes);
+}
+
+#pragma mark Freezing
+
+#import "CHFrozenSortedSet.h"
+
+@interface CHFrozenSortedSet (Freezing)
+
+/**
+ Initializes a frozen set with objects which are already sorted and unique, ordered the same way as another sorted set. This is the designated initializer, and is used by every sorted set to implement @c -freeze.
+ 
+ @param sortedObjects The objects of the set, in ascending order.
+ @param sourceComparator The comparison state of the set being frozen, or @c NULL to send @c -compare: messages.
+ @return An initialized frozen set containing the objects in @a sortedObjects.
+ */
+- (id) initWithSortedObjects:(NSArray*)sortedObjects
+                  comparator:(CHSearchTreeComparator*)sourceComparator;
+
+@end
+
 #import "CHBinaryTreeStack.h"
 #import "CHBinaryTreeQueue.h"
\ No newline at end of file
@@ -13,12 +13,17 @@
 #import "CHAnderssonTree.h"
 #import "CHAbstractBinarySearchTree_Internal.h"
 
+// Neither macro may be used on a node which is shared with a snapshot. Each one
+// copies the child it rotates up if need be, but not that child's children.
+
 // Remove left horizontal links
 #define skew(node) { \
 	if ( node->left->level == node->level && node->level != 0 ) { \
-		CHBinaryTreeNode *save = node->left; \
+		CHBinaryTreeNode *save = CHUnshareBinaryTreeNode(nodePool, &node->left, sentinel); \
 		node->left = save->right; \
 		save->right = node; \
+		save->size = node->size; \
+		CHUpdateSubtreeSize(node); \
 		node = save; \
 	} \
 }
@@ -26,9 +31,11 @@
 // Remove consecutive horizontal links
 #define split(node) { \
 	if ( node->right->right->level == node->level && node->level != 0 ) { \
-		CHBinaryTreeNode *save = node->right; \
+		CHBinaryTreeNode *save = CHUnshareBinaryTreeNode(nodePool, &node->right, sentinel); \
 		node->right = save->left; \
 		save->left = node; \
+		save->size = node->size; \
+		CHUpdateSubtreeSize(node); \
 		node = save; \
 		++(node->level); \
 	} \
@@ -49,11 +56,13 @@
 	CHBinaryTreeStack * stack;
 	stack = [[CHBinaryTreeStack alloc] init];
 	
+	// Every node on the path changes (if only its size), so none may be shared.
 	sentinel->object = anObject; // Assure that we find a spot to insert
 	NSComparisonResult comparison;
-	while (comparison = [current->object compare:anObject]) {
+	while (comparison = CHSearchTreeCompare(comparator, current->object, anObject)) {
 		[stack push:current];
-		current = current->link[comparison == NSOrderedAscending]; // R on YES
+		++(current->size); // Assume the object is new; undo below if not.
+		current = CHUnshareBinaryTreeNode(nodePool, &current->link[comparison == NSOrderedAscending], sentinel); // R on YES
 	}
 	
 	[anObject retain]; // Must retain whether replacing value or adding new node
@@ -61,10 +70,12 @@
 		// Replace the existing object with the new object.
 		[current->object release];
 		current->object = anObject;
+		while (current = [stack pop])
+			--(current->size);
 		// No need to rebalance up the path since we didn't modify the structure
 		goto done;
 	} else {
-		current = CHCreateBinaryTreeNodeWithObject(anObject);
+		current = CHCreateBinaryTreeNodeFromPool(nodePool, anObject);
 		current->left   = sentinel;
 		current->right  = sentinel;
 		current->level  = 1;
@@ -72,7 +83,7 @@
 		// Link from parent as the proper child, based on last comparison
 		parent = [stack pop];
 		NSAssert(parent != nil, @"Illegal state, parent should never be nil!");
-		comparison = [parent->object compare:anObject];
+		comparison = CHSearchTreeCompare(comparator, parent->object, anObject);
 		parent->link[comparison == NSOrderedAscending] = current; // R if YES
 	}
 	
@@ -95,6 +106,9 @@ done:
 	if (count == 0 || anObject == nil)
 		return;
 	++mutations;
+	// Don't copy any nodes shared with a snapshot unless the object is there to remove.
+	if (CHSearchTreeMayShareNodes() && [self member:anObject] == nil)
+		return;
 	
 	CHBinaryTreeNode *parent, *current = header;
 	CHBinaryTreeStack * stack;
@@ -102,12 +116,15 @@ done:
 	
 	sentinel->object = anObject; // Assure that we stop at a leaf if not found.
 	NSComparisonResult comparison;
-	while (comparison = [current->object compare:anObject]) {
+	while (comparison = CHSearchTreeCompare(comparator, current->object, anObject)) {
 		[stack push:current];
-		current = current->link[comparison == NSOrderedAscending]; // R on YES
+		--(current->size); // Assume the object is present; undo below if not.
+		current = CHUnshareBinaryTreeNode(nodePool, &current->link[comparison == NSOrderedAscending], sentinel); // R on YES
 	}
 	// Exit if the specified node was not found in the tree.
 	if (current == sentinel) {
+		while (current = [stack pop])
+			++(current->size);
 		goto done;
 	}
 	
@@ -119,22 +136,22 @@ done:
 		NSAssert(parent != nil, @"Illegal state, parent should never be nil!");
 		parent->link[parent->right == current]
 			= current->link[current->left == sentinel];
-		if (kCHGarbageCollectionNotEnabled)
-			free(current);
+		CHRecycleBinaryTreeNode(nodePool, current);
 	} else {
 		// Two child case -- replace with minimum object in right subtree
 		[stack push:current]; // Need to start here when rebalancing
-		CHBinaryTreeNode *replacement = current->right;
+		--(current->size);
+		CHBinaryTreeNode *replacement = CHUnshareBinaryTreeNode(nodePool, &current->right, sentinel);
 		while (replacement->left != sentinel) {
 			[stack push:replacement];
-			replacement = replacement->left;
+			--(replacement->size);
+			replacement = CHUnshareBinaryTreeNode(nodePool, &replacement->left, sentinel);
 		}
 		parent = [stack top];
 		// Grab object from replacement node, steal its right child, deallocate
 		current->object = replacement->object;
 		parent->link[parent->right == replacement] = replacement->right;
-		if (kCHGarbageCollectionNotEnabled)
-			free(replacement);
+		CHRecycleBinaryTreeNode(nodePool, replacement);
 	}
 	
 	// Walk back up the path and rebalance as we go
@@ -149,6 +166,9 @@ done:
 		if (current->left->level < current->level-1 ||
 			current->right->level < current->level-1)
 		{
+			// Copy the nodes below on the right which may be skewed or split, from the top down.
+			CHUnshareBinaryTreeNode(nodePool, &current->right, sentinel);
+			CHUnshareBinaryTreeNode(nodePool, &current->right->right, sentinel);
 			if (current->right->level > --(current->level)) {
 				current->right->level = current->level;
 			}
@@ -164,6 +184,18 @@ done:
 	[stack release];
 }
 
+// In a bulk-loaded tree, the level of a node with n nodes in its subtree is floor(log2(n+1)); only a right child can share the level of its parent.
+- (void) prepareBulkLoadedNode:(CHBinaryTreeNode*)node
+                          size:(NSUInteger)size
+                         depth:(NSUInteger)depth
+                      maxDepth:(NSUInteger)maxDepth
+{
+	u_int32_t level = 0;
+	for (++size; size > 1; size >>= 1)
+		level++;
+	node->level = level;
+}
+
 - (NSString*) debugDescriptionForNode:(CHBinaryTreeNode*)node {
 	return [NSString stringWithFormat:@"[%d]\t\"%@\"", node->level, node->object];
 }
@@ -0,0 +1,73 @@
+/*
+ CHDataStructures.framework -- CHBTree.h
+ 
+ Copyright (c) 2010, Quinn Taylor <http://homepage.mac.com/quinntaylor>
+ 
+ This source code is released under the ISC License. <http://www.opensource.org/licenses/isc-license>
+ 
+ Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted, provided that the above copyright notice and this permission notice appear in all copies.
+ 
+ The software is  provided "as is", without warranty of any kind, including all implied warranties of merchantability and fitness. In no event shall the authors or copyright holders be liable for any claim, damages, or other liability, whether in an action of contract, tort, or otherwise, arising from, out of, or in connection with the software or the use or other dealings in the software.
+ */
+
+#import "CHAbstractBinarySearchTree.h"
+
+/**
+ @file CHBTree.h
+ A <a href="http://en.wikipedia.org/wiki/B%2B_tree">B+ tree</a> implementation of CHSearchTree.
+ */
+
+/**
+ The maximum number of objects in a leaf node of a CHBTree, which is also the maximum number of children of a branch node. Every node except the root holds at least half this many. The objects in a full node occupy 512 bytes in 64-bit mode (256 bytes in 32-bit mode), so a node spans a few cache lines, and shifting objects to insert or remove one is still cheap.
+ */
+#define kCHBTreeNodeCapacity 64
+
+// Opaque node storage; defined in CHBTree.m
+struct CHBTreeNode;
+
+/**
+ A <a href="http://en.wikipedia.org/wiki/B%2B_tree">B+ tree</a>, a balanced search tree whose nodes hold many objects rather than one. Each node holds up to #kCHBTreeNodeCapacity objects in a contiguous array, which is searched with a binary search. All objects are stored in the leaves, which are all at the same depth; branch nodes only hold the objects which separate their children. The leaves are also linked to one another in order, so enumerating the objects (or a range of them) simply walks the arrays of consecutive leaves, without returning to the branches.
+ 
+ Since the tree has a branching factor of 32 to 64 rather than 2, it is about one sixth as tall as a balanced binary tree, and a lookup touches a handful of nodes rather than one node per comparison. For trees with many objects, this causes far fewer cache misses than following pointers from node to node, and uses much less memory per object (between one and two pointers per object, compared with a 32-byte node per object in 64-bit mode). The tradeoff is that inserting or removing an object moves an average of 16 or so other object pointers within a leaf.
+ 
+ Insertion splits full nodes in half, and removal either borrows an object from an adjacent node or merges two nodes which are less than half full, so the tree remains balanced and every operation is O(log n). Trees built from sorted objects (including trees created by \link NSCopying#copy -copy\endlink, \link #subsetFromObject:toObject:options: -subsetFromObject:toObject:options:\endlink, or decoding an archive) are built directly in O(n) time, with each node filled to capacity.
+ 
+ Because every object is in a leaf, and every leaf is at the same depth, the pre-order, post-order, and level-order traversals all visit the objects in the same order as @c CHTraverseAscending.
+ 
+ This class can be used wherever a CHSortedSet is expected, and is used by CHSortedDictionary to sort its keys.
+ */
+@interface CHBTree : CHLockableObject <CHSearchTree>
+{
+	__strong struct CHBTreeNode *root; // The root node, or NULL if empty.
+	__strong struct CHBTreeNode *firstLeaf; // The leaf with the least objects.
+	__strong struct CHBTreeNode *lastLeaf; // The leaf with the greatest objects.
+	__strong struct CHSearchTreeComparator *comparator; // Orders the objects.
+	NSUInteger height; // The number of levels of nodes; 0 if empty.
+	NSUInteger count; // The number of objects currently in the tree.
+	unsigned long mutations; // Tracks mutations for NSFastEnumeration.
+}
+
+/**
+ Initializes a B+ tree which orders objects using a comparison function, rather than sending them @c -compare: messages. The same caveats apply as for \link CHAbstractBinarySearchTree#initWithComparisonFunction:context: -[CHAbstractBinarySearchTree initWithComparisonFunction:context:]\endlink.
+ 
+ @param function The function used to compare objects; must not be @c NULL.
+ @param context An arbitrary pointer which is passed to @a function with each comparison.
+ @return An initialized B+ tree which orders objects using @a function.
+ 
+ @throw NSInvalidArgumentException If @a function is @c NULL.
+ */
+- (id) initWithComparisonFunction:(CHComparisonFunction)function context:(void*)context;
+
+#if NS_BLOCKS_AVAILABLE
+/**
+ Initializes a B+ tree which orders objects using a comparator block, rather than sending them @c -compare: messages. The block is copied.
+ 
+ @param cmptr The block used to compare objects; must not be @c nil.
+ @return An initialized B+ tree which orders objects using @a cmptr.
+ 
+ @throw NSInvalidArgumentException If @a cmptr is @c nil.
+ */
+- (id) initWithComparator:(NSComparator)cmptr;
+#endif
+
+@end
@@ -0,0 +1,703 @@
+/*
+ CHDataStructures.framework -- CHBTree.m
+ 
+ Copyright (c) 2010, Quinn Taylor <http://homepage.mac.com/quinntaylor>
+ 
+ This source code is released under the ISC License. <http://www.opensource.org/licenses/isc-license>
+ 
+ Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted, provided that the above copyright notice and this permission notice appear in all copies.
+ 
+ The software is  provided "as is", without warranty of any kind, including all implied warranties of merchantability and fitness. In no event shall the authors or copyright holders be liable for any claim, damages, or other liability, whether in an action of contract, tort, or otherwise, arising from, out of, or in connection with the software or the use or other dealings in the software.
+ */
+
+#import "CHBTree.h"
+#import "CHAbstractBinarySearchTree_Internal.h"
+
+/**
+ A node in a CHBTree. Leaves and branches use the same struct, but a leaf is allocated without the @a children array, so it is about half the size.
+ 
+ - In a leaf, @a objects holds @a count objects in ascending order, and @a previous and @a next link the leaves together in order.
+ - In a branch, @a children holds @a count child nodes, and @a objects holds the <code>count-1</code> separators between them: every object in the subtree at <code>children[i]</code> is less than <code>objects[i]</code>, and every object in the subtree at <code>children[i+1]</code> is greater than or equal to it. A separator is the least object in the subtree to its right when it is chosen, and is retained by the branch, since it may outlive that object in the leaf.
+ */
+typedef struct CHBTreeNode {
+	NSUInteger count;                      ///< The number of objects or children.
+	__strong struct CHBTreeNode *previous; ///< The preceding leaf (leaves only).
+	__strong struct CHBTreeNode *next;     ///< The following leaf (leaves only).
+	__strong id objects[kCHBTreeNodeCapacity]; ///< Objects, or separators in a branch.
+	__strong struct CHBTreeNode *children[kCHBTreeNodeCapacity]; ///< Branches only.
+} CHBTreeNode;
+
+// Moves pointers within or between nodes, which the garbage collector must know about.
+#define CHBTreeMove(dst,src,n) objc_memmove_collectable((dst), (src), kCHPointerSize * (n))
+
+static size_t kCHBTreeLeafSize = offsetof(CHBTreeNode, children);
+static size_t kCHBTreeBranchSize = sizeof(CHBTreeNode);
+
+// A position between two objects, identified by the object after it. The index equals the count of the leaf only at the very end of the last leaf.
+typedef struct CHBTreePosition {
+	CHBTreeNode *leaf;
+	NSUInteger index;
+} CHBTreePosition;
+
+static CHBTreeNode* createNode(BOOL isLeaf) {
+	CHBTreeNode *node = NSAllocateCollectable(isLeaf ? kCHBTreeLeafSize : kCHBTreeBranchSize,
+	                                          NSScannedOption);
+	node->count = 0;
+	node->previous = NULL;
+	node->next = NULL;
+	return node;
+}
+
+// Releases the objects (and separators) in a subtree with a given number of levels, and frees its nodes. This is never needed with GC, since dropping the root unroots the tree.
+static void freeSubtree(CHBTreeNode *node, NSUInteger levels) {
+	NSUInteger i;
+	if (levels > 1) {
+		for (i = 0; i < node->count; i++)
+			freeSubtree(node->children[i], levels - 1);
+		for (i = 1; i < node->count; i++)
+			[node->objects[i-1] release];
+	}
+	else {
+		for (i = 0; i < node->count; i++)
+			[node->objects[i] release];
+	}
+	free(node);
+}
+
+/**
+ Performs a binary search for an object in a sorted array of objects.
+ 
+ @param comparator The comparison state of the tree.
+ @param objects A C array of objects in strictly ascending order.
+ @param objectCount The number of objects in @a objects.
+ @param anObject The object to search for.
+ @param found Set to @c YES if an object equal to @a anObject is in @a objects.
+ @return The index of the object equal to @a anObject if there is one, otherwise the index of the first object which is greater than @a anObject (which may be @a objectCount).
+ */
+static NSUInteger searchObjects(CHSearchTreeComparator *comparator,
+                                id *objects, NSUInteger objectCount,
+                                id anObject, BOOL *found)
+{
+	NSUInteger low = 0, high = objectCount, middle;
+	NSComparisonResult comparison;
+	while (low < high) {
+		middle = (low + high) / 2;
+		comparison = CHSearchTreeCompare(comparator, objects[middle], anObject);
+		if (comparison == NSOrderedAscending)
+			low = middle + 1;
+		else if (comparison == NSOrderedDescending)
+			high = middle;
+		else {
+			*found = YES;
+			return middle;
+		}
+	}
+	*found = NO;
+	return low;
+}
+
+// Returns the index of the child of a branch whose subtree holds (or would hold) an object.
+static inline NSUInteger childIndex(CHSearchTreeComparator *comparator,
+                                    CHBTreeNode *branch, id anObject)
+{
+	BOOL found;
+	NSUInteger index = searchObjects(comparator, branch->objects, branch->count - 1,
+	                                 anObject, &found);
+	return found ? index + 1 : index; // An object equal to a separator is to its right.
+}
+
+// The algorithms this tree shares with CHIntegerSortedSet, specialized for objects (see CHBTree_Internal.h).
+#define CHBTreeCoreNode       CHBTreeNode
+#define CHBTreeCoreKey        id
+#define CHBTreeCoreContext    CHSearchTreeComparator*
+#define kCHBTreeCoreCapacity  kCHBTreeNodeCapacity
+#define CHBTreeKeys(node)     ((node)->objects)
+#define CHBTreeChildren(node) ((node)->children)
+#define CHBTreeChild(node,i)  ((node)->children[i])
+#define CHBTreeCreateNode(context,isLeaf)           createNode(isLeaf)
+#define CHBTreeChildIndex(context,branch,anObject)  childIndex((context), (branch), (anObject))
+#define CHBTreeMoveKeys(dst,src,n)                  CHBTreeMove((dst), (src), (n))
+#define CHBTreeMoveChildren(dst,src,n)              CHBTreeMove((dst), (src), (n))
+#define CHBTreeMoveEntries(context,dst,dstIndex,src,srcIndex,n) \
+	CHBTreeMove((dst)->objects + (dstIndex), (src)->objects + (srcIndex), (n))
+#define CHBTreeRetainKey(anObject)   [(anObject) retain]
+#define CHBTreeReleaseKey(anObject)  [(anObject) release]
+
+#import "CHBTree_Internal.h"
+
+// Finds the position of the first object which is greater than (or, if 'orEqual' is YES, equal to) an object. The tree must not be empty.
+static CHBTreePosition findPosition(CHSearchTreeComparator *comparator,
+                                    CHBTreeNode *root, NSUInteger height,
+                                    id anObject, BOOL orEqual)
+{
+	CHBTreePosition position;
+	BOOL found;
+	position.leaf = findLeaf(comparator, root, height, anObject, NULL);
+	position.index = searchObjects(comparator, position.leaf->objects,
+	                               position.leaf->count, anObject, &found);
+	if (found && !orEqual)
+		position.index++;
+	if (position.index == position.leaf->count && position.leaf->next != NULL) {
+		position.leaf = position.leaf->next;
+		position.index = 0;
+	}
+	return position;
+}
+
+// Returns the object after a position, or nil if it is at the end of the tree.
+static id objectAfterPosition(CHBTreePosition position) {
+	if (position.index < position.leaf->count)
+		return position.leaf->objects[position.index];
+	return nil;
+}
+
+// Returns the object before a position, or nil if it is at the start of the tree.
+static id objectBeforePosition(CHBTreePosition position) {
+	if (position.index > 0)
+		return position.leaf->objects[position.index - 1];
+	if (position.leaf->previous != NULL)
+		return position.leaf->previous->objects[position.leaf->previous->count - 1];
+	return nil;
+}
+
+// Returns the number of objects from one position up to another. Walks from leaf to leaf, so 'to' must not come before 'from'.
+static NSUInteger countObjectsBetween(CHBTreePosition from, CHBTreePosition to) {
+	NSUInteger objectCount = 0;
+	while (from.leaf != to.leaf) {
+		objectCount += from.leaf->count - from.index;
+		from.leaf = from.leaf->next;
+		from.index = 0;
+	}
+	return objectCount + to.index - from.index;
+}
+
+// Copies a run of consecutive objects into a C array, starting at a position. The caller must ensure that at least 'objectCount' objects remain.
+static void copyObjectsFromPosition(CHBTreePosition position, id *objects, NSUInteger objectCount) {
+	NSUInteger runLength;
+	while (objectCount > 0) {
+		runLength = MIN(objectCount, position.leaf->count - position.index);
+		memcpy(objects, position.leaf->objects + position.index, runLength * kCHPointerSize);
+		objects += runLength;
+		objectCount -= runLength;
+		position.leaf = position.leaf->next;
+		position.index = 0;
+	}
+}
+
+#pragma mark -
+
+/**
+ An NSEnumerator for traversing a CHBTree in ascending or descending order. Since the leaves are linked together, the enumerator only needs a leaf and an index within it. As with other enumerators in this framework, the tree is retained until the last object is enumerated, and a mutation exception is raised if the tree is modified.
+ */
+@interface CHBTreeEnumerator : NSEnumerator
+{
+	__strong CHBTree *searchTree; // The tree being enumerated.
+	__strong CHBTreeNode *leaf; // The leaf with the next object, or NULL.
+	NSUInteger index; // The index of the next object, or just after it if descending.
+	BOOL ascending; // Whether to enumerate in ascending order.
+	unsigned long mutationCount; // Stores the collection's initial mutation.
+	unsigned long *mutationPtr; // Pointer for checking changes in mutation.
+}
+
+/**
+ Create an enumerator which starts at one end of a tree.
+ 
+ @param tree The tree being enumerated; it is retained until all its objects have been enumerated.
+ @param start The first leaf (if @a isAscending is @c YES) or last leaf of @a tree, or @c NULL if it is empty.
+ @param isAscending Whether to enumerate objects in ascending or descending order.
+ @param mutations A pointer to the collection's mutation count for invalidation.
+ @return An initialized CHBTreeEnumerator which will enumerate the objects in @a tree.
+ */
+- (id) initWithTree:(CHBTree*)tree
+          startLeaf:(CHBTreeNode*)start
+          ascending:(BOOL)isAscending
+    mutationPointer:(unsigned long*)mutations;
+
+- (NSArray*) allObjects;
+
+- (id) nextObject;
+
+@end
+
+@implementation CHBTreeEnumerator
+
+- (id) initWithTree:(CHBTree*)tree
+          startLeaf:(CHBTreeNode*)start
+          ascending:(BOOL)isAscending
+    mutationPointer:(unsigned long*)mutations
+{
+	if ((self = [super init]) == nil) return nil;
+	searchTree = (start != NULL) ? [tree retain] : nil;
+	leaf = start;
+	ascending = isAscending;
+	index = (start != NULL && !ascending) ? start->count : 0;
+	mutationCount = *mutations;
+	mutationPtr = mutations;
+	return self;
+}
+
+- (void) dealloc {
+	[searchTree release];
+	[super dealloc];
+}
+
+- (NSArray*) allObjects {
+	if (mutationCount != *mutationPtr)
+		CHMutatedCollectionException([self class], _cmd);
+	NSMutableArray *array = [[NSMutableArray alloc] init];
+	id anObject;
+	while ((anObject = [self nextObject]))
+		[array addObject:anObject];
+	[searchTree release];
+	searchTree = nil;
+	return [array autorelease];
+}
+
+- (id) nextObject {
+	if (mutationCount != *mutationPtr)
+		CHMutatedCollectionException([self class], _cmd);
+	if (leaf == NULL) {
+		[searchTree release];
+		searchTree = nil;
+		return nil;
+	}
+	id anObject;
+	if (ascending) {
+		anObject = leaf->objects[index++];
+		if (index == leaf->count) {
+			leaf = leaf->next;
+			index = 0;
+		}
+	}
+	else {
+		anObject = leaf->objects[--index];
+		if (index == 0) {
+			leaf = leaf->previous;
+			index = (leaf != NULL) ? leaf->count : 0;
+		}
+	}
+	return anObject;
+}
+
+@end
+
+#pragma mark -
+
+@interface CHBTree ()
+
+// Replaces the (empty) tree with one built from objects in strictly ascending order.
+- (void) buildTreeFromSortedObjects:(id*)objects count:(NSUInteger)objectCount;
+
+@end
+
+@implementation CHBTree
+
+- (void) dealloc {
+	if (root != NULL)
+		freeSubtree(root, height);
+	CHSearchTreeComparatorFree(comparator);
+	[super dealloc];
+}
+
+- (id) init {
+	if ((self = [super init]) == nil) return nil;
+	root = firstLeaf = lastLeaf = NULL;
+	height = 0;
+	count = 0;
+	mutations = 0;
+	comparator = CHSearchTreeComparatorCreate(nil);
+	return self;
+}
+
+- (id) initWithArray:(NSArray*)anArray {
+	if ([self init] == nil) return nil;
+	[self addObjectsFromArray:anArray];
+	return self;
+}
+
+- (id) initWithComparisonFunction:(CHComparisonFunction)function context:(void*)context {
+	if ([self init] == nil) return nil;
+	if (function == NULL)
+		CHInvalidArgumentException([self class], _cmd, @"Invalid comparison function.");
+	comparator->function = function;
+	comparator->context = context;
+	return self;
+}
+
+#if NS_BLOCKS_AVAILABLE
+- (id) initWithComparator:(NSComparator)cmptr {
+	if ([self init] == nil) return nil;
+	if (cmptr == nil)
+		CHNilArgumentException([self class], _cmd);
+	comparator->block = [cmptr copy];
+	comparator->function = CHCompareObjectsUsingBlock;
+	comparator->context = comparator->block;
+	return self;
+}
+#endif
+
+#pragma mark <NSCoding>
+
+// Since the objects are encoded in ascending order, the tree is rebuilt in O(n) time.
+- (id) initWithCoder:(NSCoder*)decoder {
+	return [self initWithArray:[decoder decodeObjectForKey:@"objects"]];
+}
+
+- (void) encodeWithCoder:(NSCoder*)encoder {
+	[encoder encodeObject:[self allObjects] forKey:@"objects"];
+}
+
+#pragma mark <NSCopying> methods
+
+// Builds the copy directly from the objects in order, in O(n) time.
+- (id) copyWithZone:(NSZone*)zone {
+	CHBTree *newTree = [[[self class] allocWithZone:zone] init];
+	CHSearchTreeComparatorCopy(newTree->comparator, comparator);
+	if (count > 0) {
+		id *objects = NSAllocateCollectable(count * kCHPointerSize, NSScannedOption);
+		CHBTreePosition start = {firstLeaf, 0};
+		copyObjectsFromPosition(start, objects, count);
+		[newTree buildTreeFromSortedObjects:objects count:count];
+		if (kCHGarbageCollectionNotEnabled)
+			free(objects);
+	}
+	return newTree;
+}
+
+#pragma mark <NSFastEnumeration>
+
+/*
+ Each call returns all the objects in one leaf, directly from the leaf itself, so nothing is copied. The state holds the leaf that was returned last. Nothing is allocated, so there is nothing to clean up when a loop exits early.
+ */
+- (NSUInteger) countByEnumeratingWithState:(NSFastEnumerationState*)state
+                                   objects:(id*)stackbuf
+                                     count:(NSUInteger)len
+{
+	CHBTreeNode *leaf;
+	if (state->state == 0) {
+		state->mutationsPtr = &mutations;
+		state->state = 1;
+		leaf = firstLeaf;
+	}
+	else
+		leaf = ((CHBTreeNode*) state->extra[0])->next;
+	if (leaf == NULL)
+		return 0;
+	state->extra[0] = (unsigned long) leaf;
+	state->itemsPtr = leaf->objects;
+	return leaf->count;
+}
+
+#pragma mark Querying Contents
+
+- (NSArray*) allObjects {
+	return [self allObjectsWithTraversalOrder:CHTraverseAscending];
+}
+
+- (NSArray*) allObjectsWithTraversalOrder:(CHTraversalOrder)order {
+	return [[self objectEnumeratorWithTraversalOrder:order] allObjects];
+}
+
+- (id) anyObject {
+	return (count > 0) ? firstLeaf->objects[0] : nil;
+}
+
+- (BOOL) containsObject:(id)anObject {
+	return ([self member:anObject] != nil);
+}
+
+- (NSUInteger) count {
+	return count;
+}
+
+- (NSString*) description {
+	return [[self allObjects] description];
+}
+
+- (id) firstObject {
+	return (count > 0) ? firstLeaf->objects[0] : nil;
+}
+
+- (CHFrozenSortedSet*) freeze {
+	return [[[CHFrozenSortedSet alloc] initWithSortedObjects:[self allObjects]
+	                                              comparator:comparator] autorelease];
+}
+
+- (NSUInteger) hash {
+	return hashOfCountAndObjects(count, [self firstObject], [self lastObject]);
+}
+
+- (BOOL) isEqual:(id)otherObject {
+	if ([otherObject conformsToProtocol:@protocol(CHSortedSet)])
+		return [self isEqualToSortedSet:otherObject];
+	else
+		return NO;
+}
+
+- (BOOL) isEqualToSearchTree:(id<CHSearchTree>)otherTree {
+	return collectionsAreEqual(self, otherTree);
+}
+
+- (BOOL) isEqualToSortedSet:(id<CHSortedSet>)otherSortedSet {
+	return collectionsAreEqual(self, otherSortedSet);
+}
+
+- (id) lastObject {
+	return (count > 0) ? lastLeaf->objects[lastLeaf->count - 1] : nil;
+}
+
+- (id) member:(id)anObject {
+	if (anObject == nil || count == 0)
+		return nil;
+	CHBTreeNode *leaf = findLeaf(comparator, root, height, anObject, NULL);
+	BOOL found;
+	NSUInteger index = searchObjects(comparator, leaf->objects, leaf->count, anObject, &found);
+	return found ? leaf->objects[index] : nil;
+}
+
+- (NSEnumerator*) objectEnumerator {
+	return [self objectEnumeratorWithTraversalOrder:CHTraverseAscending];
+}
+
+// Every order other than descending visits the leaves from left to right.
+- (NSEnumerator*) objectEnumeratorWithTraversalOrder:(CHTraversalOrder)order {
+	if (!isValidTraversalOrder(order))
+		return nil;
+	BOOL ascending = (order != CHTraverseDescending);
+	return [[[CHBTreeEnumerator alloc] initWithTree:self
+	                                      startLeaf:(ascending ? firstLeaf : lastLeaf)
+	                                      ascending:ascending
+	                                mutationPointer:&mutations] autorelease];
+}
+
+- (id) objectGreaterThan:(id)anObject {
+	if (anObject == nil || count == 0)
+		return nil;
+	return objectAfterPosition(findPosition(comparator, root, height, anObject, NO));
+}
+
+- (id) objectGreaterThanOrEqualTo:(id)anObject {
+	if (anObject == nil || count == 0)
+		return nil;
+	return objectAfterPosition(findPosition(comparator, root, height, anObject, YES));
+}
+
+- (id) objectLessThan:(id)anObject {
+	if (anObject == nil || count == 0)
+		return nil;
+	return objectBeforePosition(findPosition(comparator, root, height, anObject, YES));
+}
+
+- (id) objectLessThanOrEqualTo:(id)anObject {
+	if (anObject == nil || count == 0)
+		return nil;
+	return objectBeforePosition(findPosition(comparator, root, height, anObject, NO));
+}
+
+- (NSEnumerator*) reverseObjectEnumerator {
+	return [self objectEnumeratorWithTraversalOrder:CHTraverseDescending];
+}
+
+- (CHSearchTreeComparator*) searchTreeComparator {
+	return comparator;
+}
+
+- (NSSet*) set {
+	NSMutableSet *set = [NSMutableSet setWithCapacity:count];
+	for (CHBTreeNode *leaf = firstLeaf; leaf != NULL; leaf = leaf->next)
+		for (NSUInteger i = 0; i < leaf->count; i++)
+			[set addObject:leaf->objects[i]];
+	return set;
+}
+
+/*
+ \copydoc CHSortedSet::subsetFromObject:toObject:
+ 
+ \attention This implementation finds the positions of the endpoints in O(log n) time, copies the objects between them by walking the arrays of the leaves in the range, and builds the subset directly from the sorted objects. The total cost is O(log n + k) for a subset of k objects.
+ */
+- (id<CHSortedSet>) subsetFromObject:(id)start
+                            toObject:(id)end
+                             options:(CHSubsetConstructionOptions)options
+{
+	// If both parameters are nil, return a copy containing all the objects.
+	if (start == nil && end == nil)
+		return [[self copy] autorelease];
+
+	CHBTree *subset = [[[[self class] alloc] init] autorelease];
+	CHSearchTreeComparatorCopy(subset->comparator, comparator);
+	if (count == 0)
+		return subset;
+
+	// The positions of the first object in the range, and just after the last.
+	CHBTreePosition first = {firstLeaf, 0}, last = {lastLeaf, lastLeaf->count};
+	CHBTreePosition low = first, high = last;
+	if (start != nil)
+		low = findPosition(comparator, root, height, start,
+		                   !(options & CHSubsetExcludeLowEndpoint));
+	if (end != nil)
+		high = findPosition(comparator, root, height, end,
+		                    (options & CHSubsetExcludeHighEndpoint) != 0);
+	NSUInteger lowCount, highCount; // Sizes of the (at most two) runs to copy.
+	CHBTreePosition lowStart; // Where the first run starts; the second starts at low.
+
+	if (start == nil || end == nil || CHSearchTreeCompare(comparator, start, end) != NSOrderedDescending) {
+		// Include subset of objects between the range parameters. If the endpoints are equal and excluded, the range may be "inside out", which leaves nothing in between.
+		BOOL isEmpty = (low.leaf == high.leaf)
+			? (low.index >= high.index)
+			: (CHSearchTreeCompare(comparator, low.leaf->objects[0],
+			                       high.leaf->objects[0]) != NSOrderedAscending);
+		lowCount = isEmpty ? 0 : countObjectsBetween(low, high);
+		highCount = 0;
+		lowStart = low;
+	}
+	else {
+		// Include subset of objects NOT between the range parameters. The ones up to the end come first, since they are all less than the ones after start.
+		lowCount = countObjectsBetween(first, high);
+		highCount = countObjectsBetween(low, last);
+		lowStart = first;
+	}
+	if (lowCount + highCount == 0)
+		return subset;
+
+	id *objects = NSAllocateCollectable((lowCount + highCount) * kCHPointerSize,
+	                                    NSScannedOption);
+	copyObjectsFromPosition(lowStart, objects, lowCount);
+	copyObjectsFromPosition(low, objects + lowCount, highCount);
+	[subset buildTreeFromSortedObjects:objects count:lowCount + highCount];
+	if (kCHGarbageCollectionNotEnabled)
+		free(objects);
+	return subset;
+}
+
+#pragma mark Modifying Contents
+
+- (void) addObject:(id)anObject {
+	if (anObject == nil)
+		CHNilArgumentException([self class], _cmd);
+	++mutations;
+	if (root == NULL) {
+		root = firstLeaf = lastLeaf = createNode(YES);
+		height = 1;
+	}
+
+	CHBTreeCorePath path;
+	CHBTreeNode *node = findLeaf(comparator, root, height, anObject, &path);
+	BOOL found;
+	NSUInteger index = searchObjects(comparator, node->objects, node->count, anObject, &found);
+	[anObject retain]; // Must retain whether replacing value or adding new object
+	if (found) {
+		[node->objects[index] release];
+		node->objects[index] = anObject;
+		return;
+	}
+	++count;
+	CHBTreeNode *sibling;
+	node = makeRoomInLeaf(comparator, node, &index, &sibling, &lastLeaf);
+	node->objects[index] = anObject;
+	node->count++;
+	if (sibling != NULL)
+		insertIntoParents(comparator, &path, sibling, &root, &height);
+}
+
+/*
+ If the receiver is empty and the objects in the array are in strictly ascending order (as they are when decoding an archive), the tree is built directly in O(n) time. Otherwise, the objects are added one at a time.
+ */
+- (void) addObjectsFromArray:(NSArray*)anArray {
+	NSUInteger arrayCount = [anArray count];
+	if (count == 0 && arrayCount > 1) {
+		id *objects = NSAllocateCollectable(arrayCount * kCHPointerSize, NSScannedOption);
+		[anArray getObjects:objects];
+		NSUInteger i;
+		for (i = 1; i < arrayCount; i++)
+			if (CHSearchTreeCompare(comparator, objects[i-1], objects[i]) != NSOrderedAscending)
+				break;
+		BOOL isSorted = (i == arrayCount);
+		if (isSorted)
+			[self buildTreeFromSortedObjects:objects count:arrayCount];
+		if (kCHGarbageCollectionNotEnabled)
+			free(objects);
+		if (isSorted)
+			return;
+	}
+	for (id anObject in anArray) {
+		[self addObject:anObject];
+	}
+}
+
+// Fills each leaf as full as possible, then each level of branches above them. The objects (or children) are spread evenly among the nodes in each level, so every node is at least half full.
+- (void) buildTreeFromSortedObjects:(id*)objects count:(NSUInteger)objectCount {
+	NSAssert(count == 0, @"Can only bulk load objects into an empty tree.");
+	++mutations;
+	if (objectCount == 0)
+		return;
+	NSUInteger nodeCount = (objectCount + kCHBTreeNodeCapacity - 1) / kCHBTreeNodeCapacity;
+	// The nodes in the level being built, and the least object in each one's subtree.
+	CHBTreeNode **nodes = NSAllocateCollectable(nodeCount * kCHPointerSize, NSScannedOption);
+	id *minimums = NSAllocateCollectable(nodeCount * kCHPointerSize, NSScannedOption);
+	CHBTreeNode *node, *previous = NULL;
+	NSUInteger i, j, size, offset = 0;
+	for (i = 0; i < nodeCount; i++) {
+		size = objectCount / nodeCount + (i < objectCount % nodeCount);
+		node = createNode(YES);
+		for (j = 0; j < size; j++)
+			node->objects[j] = [objects[offset + j] retain];
+		node->count = size;
+		node->previous = previous;
+		if (previous != NULL)
+			previous->next = node;
+		else
+			firstLeaf = node;
+		previous = node;
+		nodes[i] = node;
+		minimums[i] = objects[offset];
+		offset += size;
+	}
+	lastLeaf = previous;
+	height = 1;
+	root = buildBranches(comparator, nodes, minimums, nodeCount, &height);
+	count = objectCount;
+	if (kCHGarbageCollectionNotEnabled) {
+		free(nodes);
+		free(minimums);
+	}
+}
+
+// Doesn't call -[NSGarbageCollector collectIfNeeded] -- lets the sender choose.
+- (void) removeAllObjects {
+	if (count == 0)
+		return;
+	++mutations;
+	if (kCHGarbageCollectionNotEnabled)
+		freeSubtree(root, height);
+	root = firstLeaf = lastLeaf = NULL; // With GC, this is sufficient to unroot the tree.
+	height = 0;
+	count = 0;
+}
+
+- (void) removeFirstObject {
+	[self removeObject:[self firstObject]];
+}
+
+- (void) removeLastObject {
+	[self removeObject:[self lastObject]];
+}
+
+/*
+ After the object is removed from its leaf, any node on the path which is less than half full either borrows an object (or child) from an adjacent sibling that can spare one, or is merged with a sibling, which removes a child from the parent. This continues up the tree until a node is at least half full. If the root is left with only one child, that child becomes the root. (See removeFromLeaf() in CHBTree_Internal.h.)
+ */
+- (void) removeObject:(id)anObject {
+	if (count == 0 || anObject == nil)
+		return;
+	CHBTreeCorePath path;
+	CHBTreeNode *node = findLeaf(comparator, root, height, anObject, &path);
+	BOOL found;
+	NSUInteger index = searchObjects(comparator, node->objects, node->count, anObject, &found);
+	if (!found)
+		return;
+	++mutations;
+	--count;
+	[node->objects[index] release];
+	removeFromLeaf(comparator, &path, node, index, &root, &height, &firstLeaf, &lastLeaf);
+}
+
+@end
@@ -0,0 +1,308 @@
+/*
+ CHDataStructures.framework -- CHBTree_Internal.h
+ 
+ Copyright (c) 2010, Quinn Taylor <http://homepage.mac.com/quinntaylor>
+ 
+ This source code is released under the ISC License. <http://www.opensource.org/licenses/isc-license>
+ 
+ Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted, provided that the above copyright notice and this permission notice appear in all copies.
+ 
+ The software is  provided "as is", without warranty of any kind, including all implied warranties of merchantability and fitness. In no event shall the authors or copyright holders be liable for any claim, damages, or other liability, whether in an action of contract, tort, or otherwise, arising from, out of, or in connection with the software or the use or other dealings in the software.
+ */
+
+/**
+ @file CHBTree_Internal.h
+ The B+ tree algorithms shared by CHBTree, whose keys are objects, and the integer trees of CHIntegerSortedSet and CHIntegerSortedDictionary (see CHIntegerSortedSet_Internal.h). Searching, splitting, borrowing, merging and bulk loading work the same way in both; only the keys and the way they are compared, moved and retained differ. Rather than pay for a call through a function pointer each time a key is compared or moved, the algorithms are written once here in terms of a few macros, and each tree's source file defines the macros for its own nodes and then imports this file, which gives it a private copy of the functions specialized for those nodes.
+ 
+ The importing file must first define:
+ - @c CHBTreeCoreNode: the node struct, which has @a count, @a previous and @a next fields as described for CHBTree. A branch holds @a count children, and the <code>count-1</code> separators between them as keys.
+ - @c CHBTreeCoreKey: the type of a key.
+ - @c CHBTreeCoreContext: the type of the state passed through to the hooks below.
+ - @c kCHBTreeCoreCapacity: the most keys (or children) a node can hold.
+ - <code>CHBTreeKeys(node)</code>: the array of keys in a leaf, or separators in a branch.
+ - <code>CHBTreeChildren(node)</code>: the array of children of a branch, for storing and moving them.
+ - <code>CHBTreeChild(node,i)</code>: the child of a branch at an index, as a <code>CHBTreeCoreNode*</code>.
+ - <code>CHBTreeCreateNode(context,isLeaf)</code>: allocates an empty leaf or branch.
+ - <code>CHBTreeChildIndex(context,branch,key)</code>: the index of the child of a branch whose subtree holds (or would hold) a key. A key equal to a separator is in the subtree to its right.
+ - <code>CHBTreeMoveKeys(dst,src,n)</code>: moves separators within or between branches.
+ - <code>CHBTreeMoveChildren(dst,src,n)</code>: moves children within or between branches.
+ - <code>CHBTreeMoveEntries(context,dst,dstIndex,src,srcIndex,n)</code>: moves keys, and anything stored with them, within or between leaves. The ranges may overlap.
+ - <code>CHBTreeRetainKey(key)</code> and <code>CHBTreeReleaseKey(key)</code>: claim or give up a key which is used as a separator. The first returns the key.
+ 
+ The root, the first and last leaves, and the height of the tree are passed by reference to the functions which may change them, since one tree keeps them in instance variables and the other in a struct.
+ */
+
+// The fewest keys (or children) that a node other than the root may have.
+#define kCHBTreeCoreMinimum (kCHBTreeCoreCapacity / 2)
+
+// Since every node but the root has at least 32 children, even 2^64 keys would only need 13 levels.
+#define kCHBTreeCoreMaxHeight 16
+
+// The branches visited on the way to a leaf, and the index of the child taken from each, from the root down.
+typedef struct CHBTreeCorePath {
+	CHBTreeCoreNode *branches[kCHBTreeCoreMaxHeight];
+	NSUInteger indexes[kCHBTreeCoreMaxHeight];
+} CHBTreeCorePath;
+
+// Descends from the root to the leaf where a key is (or would be). If 'path' is not NULL, the branches along the way are recorded in it.
+static CHBTreeCoreNode* findLeaf(CHBTreeCoreContext context,
+                                 CHBTreeCoreNode *node, NSUInteger height,
+                                 CHBTreeCoreKey key, CHBTreeCorePath *path)
+{
+	NSUInteger level, index;
+	for (level = 0; level + 1 < height; level++) {
+		index = CHBTreeChildIndex(context, node, key);
+		if (path != NULL) {
+			path->branches[level] = node;
+			path->indexes[level] = index;
+		}
+		node = CHBTreeChild(node, index);
+	}
+	return node;
+}
+
+#pragma mark Insertion
+
+// Makes room for a new key at an index in a leaf, splitting the leaf if it is full; the larger half (with the new key) stays on the left. Returns the leaf with the room, and adjusts 'index' to match; the caller stores the key (and anything with it) there and increments the count of the leaf. If the leaf was split, 'sibling' is set to the new leaf on its right, which the caller passes to insertIntoParents() once the key is stored; otherwise it is set to NULL. If the new leaf is the last, 'lastLeaf' is updated.
+static CHBTreeCoreNode* makeRoomInLeaf(CHBTreeCoreContext context, CHBTreeCoreNode *node,
+                                       NSUInteger *index, CHBTreeCoreNode **sibling,
+                                       __strong CHBTreeCoreNode **lastLeaf)
+{
+	CHBTreeCoreNode *target = node;
+	*sibling = NULL;
+	if (node->count == kCHBTreeCoreCapacity) {
+		NSUInteger leftCount = (kCHBTreeCoreCapacity + 2) / 2;
+		CHBTreeCoreNode *right = CHBTreeCreateNode(context, YES);
+		if (*index < leftCount) {
+			node->count = leftCount - 1;
+		}
+		else {
+			node->count = leftCount;
+			*index -= leftCount;
+			target = right;
+		}
+		right->count = kCHBTreeCoreCapacity - node->count;
+		CHBTreeMoveEntries(context, right, 0, node, node->count, right->count);
+		right->previous = node;
+		right->next = node->next;
+		if (node->next != NULL)
+			node->next->previous = right;
+		else
+			*lastLeaf = right;
+		node->next = right;
+		*sibling = right;
+	}
+	CHBTreeMoveEntries(context, target, *index + 1, target, *index, target->count - *index);
+	return target;
+}
+
+// Links a leaf which was split off to the right of the leaf at the end of a path into the branches above it, splitting full branches on the way up. If the root is split, the tree grows by one level.
+static void insertIntoParents(CHBTreeCoreContext context, CHBTreeCorePath *path,
+                              CHBTreeCoreNode *sibling,
+                              __strong CHBTreeCoreNode **root, NSUInteger *height)
+{
+	CHBTreeCoreKey separator = CHBTreeRetainKey(CHBTreeKeys(sibling)[0]);
+	CHBTreeCoreKey keys[kCHBTreeCoreCapacity];
+	void *children[kCHBTreeCoreCapacity + 1];
+	NSUInteger leftCount = (kCHBTreeCoreCapacity + 2) / 2, index;
+	CHBTreeCoreNode *branch;
+	NSInteger level;
+	for (level = *height - 2; level >= 0; level--) {
+		branch = path->branches[level];
+		index = path->indexes[level]; // The child which was split.
+		if (branch->count < kCHBTreeCoreCapacity) {
+			CHBTreeMoveKeys(CHBTreeKeys(branch) + index + 1, CHBTreeKeys(branch) + index,
+			                branch->count - 1 - index);
+			CHBTreeMoveChildren(CHBTreeChildren(branch) + index + 2, CHBTreeChildren(branch) + index + 1,
+			                    branch->count - 1 - index);
+			CHBTreeKeys(branch)[index] = separator;
+			CHBTreeChildren(branch)[index + 1] = sibling;
+			branch->count++;
+			return;
+		}
+		// Lay out all the separators and children in order, then divide them. The separator in the middle moves up to the parent.
+		memcpy(keys, CHBTreeKeys(branch), index * sizeof(CHBTreeCoreKey));
+		keys[index] = separator;
+		memcpy(keys + index + 1, CHBTreeKeys(branch) + index,
+		       (kCHBTreeCoreCapacity - 1 - index) * sizeof(CHBTreeCoreKey));
+		memcpy(children, CHBTreeChildren(branch), (index + 1) * kCHPointerSize);
+		children[index + 1] = sibling;
+		memcpy(children + index + 2, CHBTreeChildren(branch) + index + 1,
+		       (kCHBTreeCoreCapacity - 1 - index) * kCHPointerSize);
+
+		sibling = CHBTreeCreateNode(context, NO);
+		branch->count = leftCount;
+		sibling->count = kCHBTreeCoreCapacity + 1 - leftCount;
+		CHBTreeMoveKeys(CHBTreeKeys(branch), keys, leftCount - 1);
+		CHBTreeMoveChildren(CHBTreeChildren(branch), children, leftCount);
+		separator = keys[leftCount - 1];
+		CHBTreeMoveKeys(CHBTreeKeys(sibling), keys + leftCount, sibling->count - 1);
+		CHBTreeMoveChildren(CHBTreeChildren(sibling), children + leftCount, sibling->count);
+	}
+	// The root was split, so the tree grows by one level.
+	branch = CHBTreeCreateNode(context, NO);
+	CHBTreeKeys(branch)[0] = separator;
+	CHBTreeChildren(branch)[0] = *root;
+	CHBTreeChildren(branch)[1] = sibling;
+	branch->count = 2;
+	*root = branch;
+	(*height)++;
+}
+
+#pragma mark Removal
+
+// Moves the last key (or child) of the left sibling of an underfull node to the node.
+static void borrowFromLeft(CHBTreeCoreContext context, CHBTreeCoreNode *parent,
+                           NSUInteger index, BOOL isLeaf)
+{
+	CHBTreeCoreNode *node = CHBTreeChild(parent, index), *left = CHBTreeChild(parent, index-1);
+	if (isLeaf) {
+		CHBTreeMoveEntries(context, node, 1, node, 0, node->count);
+		CHBTreeMoveEntries(context, node, 0, left, left->count - 1, 1);
+		left->count--;
+		node->count++;
+		CHBTreeReleaseKey(CHBTreeKeys(parent)[index-1]);
+		CHBTreeKeys(parent)[index-1] = CHBTreeRetainKey(CHBTreeKeys(node)[0]);
+	}
+	else {
+		// The separator moves down, and the sibling's last separator moves up to replace it.
+		CHBTreeMoveKeys(CHBTreeKeys(node) + 1, CHBTreeKeys(node), node->count - 1);
+		CHBTreeMoveChildren(CHBTreeChildren(node) + 1, CHBTreeChildren(node), node->count);
+		CHBTreeKeys(node)[0] = CHBTreeKeys(parent)[index-1];
+		CHBTreeChildren(node)[0] = CHBTreeChild(left, left->count - 1);
+		node->count++;
+		CHBTreeKeys(parent)[index-1] = CHBTreeKeys(left)[left->count - 2];
+		left->count--;
+	}
+}
+
+// Moves the first key (or child) of the right sibling of an underfull node to the node.
+static void borrowFromRight(CHBTreeCoreContext context, CHBTreeCoreNode *parent,
+                            NSUInteger index, BOOL isLeaf)
+{
+	CHBTreeCoreNode *node = CHBTreeChild(parent, index), *right = CHBTreeChild(parent, index+1);
+	if (isLeaf) {
+		CHBTreeMoveEntries(context, node, node->count, right, 0, 1);
+		node->count++;
+		right->count--;
+		CHBTreeMoveEntries(context, right, 0, right, 1, right->count);
+		CHBTreeReleaseKey(CHBTreeKeys(parent)[index]);
+		CHBTreeKeys(parent)[index] = CHBTreeRetainKey(CHBTreeKeys(right)[0]);
+	}
+	else {
+		// The separator moves down, and the sibling's first separator moves up to replace it.
+		CHBTreeKeys(node)[node->count - 1] = CHBTreeKeys(parent)[index];
+		CHBTreeChildren(node)[node->count] = CHBTreeChild(right, 0);
+		node->count++;
+		CHBTreeKeys(parent)[index] = CHBTreeKeys(right)[0];
+		CHBTreeMoveKeys(CHBTreeKeys(right), CHBTreeKeys(right) + 1, right->count - 2);
+		CHBTreeMoveChildren(CHBTreeChildren(right), CHBTreeChildren(right) + 1, right->count - 1);
+		right->count--;
+	}
+}
+
+// Merges the child to the right of a separator into the child to its left, then removes the separator and the right child from the parent. Neither child may be more than half full. If the right child is the last leaf, 'lastLeaf' is updated.
+static void mergeChildren(CHBTreeCoreContext context, CHBTreeCoreNode *parent,
+                          NSUInteger index, BOOL isLeaf, __strong CHBTreeCoreNode **lastLeaf)
+{
+	CHBTreeCoreNode *left = CHBTreeChild(parent, index), *right = CHBTreeChild(parent, index+1);
+	if (isLeaf) {
+		CHBTreeMoveEntries(context, left, left->count, right, 0, right->count);
+		left->next = right->next;
+		if (right->next != NULL)
+			right->next->previous = left;
+		else
+			*lastLeaf = left;
+		CHBTreeReleaseKey(CHBTreeKeys(parent)[index]);
+	}
+	else {
+		CHBTreeKeys(left)[left->count - 1] = CHBTreeKeys(parent)[index]; // Moves down
+		CHBTreeMoveKeys(CHBTreeKeys(left) + left->count, CHBTreeKeys(right), right->count - 1);
+		CHBTreeMoveChildren(CHBTreeChildren(left) + left->count, CHBTreeChildren(right), right->count);
+	}
+	left->count += right->count;
+	parent->count--;
+	CHBTreeMoveKeys(CHBTreeKeys(parent) + index, CHBTreeKeys(parent) + index + 1,
+	                parent->count - index - 1);
+	CHBTreeMoveChildren(CHBTreeChildren(parent) + index + 1, CHBTreeChildren(parent) + index + 2,
+	                    parent->count - index - 1);
+	if (kCHGarbageCollectionNotEnabled)
+		free(right);
+}
+
+/*
+ Removes the key at an index in the leaf at the end of a path; the caller first releases anything stored with it. Then any node on the path which is less than half full either borrows a key (or child) from an adjacent sibling that can spare one, or is merged with a sibling, which removes a child from the parent. This continues up the tree until a node is at least half full. If the root is left with only one child, that child becomes the root; if the tree is left empty, the root is freed, and the root and both leaves become NULL.
+ */
+static void removeFromLeaf(CHBTreeCoreContext context, CHBTreeCorePath *path,
+                           CHBTreeCoreNode *node, NSUInteger index,
+                           __strong CHBTreeCoreNode **root, NSUInteger *height,
+                           __strong CHBTreeCoreNode **firstLeaf,
+                           __strong CHBTreeCoreNode **lastLeaf)
+{
+	node->count--;
+	CHBTreeMoveEntries(context, node, index, node, index + 1, node->count - index);
+
+	CHBTreeCoreNode *parent;
+	BOOL isLeaf = YES;
+	NSInteger level;
+	for (level = *height - 2; level >= 0 && node->count < kCHBTreeCoreMinimum; level--) {
+		parent = path->branches[level];
+		index = path->indexes[level];
+		if (index > 0 && CHBTreeChild(parent, index-1)->count > kCHBTreeCoreMinimum)
+			borrowFromLeft(context, parent, index, isLeaf);
+		else if (index + 1 < parent->count && CHBTreeChild(parent, index+1)->count > kCHBTreeCoreMinimum)
+			borrowFromRight(context, parent, index, isLeaf);
+		else
+			mergeChildren(context, parent, (index > 0) ? index - 1 : index, isLeaf, lastLeaf);
+		node = parent;
+		isLeaf = NO;
+	}
+
+	// Only a root which is a leaf can be left empty, since a branch with one child is replaced.
+	if ((*root)->count == 0) {
+		if (kCHGarbageCollectionNotEnabled)
+			free(*root);
+		*root = *firstLeaf = *lastLeaf = NULL;
+		*height = 0;
+	}
+	else if (*height > 1 && (*root)->count == 1) {
+		// The root's only child becomes the root, so the tree shrinks by one level.
+		node = *root;
+		*root = CHBTreeChild(node, 0);
+		if (kCHGarbageCollectionNotEnabled)
+			free(node);
+		(*height)--;
+	}
+}
+
+#pragma mark Bulk Loading
+
+// Builds the levels of branches above a level of nodes, given the least key in each node's subtree, and returns the root. The children (and separators) are spread evenly among the branches in each level, so every branch is at least half full, and 'height' is incremented for each level. Both arrays are overwritten.
+static CHBTreeCoreNode* buildBranches(CHBTreeCoreContext context,
+                                      CHBTreeCoreNode **nodes, CHBTreeCoreKey *minimums,
+                                      NSUInteger nodeCount, NSUInteger *height)
+{
+	CHBTreeCoreNode *node;
+	NSUInteger childCount, i, j, size, offset;
+	while (nodeCount > 1) {
+		childCount = nodeCount;
+		nodeCount = (childCount + kCHBTreeCoreCapacity - 1) / kCHBTreeCoreCapacity;
+		offset = 0;
+		// Each branch is stored over the first of its children, which were already read.
+		for (i = 0; i < nodeCount; i++) {
+			size = childCount / nodeCount + (i < childCount % nodeCount);
+			node = CHBTreeCreateNode(context, NO);
+			CHBTreeChildren(node)[0] = nodes[offset];
+			for (j = 1; j < size; j++) {
+				CHBTreeChildren(node)[j] = nodes[offset + j];
+				CHBTreeKeys(node)[j-1] = CHBTreeRetainKey(minimums[offset + j]);
+			}
+			node->count = size;
+			nodes[i] = node;
+			minimums[i] = minimums[offset];
+			offset += size;
+		}
+		(*height)++;
+	}
+	return nodes[0];
+}
@@ -15,6 +15,8 @@
 	NSUInteger queueCapacity;
 	NSUInteger queueHead;
 	NSUInteger queueTail;
+	NSUInteger minimumCapacity;
+	NSUInteger shrinkThreshold;
 }
 
 - (id) init;
@@ -23,4 +25,11 @@
 - (void) dequeue;
 - (CHBinaryTreeNode *) front;
 
+// Capacity is always a power of 2. These behave as they do in CHCircularBuffer,
+// except that the threshold is 0 (never shrink automatically) unless it is set.
+- (NSUInteger) shrinkThreshold;
+- (void) setShrinkThreshold:(NSUInteger)threshold;
+- (void) reserveCapacity:(NSUInteger)capacity;
+- (void) trimToSize;
+
 @end
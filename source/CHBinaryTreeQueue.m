@@ -7,17 +7,23 @@
 //
 
 #import "CHBinaryTreeQueue.h"
+#import "CHCircularBuffer_Internal.h"
 
+#define DEFAULT_QUEUE_CAPACITY 128u
+
+#define queueCount ((queueTail - queueHead) & (queueCapacity - 1))
 
 @implementation CHBinaryTreeQueue
 
 - (id) init {
 	self = [super init];
 	if (self) {
-		queueCapacity = 128;
+		queueCapacity = DEFAULT_QUEUE_CAPACITY;
 		queue = NSAllocateCollectable(kCHPointerSize*queueCapacity, NSScannedOption);
 		queueHead = 0;
 		queueTail = 0;
+		minimumCapacity = DEFAULT_QUEUE_CAPACITY;
+		shrinkThreshold = 0; // Traversals are short-lived, so don't shrink unless asked.
 	}
 	return self;
 }
@@ -39,11 +45,60 @@
 	[super finalize];
 }
 
+// Private method which moves the nodes to a new array (with the head at index 0)
+// of a given capacity, which must be a power of 2 greater than the node count.
+- (void) resizeArrayToCapacity:(NSUInteger)capacity {
+	NSUInteger count = queueCount;
+	__strong CHBinaryTreeNode **newQueue = NSAllocateCollectable(kCHPointerSize*capacity, NSScannedOption);
+	NSUInteger headCount = MIN(count, queueCapacity - queueHead);
+	objc_memmove_collectable(newQueue, queue + queueHead, kCHPointerSize*headCount);
+	objc_memmove_collectable(newQueue + headCount, queue, kCHPointerSize*(count - headCount));
+	if (kCHGarbageCollectionNotEnabled)
+		free(queue);
+	queue = newQueue;
+	queueCapacity = capacity;
+	queueHead = 0;
+	queueTail = count;
+}
+
+// Private method which halves the capacity while the queue is less than
+// 1/shrinkThreshold full.
+- (void) shrinkArray {
+	NSUInteger capacity = CHShrunkArrayCapacity(queueCount, queueCapacity,
+	                                            minimumCapacity, shrinkThreshold);
+	if (capacity < queueCapacity)
+		[self resizeArrayToCapacity:capacity];
+}
+
+- (NSUInteger) shrinkThreshold {
+	return shrinkThreshold;
+}
+
+- (void) setShrinkThreshold:(NSUInteger)threshold {
+	CHCheckShrinkThreshold([self class], _cmd, threshold);
+	shrinkThreshold = threshold;
+	[self shrinkArray];
+}
+
+- (void) reserveCapacity:(NSUInteger)capacity {
+	NSUInteger newCapacity = CHArrayCapacityAbove(capacity, minimumCapacity);
+	minimumCapacity = newCapacity;
+	if (newCapacity > queueCapacity)
+		[self resizeArrayToCapacity:newCapacity];
+}
+
+- (void) trimToSize {
+	minimumCapacity = MIN(queueCapacity, DEFAULT_QUEUE_CAPACITY);
+	NSUInteger newCapacity = CHArrayCapacityAbove(queueCount, minimumCapacity);
+	if (newCapacity < queueCapacity)
+		[self resizeArrayToCapacity:newCapacity];
+}
+
 #pragma mark Queue
 
 - (void) enqueue:(CHBinaryTreeNode *)node {
 	queue[queueTail++] = node;
-	queueTail %= queueCapacity;
+	queueTail &= queueCapacity - 1; // Capacity is a power of 2
 	if (queueHead == queueTail) {
 		queue = NSReallocateCollectable(queue, kCHPointerSize*queueCapacity*2, NSScannedOption);
 		/* Copy wrapped-around portion to end of queue and move tail index */
@@ -61,7 +116,9 @@
 
 - (void) dequeue {
 	if (queueHead != queueTail) {
-		queueHead = (queueHead + 1) % queueCapacity;
+		queueHead = (queueHead + 1) & (queueCapacity - 1);
+		if (CHArrayShouldShrink(queueCount, queueCapacity, minimumCapacity, shrinkThreshold))
+			[self shrinkArray];
 	}
 }
 
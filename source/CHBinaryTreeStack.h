@@ -14,6 +14,8 @@
 	__strong CHBinaryTreeNode** stack;
 	NSUInteger stackCapacity;
 	NSUInteger stackSize;
+	NSUInteger minimumCapacity;
+	NSUInteger shrinkThreshold;
 }
 
 - (id) init;
@@ -24,4 +26,11 @@
 
 - (NSUInteger) stackSize;
 
+// Capacity is always a power of 2. These behave as they do in CHCircularBuffer,
+// except that the threshold is 0 (never shrink automatically) unless it is set.
+- (NSUInteger) shrinkThreshold;
+- (void) setShrinkThreshold:(NSUInteger)threshold;
+- (void) reserveCapacity:(NSUInteger)capacity;
+- (void) trimToSize;
+
 @end
@@ -8,15 +8,20 @@
 
 #import "CHBinaryTreeStack.h"
 #import "CHAbstractBinarySearchTree_Internal.h"
+#import "CHCircularBuffer_Internal.h"
+
+#define DEFAULT_STACK_CAPACITY 32u
 
 @implementation CHBinaryTreeStack
 
 - (id) init {
 	self = [super init];
 	if (self) {
-		stackCapacity = 32;
-		stack = NSAllocateCollectable(kCHBinaryTreeNodeSize*stackCapacity, NSScannedOption); \
+		stackCapacity = DEFAULT_STACK_CAPACITY;
+		stack = NSAllocateCollectable(kCHPointerSize*stackCapacity, NSScannedOption);
 		stackSize = 0;
+		minimumCapacity = DEFAULT_STACK_CAPACITY;
+		shrinkThreshold = 0; // Traversals are short-lived, so don't shrink unless asked.
 	}
 	return self;
 }
@@ -38,6 +43,46 @@
 	[super finalize];
 }
 
+// Private method which reallocates the array to a given capacity; the nodes are
+// contiguous from index 0, so they needn't be moved.
+- (void) resizeArrayToCapacity:(NSUInteger)capacity {
+	stackCapacity = capacity;
+	stack = NSReallocateCollectable(stack, kCHPointerSize*stackCapacity, NSScannedOption);
+}
+
+// Private method which halves the capacity while the stack is less than
+// 1/shrinkThreshold full.
+- (void) shrinkArray {
+	NSUInteger capacity = CHShrunkArrayCapacity(stackSize, stackCapacity,
+	                                            minimumCapacity, shrinkThreshold);
+	if (capacity < stackCapacity)
+		[self resizeArrayToCapacity:capacity];
+}
+
+- (NSUInteger) shrinkThreshold {
+	return shrinkThreshold;
+}
+
+- (void) setShrinkThreshold:(NSUInteger)threshold {
+	CHCheckShrinkThreshold([self class], _cmd, threshold);
+	shrinkThreshold = threshold;
+	[self shrinkArray];
+}
+
+- (void) reserveCapacity:(NSUInteger)capacity {
+	NSUInteger newCapacity = CHArrayCapacityAbove(capacity, minimumCapacity);
+	minimumCapacity = newCapacity;
+	if (newCapacity > stackCapacity)
+		[self resizeArrayToCapacity:newCapacity];
+}
+
+- (void) trimToSize {
+	minimumCapacity = MIN(stackCapacity, DEFAULT_STACK_CAPACITY);
+	NSUInteger newCapacity = CHArrayCapacityAbove(stackSize, minimumCapacity);
+	if (newCapacity < stackCapacity)
+		[self resizeArrayToCapacity:newCapacity];
+}
+
 #pragma mark -
 
 - (void) push:(CHBinaryTreeNode *)node {
@@ -49,7 +94,12 @@
 }
 
 - (CHBinaryTreeNode *) pop {
-	return ((stackSize > 0) ? stack[--stackSize] : NULL);
+	if (stackSize == 0)
+		return NULL;
+	CHBinaryTreeNode *node = stack[--stackSize];
+	if (CHArrayShouldShrink(stackSize, stackCapacity, minimumCapacity, shrinkThreshold))
+		[self shrinkArray];
+	return node;
 }
 
 - (CHBinaryTreeNode *) top {
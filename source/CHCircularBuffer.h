@@ -18,8 +18,11 @@
  A circular buffer array with simple built-in locking capabilities.
  */
 
+/** The capacity of a buffer created by @c -init or @c -initWithArray:, and the least capacity to which those buffers shrink unless more is reserved. */
+#define kCHCircularBufferDefaultCapacity 16u
+
 /**
- A circular buffer array with simple built-in locking capabilities. A <a href="http://en.wikipedia.org/wiki/Circular_buffer">circular buffer</a> is a structure that emulates a continuous ring of N data slots, such that data can be appended without worrying about exceeding the valid indexes of an array. This class uses a C array with start and end indexes to track the front and back of the elements in the buffer. The array is dynamically expanded to accommodate added objects. This type of storage is ideal for scenarios where objects are added and removed only at one or both ends (such as a stack or queue) but still supports all normal NSMutableArray functionality.
+ A circular buffer array with simple built-in locking capabilities. A <a href="http://en.wikipedia.org/wiki/Circular_buffer">circular buffer</a> is a structure that emulates a continuous ring of N data slots, such that data can be appended without worrying about exceeding the valid indexes of an array. This class uses a C array with start and end indexes to track the front and back of the elements in the buffer. The array is dynamically expanded to accommodate added objects, and shrinks again as objects are removed (see #setShrinkThreshold:). Its capacity is always a power of 2 (any capacity given to @c -initWithCapacity: is rounded up), so an index can be wrapped around the end of the array with a bit mask rather than an integer division, which makes every access cheaper. This type of storage is ideal for scenarios where objects are added and removed only at one or both ends (such as a stack or queue) but still supports all normal NSMutableArray functionality.
  
  Since this class extends NSMutableArray, it or any of its children may be used anywhere an NSArray or NSMutableArray is required. It is designed to behave virtually identically to a standard NSMutableArray, but with the addition of built-in locking.
  
@@ -31,11 +34,47 @@
 	NSUInteger count; // The number of objects currently in the buffer.
 	NSUInteger headIndex; // The array index of the first object.
 	NSUInteger tailIndex; // The array index after the last object.
+	NSUInteger minimumCapacity; // The array is never shrunk below this capacity.
+	NSUInteger shrinkThreshold; // Shrink when less than 1/shrinkThreshold full.
 	unsigned long mutations; // Tracks mutations for NSFastEnumeration.
 	
 	NSLock* lock; // A lock for synchronizing interaction between threads.
 }
 
+/**
+ Returns the divisor which determines when the receiver shrinks its array as objects are removed. (The default is 4.)
+ 
+ @return The divisor which determines when the receiver shrinks, or 0 if it never shrinks automatically.
+ 
+ @see setShrinkThreshold:
+ */
+- (NSUInteger) shrinkThreshold;
+
+/**
+ Sets the divisor which determines when the receiver shrinks its array as objects are removed. Whenever a removal leaves the buffer less than 1/@a threshold full, its capacity is halved (repeatedly if needed), but never below the capacity given to @c -initWithCapacity: or #reserveCapacity:. Since the capacity doubles only when the buffer is full, a threshold greater than 2 keeps a buffer whose count hovers around a power of 2 from growing and shrinking on alternate insertions and removals.
+ 
+ @param threshold The divisor to use, or 0 to shrink only when #trimToSize or @c -removeAllObjects is called.
+ 
+ @throw NSInvalidArgumentException if @a threshold is 1 or 2.
+ */
+- (void) setShrinkThreshold:(NSUInteger)threshold;
+
+/**
+ Ensures that the receiver can hold at least a given number of objects without enlarging its array, and that it will not shrink below that size automatically.
+ 
+ @param capacity The number of objects the receiver should be able to hold. The array capacity is rounded up to a power of 2 which exceeds @a capacity.
+ 
+ @see trimToSize
+ */
+- (void) reserveCapacity:(NSUInteger)capacity;
+
+/**
+ Shrinks the receiver's array to the smallest power of 2 which can hold its objects (but no smaller than the default capacity of 16 unless it already is), and forgets any capacity reserved by @c -initWithCapacity: or #reserveCapacity:.
+ 
+ @see reserveCapacity:
+ */
+- (void) trimToSize;
+
 // The following methods are undocumented since they are only reimplementations.
 // Users should consult the API documentation for NSArray and NSMutableArray.
 
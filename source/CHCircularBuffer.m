@@ -11,27 +11,52 @@
  */
 
 #import "CHCircularBuffer.h"
+#import "CHCircularBuffer_Internal.h"
 
-#define DEFAULT_BUFFER_SIZE 16u
-
-#define transformIndex(index) ((headIndex + index) % arrayCapacity)
-#define incrementIndex(index) (index = (index + 1) % arrayCapacity)
-#define decrementIndex(index) (index = index ? index - 1 : arrayCapacity - 1)
+// The capacity is always a power of 2, so indexes wrap with a mask instead of '%'.
+#define wrapIndex(index) ((index) & (arrayCapacity - 1))
+#define transformIndex(index) wrapIndex(headIndex + index)
+#define incrementIndex(index) (index = wrapIndex(index + 1))
+#define decrementIndex(index) (index = wrapIndex(index - 1))
 
 // Shift a group of elements within the underlying array; used to close up gaps.
 // Guarantees that 'number' is in the correct range for the array capacity.
 #define blockMove(dst, src, scan) \
 do { \
-	NSUInteger itemsLeftToCopy = (scan - src + arrayCapacity) % arrayCapacity; \
+	NSUInteger itemsLeftToCopy = wrapIndex(scan - src); \
 	while (itemsLeftToCopy) { \
 		NSUInteger size = MIN(itemsLeftToCopy, arrayCapacity - MAX(dst, src)); \
 		objc_memmove_collectable(&array[dst], &array[src], kCHPointerSize * size); \
-		src = (src + size) % arrayCapacity; \
-		dst = (dst + size) % arrayCapacity; \
+		src = wrapIndex(src + size); \
+		dst = wrapIndex(dst + size); \
+		itemsLeftToCopy -= size; \
+	} \
+} while(0)
+
+// Shift a group of elements within the underlying array toward the tail, starting
+// with the last element so none are overwritten; used to open up gaps. The 'dst'
+// and 'src' indexes are just past the last element of each group.
+#define blockMoveBackward(dst, src, items) \
+do { \
+	NSUInteger itemsLeftToCopy = items; \
+	while (itemsLeftToCopy) { \
+		if (src == 0) src = arrayCapacity; \
+		if (dst == 0) dst = arrayCapacity; \
+		NSUInteger size = MIN(itemsLeftToCopy, MIN(dst, src)); \
+		src -= size; \
+		dst -= size; \
+		objc_memmove_collectable(&array[dst], &array[src], kCHPointerSize * size); \
 		itemsLeftToCopy -= size; \
 	} \
 } while(0)
 
+// Shrink the array if a removal has left it less than 1/shrinkThreshold full.
+#define shrinkIfSparse() \
+do { \
+	if (CHArrayShouldShrink(count, arrayCapacity, minimumCapacity, shrinkThreshold)) \
+		[self shrinkArray]; \
+} while(0)
+
 /**
  An NSEnumerator for traversing a CHAbstractCircularBufferCollection subclass.
  
@@ -152,19 +177,11 @@ do { \
 #pragma mark -
 
 /**
- @todo Reimplement @c removeObjectsAtIndexes: for efficiency with multiple objects.
-
- @todo Look at refactoring @c insertObject:atIndex: and @c removeObjectAtIndex:
- to always shift the smaller chunk of elements and deal with wrapping around.
- The current worst-case is that removing at index N-1 of N when the buffer wraps
- (or inserting at index 1 of N when it doesn't) causes N-1 objects to be shifted
- in memory, where it would obviously make more sense to shift only one object.
- Being able to shift the shorter side would almost always move less total data.
- - Shifting without wrapping requires only 1 memmove(), <= the current size.
- - Shifting around the end requires 0-2 memmove()s and an assignment.
-	- 0 if inserting/removing just inside head or tail, causing them to (un)wrap.
-	- 1 if inserting in first/last array slot with 1+ items wrapped on other end.
-	- 2 if inserting/removing further inside with 1+ items on other end.
+ Inserting or removing in the middle of the buffer shifts whichever side of the
+ index has fewer objects, moving the head or tail index (and wrapping it around
+ the end of the array if needed), so at most half of the objects are moved.
+ - Shifting without wrapping requires only 1 memmove().
+ - Shifting around the end requires 2 memmove()s and an assignment.
  */
 @implementation CHCircularBuffer
 
@@ -177,14 +194,13 @@ do { \
 
 // Note: Defined here since -init is not implemented in NS(Mutable)Array.
 - (id) init {
-	return [self initWithCapacity:DEFAULT_BUFFER_SIZE];
+	return [self initWithCapacity:kCHCircularBufferDefaultCapacity];
 }
 
 - (id) initWithArray:(NSArray*)anArray {
-	NSUInteger capacity = DEFAULT_BUFFER_SIZE;
-	while (capacity <= [anArray count])
-		capacity *= 2;
+	NSUInteger capacity = CHArrayCapacityAbove([anArray count], kCHCircularBufferDefaultCapacity);
 	if ([self initWithCapacity:capacity] == nil) return nil;
+	minimumCapacity = kCHCircularBufferDefaultCapacity; // Only reserve capacity when asked.
 	for (id anObject in anArray) {
 		array[tailIndex++] = [anObject retain];
 	}
@@ -193,13 +209,67 @@ do { \
 }
 
 // This is the designated initializer for CHCircularBuffer.
+// The capacity is rounded up to a power of 2 (see wrapIndex).
 - (id) initWithCapacity:(NSUInteger)capacity {
 	if ((self = [super init]) == nil) return nil;
-	arrayCapacity = capacity ? capacity : DEFAULT_BUFFER_SIZE;
+	arrayCapacity = capacity ? 1 : kCHCircularBufferDefaultCapacity;
+	while (arrayCapacity < capacity)
+		arrayCapacity *= 2;
 	array = NSAllocateCollectable(kCHPointerSize*arrayCapacity, NSScannedOption);
+	minimumCapacity = arrayCapacity;
+	shrinkThreshold = kCHCircularBufferDefaultShrinkThreshold;
 	return self;	
 }
 
+// Private method which moves the objects to a new array of the given capacity,
+// which must be a power of 2 greater than the count, with the head at index 0.
+- (void) resizeArrayToCapacity:(NSUInteger)capacity {
+	__strong id *newArray = NSAllocateCollectable(kCHPointerSize*capacity, NSScannedOption);
+	NSUInteger headCount = MIN(count, arrayCapacity - headIndex);
+	objc_memmove_collectable(newArray, array + headIndex, kCHPointerSize * headCount);
+	objc_memmove_collectable(newArray + headCount, array, kCHPointerSize * (count - headCount));
+	if (kCHGarbageCollectionNotEnabled)
+		free(array);
+	array = newArray;
+	arrayCapacity = capacity;
+	headIndex = 0;
+	tailIndex = count;
+	++mutations; // Enumerators still refer to the old array.
+}
+
+// Private method which halves the capacity as many times as shrinkIfSparse()
+// would, so a removal of many objects needs only one new array.
+- (void) shrinkArray {
+	[self resizeArrayToCapacity:CHShrunkArrayCapacity(count, arrayCapacity,
+	                                                  minimumCapacity, shrinkThreshold)];
+}
+
+#pragma mark Managing Capacity
+
+- (NSUInteger) shrinkThreshold {
+	return shrinkThreshold;
+}
+
+- (void) setShrinkThreshold:(NSUInteger)threshold {
+	CHCheckShrinkThreshold([self class], _cmd, threshold);
+	shrinkThreshold = threshold;
+	shrinkIfSparse();
+}
+
+- (void) reserveCapacity:(NSUInteger)capacity {
+	NSUInteger newCapacity = CHArrayCapacityAbove(capacity, minimumCapacity);
+	minimumCapacity = newCapacity;
+	if (newCapacity > arrayCapacity)
+		[self resizeArrayToCapacity:newCapacity];
+}
+
+- (void) trimToSize {
+	minimumCapacity = MIN(arrayCapacity, kCHCircularBufferDefaultCapacity);
+	NSUInteger newCapacity = CHArrayCapacityAbove(count, minimumCapacity);
+	if (newCapacity < arrayCapacity)
+		[self resizeArrayToCapacity:newCapacity];
+}
+
 #pragma mark <NSCoding>
 
 // Overridden from NSMutableArray to encode/decode as the proper class.
@@ -330,7 +400,7 @@ do { \
 }
 
 - (id) lastObject {
-	return (count > 0) ? array[((tailIndex) ? tailIndex : arrayCapacity) - 1] : nil;
+	return (count > 0) ? array[wrapIndex(tailIndex - 1)] : nil;
 }
 
 - (NSUInteger) indexOfObject:(id)anObject {
@@ -381,15 +451,22 @@ do { \
 - (NSArray*) objectsAtIndexes:(NSIndexSet*)indexes {
 	if (indexes == nil)
 		CHNilArgumentException([self class], _cmd);
-	if ([indexes count] == 0)
+	NSUInteger indexCount = [indexes count];
+	if (indexCount == 0)
 		return [NSArray array];
-	NSMutableArray *objects = [NSMutableArray arrayWithCapacity:[indexes count]];
-	NSUInteger index = [indexes firstIndex];
-	while (index != NSNotFound) {
-		[objects addObject:[self objectAtIndex:index]];
-		index = [indexes indexGreaterThanIndex:index];
-	}
-	return objects;
+	if ([indexes lastIndex] >= count)
+		CHIndexOutOfRangeException([self class], _cmd, [indexes lastIndex], count);
+	// Copy the indexes all at once, rather than searching the index set for each.
+	NSUInteger *indexArray = malloc(sizeof(NSUInteger) * indexCount);
+	[indexes getIndexes:indexArray maxCount:indexCount inIndexRange:NULL];
+	id *objects = NSAllocateCollectable(kCHPointerSize * indexCount, NSScannedOption);
+	for (NSUInteger i = 0; i < indexCount; i++)
+		objects[i] = array[transformIndex(indexArray[i])];
+	NSArray *result = [NSArray arrayWithObjects:objects count:indexCount];
+	free(indexArray);
+	if (kCHGarbageCollectionNotEnabled)
+		free(objects);
+	return result;
 }
 
 - (NSEnumerator*) objectEnumerator {
@@ -434,23 +511,21 @@ do { \
 		// To prepend, just move the head backward one slot (wrapping if needed)
 		decrementIndex(headIndex);
 		array[headIndex] = anObject;
+	} else if (index < count - index) {
+		// Shift the objects before 'index' toward the head (wrapping if needed)
+		NSUInteger copySrcIndex = headIndex;
+		NSUInteger copyScanIndex = transformIndex(index);
+		decrementIndex(headIndex);
+		NSUInteger copyDstIndex = headIndex;
+		blockMove(copyDstIndex, copySrcIndex, copyScanIndex);
+		array[copyDstIndex] = anObject; // blockMove leaves dst just past the moved objects
 	} else {
-		NSUInteger actualIndex = transformIndex(index);
-		if (actualIndex > tailIndex) {
-			// Buffer wraps and 'index' is between head and end, so shift left.
-			objc_memmove_collectable(&array[headIndex-1], &array[headIndex],
-			                         kCHPointerSize * index);
-			// These can't wrap around (we'll hit tail first) so just decrement.
-			--headIndex;
-			--actualIndex;
-		}
-		else {
-			// Otherwise, shift everything from given index onward to the right.
-			objc_memmove_collectable(&array[actualIndex+1], &array[actualIndex],
-			                         kCHPointerSize * (tailIndex - actualIndex));
-			incrementIndex(tailIndex);
-		}
-		array[actualIndex] = anObject;
+		// Shift the objects from 'index' onward toward the tail (wrapping if needed)
+		NSUInteger copySrcIndex = tailIndex;
+		incrementIndex(tailIndex);
+		NSUInteger copyDstIndex = tailIndex;
+		blockMoveBackward(copyDstIndex, copySrcIndex, count - index);
+		array[copySrcIndex] = anObject; // blockMoveBackward leaves src at 'index'
 	}
 	++count;
 	++mutations;	
@@ -489,6 +564,7 @@ do { \
 	incrementIndex(headIndex);
 	--count;
 	++mutations;
+	shrinkIfSparse();
 }
 
 // NSMutableArray primitive method
@@ -500,6 +576,7 @@ do { \
 	array[tailIndex] = nil; // Let GC do its thing
 	--count;
 	++mutations;
+	shrinkIfSparse();
 }
 
 // Private method that accepts a function pointer for testing object equality.
@@ -543,8 +620,9 @@ do { \
 		}
 		tailIndex = copyDstIndex;
 	}
-	count = (tailIndex + arrayCapacity - headIndex) % arrayCapacity;
+	count = wrapIndex(tailIndex - headIndex);
 	++mutations;
+	shrinkIfSparse();
 }
 
 - (void) removeObject:(id)anObject {
@@ -564,40 +642,97 @@ do { \
 	} else if (index == count - 1) {
 		array[actualIndex] = nil; // Prevents possible memory leak under GC
 		decrementIndex(tailIndex);
+	} else if (index < count - 1 - index) {
+		// Shift the objects before 'index' toward the tail, then vacate the head.
+		NSUInteger copySrcIndex = actualIndex;
+		NSUInteger copyDstIndex = actualIndex;
+		incrementIndex(copyDstIndex);
+		blockMoveBackward(copyDstIndex, copySrcIndex, index);
+		array[headIndex] = nil; // Prevents possible memory leak under GC
+		incrementIndex(headIndex);
 	} else {
-		// This logic is derived from http://www.javafaq.nu/java-article808.html
-		// For simplicity, this code doesnt shift elements around the array end.
-		// Consequently headIndex and tailIndex will not wrap past the end here.
-		if (actualIndex > tailIndex) {
-			// If the buffer wraps and index is in "the right side", shift right.
-			objc_memmove_collectable(&array[headIndex+1], &array[headIndex],
-			                         kCHPointerSize * index);
-			array[headIndex++] = nil; // Prevents possible memory leak under GC
-		} else {
-			// Otherwise, shift everything from index to tail one to the left.
-			objc_memmove_collectable(&array[actualIndex], &array[actualIndex+1],
-			                         kCHPointerSize * (tailIndex-actualIndex-1));
-			array[--tailIndex] = nil; // Prevents possible memory leak under GC
-		}
+		// Shift the objects after 'index' toward the head, then vacate the tail.
+		NSUInteger copyDstIndex = actualIndex;
+		NSUInteger copySrcIndex = actualIndex;
+		incrementIndex(copySrcIndex);
+		blockMove(copyDstIndex, copySrcIndex, tailIndex);
+		decrementIndex(tailIndex);
+		array[tailIndex] = nil; // Prevents possible memory leak under GC
 	}
 	--count;
 	++mutations;
+	shrinkIfSparse();
 }
 
 - (void) removeObjectIdenticalTo:(id)anObject {
 	[self removeObject:anObject withEqualityTest:&objectsAreIdentical];
 }
 
+// Removes all the objects in a single pass, closing each gap as the next is reached
+// (as in -removeObject:withEqualityTest:), so no object is moved more than once.
+// Like single removals, it compacts toward whichever end moves fewer objects.
 - (void) removeObjectsAtIndexes:(NSIndexSet*)indexes {
 	if (indexes == nil)
 		CHNilArgumentException([self class], _cmd);
-	if ([indexes count] > 0) {
-		NSUInteger index = [indexes lastIndex];
-		while (index != NSNotFound) {
-			[self removeObjectAtIndex:index];
-			index = [indexes indexLessThanIndex:index];
+	NSUInteger indexCount = [indexes count];
+	if (indexCount == 0)
+		return;
+	if ([indexes lastIndex] >= count)
+		CHIndexOutOfRangeException([self class], _cmd, [indexes lastIndex], count);
+	NSUInteger *indexArray = malloc(sizeof(NSUInteger) * indexCount);
+	[indexes getIndexes:indexArray maxCount:indexCount inIndexRange:NULL];
+	NSUInteger firstIndex = indexArray[0], lastIndex = indexArray[indexCount-1];
+	NSUInteger copySrcIndex, copyDstIndex, scanIndex, i;
+	if (lastIndex + 1 - indexCount <= count - firstIndex - indexCount) {
+		// Fewer objects to keep before the last index, so close gaps toward the tail.
+		// The copy indexes are just past the objects to copy, as in blockMoveBackward.
+		copySrcIndex = transformIndex(lastIndex);
+		incrementIndex(copySrcIndex);
+		copyDstIndex = copySrcIndex;
+		i = indexCount;
+		while (i > 0) {
+			scanIndex = transformIndex(indexArray[--i]);
+			[array[scanIndex] release];
+			incrementIndex(scanIndex);
+			blockMoveBackward(copyDstIndex, copySrcIndex,
+			                  wrapIndex(copySrcIndex - scanIndex));
+			decrementIndex(copySrcIndex); // Skip the removed object.
+		}
+		blockMoveBackward(copyDstIndex, copySrcIndex,
+		                  wrapIndex(copySrcIndex - headIndex));
+		// Zero the now-unoccupied array elements before the new head.
+		if (copyDstIndex > headIndex) {
+			bzero(array + headIndex, kCHPointerSize * (copyDstIndex - headIndex));
+		} else {
+			bzero(array + headIndex, kCHPointerSize * (arrayCapacity - headIndex));
+			bzero(array,             kCHPointerSize * copyDstIndex);
 		}
+		headIndex = copyDstIndex;
 	}
+	else {
+		// Fewer objects to keep after the first index, so close gaps toward the head.
+		copySrcIndex = copyDstIndex = transformIndex(firstIndex);
+		for (i = 0; i < indexCount; i++) {
+			scanIndex = transformIndex(indexArray[i]);
+			[array[scanIndex] release];
+			// NOTE: blockMove advances src/dst indexes by the count of objects.
+			blockMove(copyDstIndex, copySrcIndex, scanIndex);
+			incrementIndex(copySrcIndex); // Skip the removed object.
+		}
+		blockMove(copyDstIndex, copySrcIndex, tailIndex);
+		// Zero the now-unoccupied array elements after the new tail.
+		if (tailIndex > copyDstIndex) {
+			bzero(array + copyDstIndex, kCHPointerSize * (tailIndex - copyDstIndex));
+		} else {
+			bzero(array + copyDstIndex, kCHPointerSize * (arrayCapacity - copyDstIndex));
+			bzero(array,                kCHPointerSize * tailIndex);
+		}
+		tailIndex = copyDstIndex;
+	}
+	free(indexArray);
+	count -= indexCount;
+	++mutations;
+	shrinkIfSparse();
 }
 
 - (void) removeAllObjects {
@@ -610,10 +745,10 @@ do { \
 		}
 		else {
 			// Only zero out pointers that will remain when the buffer shrinks.
-			bzero(array, kCHPointerSize * MIN(arrayCapacity, DEFAULT_BUFFER_SIZE));
+			bzero(array, kCHPointerSize * MIN(arrayCapacity, minimumCapacity));
 		}
-		if (arrayCapacity > DEFAULT_BUFFER_SIZE) {
-			arrayCapacity = DEFAULT_BUFFER_SIZE;
+		if (arrayCapacity > minimumCapacity) {
+			arrayCapacity = minimumCapacity;
 			// Shrink the size of allocated memory; calls realloc() under non-GC
 			array = NSReallocateCollectable(array, kCHPointerSize*arrayCapacity, NSScannedOption);
 		}
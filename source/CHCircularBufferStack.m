@@ -11,6 +11,7 @@
  */
 
 #import "CHCircularBufferStack.h"
+#import "CHCircularBuffer_Internal.h"
 
 @implementation CHCircularBufferStack
 
@@ -24,10 +25,9 @@
 
 // Overridden from parent class so objects are inserted in reverse order.
 - (id) initWithArray:(NSArray*)anArray {
-	NSUInteger capacity = 16;
-	while (capacity <= [anArray count])
-		capacity *= 2;
+	NSUInteger capacity = CHArrayCapacityAbove([anArray count], kCHCircularBufferDefaultCapacity);
 	if ([self initWithCapacity:capacity] == nil) return nil;
+	minimumCapacity = kCHCircularBufferDefaultCapacity; // Only reserve capacity when asked, as in the parent.
 	if ([anArray count] > 0) {
 		headIndex = capacity; // Puts the bottom of the stack at the last slot.
 		tailIndex = 0;
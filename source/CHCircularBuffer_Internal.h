@@ -0,0 +1,59 @@
+/*
+ CHDataStructures.framework -- CHCircularBuffer_Internal.h
+ 
+ Copyright (c) 2009-2010, Quinn Taylor <http://homepage.mac.com/quinntaylor>
+ 
+ This source code is released under the ISC License. <http://www.opensource.org/licenses/isc-license>
+ 
+ Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted, provided that the above copyright notice and this permission notice appear in all copies.
+ 
+ The software is  provided "as is", without warranty of any kind, including all implied warranties of merchantability and fitness. In no event shall the authors or copyright holders be liable for any claim, damages, or other liability, whether in an action of contract, tort, or otherwise, arising from, out of, or in connection with the software or the use or other dealings in the software.
+ */
+
+#import "Util.h"
+
+/**
+ @file CHCircularBuffer_Internal.h
+ The policy for growing and shrinking an array whose capacity is a power of 2, shared by CHCircularBuffer and the stacks and queues used to traverse binary search trees (CHBinaryTreeStack and CHBinaryTreeQueue). Each keeps a minimum capacity, below which it never shrinks automatically, and a shrink threshold, as described for \link CHCircularBuffer#setShrinkThreshold: -[CHCircularBuffer setShrinkThreshold:]\endlink.
+ */
+
+/** The default shrink threshold for a CHCircularBuffer. */
+#define kCHCircularBufferDefaultShrinkThreshold 4u
+
+/**
+ Raises an exception if a shrink threshold is 1 or 2, which would make an array shrink as soon as it was half full, so it could grow and shrink on alternate insertions and removals.
+ */
+static inline void CHCheckShrinkThreshold(Class aClass, SEL method, NSUInteger threshold) {
+	if (threshold == 1 || threshold == 2)
+		CHInvalidArgumentException(aClass, method, @"Threshold must be 0 or greater than 2.");
+}
+
+/**
+ Returns whether an array should shrink after a removal: it is larger than its minimum capacity, and less than 1/@a threshold full. This is checked after every removal, so the threshold is tested first (0 disables shrinking) and the count is multiplied rather than the capacity divided.
+ */
+static inline BOOL CHArrayShouldShrink(NSUInteger count, NSUInteger capacity,
+                                       NSUInteger minimumCapacity, NSUInteger threshold)
+{
+	return (threshold != 0 && capacity > minimumCapacity && count * threshold < capacity);
+}
+
+/**
+ Returns the capacity to which an array should shrink, halving it as many times as CHArrayShouldShrink() allows, so a removal of many objects needs only one new array.
+ */
+static inline NSUInteger CHShrunkArrayCapacity(NSUInteger count, NSUInteger capacity,
+                                               NSUInteger minimumCapacity, NSUInteger threshold)
+{
+	while (CHArrayShouldShrink(count, capacity, minimumCapacity, threshold))
+		capacity /= 2;
+	return capacity;
+}
+
+/**
+ Returns the least capacity greater than @a count which is @a minimumCapacity doubled zero or more times. Used to reserve capacity, to trim an array to its contents, and to size an array for a given number of objects.
+ */
+static inline NSUInteger CHArrayCapacityAbove(NSUInteger count, NSUInteger minimumCapacity) {
+	NSUInteger capacity = minimumCapacity;
+	while (capacity <= count)
+		capacity *= 2;
+	return capacity;
+}
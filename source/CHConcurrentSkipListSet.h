@@ -0,0 +1,74 @@
+/*
+ CHDataStructures.framework -- CHConcurrentSkipListSet.h
+ 
+ Copyright (c) 2010, Quinn Taylor <http://homepage.mac.com/quinntaylor>
+ 
+ This source code is released under the ISC License. <http://www.opensource.org/licenses/isc-license>
+ 
+ Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted, provided that the above copyright notice and this permission notice appear in all copies.
+ 
+ The software is  provided "as is", without warranty of any kind, including all implied warranties of merchantability and fitness. In no event shall the authors or copyright holders be liable for any claim, damages, or other liability, whether in an action of contract, tort, or otherwise, arising from, out of, or in connection with the software or the use or other dealings in the software.
+ */
+
+#import "CHAbstractBinarySearchTree.h"
+
+/**
+ @file CHConcurrentSkipListSet.h
+ A lock-free <a href="http://en.wikipedia.org/wiki/Skip_list">skip list</a> implementation of CHSortedSet which may be used by many threads at once.
+ */
+
+/**
+ The maximum number of levels in a CHConcurrentSkipListSet. Since each level has about one quarter as many nodes as the level below it, this is enough for billions of objects.
+ */
+#define kCHConcurrentSkipListMaxLevel 16
+
+// Opaque node storage; defined in CHConcurrentSkipListSet.m
+struct CHConcurrentSkipListNode;
+
+/**
+ A sorted set which any number of threads can read and modify at the same time without locking. Every other CHSortedSet must be guarded by a lock (such as the one provided by CHLockableObject) when it is shared between threads, so all threads using it take turns; with this class, threads only interfere when they modify the same part of the set at the same moment.
+ 
+ The objects are kept in a <a href="http://en.wikipedia.org/wiki/Skip_list">skip list</a>: a linked list in sorted order (level 0), plus progressively sparser linked lists above it which allow searches to skip ahead, so operations take O(log n) time on average. The lists are modified only with atomic compare-and-swap operations, using the algorithm described by Herlihy and Shavit in <em>The Art of Multiprocessor Programming</em> (which builds on lock-free linked lists by Harris and Michael). An object is removed by first marking the links out of its node, which removes it logically, and then unlinking the node from each level; any thread which encounters a marked node helps to unlink it.
+ 
+ A node cannot be freed as soon as it is unlinked, since other threads may still be reading it. Unlinked nodes are instead reclaimed using <a href="http://www.cl.cam.ac.uk/techreports/UCAM-CL-TR-579.pdf">epoch-based reclamation</a>: each thread announces the global epoch when it starts an operation, the epoch only advances once every active thread has seen it, and a node is freed (releasing its object) once the epoch has advanced twice after it was unlinked. As a result, a removed object is released a little later than it would be by other sorted sets, by whichever thread removed it, during a later removal.
+ 
+ Every method is safe to call from any thread at any time, with these differences from other sorted sets:
+ - @c -addObject: does not replace an object which is already in the set with an equal object; the set is left unchanged. (Replacing the object would require reclaiming the old one as well.)
+ - Methods which return objects return them retained and autoreleased, since another thread may remove them from the set at any moment.
+ - Enumeration, including @c -allObjects and fast enumeration, is <em>weakly consistent</em>: it never raises an exception when the set is modified, returns each object at most once and in ascending order, includes every object that is in the set for the whole enumeration, and may or may not include objects which are added or removed while it is in progress. The @c -count and @c -removeAllObjects methods are similarly approximate when other threads are modifying the set.
+ - A set being copied, archived, or compared for equality may be modified during the operation, so the result reflects the set at no single moment.
+ 
+ Comparisons (whether by @c -compare: or a comparison function) must not raise exceptions, and must not modify the set.
+ */
+@interface CHConcurrentSkipListSet : NSObject <CHSortedSet>
+{
+	__strong struct CHConcurrentSkipListNode *head; // Precedes the first node on every level.
+	__strong struct CHSearchTreeComparator *comparator; // Orders the objects.
+	volatile int32_t levels; // The number of levels in use, which searches start from.
+	volatile int64_t count; // The number of objects currently in the set.
+}
+
+/**
+ Initializes a skip list which orders objects using a comparison function, rather than sending them @c -compare: messages. The same caveats apply as for \link CHAbstractBinarySearchTree#initWithComparisonFunction:context: -[CHAbstractBinarySearchTree initWithComparisonFunction:context:]\endlink, and the function must be safe to call from several threads at once.
+ 
+ @param function The function used to compare objects; must not be @c NULL.
+ @param context An arbitrary pointer which is passed to @a function with each comparison.
+ @return An initialized skip list which orders objects using @a function.
+ 
+ @throw NSInvalidArgumentException If @a function is @c NULL.
+ */
+- (id) initWithComparisonFunction:(CHComparisonFunction)function context:(void*)context;
+
+#if NS_BLOCKS_AVAILABLE
+/**
+ Initializes a skip list which orders objects using a comparator block, rather than sending them @c -compare: messages. The block is copied, and must be safe to call from several threads at once.
+ 
+ @param cmptr The block used to compare objects; must not be @c nil.
+ @return An initialized skip list which orders objects using @a cmptr.
+ 
+ @throw NSInvalidArgumentException If @a cmptr is @c nil.
+ */
+- (id) initWithComparator:(NSComparator)cmptr;
+#endif
+
+@end
@@ -0,0 +1,888 @@
+/*
+ CHDataStructures.framework -- CHConcurrentSkipListSet.m
+ 
+ Copyright (c) 2010, Quinn Taylor <http://homepage.mac.com/quinntaylor>
+ 
+ This source code is released under the ISC License. <http://www.opensource.org/licenses/isc-license>
+ 
+ Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted, provided that the above copyright notice and this permission notice appear in all copies.
+ 
+ The software is  provided "as is", without warranty of any kind, including all implied warranties of merchantability and fitness. In no event shall the authors or copyright holders be liable for any claim, damages, or other liability, whether in an action of contract, tort, or otherwise, arising from, out of, or in connection with the software or the use or other dealings in the software.
+ */
+
+#import "CHConcurrentSkipListSet.h"
+#import "CHAbstractBinarySearchTree_Internal.h"
+#import <pthread.h>
+
+/**
+ A node in a CHConcurrentSkipListSet, which is linked into the lowest @a height levels of the list. The lowest bit of each @a next pointer is set when the node has been removed, so a thread cannot link a new node after it (or unlink the node after it) once it is marked, since the compare-and-swap would expect an unmarked pointer.
+ 
+ A node is retired (see retireNode()) once both the thread that added it has finished linking it and the thread that removed it has unlinked it, which @a claims counts down.
+ */
+typedef struct CHConcurrentSkipListNode {
+	__strong id object;     ///< The object, or @c nil in the head node.
+	NSUInteger height;      ///< The number of levels the node belongs to.
+	volatile int32_t claims; ///< Threads which must finish with the node before it is retired.
+	__strong struct CHConcurrentSkipListNode * volatile next[]; ///< The following node on each level.
+} CHConcurrentSkipListNode;
+
+#define isMarked(node)  (((uintptr_t)(node) & 1) != 0)
+#define marked(node)    ((CHConcurrentSkipListNode*)((uintptr_t)(node) | 1))
+#define unmarked(node)  ((CHConcurrentSkipListNode*)((uintptr_t)(node) & ~(uintptr_t)1))
+
+// Links are swapped atomically, with a write barrier for the garbage collector (if enabled).
+#if (TARGET_OS_IPHONE || TARGET_OS_EMBEDDED || !TARGET_OS_MAC)
+#define CHCompareAndSwapNext(node,level,old,new) \
+	OSAtomicCompareAndSwapPtrBarrier((old), (new), (void* volatile*)&(node)->next[level])
+#else
+// This is declared in <objc/objc-auto.h>, but importing the header is overkill.
+OBJC_EXPORT BOOL objc_atomicCompareAndSwapPtrBarrier(id predicate, id replacement, volatile id *objectLocation);
+#define CHCompareAndSwapNext(node,level,old,new) \
+	objc_atomicCompareAndSwapPtrBarrier((id)(old), (id)(new), (volatile id*)&(node)->next[level])
+#endif
+
+static CHConcurrentSkipListNode* createNode(id anObject, NSUInteger height, int32_t claims) {
+	CHConcurrentSkipListNode *node = NSAllocateCollectable(sizeof(CHConcurrentSkipListNode) + height * kCHPointerSize, NSScannedOption);
+	node->object = anObject;
+	node->height = height;
+	node->claims = claims;
+	for (NSUInteger level = 0; level < height; level++)
+		node->next[level] = NULL;
+	return node;
+}
+
+// Releases the object in a node and frees it. Only called when GC is not enabled.
+static void freeNode(CHConcurrentSkipListNode *node) {
+	[node->object release];
+	free(node);
+}
+
+#pragma mark Epoch-Based Reclamation
+
+// The number of nodes a thread retires between attempts to advance the epoch and free nodes.
+#define kCHEpochReclaimInterval 64
+
+// A node which has been unlinked, and the global epoch just after it was unlinked.
+typedef struct CHRetiredNode {
+	CHConcurrentSkipListNode *node;
+	int32_t epoch;
+} CHRetiredNode;
+
+/**
+ The reclamation state of one thread, which is shared by every skip list the thread uses. Records are created the first time a thread uses a skip list, and are never freed: once a thread exits, its record (and any nodes it has yet to free) is adopted by the next new thread.
+ */
+typedef struct CHEpochRecord {
+	struct CHEpochRecord *next; ///< The record that was created before this one.
+	volatile int32_t inUse;     ///< Nonzero while a thread owns the record.
+	volatile int32_t state;     ///< 0 when idle, otherwise (epoch << 1) | 1 for the epoch announced.
+	NSUInteger depth;           ///< The nesting depth of CHEpochEnter() calls.
+	NSUInteger retirements;     ///< The number of nodes retired, which triggers reclamation.
+	uint32_t random;            ///< Xorshift state for choosing the height of new nodes.
+	CHRetiredNode *retired;     ///< Nodes waiting to be freed, in the order they were retired.
+	NSUInteger retiredCount;    ///< The number of nodes in @a retired.
+	NSUInteger retiredCapacity; ///< The number of nodes @a retired can hold.
+} CHEpochRecord;
+
+static volatile int32_t globalEpoch = 0;
+static CHEpochRecord * volatile epochRecords = NULL;
+static pthread_key_t epochRecordKey;
+static pthread_once_t epochRecordKeyOnce = PTHREAD_ONCE_INIT;
+
+static inline int32_t announcedState(int32_t epoch) {
+	return (int32_t) (((uint32_t)epoch << 1) | 1);
+}
+
+// Called when a thread exits; the record keeps its retired nodes for the next owner.
+static void relinquishEpochRecord(void *record) {
+	((CHEpochRecord*) record)->state = 0;
+	OSMemoryBarrier();
+	((CHEpochRecord*) record)->inUse = 0;
+}
+
+static void createEpochRecordKey(void) {
+	pthread_key_create(&epochRecordKey, relinquishEpochRecord);
+}
+
+static CHEpochRecord* currentEpochRecord(void) {
+	pthread_once(&epochRecordKeyOnce, createEpochRecordKey);
+	CHEpochRecord *record = pthread_getspecific(epochRecordKey);
+	if (record != NULL)
+		return record;
+	// Adopt the record of a thread which has exited, or create a new one.
+	for (record = epochRecords; record != NULL; record = record->next)
+		if (record->inUse == 0 && OSAtomicCompareAndSwap32Barrier(0, 1, &record->inUse))
+			break;
+	if (record == NULL) {
+		record = calloc(1, sizeof(CHEpochRecord));
+		record->inUse = 1;
+		do {
+			record->next = epochRecords;
+		} while (!OSAtomicCompareAndSwapPtrBarrier(record->next, record, (void* volatile*)&epochRecords));
+	}
+	record->random = arc4random() | 1;
+	pthread_setspecific(epochRecordKey, record);
+	return record;
+}
+
+/**
+ Announces that the current thread is about to read the nodes of a skip list, which prevents any node it may reach from being freed until it calls CHEpochExit(). Calls may be nested.
+ */
+static inline CHEpochRecord* CHEpochEnter(void) {
+	CHEpochRecord *record = currentEpochRecord();
+	if (record->depth++ == 0) {
+		record->state = announcedState(globalEpoch);
+		OSMemoryBarrier();
+	}
+	return record;
+}
+
+static inline void CHEpochExit(CHEpochRecord *record) {
+	if (--record->depth == 0) {
+		OSMemoryBarrier();
+		record->state = 0;
+	}
+}
+
+// Advances the global epoch if every thread in an operation has announced the current one.
+static void tryAdvanceEpoch(void) {
+	int32_t epoch = globalEpoch;
+	OSMemoryBarrier();
+	int32_t current = announcedState(epoch);
+	for (CHEpochRecord *record = epochRecords; record != NULL; record = record->next) {
+		int32_t state = record->state;
+		if (state != 0 && state != current)
+			return;
+	}
+	OSAtomicCompareAndSwap32Barrier(epoch, (int32_t)((uint32_t)epoch + 1), &globalEpoch);
+}
+
+/**
+ Frees the nodes a thread has retired which no thread can still be reading. A node retired in epoch e was unlinked before the epoch became e+1, so only threads which announced e or earlier can have reached it. Once the epoch reaches e+2 (which requires every thread in an operation to have announced e+1), none of them can still be reading it.
+ */
+static void reclaimRetiredNodes(CHEpochRecord *record) {
+	int32_t epoch = globalEpoch;
+	NSUInteger reclaimable = 0;
+	while (reclaimable < record->retiredCount &&
+	       (int32_t)((uint32_t)epoch - (uint32_t)record->retired[reclaimable].epoch) >= 2)
+		reclaimable++;
+	if (reclaimable == 0)
+		return;
+	// Releasing an object may remove objects from a skip list and retire more nodes, so the nodes to free are taken out of the record first.
+	CHConcurrentSkipListNode **nodes = malloc(reclaimable * sizeof(CHConcurrentSkipListNode*));
+	for (NSUInteger i = 0; i < reclaimable; i++)
+		nodes[i] = record->retired[i].node;
+	record->retiredCount -= reclaimable;
+	memmove(record->retired, record->retired + reclaimable,
+	        record->retiredCount * sizeof(CHRetiredNode));
+	for (NSUInteger i = 0; i < reclaimable; i++)
+		freeNode(nodes[i]);
+	free(nodes);
+}
+
+// Schedules a node which is no longer reachable from the list to be freed. With GC, the collector frees it instead.
+static void retireNode(CHEpochRecord *record, CHConcurrentSkipListNode *node) {
+	if (!kCHGarbageCollectionNotEnabled)
+		return;
+	OSMemoryBarrier();
+	if (record->retiredCount == record->retiredCapacity) {
+		record->retiredCapacity = MAX(2 * record->retiredCapacity, kCHEpochReclaimInterval);
+		record->retired = realloc(record->retired, record->retiredCapacity * sizeof(CHRetiredNode));
+	}
+	record->retired[record->retiredCount].node = node;
+	record->retired[record->retiredCount].epoch = globalEpoch;
+	record->retiredCount++;
+	if (++record->retirements % kCHEpochReclaimInterval == 0) {
+		tryAdvanceEpoch();
+		reclaimRetiredNodes(record);
+	}
+}
+
+// Gives up one claim on a node, and retires it if that was the last one.
+static inline void releaseClaim(CHEpochRecord *record, CHConcurrentSkipListNode *node) {
+	if (OSAtomicDecrement32Barrier(&node->claims) == 0)
+		retireNode(record, node);
+}
+
+#pragma mark Searching
+
+// Chooses a height for a new node; each level is a quarter as likely as the one below it.
+static NSUInteger randomHeight(CHEpochRecord *record) {
+	uint32_t x = record->random;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	record->random = x;
+	NSUInteger height = 1;
+	while ((x & 3) == 0 && height < kCHConcurrentSkipListMaxLevel) {
+		height++;
+		x >>= 2;
+	}
+	return height;
+}
+
+/**
+ Finds the nodes before and after the position of an object on every level, unlinking any removed nodes it encounters along the way. The number of levels in use is read each time the search starts, so a node which has just been linked on a new level is not missed. On each level in use, @a preds receives the last node whose object is less than @a anObject, and @a succs the node after it; above that, the head node and whatever follows it.
+ 
+ @return @c YES if the node in <code>succs[0]</code> holds an object equal to @a anObject.
+ */
+static BOOL findNode(CHConcurrentSkipListNode *head, volatile int32_t *levels,
+                     CHSearchTreeComparator *comparator, id anObject,
+                     CHConcurrentSkipListNode **preds, CHConcurrentSkipListNode **succs)
+{
+	CHConcurrentSkipListNode *pred, *curr, *succ;
+	NSComparisonResult comparison;
+	NSInteger level;
+retry:
+	pred = head;
+	for (level = kCHConcurrentSkipListMaxLevel - 1; level >= *levels; level--) {
+		preds[level] = head;
+		succs[level] = head->next[level];
+	}
+	comparison = NSOrderedDescending;
+	for (; level >= 0; level--) {
+		curr = pred->next[level];
+		if (isMarked(curr))
+			goto retry; // The predecessor itself has just been removed.
+		while (curr != NULL) {
+			succ = curr->next[level];
+			while (isMarked(succ)) {
+				// Unlink the removed node, or start over if the predecessor changed.
+				if (!CHCompareAndSwapNext(pred, level, curr, unmarked(succ)))
+					goto retry;
+				curr = unmarked(succ);
+				if (curr == NULL)
+					break;
+				succ = curr->next[level];
+			}
+			if (curr == NULL)
+				break;
+			comparison = CHSearchTreeCompare(comparator, curr->object, anObject);
+			if (comparison != NSOrderedAscending)
+				break;
+			pred = curr;
+			curr = succ;
+		}
+		if (curr == NULL)
+			comparison = NSOrderedDescending;
+		preds[level] = pred;
+		succs[level] = curr;
+	}
+	return (comparison == NSOrderedSame);
+}
+
+/**
+ Finds the first node whose object is not less than @a anObject (or, if @a orEqual is @c NO, greater than @a anObject) without modifying the list, skipping over removed nodes.
+ 
+ @param predecessor If not @c NULL, receives the last node found whose object precedes that position, or the head node if there is none.
+ @return The node found, or @c NULL if there is none. The node was not removed when it was found.
+ */
+static CHConcurrentSkipListNode* seekNode(CHConcurrentSkipListNode *head, NSInteger levels,
+                                          CHSearchTreeComparator *comparator, id anObject,
+                                          BOOL orEqual, CHConcurrentSkipListNode **predecessor)
+{
+	CHConcurrentSkipListNode *pred = head, *curr = NULL, *succ;
+	NSComparisonResult comparison;
+	for (NSInteger level = levels - 1; level >= 0; level--) {
+		curr = unmarked(pred->next[level]);
+		while (curr != NULL) {
+			succ = curr->next[level];
+			if (isMarked(succ)) {
+				curr = unmarked(succ);
+				continue;
+			}
+			comparison = CHSearchTreeCompare(comparator, curr->object, anObject);
+			if (comparison == NSOrderedDescending || (comparison == NSOrderedSame && orEqual))
+				break;
+			pred = curr;
+			curr = succ;
+		}
+	}
+	if (predecessor != NULL)
+		*predecessor = pred;
+	return curr;
+}
+
+// Returns the first node after a node on level 0 which has not been removed, or NULL.
+static CHConcurrentSkipListNode* nextLiveNode(CHConcurrentSkipListNode *node) {
+	node = unmarked(node->next[0]);
+	while (node != NULL && isMarked(node->next[0]))
+		node = unmarked(node->next[0]);
+	return node;
+}
+
+// Returns the last node which has not been removed, or the head node if there is none.
+static CHConcurrentSkipListNode* lastLiveNode(CHConcurrentSkipListNode *head, NSInteger levels) {
+	CHConcurrentSkipListNode *pred = head, *curr;
+	for (NSInteger level = levels - 1; level >= 0; level--) {
+		curr = unmarked(pred->next[level]);
+		while (curr != NULL) {
+			if (!isMarked(curr->next[level]))
+				pred = curr;
+			curr = unmarked(curr->next[level]);
+		}
+	}
+	return pred;
+}
+
+#pragma mark Modification
+
+/**
+ Adds an object, unless an equal object is already present. The node is linked on level 0 first, which makes the object visible to other threads, and then on each higher level in turn. If the node is removed before it is linked on every level, linking stops, and the node is unlinked again afterward.
+ 
+ @return @c YES if the object was added.
+ */
+static BOOL insertObject(CHEpochRecord *record, CHConcurrentSkipListNode *head,
+                         volatile int32_t *levels, CHSearchTreeComparator *comparator,
+                         id anObject)
+{
+	CHConcurrentSkipListNode *preds[kCHConcurrentSkipListMaxLevel];
+	CHConcurrentSkipListNode *succs[kCHConcurrentSkipListMaxLevel];
+	CHConcurrentSkipListNode *node = NULL, *succ;
+	NSUInteger height = randomHeight(record), level;
+	do {
+		if (findNode(head, levels, comparator, anObject, preds, succs)) {
+			if (node != NULL) {
+				[anObject release];
+				if (kCHGarbageCollectionNotEnabled)
+					free(node);
+			}
+			return NO;
+		}
+		if (node == NULL)
+			node = createNode([anObject retain], height, 2);
+		for (level = 0; level < height; level++)
+			node->next[level] = succs[level];
+	} while (!CHCompareAndSwapNext(preds[0], 0, succs[0], node));
+
+	for (level = 1; level < height; level++) {
+		while (1) {
+			// Point the node at its successor on this level, unless it is being removed.
+			succ = node->next[level];
+			if (isMarked(succ))
+				goto linked;
+			if (succ != succs[level] && !CHCompareAndSwapNext(node, level, succ, succs[level]))
+				goto linked;
+			if (CHCompareAndSwapNext(preds[level], level, succs[level], node))
+				break;
+			findNode(head, levels, comparator, anObject, preds, succs);
+			if (succs[0] != node)
+				goto linked; // Removed (and unlinked from level 0) already.
+		}
+	}
+linked:
+	for (int32_t oldLevels = *levels; (NSUInteger) oldLevels < height; oldLevels = *levels)
+		if (OSAtomicCompareAndSwap32Barrier(oldLevels, (int32_t) height, levels))
+			break;
+	OSMemoryBarrier();
+	// If the node was removed while it was being linked, the remover may have missed some levels.
+	if (isMarked(node->next[0]))
+		findNode(head, levels, comparator, anObject, preds, succs);
+	releaseClaim(record, node);
+	return YES;
+}
+
+/**
+ Removes a node from the list: marks its links from the top level down, which removes it logically once level 0 is marked, then unlinks it from every level.
+ 
+ @return @c YES if this thread removed the node, or @c NO if another thread did.
+ */
+static BOOL removeNode(CHEpochRecord *record, CHConcurrentSkipListNode *head,
+                       volatile int32_t *levels, CHSearchTreeComparator *comparator,
+                       CHConcurrentSkipListNode *node)
+{
+	CHConcurrentSkipListNode *preds[kCHConcurrentSkipListMaxLevel];
+	CHConcurrentSkipListNode *succs[kCHConcurrentSkipListMaxLevel];
+	CHConcurrentSkipListNode *succ;
+	for (NSInteger level = node->height - 1; level > 0; level--) {
+		do {
+			succ = node->next[level];
+		} while (!isMarked(succ) && !CHCompareAndSwapNext(node, level, succ, marked(succ)));
+	}
+	do {
+		succ = node->next[0];
+		if (isMarked(succ))
+			return NO;
+	} while (!CHCompareAndSwapNext(node, 0, succ, marked(succ)));
+	findNode(head, levels, comparator, node->object, preds, succs);
+	releaseClaim(record, node);
+	return YES;
+}
+
+/**
+ Links nodes for objects in strictly ascending order into an empty list, in O(n) time. Only used for lists which no other thread can see yet.
+ 
+ @return The number of levels used.
+ */
+static NSUInteger buildList(CHEpochRecord *record, CHConcurrentSkipListNode *head,
+                            id *objects, NSUInteger objectCount)
+{
+	CHConcurrentSkipListNode *tails[kCHConcurrentSkipListMaxLevel];
+	NSUInteger level, levels = 1;
+	for (level = 0; level < kCHConcurrentSkipListMaxLevel; level++)
+		tails[level] = head;
+	for (NSUInteger i = 0; i < objectCount; i++) {
+		NSUInteger height = randomHeight(record);
+		CHConcurrentSkipListNode *node = createNode([objects[i] retain], height, 1);
+		for (level = 0; level < height; level++) {
+			tails[level]->next[level] = node;
+			tails[level] = node;
+		}
+		levels = MAX(levels, height);
+	}
+	return levels;
+}
+
+#pragma mark -
+
+/**
+ An NSEnumerator for a CHConcurrentSkipListSet. Each object is found by searching for the object after (or before) the last one returned, so the enumerator never holds a node between calls, and sees objects added or removed while it is in use. The set and the last object are retained until the enumerator is exhausted.
+ */
+@interface CHConcurrentSkipListEnumerator : NSEnumerator
+{
+	CHConcurrentSkipListSet *set; // The set being enumerated.
+	id lastObject; // The object returned last, or nil before the first.
+	BOOL ascending; // Whether the objects are returned in ascending order.
+}
+
+- (id) initWithSet:(CHConcurrentSkipListSet*)aSet ascending:(BOOL)isAscending;
+
+@end
+
+@implementation CHConcurrentSkipListEnumerator
+
+- (id) initWithSet:(CHConcurrentSkipListSet*)aSet ascending:(BOOL)isAscending {
+	if ((self = [super init]) == nil) return nil;
+	set = [aSet retain];
+	lastObject = nil;
+	ascending = isAscending;
+	return self;
+}
+
+- (void) dealloc {
+	[set release];
+	[lastObject release];
+	[super dealloc];
+}
+
+- (NSArray*) allObjects {
+	NSMutableArray *array = [[NSMutableArray alloc] init];
+	id anObject;
+	while ((anObject = [self nextObject]))
+		[array addObject:anObject];
+	return [array autorelease];
+}
+
+- (id) nextObject {
+	if (set == nil)
+		return nil;
+	id anObject;
+	if (ascending)
+		anObject = (lastObject == nil) ? [set firstObject] : [set objectGreaterThan:lastObject];
+	else
+		anObject = (lastObject == nil) ? [set lastObject] : [set objectLessThan:lastObject];
+	[lastObject release];
+	lastObject = [anObject retain];
+	if (anObject == nil) {
+		[set release];
+		set = nil;
+	}
+	return anObject;
+}
+
+@end
+
+#pragma mark -
+
+@interface CHConcurrentSkipListSet ()
+
+- (void) buildListFromSortedObjects:(id*)objects count:(NSUInteger)objectCount;
+
+@end
+
+@implementation CHConcurrentSkipListSet
+
+// Since no other thread can be using the set, every node left is still linked on level 0.
+- (void) dealloc {
+	if (kCHGarbageCollectionNotEnabled) {
+		CHConcurrentSkipListNode *node = unmarked(head->next[0]), *next;
+		while (node != NULL) {
+			next = unmarked(node->next[0]);
+			freeNode(node);
+			node = next;
+		}
+		free(head);
+	}
+	CHSearchTreeComparatorFree(comparator);
+	[super dealloc];
+}
+
+- (id) init {
+	if ((self = [super init]) == nil) return nil;
+	head = createNode(nil, kCHConcurrentSkipListMaxLevel, 1);
+	comparator = CHSearchTreeComparatorCreate(nil);
+	levels = 1;
+	count = 0;
+	return self;
+}
+
+// Sorted objects are linked directly, since no other thread can see the set yet.
+- (id) initWithArray:(NSArray*)anArray {
+	if ([self init] == nil) return nil;
+	NSUInteger arrayCount = [anArray count];
+	if (arrayCount > 1) {
+		id *objects = NSAllocateCollectable(arrayCount * kCHPointerSize, NSScannedOption);
+		[anArray getObjects:objects];
+		NSUInteger i;
+		for (i = 1; i < arrayCount; i++)
+			if (CHSearchTreeCompare(comparator, objects[i-1], objects[i]) != NSOrderedAscending)
+				break;
+		BOOL isSorted = (i == arrayCount);
+		if (isSorted)
+			[self buildListFromSortedObjects:objects count:arrayCount];
+		if (kCHGarbageCollectionNotEnabled)
+			free(objects);
+		if (isSorted)
+			return self;
+	}
+	[self addObjectsFromArray:anArray];
+	return self;
+}
+
+- (id) initWithComparisonFunction:(CHComparisonFunction)function context:(void*)context {
+	if ([self init] == nil) return nil;
+	if (function == NULL)
+		CHInvalidArgumentException([self class], _cmd, @"Invalid comparison function.");
+	comparator->function = function;
+	comparator->context = context;
+	return self;
+}
+
+#if NS_BLOCKS_AVAILABLE
+- (id) initWithComparator:(NSComparator)cmptr {
+	if ([self init] == nil) return nil;
+	if (cmptr == nil)
+		CHNilArgumentException([self class], _cmd);
+	comparator->block = [cmptr copy];
+	comparator->function = CHCompareObjectsUsingBlock;
+	comparator->context = comparator->block;
+	return self;
+}
+#endif
+
+// Creates an empty set (not visible to other threads) which orders objects like the receiver.
+- (CHConcurrentSkipListSet*) emptySetWithZone:(NSZone*)zone {
+	CHConcurrentSkipListSet *newSet = [[[self class] allocWithZone:zone] init];
+	CHSearchTreeComparatorCopy(newSet->comparator, comparator);
+	return newSet;
+}
+
+#pragma mark <NSCoding>
+
+- (id) initWithCoder:(NSCoder*)decoder {
+	return [self initWithArray:[decoder decodeObjectForKey:@"objects"]];
+}
+
+- (void) encodeWithCoder:(NSCoder*)encoder {
+	[encoder encodeObject:[self allObjects] forKey:@"objects"];
+}
+
+#pragma mark <NSCopying> methods
+
+- (id) copyWithZone:(NSZone*)zone {
+	CHConcurrentSkipListSet *newSet = [self emptySetWithZone:zone];
+	NSArray *objects = [self allObjects];
+	NSUInteger objectCount = [objects count];
+	if (objectCount > 0) {
+		id *buffer = NSAllocateCollectable(objectCount * kCHPointerSize, NSScannedOption);
+		[objects getObjects:buffer];
+		[newSet buildListFromSortedObjects:buffer count:objectCount];
+		if (kCHGarbageCollectionNotEnabled)
+			free(buffer);
+	}
+	return newSet;
+}
+
+#pragma mark <NSFastEnumeration>
+
+/*
+ Each call copies the next batch of objects (retained and autoreleased) into the stack buffer, then leaves the list, so no node is held between calls. The state holds the last object returned, and the next call resumes with the first object greater than it. Since the set may be modified at any time, the mutations pointer refers to a value which never changes.
+ */
+- (NSUInteger) countByEnumeratingWithState:(NSFastEnumerationState*)state
+                                   objects:(id*)stackbuf
+                                     count:(NSUInteger)len
+{
+	if (state->state == 2)
+		return 0;
+	CHSearchTreeComparator localComparator = *comparator;
+	CHEpochRecord *record = CHEpochEnter();
+	CHConcurrentSkipListNode *node;
+	if (state->state == 0) {
+		state->mutationsPtr = &state->extra[1];
+		state->state = 1;
+		node = nextLiveNode(head);
+	}
+	else
+		node = seekNode(head, levels, &localComparator, (id) state->extra[0], NO, NULL);
+	NSUInteger batchCount = 0;
+	while (node != NULL && batchCount < len) {
+		if (!isMarked(node->next[0]))
+			stackbuf[batchCount++] = [node->object retain];
+		node = unmarked(node->next[0]);
+	}
+	CHEpochExit(record);
+	for (NSUInteger i = 0; i < batchCount; i++)
+		[stackbuf[i] autorelease];
+	if (batchCount == 0) {
+		state->state = 2;
+		return 0;
+	}
+	state->extra[0] = (unsigned long) stackbuf[batchCount - 1];
+	state->itemsPtr = stackbuf;
+	return batchCount;
+}
+
+#pragma mark Querying Contents
+
+- (NSArray*) allObjects {
+	NSMutableArray *array = [NSMutableArray array];
+	CHEpochRecord *record = CHEpochEnter();
+	for (CHConcurrentSkipListNode *node = nextLiveNode(head); node != NULL; node = nextLiveNode(node))
+		[array addObject:node->object];
+	CHEpochExit(record);
+	return array;
+}
+
+- (id) anyObject {
+	return [self firstObject];
+}
+
+- (BOOL) containsObject:(id)anObject {
+	if (anObject == nil)
+		return NO;
+	CHSearchTreeComparator localComparator = *comparator;
+	CHEpochRecord *record = CHEpochEnter();
+	CHConcurrentSkipListNode *node = seekNode(head, levels, &localComparator, anObject, YES, NULL);
+	BOOL found = (node != NULL &&
+	              CHSearchTreeCompare(&localComparator, node->object, anObject) == NSOrderedSame);
+	CHEpochExit(record);
+	return found;
+}
+
+- (NSUInteger) count {
+	int64_t currentCount = count;
+	return (currentCount > 0) ? (NSUInteger) currentCount : 0;
+}
+
+- (NSString*) description {
+	return [[self allObjects] description];
+}
+
+- (id) firstObject {
+	CHEpochRecord *record = CHEpochEnter();
+	CHConcurrentSkipListNode *node = nextLiveNode(head);
+	id anObject = (node != NULL) ? [node->object retain] : nil;
+	CHEpochExit(record);
+	return [anObject autorelease];
+}
+
+// The shared comparison state is never modified after initialization, so it is safe to copy.
+- (CHFrozenSortedSet*) freeze {
+	return [[[CHFrozenSortedSet alloc] initWithSortedObjects:[self allObjects]
+	                                              comparator:comparator] autorelease];
+}
+
+- (NSUInteger) hash {
+	return hashOfCountAndObjects([self count], [self firstObject], [self lastObject]);
+}
+
+- (BOOL) isEqual:(id)otherObject {
+	if ([otherObject conformsToProtocol:@protocol(CHSortedSet)])
+		return [self isEqualToSortedSet:otherObject];
+	else
+		return NO;
+}
+
+- (BOOL) isEqualToSortedSet:(id<CHSortedSet>)otherSortedSet {
+	return collectionsAreEqual(self, otherSortedSet);
+}
+
+- (id) lastObject {
+	CHEpochRecord *record = CHEpochEnter();
+	CHConcurrentSkipListNode *node = lastLiveNode(head, levels);
+	id anObject = [node->object retain]; // nil for the head node
+	CHEpochExit(record);
+	return [anObject autorelease];
+}
+
+// Finds the first object at or after an object (or the last object before it), returning it retained.
+- (id) retainedObjectAdjacentTo:(id)anObject after:(BOOL)after orEqual:(BOOL)orEqual {
+	if (anObject == nil)
+		return nil;
+	CHSearchTreeComparator localComparator = *comparator;
+	CHEpochRecord *record = CHEpochEnter();
+	CHConcurrentSkipListNode *pred, *node;
+	node = seekNode(head, levels, &localComparator, anObject, after ? orEqual : !orEqual, &pred);
+	id result = after ? (node ? node->object : nil) : pred->object; // nil for the head node
+	[result retain];
+	CHEpochExit(record);
+	return result;
+}
+
+- (id) member:(id)anObject {
+	CHSearchTreeComparator localComparator = *comparator;
+	id result = [self retainedObjectAdjacentTo:anObject after:YES orEqual:YES];
+	if (result != nil && CHSearchTreeCompare(&localComparator, result, anObject) != NSOrderedSame) {
+		[result release];
+		return nil;
+	}
+	return [result autorelease];
+}
+
+- (NSEnumerator*) objectEnumerator {
+	return [[[CHConcurrentSkipListEnumerator alloc] initWithSet:self ascending:YES] autorelease];
+}
+
+- (id) objectGreaterThan:(id)anObject {
+	return [[self retainedObjectAdjacentTo:anObject after:YES orEqual:NO] autorelease];
+}
+
+- (id) objectGreaterThanOrEqualTo:(id)anObject {
+	return [[self retainedObjectAdjacentTo:anObject after:YES orEqual:YES] autorelease];
+}
+
+- (id) objectLessThan:(id)anObject {
+	return [[self retainedObjectAdjacentTo:anObject after:NO orEqual:NO] autorelease];
+}
+
+- (id) objectLessThanOrEqualTo:(id)anObject {
+	return [[self retainedObjectAdjacentTo:anObject after:NO orEqual:YES] autorelease];
+}
+
+- (NSEnumerator*) reverseObjectEnumerator {
+	return [[[CHConcurrentSkipListEnumerator alloc] initWithSet:self ascending:NO] autorelease];
+}
+
+- (CHSearchTreeComparator*) searchTreeComparator {
+	return comparator;
+}
+
+- (NSSet*) set {
+	return [NSSet setWithArray:[self allObjects]];
+}
+
+- (id<CHSortedSet>) subsetFromObject:(id)start
+                            toObject:(id)end
+                             options:(CHSubsetConstructionOptions)options
+{
+	// If both parameters are nil, return a copy containing all the objects.
+	if (start == nil && end == nil)
+		return [[self copy] autorelease];
+
+	CHSearchTreeComparator localComparator = *comparator;
+	BOOL between = (start == nil || end == nil ||
+	                CHSearchTreeCompare(&localComparator, start, end) != NSOrderedDescending);
+	NSComparisonResult lowLimit = (options & CHSubsetExcludeLowEndpoint) ? NSOrderedDescending : NSOrderedSame;
+	NSComparisonResult highLimit = (options & CHSubsetExcludeHighEndpoint) ? NSOrderedAscending : NSOrderedSame;
+	NSMutableArray *objects = [NSMutableArray array];
+	for (id anObject in self) {
+		BOOL afterStart = (start == nil) ||
+			CHSearchTreeCompare(&localComparator, anObject, start) >= lowLimit;
+		BOOL beforeEnd = (end == nil) ||
+			CHSearchTreeCompare(&localComparator, anObject, end) <= highLimit;
+		// Include objects between the endpoints, or (if start follows end) all objects except those between them.
+		if (between ? (afterStart && beforeEnd) : (afterStart || beforeEnd))
+			[objects addObject:anObject];
+	}
+
+	CHConcurrentSkipListSet *subset = [[self emptySetWithZone:nil] autorelease];
+	NSUInteger objectCount = [objects count];
+	if (objectCount > 0) {
+		id *buffer = NSAllocateCollectable(objectCount * kCHPointerSize, NSScannedOption);
+		[objects getObjects:buffer];
+		[subset buildListFromSortedObjects:buffer count:objectCount];
+		if (kCHGarbageCollectionNotEnabled)
+			free(buffer);
+	}
+	return subset;
+}
+
+#pragma mark Modifying Contents
+
+- (void) addObject:(id)anObject {
+	if (anObject == nil)
+		CHNilArgumentException([self class], _cmd);
+	CHSearchTreeComparator localComparator = *comparator;
+	CHEpochRecord *record = CHEpochEnter();
+	if (insertObject(record, head, &levels, &localComparator, anObject))
+		OSAtomicIncrement64Barrier(&count);
+	CHEpochExit(record);
+}
+
+- (void) addObjectsFromArray:(NSArray*)anArray {
+	for (id anObject in anArray)
+		[self addObject:anObject];
+}
+
+- (void) buildListFromSortedObjects:(id*)objects count:(NSUInteger)objectCount {
+	NSAssert(count == 0, @"Can only bulk load objects into an empty set.");
+	CHEpochRecord *record = CHEpochEnter();
+	levels = (int32_t) buildList(record, head, objects, objectCount);
+	count = objectCount;
+	CHEpochExit(record);
+	OSMemoryBarrier();
+}
+
+// Removes objects one at a time from the front, so objects added meanwhile may remain.
+- (void) removeAllObjects {
+	CHSearchTreeComparator localComparator = *comparator;
+	CHEpochRecord *record = CHEpochEnter();
+	CHConcurrentSkipListNode *node;
+	while ((node = nextLiveNode(head)) != NULL) {
+		if (removeNode(record, head, &levels, &localComparator, node))
+			OSAtomicDecrement64Barrier(&count);
+	}
+	CHEpochExit(record);
+}
+
+- (void) removeFirstObject {
+	CHSearchTreeComparator localComparator = *comparator;
+	CHEpochRecord *record = CHEpochEnter();
+	CHConcurrentSkipListNode *node;
+	// If another thread removes the first object first, try the new first object.
+	while ((node = nextLiveNode(head)) != NULL) {
+		if (removeNode(record, head, &levels, &localComparator, node)) {
+			OSAtomicDecrement64Barrier(&count);
+			break;
+		}
+	}
+	CHEpochExit(record);
+}
+
+- (void) removeLastObject {
+	CHSearchTreeComparator localComparator = *comparator;
+	CHEpochRecord *record = CHEpochEnter();
+	CHConcurrentSkipListNode *node;
+	while ((node = lastLiveNode(head, levels)) != head) {
+		if (removeNode(record, head, &levels, &localComparator, node)) {
+			OSAtomicDecrement64Barrier(&count);
+			break;
+		}
+	}
+	CHEpochExit(record);
+}
+
+- (void) removeObject:(id)anObject {
+	if (anObject == nil)
+		return;
+	CHSearchTreeComparator localComparator = *comparator;
+	CHEpochRecord *record = CHEpochEnter();
+	CHConcurrentSkipListNode *node = seekNode(head, levels, &localComparator, anObject, YES, NULL);
+	if (node != NULL && CHSearchTreeCompare(&localComparator, node->object, anObject) == NSOrderedSame &&
+	    removeNode(record, head, &levels, &localComparator, node))
+	{
+		OSAtomicDecrement64Barrier(&count);
+	}
+	CHEpochExit(record);
+}
+
+@end
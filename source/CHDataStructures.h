@@ -26,12 +26,17 @@
 #import "CHAnderssonTree.h"
 #import "CHBidirectionalDictionary.h"
 #import "CHBinaryHeap.h"
+#import "CHBTree.h"
 #import "CHAVLTree.h"
 #import "CHCircularBuffer.h"
 #import "CHCircularBufferDeque.h"
 #import "CHCircularBufferQueue.h"
 #import "CHCircularBufferStack.h"
+#import "CHConcurrentSkipListSet.h"
 #import "CHDoublyLinkedList.h"
+#import "CHFrozenSortedSet.h"
+#import "CHIntegerSortedDictionary.h"
+#import "CHIntegerSortedSet.h"
 #import "CHListDeque.h"
 #import "CHListQueue.h"
 #import "CHListStack.h"
@@ -42,8 +47,11 @@
 #import "CHOrderedDictionary.h"
 #import "CHOrderedSet.h"
 #import "CHRedBlackTree.h"
+#import "CHSPSCQueue.h"
+#import "CHScapegoatTree.h"
 #import "CHSinglyLinkedList.h"
 #import "CHSortedDictionary.h"
+#import "CHSplayTree.h"
 #import "CHTreap.h"
 #import "CHUnbalancedTree.h"
 
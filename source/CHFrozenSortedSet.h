@@ -0,0 +1,39 @@
+/*
+ CHDataStructures.framework -- CHFrozenSortedSet.h
+ 
+ Copyright (c) 2010, Quinn Taylor <http://homepage.mac.com/quinntaylor>
+ 
+ This source code is released under the ISC License. <http://www.opensource.org/licenses/isc-license>
+ 
+ Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted, provided that the above copyright notice and this permission notice appear in all copies.
+ 
+ The software is  provided "as is", without warranty of any kind, including all implied warranties of merchantability and fitness. In no event shall the authors or copyright holders be liable for any claim, damages, or other liability, whether in an action of contract, tort, or otherwise, arising from, out of, or in connection with the software or the use or other dealings in the software.
+ */
+
+#import "CHSortedSet.h"
+
+/**
+ @file CHFrozenSortedSet.h
+ An immutable CHSortedSet which stores its objects in a single array, laid out for fast searching.
+ */
+
+// Comparison state shared with the search trees; defined in CHAbstractBinarySearchTree_Internal.h
+struct CHSearchTreeComparator;
+
+/**
+ An immutable sorted set, for data which is built once and then searched many times. A frozen set is usually created by sending @c -freeze to another sorted set, which keeps the same ordering (including any comparison function or block) and the same objects.
+ 
+ The objects are stored in one contiguous array in <a href="http://arxiv.org/abs/1509.05053">Eytzinger order</a>: the root of an implicit, perfectly balanced binary search tree is at index 1, and the children of the object at index @e k are at indexes <em>2k</em> and <em>2k+1</em>. Compared to a sorted array, the objects examined by the first steps of every search are packed together at the start of the array, so they tend to stay in the cache; compared to a search tree, there are no nodes or child pointers to load. Each step of a search picks the next index arithmetically from the result of the comparison (rather than branching on it), and the array entries several levels further down are prefetched while the comparison runs, since they share a cache line.
+ 
+ Searches for an object, including @c -member:, @c -containsObject:, and the @c -objectGreaterThan: family, take O(log n) time. Enumeration visits the array in sorted order, which takes O(1) amortized time per object; @c -anyObject and @c -set do not need sorted order, so they read the array directly.
+ 
+ All the methods which modify a sorted set raise an @c NSInternalInconsistencyException. Since the set can never change, it may be read from any number of threads at once, copying it just retains it, and it may be enumerated while other code reads it.
+ */
+@interface CHFrozenSortedSet : NSObject <CHSortedSet>
+{
+	__strong id *objects; // The objects in Eytzinger order, from index 1; index 0 is unused.
+	NSUInteger count; // The number of objects in the set.
+	__strong struct CHSearchTreeComparator *comparator; // Orders the objects.
+}
+
+@end
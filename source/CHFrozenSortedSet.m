@@ -0,0 +1,477 @@
+/*
+ CHDataStructures.framework -- CHFrozenSortedSet.m
+ 
+ Copyright (c) 2010, Quinn Taylor <http://homepage.mac.com/quinntaylor>
+ 
+ This source code is released under the ISC License. <http://www.opensource.org/licenses/isc-license>
+ 
+ Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted, provided that the above copyright notice and this permission notice appear in all copies.
+ 
+ The software is  provided "as is", without warranty of any kind, including all implied warranties of merchantability and fitness. In no event shall the authors or copyright holders be liable for any claim, damages, or other liability, whether in an action of contract, tort, or otherwise, arising from, out of, or in connection with the software or the use or other dealings in the software.
+ */
+
+#import "CHFrozenSortedSet.h"
+#import "CHAbstractBinarySearchTree_Internal.h"
+#import "CHBTree.h"
+
+/*
+ The number of array entries in a 64-byte cache line. The descendants of index k which are this many levels down (log2 of the stride) start at index k*stride and are contiguous, so a search prefetches that line while it compares the object at k.
+ */
+#define kCHFrozenPrefetchStride (64 / sizeof(id))
+
+#if defined(__GNUC__)
+#define CHPrefetch(address) __builtin_prefetch(address)
+#else
+#define CHPrefetch(address)
+#endif
+
+// Copies sorted objects into the subtree rooted at index k of a layout with n objects, and returns the index of the next object to copy.
+static NSUInteger fillLayout(id *layout, NSUInteger n, NSUInteger k,
+                             id *sorted, NSUInteger next)
+{
+	if (k <= n) {
+		next = fillLayout(layout, n, 2 * k, sorted, next);
+		layout[k] = [sorted[next++] retain];
+		next = fillLayout(layout, n, 2 * k + 1, sorted, next);
+	}
+	return next;
+}
+
+/**
+ Finds the first object in a layout which is greater than (or equal to) a given object, without branching on the comparisons.
+ 
+ @param comparator The comparison state of the set. Since the set may be searched from several threads at once, this should be a copy on the caller's stack, so that the cached @c -compare: method is never updated by two threads at once.
+ @param layout The objects in Eytzinger order.
+ @param n The number of objects in @a layout.
+ @param anObject The object to search for.
+ @param orEqual Whether an object equal to @a anObject is a match.
+ @return The index of the matching object, or 0 if every object is less than (or equal to) @a anObject.
+ */
+static inline NSUInteger searchLayout(CHSearchTreeComparator *comparator,
+                                      id *layout, NSUInteger n,
+                                      id anObject, BOOL orEqual)
+{
+	// The search goes right past every object that compares less than this.
+	NSComparisonResult limit = orEqual ? NSOrderedSame : NSOrderedDescending;
+	NSUInteger k = 1;
+	while (k <= n) {
+		CHPrefetch(layout + k * kCHFrozenPrefetchStride);
+		k = 2 * k + (CHSearchTreeCompare(comparator, layout[k], anObject) < limit);
+	}
+	// The path went right at each trailing 1 bit of k, and last went left at the 0 bit before them; that left turn was at the match.
+	return k >> __builtin_ffsl((long) ~k);
+}
+
+// Returns the index of the object after the one at index k, or 0 if it is last.
+static inline NSUInteger successorIndex(NSUInteger k, NSUInteger n) {
+	if (2 * k + 1 <= n) {
+		k = 2 * k + 1;
+		while (2 * k <= n)
+			k = 2 * k;
+		return k;
+	}
+	// Climb while k is a right child; its parent follows it if it is a left child.
+	while (k & 1)
+		k >>= 1;
+	return k >> 1;
+}
+
+// Returns the index of the object before the one at index k, or 0 if it is first.
+static inline NSUInteger predecessorIndex(NSUInteger k, NSUInteger n) {
+	if (2 * k <= n) {
+		k = 2 * k;
+		while (2 * k + 1 <= n)
+			k = 2 * k + 1;
+		return k;
+	}
+	// Climb while k is a left child; its parent precedes it if it is a right child.
+	while ((k & 1) == 0)
+		k >>= 1;
+	return k >> 1;
+}
+
+// Returns the index of the least object (the leftmost), or 0 if there are none.
+static inline NSUInteger firstIndex(NSUInteger n) {
+	if (n == 0)
+		return 0;
+	NSUInteger k = 1;
+	while (2 * k <= n)
+		k = 2 * k;
+	return k;
+}
+
+// Returns the index of the greatest object (the rightmost), or 0 if there are none.
+static inline NSUInteger lastIndex(NSUInteger n) {
+	if (n == 0)
+		return 0;
+	NSUInteger k = 1;
+	while (2 * k + 1 <= n)
+		k = 2 * k + 1;
+	return k;
+}
+
+#pragma mark -
+
+/**
+ An NSEnumerator for traversing a CHFrozenSortedSet in ascending or descending order. Since the set cannot change, there is no need to check for mutations; as with other enumerators in this framework, the set is retained until the last object is enumerated.
+ */
+@interface CHFrozenSortedSetEnumerator : NSEnumerator
+{
+	__strong CHFrozenSortedSet *sortedSet; // The set being enumerated.
+	__strong id *layout; // The objects of the set in Eytzinger order.
+	NSUInteger count; // The number of objects in the set.
+	NSUInteger index; // The index of the next object, or 0 when finished.
+	BOOL ascending; // Whether to enumerate in ascending order.
+}
+
+/**
+ Create an enumerator which starts at one end of a frozen set.
+ 
+ @param set The set being enumerated; it is retained until all its objects have been enumerated.
+ @param objects The objects of @a set in Eytzinger order.
+ @param objectCount The number of objects in @a set.
+ @param isAscending Whether to enumerate objects in ascending or descending order.
+ @return An initialized CHFrozenSortedSetEnumerator which will enumerate the objects in @a set.
+ */
+- (id) initWithSortedSet:(CHFrozenSortedSet*)set
+                 objects:(id*)objects
+                   count:(NSUInteger)objectCount
+               ascending:(BOOL)isAscending;
+
+- (NSArray*) allObjects;
+
+- (id) nextObject;
+
+@end
+
+@implementation CHFrozenSortedSetEnumerator
+
+- (id) initWithSortedSet:(CHFrozenSortedSet*)set
+                 objects:(id*)objects
+                   count:(NSUInteger)objectCount
+               ascending:(BOOL)isAscending
+{
+	if ((self = [super init]) == nil) return nil;
+	sortedSet = (objectCount > 0) ? [set retain] : nil;
+	layout = objects;
+	count = objectCount;
+	ascending = isAscending;
+	index = ascending ? firstIndex(count) : lastIndex(count);
+	return self;
+}
+
+- (void) dealloc {
+	[sortedSet release];
+	[super dealloc];
+}
+
+- (NSArray*) allObjects {
+	NSMutableArray *array = [[NSMutableArray alloc] init];
+	id anObject;
+	while ((anObject = [self nextObject]))
+		[array addObject:anObject];
+	return [array autorelease];
+}
+
+- (id) nextObject {
+	if (index == 0) {
+		[sortedSet release];
+		sortedSet = nil;
+		return nil;
+	}
+	id anObject = layout[index];
+	index = ascending ? successorIndex(index, count) : predecessorIndex(index, count);
+	return anObject;
+}
+
+@end
+
+#pragma mark -
+
+@implementation CHFrozenSortedSet
+
+- (void) dealloc {
+	if (kCHGarbageCollectionNotEnabled) {
+		for (NSUInteger k = 1; k <= count; k++)
+			[objects[k] release];
+		free(objects);
+	}
+	CHSearchTreeComparatorFree(comparator);
+	[super dealloc];
+}
+
+- (id) init {
+	return [self initWithSortedObjects:[NSArray array] comparator:NULL];
+}
+
+// A B+ tree sorts the objects and resolves duplicates exactly as other sorted sets do.
+- (id) initWithArray:(NSArray*)anArray {
+	CHBTree *tree = [[CHBTree alloc] initWithArray:anArray];
+	self = [self initWithSortedObjects:[tree allObjects] comparator:NULL];
+	[tree release];
+	return self;
+}
+
+#pragma mark <NSCoding>
+
+- (id) initWithCoder:(NSCoder*)decoder {
+	return [self initWithArray:[decoder decodeObjectForKey:@"objects"]];
+}
+
+- (void) encodeWithCoder:(NSCoder*)encoder {
+	[encoder encodeObject:[self allObjects] forKey:@"objects"];
+}
+
+#pragma mark <NSCopying>
+
+// Since the receiver is immutable, a copy can share it.
+- (id) copyWithZone:(NSZone*)zone {
+	return [self retain];
+}
+
+#pragma mark <NSFastEnumeration>
+
+/*
+ Each call copies the next batch of objects in sorted order into the stack buffer. The state holds the index of the next object to copy. The set never changes, so the mutations pointer refers to a value in the state which stays the same.
+ */
+- (NSUInteger) countByEnumeratingWithState:(NSFastEnumerationState*)state
+                                   objects:(id*)stackbuf
+                                     count:(NSUInteger)len
+{
+	NSUInteger k;
+	if (state->state == 0) {
+		state->mutationsPtr = &state->extra[1];
+		state->state = 1;
+		k = firstIndex(count);
+	}
+	else
+		k = state->extra[0];
+	NSUInteger batchCount = 0;
+	while (k != 0 && batchCount < len) {
+		stackbuf[batchCount++] = objects[k];
+		k = successorIndex(k, count);
+	}
+	state->extra[0] = k;
+	state->itemsPtr = stackbuf;
+	return batchCount;
+}
+
+#pragma mark Querying Contents
+
+- (NSArray*) allObjects {
+	return [[self objectEnumerator] allObjects];
+}
+
+// The root is as good as any other object, and takes no searching.
+- (id) anyObject {
+	return (count > 0) ? objects[1] : nil;
+}
+
+- (BOOL) containsObject:(id)anObject {
+	return ([self member:anObject] != nil);
+}
+
+- (NSUInteger) count {
+	return count;
+}
+
+- (NSString*) description {
+	return [[self allObjects] description];
+}
+
+- (id) firstObject {
+	return (count > 0) ? objects[firstIndex(count)] : nil;
+}
+
+- (CHFrozenSortedSet*) freeze {
+	return [[self retain] autorelease];
+}
+
+- (NSUInteger) hash {
+	return hashOfCountAndObjects(count, [self firstObject], [self lastObject]);
+}
+
+- (BOOL) isEqual:(id)otherObject {
+	if ([otherObject conformsToProtocol:@protocol(CHSortedSet)])
+		return [self isEqualToSortedSet:otherObject];
+	else
+		return NO;
+}
+
+- (BOOL) isEqualToSortedSet:(id<CHSortedSet>)otherSortedSet {
+	return collectionsAreEqual(self, otherSortedSet);
+}
+
+- (id) lastObject {
+	return (count > 0) ? objects[lastIndex(count)] : nil;
+}
+
+- (id) member:(id)anObject {
+	if (anObject == nil || count == 0)
+		return nil;
+	CHSearchTreeComparator localComparator = *comparator;
+	NSUInteger k = searchLayout(&localComparator, objects, count, anObject, YES);
+	if (k != 0 && CHSearchTreeCompare(&localComparator, objects[k], anObject) == NSOrderedSame)
+		return objects[k];
+	return nil;
+}
+
+- (NSEnumerator*) objectEnumerator {
+	return [[[CHFrozenSortedSetEnumerator alloc] initWithSortedSet:self
+	                                                       objects:objects
+	                                                         count:count
+	                                                     ascending:YES] autorelease];
+}
+
+- (id) objectGreaterThan:(id)anObject {
+	if (anObject == nil || count == 0)
+		return nil;
+	CHSearchTreeComparator localComparator = *comparator;
+	NSUInteger k = searchLayout(&localComparator, objects, count, anObject, NO);
+	return (k != 0) ? objects[k] : nil;
+}
+
+- (id) objectGreaterThanOrEqualTo:(id)anObject {
+	if (anObject == nil || count == 0)
+		return nil;
+	CHSearchTreeComparator localComparator = *comparator;
+	NSUInteger k = searchLayout(&localComparator, objects, count, anObject, YES);
+	return (k != 0) ? objects[k] : nil;
+}
+
+// The answer precedes the first object which is greater than or equal to anObject.
+- (id) objectLessThan:(id)anObject {
+	if (anObject == nil || count == 0)
+		return nil;
+	CHSearchTreeComparator localComparator = *comparator;
+	NSUInteger k = searchLayout(&localComparator, objects, count, anObject, YES);
+	k = (k != 0) ? predecessorIndex(k, count) : lastIndex(count);
+	return (k != 0) ? objects[k] : nil;
+}
+
+- (id) objectLessThanOrEqualTo:(id)anObject {
+	if (anObject == nil || count == 0)
+		return nil;
+	CHSearchTreeComparator localComparator = *comparator;
+	NSUInteger k = searchLayout(&localComparator, objects, count, anObject, NO);
+	k = (k != 0) ? predecessorIndex(k, count) : lastIndex(count);
+	return (k != 0) ? objects[k] : nil;
+}
+
+- (NSEnumerator*) reverseObjectEnumerator {
+	return [[[CHFrozenSortedSetEnumerator alloc] initWithSortedSet:self
+	                                                       objects:objects
+	                                                         count:count
+	                                                     ascending:NO] autorelease];
+}
+
+- (CHSearchTreeComparator*) searchTreeComparator {
+	return comparator;
+}
+
+// Order doesn't matter, so the array is read straight through.
+- (NSSet*) set {
+	NSMutableSet *set = [NSMutableSet setWithCapacity:count];
+	for (NSUInteger k = 1; k <= count; k++)
+		[set addObject:objects[k]];
+	return set;
+}
+
+/*
+ \copydoc CHSortedSet::subsetFromObject:toObject:
+ 
+ \attention This implementation finds the endpoints in O(log n) time, and copies the objects between them in sorted order. The subset is also a CHFrozenSortedSet, with the same ordering as the receiver.
+ */
+- (id<CHSortedSet>) subsetFromObject:(id)start
+                            toObject:(id)end
+                             options:(CHSubsetConstructionOptions)options
+{
+	// If both parameters are nil, the whole set is included, and it may be shared.
+	if (start == nil && end == nil)
+		return [[self copy] autorelease];
+
+	// The index of the first object in the range, and of the first object after it (0 for the end).
+	NSUInteger low = firstIndex(count), high = 0;
+	CHSearchTreeComparator localComparator = *comparator;
+	if (start != nil && count > 0)
+		low = searchLayout(&localComparator, objects, count, start,
+		                   !(options & CHSubsetExcludeLowEndpoint));
+	if (end != nil && count > 0)
+		high = searchLayout(&localComparator, objects, count, end,
+		                    (options & CHSubsetExcludeHighEndpoint) != 0);
+
+	NSMutableArray *subsetObjects = [NSMutableArray array];
+	NSUInteger k;
+	if (start == nil || end == nil || CHSearchTreeCompare(&localComparator, start, end) != NSOrderedDescending) {
+		// Include subset of objects between the range parameters. If the endpoints are equal and excluded, the range may be "inside out", which leaves nothing in between.
+		BOOL isEmpty = (low == 0) || (high != 0 &&
+			CHSearchTreeCompare(&localComparator, objects[low], objects[high]) != NSOrderedAscending);
+		for (k = isEmpty ? 0 : low; k != high && k != 0; k = successorIndex(k, count))
+			[subsetObjects addObject:objects[k]];
+	}
+	else {
+		// Include subset of objects NOT between the range parameters. The ones up to the end come first, since they are all less than the ones after start.
+		for (k = firstIndex(count); k != high && k != 0; k = successorIndex(k, count))
+			[subsetObjects addObject:objects[k]];
+		for (k = low; k != 0; k = successorIndex(k, count))
+			[subsetObjects addObject:objects[k]];
+	}
+	return [[[[self class] alloc] initWithSortedObjects:subsetObjects
+	                                         comparator:comparator] autorelease];
+}
+
+#pragma mark Modifying Contents
+
+- (void) addObject:(id)anObject {
+	CHUnsupportedOperationException([self class], _cmd);
+}
+
+- (void) addObjectsFromArray:(NSArray*)anArray {
+	CHUnsupportedOperationException([self class], _cmd);
+}
+
+- (void) removeAllObjects {
+	CHUnsupportedOperationException([self class], _cmd);
+}
+
+- (void) removeFirstObject {
+	CHUnsupportedOperationException([self class], _cmd);
+}
+
+- (void) removeLastObject {
+	CHUnsupportedOperationException([self class], _cmd);
+}
+
+- (void) removeObject:(id)anObject {
+	CHUnsupportedOperationException([self class], _cmd);
+}
+
+@end
+
+#pragma mark -
+
+@implementation CHFrozenSortedSet (Freezing)
+
+- (id) initWithSortedObjects:(NSArray*)sortedObjects
+                  comparator:(CHSearchTreeComparator*)sourceComparator
+{
+	if ((self = [super init]) == nil) return nil;
+	comparator = CHSearchTreeComparatorCreate(nil);
+	if (sourceComparator != NULL) {
+		CHSearchTreeComparatorCopy(comparator, sourceComparator);
+		comparator->headerObject = nil;
+	}
+	count = [sortedObjects count];
+	objects = NSAllocateCollectable((count + 1) * kCHPointerSize, NSScannedOption);
+	objects[0] = nil;
+	if (count > 0) {
+		id *sorted = NSAllocateCollectable(count * kCHPointerSize, NSScannedOption);
+		[sortedObjects getObjects:sorted range:NSMakeRange(0, count)];
+		fillLayout(objects, count, 1, sorted, 0);
+		if (kCHGarbageCollectionNotEnabled)
+			free(sorted);
+	}
+	return self;
+}
+
+@end
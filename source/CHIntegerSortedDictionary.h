@@ -0,0 +1,177 @@
+/*
+ CHDataStructures.framework -- CHIntegerSortedDictionary.h
+ 
+ Copyright (c) 2010, Quinn Taylor <http://homepage.mac.com/quinntaylor>
+ 
+ This source code is released under the ISC License. <http://www.opensource.org/licenses/isc-license>
+ 
+ Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted, provided that the above copyright notice and this permission notice appear in all copies.
+ 
+ The software is  provided "as is", without warranty of any kind, including all implied warranties of merchantability and fitness. In no event shall the authors or copyright holders be liable for any claim, damages, or other liability, whether in an action of contract, tort, or otherwise, arising from, out of, or in connection with the software or the use or other dealings in the software.
+ */
+
+#import "CHSortedSet.h"
+
+/**
+ @file CHIntegerSortedDictionary.h
+ A dictionary with 64-bit integer keys, which are stored directly rather than boxed in objects, and enumerated in sorted order.
+ */
+
+// Opaque tree storage; defined in CHIntegerSortedSet_Internal.h
+struct CHIntegerBTree;
+
+/**
+ A dictionary whose keys are 64-bit signed integers, kept in sorted order. Compared to a CHSortedDictionary with NSNumber keys, there is no object to allocate for each key, and no @c -compare: or @c -hash messages; the keys are compared with ordinary arithmetic.
+ 
+ The entries are kept in the same kind of <a href="http://en.wikipedia.org/wiki/B%2B_tree">B+ tree</a> as a CHIntegerSortedSet, with each leaf holding up to 64 keys and the corresponding objects in parallel arrays. Looking up, adding, or removing an entry takes O(log n) time, and entries are enumerated by walking the linked leaves in order.
+ 
+ The methods mirror those of NSMutableDictionary and CHSortedDictionary, with integers in place of key objects. Objects are retained when they are added, as with NSMutableDictionary, and may not be @c nil.
+ */
+@interface CHIntegerSortedDictionary : NSObject <NSCoding, NSCopying>
+{
+	__strong struct CHIntegerBTree *tree; // The keys, and the object for each key.
+	unsigned long mutations; // Tracks mutations for enumeration.
+}
+
+#pragma mark Querying Contents
+/** @name Querying Contents */
+// @{
+
+/**
+ Returns the number of entries in the receiver.
+ 
+ @return The number of entries in the receiver.
+ */
+- (NSUInteger) count;
+
+/**
+ Returns the object for a given key.
+ 
+ @param key The key for which to return the object.
+ @return The object for @a key, or @c nil if the receiver has no entry for @a key.
+ */
+- (id) objectForIntegerKey:(int64_t)key;
+
+/**
+ Finds the least key in the receiver.
+ 
+ @param key Set to the least key in the receiver, if there is one.
+ @return @c YES if the receiver has any entries, otherwise @c NO (and @a key is not changed).
+ */
+- (BOOL) getFirstKey:(int64_t*)key;
+
+/**
+ Finds the greatest key in the receiver.
+ 
+ @param key Set to the greatest key in the receiver, if there is one.
+ @return @c YES if the receiver has any entries, otherwise @c NO (and @a key is not changed).
+ */
+- (BOOL) getLastKey:(int64_t*)key;
+
+/**
+ Finds the greatest key in the receiver which is less than or equal to a given integer.
+ 
+ @param result Set to the key which was found, if there is one.
+ @param key The integer to compare against; need not be a key in the receiver.
+ @return @c YES if there is such a key in the receiver, otherwise @c NO.
+ 
+ @see CHSortedDictionary#floorKey:
+ */
+- (BOOL) getFloorKey:(int64_t*)result forKey:(int64_t)key;
+
+/**
+ Finds the least key in the receiver which is greater than or equal to a given integer.
+ 
+ @param result Set to the key which was found, if there is one.
+ @param key The integer to compare against; need not be a key in the receiver.
+ @return @c YES if there is such a key in the receiver, otherwise @c NO.
+ 
+ @see CHSortedDictionary#ceilingKey:
+ */
+- (BOOL) getCeilingKey:(int64_t*)result forKey:(int64_t)key;
+
+/**
+ Copies entries from the receiver into a pair of buffers, in ascending order of their keys, starting with the least key greater than or equal to a given integer. The objects are not retained.
+ 
+ @param keys A C array which can hold at least @a maxCount keys.
+ @param objects A C array which can hold at least @a maxCount objects, or @c NULL if the objects are not needed.
+ @param maxCount The most entries to copy.
+ @param start The integer to start from; need not be a key in the receiver.
+ @return The number of entries copied, which is less than @a maxCount only if the entry for the last key in the receiver was copied.
+ */
+- (NSUInteger) getKeys:(int64_t*)keys
+               objects:(id*)objects
+              maxCount:(NSUInteger)maxCount
+         startingAtKey:(int64_t)start;
+
+#if NS_BLOCKS_AVAILABLE
+/**
+ Calls a block with each key and object in the receiver, in ascending order of the keys.
+ 
+ @param block The block to call, which may set @a stop to @c YES to stop the enumeration.
+ 
+ @throw NSGenericException If the receiver is modified during the enumeration.
+ */
+- (void) enumerateKeysAndObjectsUsingBlock:(void (^)(int64_t key, id obj, BOOL *stop))block;
+
+/**
+ Calls a block with each key and object in the receiver, in ascending order of the keys, or in descending order if @a opts includes @c NSEnumerationReverse. (@c NSEnumerationConcurrent is ignored.)
+ 
+ @param opts Options for the enumeration.
+ @param block The block to call, which may set @a stop to @c YES to stop the enumeration.
+ 
+ @throw NSGenericException If the receiver is modified during the enumeration.
+ */
+- (void) enumerateKeysAndObjectsWithOptions:(NSEnumerationOptions)opts
+                                 usingBlock:(void (^)(int64_t key, id obj, BOOL *stop))block;
+#endif
+
+/**
+ Compares the receiver to another dictionary with integer keys.
+ 
+ @param otherDictionary A dictionary with integer keys.
+ @return @c YES if @a otherDictionary has the same keys as the receiver, and the objects for each key satisfy the \link NSObject#isEqual: -isEqual:\endlink test, otherwise @c NO.
+ */
+- (BOOL) isEqualToIntegerSortedDictionary:(CHIntegerSortedDictionary*)otherDictionary;
+
+/**
+ Returns a new dictionary containing the entries for keys delineated by two given integers, in O(log n + k) time for a subset of k entries. The endpoints work just as for \link CHSortedDictionary#subsetFromKey:toKey:options: -[CHSortedDictionary subsetFromKey:toKey:options:]\endlink; pass @c INT64_MIN or @c INT64_MAX for an endpoint which should not limit the subset.
+ 
+ @param start Low endpoint of the subset; need not be a key in the receiver.
+ @param end High endpoint of the subset; need not be a key in the receiver.
+ @param options A combination of @c CHSubsetConstructionOptions values.
+ @return A new (autoreleased) dictionary containing the entries delineated by @a start and @a end. If @a start is greater than @a end, it contains the entries whose keys are @b not between them.
+ */
+- (CHIntegerSortedDictionary*) subsetFromIntegerKey:(int64_t)start
+                                       toIntegerKey:(int64_t)end
+                                            options:(CHSubsetConstructionOptions)options;
+
+// @}
+#pragma mark Modifying Contents
+/** @name Modifying Contents */
+// @{
+
+/**
+ Removes all entries from the receiver.
+ */
+- (void) removeAllObjects;
+
+/**
+ Removes the entry for a given key from the receiver, and releases its object. If the receiver has no entry for @a key, there is no effect.
+ 
+ @param key The key to remove from the receiver.
+ */
+- (void) removeObjectForIntegerKey:(int64_t)key;
+
+/**
+ Adds an entry to the receiver, replacing (and releasing) the object if there is already an entry for the key.
+ 
+ @param anObject The object for @a key; it is retained by the receiver.
+ @param key The key for @a anObject.
+ 
+ @throw NSInvalidArgumentException If @a anObject is @c nil.
+ */
+- (void) setObject:(id)anObject forIntegerKey:(int64_t)key;
+
+// @}
+@end
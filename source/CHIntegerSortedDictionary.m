@@ -0,0 +1,220 @@
+/*
+ CHDataStructures.framework -- CHIntegerSortedDictionary.m
+ 
+ Copyright (c) 2010, Quinn Taylor <http://homepage.mac.com/quinntaylor>
+ 
+ This source code is released under the ISC License. <http://www.opensource.org/licenses/isc-license>
+ 
+ Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted, provided that the above copyright notice and this permission notice appear in all copies.
+ 
+ The software is  provided "as is", without warranty of any kind, including all implied warranties of merchantability and fitness. In no event shall the authors or copyright holders be liable for any claim, damages, or other liability, whether in an action of contract, tort, or otherwise, arising from, out of, or in connection with the software or the use or other dealings in the software.
+ */
+
+#import "CHIntegerSortedDictionary.h"
+#import "CHIntegerSortedSet_Internal.h"
+
+@implementation CHIntegerSortedDictionary
+
+- (void) dealloc {
+	CHIntegerBTreeFree(tree);
+	[super dealloc];
+}
+
+- (id) init {
+	if ((self = [super init]) == nil) return nil;
+	tree = CHIntegerBTreeCreate(YES);
+	return self;
+}
+
+#pragma mark <NSCoding>
+
+// The keys are archived in ascending order as little-endian bytes, with the objects in the same order, so the dictionary is rebuilt in O(n) time.
+- (id) initWithCoder:(NSCoder*)decoder {
+	if ([self init] == nil) return nil;
+	NSUInteger length = 0;
+	const uint8_t *bytes = [decoder decodeBytesForKey:@"keys" returnedLength:&length];
+	NSArray *objectArray = [decoder decodeObjectForKey:@"objects"];
+	NSUInteger count = MIN(length / sizeof(int64_t), [objectArray count]), i;
+	int64_t *keys = malloc(MAX(count, 1) * sizeof(int64_t));
+	memcpy(keys, bytes, count * sizeof(int64_t));
+	for (i = 0; i < count; i++)
+		keys[i] = NSSwapLittleLongLongToHost(keys[i]);
+	for (i = 1; i < count; i++)
+		if (keys[i-1] >= keys[i])
+			break;
+	if (i >= count) {
+		id *objects = NSAllocateCollectable(MAX(count, 1) * kCHPointerSize, NSScannedOption);
+		[objectArray getObjects:objects range:NSMakeRange(0, count)];
+		CHIntegerBTreeBuild(tree, keys, objects, count);
+		if (kCHGarbageCollectionNotEnabled)
+			free(objects);
+	}
+	else {
+		for (i = 0; i < count; i++)
+			[self setObject:[objectArray objectAtIndex:i] forIntegerKey:keys[i]];
+	}
+	free(keys);
+	return self;
+}
+
+- (void) encodeWithCoder:(NSCoder*)encoder {
+	NSUInteger count = tree->count;
+	int64_t *keys = malloc(MAX(count, 1) * sizeof(int64_t));
+	id *objects = NSAllocateCollectable(MAX(count, 1) * kCHPointerSize, NSScannedOption);
+	CHIntegerBTreeCopy(CHIntegerBTreeFirst(tree), keys, objects, count);
+	for (NSUInteger i = 0; i < count; i++)
+		keys[i] = NSSwapHostLongLongToLittle(keys[i]);
+	[encoder encodeBytes:(const uint8_t*)keys length:count * sizeof(int64_t) forKey:@"keys"];
+	[encoder encodeObject:[NSArray arrayWithObjects:objects count:count] forKey:@"objects"];
+	free(keys);
+	if (kCHGarbageCollectionNotEnabled)
+		free(objects);
+}
+
+#pragma mark <NSCopying>
+
+// The copy shares the objects, as with NSMutableDictionary.
+- (id) copyWithZone:(NSZone*)zone {
+	CHIntegerSortedDictionary *newDictionary = [[[self class] allocWithZone:zone] init];
+	CHIntegerBTreeBuildSubset(newDictionary->tree, tree, INT64_MIN, INT64_MAX, 0);
+	return newDictionary;
+}
+
+#pragma mark Querying Contents
+
+- (NSUInteger) count {
+	return tree->count;
+}
+
+- (NSString*) description {
+	NSMutableString *description = [NSMutableString stringWithString:@"{"];
+	CHIntegerBTreePosition position;
+	for (position = CHIntegerBTreeFirst(tree); position.leaf != NULL;
+	     position = CHIntegerBTreeNext(position))
+	{
+		[description appendFormat:@"\n    %lld = %@;",
+		                          (long long) position.leaf->keys[position.index],
+		                          (id) position.leaf->slots[position.index]];
+	}
+	[description appendString:@"\n}"];
+	return description;
+}
+
+#if NS_BLOCKS_AVAILABLE
+- (void) enumerateKeysAndObjectsUsingBlock:(void (^)(int64_t key, id obj, BOOL *stop))block {
+	[self enumerateKeysAndObjectsWithOptions:0 usingBlock:block];
+}
+
+- (void) enumerateKeysAndObjectsWithOptions:(NSEnumerationOptions)opts
+                                 usingBlock:(void (^)(int64_t key, id obj, BOOL *stop))block
+{
+	if (tree->count == 0)
+		return;
+	BOOL reverse = (opts & NSEnumerationReverse) != 0, stop = NO;
+	unsigned long mutationCount = mutations;
+	CHIntegerBTreePosition position = reverse ? CHIntegerBTreeLast(tree) : CHIntegerBTreeFirst(tree);
+	while (position.leaf != NULL && !stop) {
+		block(position.leaf->keys[position.index], (id) position.leaf->slots[position.index], &stop);
+		if (mutations != mutationCount)
+			CHMutatedCollectionException([self class], _cmd);
+		position = reverse ? CHIntegerBTreePrevious(tree, position) : CHIntegerBTreeNext(position);
+	}
+}
+#endif
+
+- (BOOL) getCeilingKey:(int64_t*)result forKey:(int64_t)key {
+	CHIntegerBTreePosition position = CHIntegerBTreeFind(tree, key, YES);
+	if (position.leaf == NULL)
+		return NO;
+	*result = position.leaf->keys[position.index];
+	return YES;
+}
+
+- (BOOL) getFirstKey:(int64_t*)key {
+	if (tree->count == 0)
+		return NO;
+	*key = tree->firstLeaf->keys[0];
+	return YES;
+}
+
+// The floor precedes the first key which is greater than 'key'.
+- (BOOL) getFloorKey:(int64_t*)result forKey:(int64_t)key {
+	CHIntegerBTreePosition position = CHIntegerBTreeFind(tree, key, NO);
+	position = CHIntegerBTreePrevious(tree, position);
+	if (position.leaf == NULL)
+		return NO;
+	*result = position.leaf->keys[position.index];
+	return YES;
+}
+
+- (NSUInteger) getKeys:(int64_t*)keys
+               objects:(id*)objects
+              maxCount:(NSUInteger)maxCount
+         startingAtKey:(int64_t)start
+{
+	return CHIntegerBTreeCopy(CHIntegerBTreeFind(tree, start, YES), keys, objects, maxCount);
+}
+
+- (BOOL) getLastKey:(int64_t*)key {
+	if (tree->count == 0)
+		return NO;
+	*key = tree->lastLeaf->keys[tree->lastLeaf->count - 1];
+	return YES;
+}
+
+- (NSUInteger) hash {
+	int64_t first = 0, last = 0;
+	[self getFirstKey:&first];
+	[self getLastKey:&last];
+	return (NSUInteger) (tree->count * 31 + (uint64_t)first * 17 + (uint64_t)last);
+}
+
+- (BOOL) isEqual:(id)otherObject {
+	if ([otherObject isKindOfClass:[CHIntegerSortedDictionary class]])
+		return [self isEqualToIntegerSortedDictionary:otherObject];
+	else
+		return NO;
+}
+
+- (BOOL) isEqualToIntegerSortedDictionary:(CHIntegerSortedDictionary*)otherDictionary {
+	return CHIntegerBTreesAreEqual(tree, otherDictionary->tree);
+}
+
+- (id) objectForIntegerKey:(int64_t)key {
+	CHIntegerBTreePosition position = CHIntegerBTreeFind(tree, key, YES);
+	if (position.leaf == NULL || position.leaf->keys[position.index] != key)
+		return nil;
+	return (id) position.leaf->slots[position.index];
+}
+
+- (CHIntegerSortedDictionary*) subsetFromIntegerKey:(int64_t)start
+                                       toIntegerKey:(int64_t)end
+                                            options:(CHSubsetConstructionOptions)options
+{
+	CHIntegerSortedDictionary *subset = [[[[self class] alloc] init] autorelease];
+	CHIntegerBTreeBuildSubset(subset->tree, tree, start, end, options);
+	return subset;
+}
+
+#pragma mark Modifying Contents
+
+- (void) removeAllObjects {
+	if (tree->count == 0)
+		return;
+	++mutations;
+	CHIntegerBTreeRemoveAll(tree);
+}
+
+- (void) removeObjectForIntegerKey:(int64_t)key {
+	if (CHIntegerBTreeRemove(tree, key))
+		++mutations;
+}
+
+- (void) setObject:(id)anObject forIntegerKey:(int64_t)key {
+	if (anObject == nil)
+		CHNilArgumentException([self class], _cmd);
+	++mutations;
+	CHIntegerBTreeInsert(tree, key, anObject);
+}
+
+@end
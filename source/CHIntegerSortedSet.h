@@ -0,0 +1,233 @@
+/*
+ CHDataStructures.framework -- CHIntegerSortedSet.h
+ 
+ Copyright (c) 2010, Quinn Taylor <http://homepage.mac.com/quinntaylor>
+ 
+ This source code is released under the ISC License. <http://www.opensource.org/licenses/isc-license>
+ 
+ Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted, provided that the above copyright notice and this permission notice appear in all copies.
+ 
+ The software is  provided "as is", without warranty of any kind, including all implied warranties of merchantability and fitness. In no event shall the authors or copyright holders be liable for any claim, damages, or other liability, whether in an action of contract, tort, or otherwise, arising from, out of, or in connection with the software or the use or other dealings in the software.
+ */
+
+#import "CHSortedSet.h"
+
+/**
+ @file CHIntegerSortedSet.h
+ A sorted set of 64-bit integers, which are stored directly rather than boxed in objects.
+ */
+
+// Opaque tree storage; defined in CHIntegerSortedSet_Internal.h
+struct CHIntegerBTree;
+
+/**
+ A sorted set of 64-bit signed integers. Storing integers in a CHSortedSet means boxing each one in an NSNumber, which costs an allocation and a retain for every integer, and an Objective-C message (@c -compare:) at every step of every search. This class stores the integers themselves, and compares them with ordinary arithmetic.
+ 
+ The integers are kept in a <a href="http://en.wikipedia.org/wiki/B%2B_tree">B+ tree</a>, like the objects in a CHBTree: each leaf holds up to 64 integers in a sorted array (512 bytes), the leaves are linked together in order, and a search for an integer takes O(log n) time. Since integers are never retained or released, adding and removing them is cheap, and releasing the set only frees its nodes.
+ 
+ The methods mirror those of CHSortedSet, with integers in place of objects. Since there is no integer equivalent of @c nil, the methods which find an integer return whether there is one, and pass it back by reference. The integers in a range can be copied into a buffer in batches, or visited with a block.
+ */
+@interface CHIntegerSortedSet : NSObject <NSCoding, NSCopying>
+{
+	__strong struct CHIntegerBTree *tree; // The integers in the set.
+	unsigned long mutations; // Tracks mutations for enumeration.
+}
+
+#pragma mark Creating Sets
+/** @name Creating Sets */
+// @{
+
+/**
+ Initializes a set which contains no integers.
+ 
+ @return An initialized set which contains no integers.
+ */
+- (id) init;
+
+/**
+ Initializes a set with the integers in a C array. If the integers are in strictly ascending order, the set is built directly in O(n) time.
+ 
+ @param integers A C array of integers, which may contain duplicates.
+ @param count The number of integers in @a integers.
+ @return An initialized set which contains the integers in @a integers.
+ */
+- (id) initWithIntegers:(const int64_t*)integers count:(NSUInteger)count;
+
+// @}
+#pragma mark Querying Contents
+/** @name Querying Contents */
+// @{
+
+/**
+ Returns the number of integers in the receiver.
+ 
+ @return The number of integers in the receiver.
+ */
+- (NSUInteger) count;
+
+/**
+ Determines whether the receiver contains a given integer.
+ 
+ @param integer The integer to test for membership in the receiver.
+ @return @c YES if the receiver contains @a integer, otherwise @c NO.
+ */
+- (BOOL) containsInteger:(int64_t)integer;
+
+/**
+ Finds the least integer in the receiver.
+ 
+ @param integer Set to the least integer in the receiver, if there is one.
+ @return @c YES if the receiver contains any integers, otherwise @c NO (and @a integer is not changed).
+ */
+- (BOOL) getFirstInteger:(int64_t*)integer;
+
+/**
+ Finds the greatest integer in the receiver.
+ 
+ @param integer Set to the greatest integer in the receiver, if there is one.
+ @return @c YES if the receiver contains any integers, otherwise @c NO (and @a integer is not changed).
+ */
+- (BOOL) getLastInteger:(int64_t*)integer;
+
+/**
+ Finds the least integer in the receiver which is greater than a given integer.
+ 
+ @param result Set to the integer which was found, if there is one.
+ @param integer The integer to compare against; need not be in the receiver.
+ @return @c YES if there is such an integer in the receiver, otherwise @c NO.
+ 
+ @see CHSortedSet#objectGreaterThan:
+ */
+- (BOOL) getInteger:(int64_t*)result greaterThan:(int64_t)integer;
+
+/**
+ Finds the least integer in the receiver which is greater than or equal to a given integer.
+ 
+ @param result Set to the integer which was found, if there is one.
+ @param integer The integer to compare against; need not be in the receiver.
+ @return @c YES if there is such an integer in the receiver, otherwise @c NO.
+ 
+ @see CHSortedSet#objectGreaterThanOrEqualTo:
+ */
+- (BOOL) getInteger:(int64_t*)result greaterThanOrEqualTo:(int64_t)integer;
+
+/**
+ Finds the greatest integer in the receiver which is less than a given integer.
+ 
+ @param result Set to the integer which was found, if there is one.
+ @param integer The integer to compare against; need not be in the receiver.
+ @return @c YES if there is such an integer in the receiver, otherwise @c NO.
+ 
+ @see CHSortedSet#objectLessThan:
+ */
+- (BOOL) getInteger:(int64_t*)result lessThan:(int64_t)integer;
+
+/**
+ Finds the greatest integer in the receiver which is less than or equal to a given integer.
+ 
+ @param result Set to the integer which was found, if there is one.
+ @param integer The integer to compare against; need not be in the receiver.
+ @return @c YES if there is such an integer in the receiver, otherwise @c NO.
+ 
+ @see CHSortedSet#objectLessThanOrEqualTo:
+ */
+- (BOOL) getInteger:(int64_t*)result lessThanOrEqualTo:(int64_t)integer;
+
+/**
+ Copies integers from the receiver into a buffer, in ascending order, starting with the least integer greater than or equal to a given integer. To copy all the integers in batches, start from @c INT64_MIN, then start each later batch just past the last integer of the one before.
+ 
+ @param buffer A C array which can hold at least @a maxCount integers.
+ @param maxCount The most integers to copy.
+ @param start The integer to start from; need not be in the receiver.
+ @return The number of integers copied into @a buffer, which is less than @a maxCount only if the last integer in the receiver was copied.
+ */
+- (NSUInteger) getIntegers:(int64_t*)buffer
+                  maxCount:(NSUInteger)maxCount
+         startingAtInteger:(int64_t)start;
+
+#if NS_BLOCKS_AVAILABLE
+/**
+ Calls a block with each integer in the receiver, in ascending order.
+ 
+ @param block The block to call, which may set @a stop to @c YES to stop the enumeration.
+ 
+ @throw NSGenericException If the receiver is modified during the enumeration.
+ */
+- (void) enumerateIntegersUsingBlock:(void (^)(int64_t integer, BOOL *stop))block;
+
+/**
+ Calls a block with each integer in the receiver, in ascending order, or in descending order if @a opts includes @c NSEnumerationReverse. (@c NSEnumerationConcurrent is ignored.)
+ 
+ @param opts Options for the enumeration.
+ @param block The block to call, which may set @a stop to @c YES to stop the enumeration.
+ 
+ @throw NSGenericException If the receiver is modified during the enumeration.
+ */
+- (void) enumerateIntegersWithOptions:(NSEnumerationOptions)opts
+                           usingBlock:(void (^)(int64_t integer, BOOL *stop))block;
+#endif
+
+/**
+ Compares the receiver to another set of integers.
+ 
+ @param otherSet A set of integers.
+ @return @c YES if @a otherSet contains exactly the same integers as the receiver, otherwise @c NO.
+ */
+- (BOOL) isEqualToIntegerSortedSet:(CHIntegerSortedSet*)otherSet;
+
+/**
+ Returns a new set containing the integers delineated by two given integers, in O(log n + k) time for a subset of k integers. The endpoints work just as for \link CHSortedSet#subsetFromObject:toObject:options: -[CHSortedSet subsetFromObject:toObject:options:]\endlink; pass @c INT64_MIN or @c INT64_MAX for an endpoint which should not limit the subset.
+ 
+ @param start Low endpoint of the subset; need not be in the receiver.
+ @param end High endpoint of the subset; need not be in the receiver.
+ @param options A combination of @c CHSubsetConstructionOptions values.
+ @return A new (autoreleased) set containing the integers delineated by @a start and @a end. If @a start is greater than @a end, it contains the integers which are @b not between them.
+ */
+- (CHIntegerSortedSet*) subsetFromInteger:(int64_t)start
+                                toInteger:(int64_t)end
+                                  options:(CHSubsetConstructionOptions)options;
+
+// @}
+#pragma mark Modifying Contents
+/** @name Modifying Contents */
+// @{
+
+/**
+ Adds an integer to the receiver, if it is not already a member.
+ 
+ @param integer The integer to add to the receiver.
+ */
+- (void) addInteger:(int64_t)integer;
+
+/**
+ Adds the integers in a C array to the receiver. If the receiver is empty and the integers are in strictly ascending order, the set is built directly in O(n) time.
+ 
+ @param integers A C array of integers, which may contain duplicates.
+ @param count The number of integers in @a integers.
+ */
+- (void) addIntegers:(const int64_t*)integers count:(NSUInteger)count;
+
+/**
+ Removes all integers from the receiver.
+ */
+- (void) removeAllIntegers;
+
+/**
+ Removes the least integer from the receiver, if there is one.
+ */
+- (void) removeFirstInteger;
+
+/**
+ Removes the greatest integer from the receiver, if there is one.
+ */
+- (void) removeLastInteger;
+
+/**
+ Removes an integer from the receiver. If the receiver does not contain @a integer, there is no effect.
+ 
+ @param integer The integer to remove from the receiver.
+ */
+- (void) removeInteger:(int64_t)integer;
+
+// @}
+@end
@@ -0,0 +1,554 @@
+/*
+ CHDataStructures.framework -- CHIntegerSortedSet.m
+ 
+ Copyright (c) 2010, Quinn Taylor <http://homepage.mac.com/quinntaylor>
+ 
+ This source code is released under the ISC License. <http://www.opensource.org/licenses/isc-license>
+ 
+ Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted, provided that the above copyright notice and this permission notice appear in all copies.
+ 
+ The software is  provided "as is", without warranty of any kind, including all implied warranties of merchantability and fitness. In no event shall the authors or copyright holders be liable for any claim, damages, or other liability, whether in an action of contract, tort, or otherwise, arising from, out of, or in connection with the software or the use or other dealings in the software.
+ */
+
+#import "CHIntegerSortedSet_Internal.h"
+
+// Moves keys within or between nodes.
+#define CHMoveKeys(dst,src,n) memmove((dst), (src), sizeof(int64_t) * (n))
+
+// Moves children or objects within or between nodes, which the garbage collector must know about.
+#define CHMoveSlots(dst,src,n) objc_memmove_collectable((dst), (src), kCHPointerSize * (n))
+
+// A leaf in a set has no slots, so it is about half the size.
+static size_t kCHIntegerBTreeKeyLeafSize = offsetof(CHIntegerBTreeNode, slots);
+static size_t kCHIntegerBTreeNodeSize = sizeof(CHIntegerBTreeNode);
+
+static CHIntegerBTreeNode* createNode(CHIntegerBTree *tree, BOOL isLeaf) {
+	size_t size = (isLeaf && !tree->hasValues) ? kCHIntegerBTreeKeyLeafSize : kCHIntegerBTreeNodeSize;
+	CHIntegerBTreeNode *node = NSAllocateCollectable(size, NSScannedOption);
+	node->count = 0;
+	node->previous = NULL;
+	node->next = NULL;
+	return node;
+}
+
+// Releases the objects in a subtree with a given number of levels (if it has any), and frees its nodes. This is never needed with GC, since dropping the root unroots the tree.
+static void freeSubtree(CHIntegerBTreeNode *node, NSUInteger levels, BOOL hasValues) {
+	NSUInteger i;
+	if (levels > 1) {
+		for (i = 0; i < node->count; i++)
+			freeSubtree(node->slots[i], levels - 1, hasValues);
+	}
+	else if (hasValues) {
+		for (i = 0; i < node->count; i++)
+			[(id)node->slots[i] release];
+	}
+	free(node);
+}
+
+// Returns the index of the first key which is greater than or equal to a key (which may be 'keyCount').
+static inline NSUInteger lowerBound(const int64_t *keys, NSUInteger keyCount, int64_t key) {
+	NSUInteger low = 0, high = keyCount, middle;
+	while (low < high) {
+		middle = (low + high) / 2;
+		if (keys[middle] < key)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+// Returns the index of the first key which is greater than a key (which may be 'keyCount').
+static inline NSUInteger upperBound(const int64_t *keys, NSUInteger keyCount, int64_t key) {
+	NSUInteger low = 0, high = keyCount, middle;
+	while (low < high) {
+		middle = (low + high) / 2;
+		if (keys[middle] <= key)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+// Moves keys, and their objects in a dictionary, within or between leaves.
+static inline void moveEntries(CHIntegerBTree *tree, CHIntegerBTreeNode *dst, NSUInteger dstIndex,
+                               CHIntegerBTreeNode *src, NSUInteger srcIndex, NSUInteger n)
+{
+	CHMoveKeys(dst->keys + dstIndex, src->keys + srcIndex, n);
+	if (tree->hasValues)
+		CHMoveSlots(dst->slots + dstIndex, src->slots + srcIndex, n);
+}
+
+// The algorithms these trees share with CHBTree, specialized for integer keys (see CHBTree_Internal.h).
+#define CHBTreeCoreNode       CHIntegerBTreeNode
+#define CHBTreeCoreKey        int64_t
+#define CHBTreeCoreContext    CHIntegerBTree*
+#define kCHBTreeCoreCapacity  kCHIntegerBTreeNodeCapacity
+#define CHBTreeKeys(node)     ((node)->keys)
+#define CHBTreeChildren(node) ((node)->slots)
+#define CHBTreeChild(node,i)  ((CHIntegerBTreeNode*)(node)->slots[i])
+#define CHBTreeCreateNode(tree,isLeaf)    createNode((tree), (isLeaf))
+#define CHBTreeChildIndex(tree,branch,key) upperBound((branch)->keys, (branch)->count - 1, (key))
+#define CHBTreeMoveKeys(dst,src,n)        CHMoveKeys((dst), (src), (n))
+#define CHBTreeMoveChildren(dst,src,n)    CHMoveSlots((dst), (src), (n))
+#define CHBTreeMoveEntries(tree,dst,dstIndex,src,srcIndex,n) \
+	moveEntries((tree), (dst), (dstIndex), (src), (srcIndex), (n))
+#define CHBTreeRetainKey(key)   (key)
+#define CHBTreeReleaseKey(key)
+
+#import "CHBTree_Internal.h"
+
+#pragma mark Tree Operations
+
+CHIntegerBTree* CHIntegerBTreeCreate(BOOL hasValues) {
+	CHIntegerBTree *tree = NSAllocateCollectable(sizeof(CHIntegerBTree), NSScannedOption);
+	tree->root = tree->firstLeaf = tree->lastLeaf = NULL;
+	tree->height = 0;
+	tree->count = 0;
+	tree->hasValues = hasValues;
+	return tree;
+}
+
+void CHIntegerBTreeFree(CHIntegerBTree *tree) {
+	if (kCHGarbageCollectionNotEnabled) {
+		CHIntegerBTreeRemoveAll(tree);
+		free(tree);
+	}
+}
+
+void CHIntegerBTreeRemoveAll(CHIntegerBTree *tree) {
+	if (tree->root != NULL && kCHGarbageCollectionNotEnabled)
+		freeSubtree(tree->root, tree->height, tree->hasValues);
+	tree->root = tree->firstLeaf = tree->lastLeaf = NULL; // With GC, this is sufficient to unroot the tree.
+	tree->height = 0;
+	tree->count = 0;
+}
+
+BOOL CHIntegerBTreeInsert(CHIntegerBTree *tree, int64_t key, id value) {
+	if (tree->root == NULL) {
+		tree->root = tree->firstLeaf = tree->lastLeaf = createNode(tree, YES);
+		tree->height = 1;
+	}
+
+	CHBTreeCorePath path;
+	CHIntegerBTreeNode *node = findLeaf(tree, tree->root, tree->height, key, &path);
+	NSUInteger index = lowerBound(node->keys, node->count, key);
+	if (index < node->count && node->keys[index] == key) {
+		if (tree->hasValues) {
+			[value retain];
+			[(id)node->slots[index] release];
+			node->slots[index] = value;
+		}
+		return NO;
+	}
+	tree->count++;
+	CHIntegerBTreeNode *sibling;
+	node = makeRoomInLeaf(tree, node, &index, &sibling, &tree->lastLeaf);
+	node->keys[index] = key;
+	if (tree->hasValues)
+		node->slots[index] = [value retain];
+	node->count++;
+	if (sibling != NULL)
+		insertIntoParents(tree, &path, sibling, &tree->root, &tree->height);
+	return YES;
+}
+
+/*
+ After the key is removed from its leaf, any node on the path which is less than half full either borrows a key (or child) from an adjacent sibling that can spare one, or is merged with a sibling, which removes a child from the parent. This continues up the tree until a node is at least half full. If the root is left with only one child, that child becomes the root. (See removeFromLeaf() in CHBTree_Internal.h.)
+ */
+BOOL CHIntegerBTreeRemove(CHIntegerBTree *tree, int64_t key) {
+	if (tree->count == 0)
+		return NO;
+	CHBTreeCorePath path;
+	CHIntegerBTreeNode *node = findLeaf(tree, tree->root, tree->height, key, &path);
+	NSUInteger index = lowerBound(node->keys, node->count, key);
+	if (index == node->count || node->keys[index] != key)
+		return NO;
+	tree->count--;
+	if (tree->hasValues)
+		[(id)node->slots[index] release];
+	removeFromLeaf(tree, &path, node, index,
+	               &tree->root, &tree->height, &tree->firstLeaf, &tree->lastLeaf);
+	return YES;
+}
+
+CHIntegerBTreePosition CHIntegerBTreeFind(CHIntegerBTree *tree, int64_t key, BOOL orEqual) {
+	CHIntegerBTreePosition position = {NULL, 0};
+	if (tree->count == 0)
+		return position;
+	position.leaf = findLeaf(tree, tree->root, tree->height, key, NULL);
+	position.index = orEqual ? lowerBound(position.leaf->keys, position.leaf->count, key)
+	                         : upperBound(position.leaf->keys, position.leaf->count, key);
+	if (position.index == position.leaf->count) {
+		position.leaf = position.leaf->next;
+		position.index = 0;
+	}
+	return position;
+}
+
+// Fills each leaf as full as possible, then each level of branches above them. The keys (or children) are spread evenly among the nodes in each level, so every node is at least half full.
+void CHIntegerBTreeBuild(CHIntegerBTree *tree, const int64_t *keys, id *values, NSUInteger keyCount) {
+	NSCAssert(tree->count == 0, @"Can only bulk load keys into an empty tree.");
+	if (keyCount == 0)
+		return;
+	NSUInteger nodeCount = (keyCount + kCHIntegerBTreeNodeCapacity - 1) / kCHIntegerBTreeNodeCapacity;
+	// The nodes in the level being built, and the least key in each one's subtree.
+	CHIntegerBTreeNode **nodes = NSAllocateCollectable(nodeCount * kCHPointerSize, NSScannedOption);
+	int64_t *minimums = malloc(nodeCount * sizeof(int64_t));
+	CHIntegerBTreeNode *node, *previous = NULL;
+	NSUInteger i, j, size, offset = 0;
+	for (i = 0; i < nodeCount; i++) {
+		size = keyCount / nodeCount + (i < keyCount % nodeCount);
+		node = createNode(tree, YES);
+		memcpy(node->keys, keys + offset, size * sizeof(int64_t));
+		if (tree->hasValues)
+			for (j = 0; j < size; j++)
+				node->slots[j] = [values[offset + j] retain];
+		node->count = size;
+		node->previous = previous;
+		if (previous != NULL)
+			previous->next = node;
+		else
+			tree->firstLeaf = node;
+		previous = node;
+		nodes[i] = node;
+		minimums[i] = keys[offset];
+		offset += size;
+	}
+	tree->lastLeaf = previous;
+	tree->height = 1;
+	tree->root = buildBranches(tree, nodes, minimums, nodeCount, &tree->height);
+	tree->count = keyCount;
+	free(minimums);
+	if (kCHGarbageCollectionNotEnabled)
+		free(nodes);
+}
+
+// Returns the number of keys from one position up to another, which must not come before it.
+static NSUInteger countKeysBetween(CHIntegerBTreePosition from, CHIntegerBTreePosition to) {
+	NSUInteger keyCount = 0;
+	while (from.leaf != to.leaf) {
+		keyCount += from.leaf->count - from.index;
+		from.leaf = from.leaf->next;
+		from.index = 0;
+	}
+	return keyCount + to.index - from.index;
+}
+
+void CHIntegerBTreeBuildSubset(CHIntegerBTree *tree, CHIntegerBTree *source,
+                               int64_t start, int64_t end,
+                               CHSubsetConstructionOptions options)
+{
+	if (source->count == 0)
+		return;
+	// The positions of the first key in the range, and just after the last.
+	CHIntegerBTreePosition first = CHIntegerBTreeFirst(source), last = {NULL, 0};
+	CHIntegerBTreePosition low, high;
+	low = CHIntegerBTreeFind(source, start, !(options & CHSubsetExcludeLowEndpoint));
+	high = CHIntegerBTreeFind(source, end, (options & CHSubsetExcludeHighEndpoint) != 0);
+	NSUInteger lowCount, highCount; // Sizes of the (at most two) runs to copy.
+	CHIntegerBTreePosition lowStart; // Where the first run starts; the second starts at low.
+
+	if (start <= end) {
+		// Include keys between the endpoints. If they are equal and excluded, the range may be "inside out", which leaves nothing in between.
+		BOOL isEmpty = (low.leaf == NULL) ||
+			(high.leaf != NULL && low.leaf->keys[low.index] >= high.leaf->keys[high.index]);
+		lowCount = isEmpty ? 0 : countKeysBetween(low, high);
+		highCount = 0;
+		lowStart = low;
+	}
+	else {
+		// Include keys NOT between the endpoints. The ones up to the end come first, since they are all less than the ones after start.
+		lowCount = countKeysBetween(first, high);
+		highCount = (low.leaf != NULL) ? countKeysBetween(low, last) : 0;
+		lowStart = first;
+	}
+	NSUInteger total = lowCount + highCount;
+	if (total == 0)
+		return;
+
+	int64_t *keys = malloc(total * sizeof(int64_t));
+	id *values = NULL;
+	if (tree->hasValues)
+		values = NSAllocateCollectable(total * kCHPointerSize, NSScannedOption);
+	CHIntegerBTreeCopy(lowStart, keys, values, lowCount);
+	if (highCount > 0)
+		CHIntegerBTreeCopy(low, keys + lowCount, (values != NULL) ? values + lowCount : NULL, highCount);
+	CHIntegerBTreeBuild(tree, keys, values, total);
+	free(keys);
+	if (values != NULL && kCHGarbageCollectionNotEnabled)
+		free(values);
+}
+
+NSUInteger CHIntegerBTreeCopy(CHIntegerBTreePosition position, int64_t *keys, id *values,
+                              NSUInteger maxCount)
+{
+	NSUInteger copied = 0, runLength;
+	while (copied < maxCount && position.leaf != NULL) {
+		runLength = MIN(maxCount - copied, position.leaf->count - position.index);
+		memcpy(keys + copied, position.leaf->keys + position.index, runLength * sizeof(int64_t));
+		if (values != NULL)
+			memcpy(values + copied, position.leaf->slots + position.index, runLength * kCHPointerSize);
+		copied += runLength;
+		position.leaf = position.leaf->next;
+		position.index = 0;
+	}
+	return copied;
+}
+
+BOOL CHIntegerBTreesAreEqual(CHIntegerBTree *tree1, CHIntegerBTree *tree2) {
+	if (tree1->count != tree2->count || tree1->hasValues != tree2->hasValues)
+		return NO;
+	CHIntegerBTreePosition position1 = CHIntegerBTreeFirst(tree1);
+	CHIntegerBTreePosition position2 = CHIntegerBTreeFirst(tree2);
+	while (position1.leaf != NULL) {
+		if (position1.leaf->keys[position1.index] != position2.leaf->keys[position2.index])
+			return NO;
+		if (tree1->hasValues && ![(id)position1.leaf->slots[position1.index]
+		                          isEqual:(id)position2.leaf->slots[position2.index]])
+			return NO;
+		position1 = CHIntegerBTreeNext(position1);
+		position2 = CHIntegerBTreeNext(position2);
+	}
+	return YES;
+}
+
+#pragma mark -
+
+@implementation CHIntegerSortedSet
+
+- (void) dealloc {
+	CHIntegerBTreeFree(tree);
+	[super dealloc];
+}
+
+- (id) init {
+	if ((self = [super init]) == nil) return nil;
+	tree = CHIntegerBTreeCreate(NO);
+	return self;
+}
+
+- (id) initWithIntegers:(const int64_t*)integers count:(NSUInteger)count {
+	if ([self init] == nil) return nil;
+	[self addIntegers:integers count:count];
+	return self;
+}
+
+#pragma mark <NSCoding>
+
+// The integers are archived in ascending order as little-endian bytes, so the set is rebuilt in O(n) time.
+- (id) initWithCoder:(NSCoder*)decoder {
+	NSUInteger length = 0;
+	const uint8_t *bytes = [decoder decodeBytesForKey:@"integers" returnedLength:&length];
+	NSUInteger count = length / sizeof(int64_t);
+	int64_t *integers = malloc(MAX(count, 1) * sizeof(int64_t));
+	memcpy(integers, bytes, count * sizeof(int64_t));
+	for (NSUInteger i = 0; i < count; i++)
+		integers[i] = NSSwapLittleLongLongToHost(integers[i]);
+	self = [self initWithIntegers:integers count:count];
+	free(integers);
+	return self;
+}
+
+- (void) encodeWithCoder:(NSCoder*)encoder {
+	NSUInteger count = tree->count;
+	int64_t *integers = malloc(MAX(count, 1) * sizeof(int64_t));
+	CHIntegerBTreeCopy(CHIntegerBTreeFirst(tree), integers, NULL, count);
+	for (NSUInteger i = 0; i < count; i++)
+		integers[i] = NSSwapHostLongLongToLittle(integers[i]);
+	[encoder encodeBytes:(const uint8_t*)integers length:count * sizeof(int64_t) forKey:@"integers"];
+	free(integers);
+}
+
+#pragma mark <NSCopying>
+
+- (id) copyWithZone:(NSZone*)zone {
+	CHIntegerSortedSet *newSet = [[[self class] allocWithZone:zone] init];
+	CHIntegerBTreeBuildSubset(newSet->tree, tree, INT64_MIN, INT64_MAX, 0);
+	return newSet;
+}
+
+#pragma mark Querying Contents
+
+- (BOOL) containsInteger:(int64_t)integer {
+	CHIntegerBTreePosition position = CHIntegerBTreeFind(tree, integer, YES);
+	return (position.leaf != NULL && position.leaf->keys[position.index] == integer);
+}
+
+- (NSUInteger) count {
+	return tree->count;
+}
+
+- (NSString*) description {
+	NSMutableString *description = [NSMutableString stringWithString:@"("];
+	NSString *separator = @"";
+	CHIntegerBTreePosition position;
+	for (position = CHIntegerBTreeFirst(tree); position.leaf != NULL;
+	     position = CHIntegerBTreeNext(position))
+	{
+		[description appendFormat:@"%@%lld", separator, (long long) position.leaf->keys[position.index]];
+		separator = @", ";
+	}
+	[description appendString:@")"];
+	return description;
+}
+
+#if NS_BLOCKS_AVAILABLE
+- (void) enumerateIntegersUsingBlock:(void (^)(int64_t integer, BOOL *stop))block {
+	[self enumerateIntegersWithOptions:0 usingBlock:block];
+}
+
+- (void) enumerateIntegersWithOptions:(NSEnumerationOptions)opts
+                           usingBlock:(void (^)(int64_t integer, BOOL *stop))block
+{
+	if (tree->count == 0)
+		return;
+	BOOL reverse = (opts & NSEnumerationReverse) != 0, stop = NO;
+	unsigned long mutationCount = mutations;
+	CHIntegerBTreePosition position = reverse ? CHIntegerBTreeLast(tree) : CHIntegerBTreeFirst(tree);
+	while (position.leaf != NULL && !stop) {
+		block(position.leaf->keys[position.index], &stop);
+		if (mutations != mutationCount)
+			CHMutatedCollectionException([self class], _cmd);
+		position = reverse ? CHIntegerBTreePrevious(tree, position) : CHIntegerBTreeNext(position);
+	}
+}
+#endif
+
+- (BOOL) getFirstInteger:(int64_t*)integer {
+	if (tree->count == 0)
+		return NO;
+	*integer = tree->firstLeaf->keys[0];
+	return YES;
+}
+
+- (BOOL) getInteger:(int64_t*)result greaterThan:(int64_t)integer {
+	CHIntegerBTreePosition position = CHIntegerBTreeFind(tree, integer, NO);
+	if (position.leaf == NULL)
+		return NO;
+	*result = position.leaf->keys[position.index];
+	return YES;
+}
+
+- (BOOL) getInteger:(int64_t*)result greaterThanOrEqualTo:(int64_t)integer {
+	CHIntegerBTreePosition position = CHIntegerBTreeFind(tree, integer, YES);
+	if (position.leaf == NULL)
+		return NO;
+	*result = position.leaf->keys[position.index];
+	return YES;
+}
+
+// The answer precedes the first integer which is greater than or equal to 'integer'.
+- (BOOL) getInteger:(int64_t*)result lessThan:(int64_t)integer {
+	CHIntegerBTreePosition position = CHIntegerBTreeFind(tree, integer, YES);
+	position = CHIntegerBTreePrevious(tree, position);
+	if (position.leaf == NULL)
+		return NO;
+	*result = position.leaf->keys[position.index];
+	return YES;
+}
+
+- (BOOL) getInteger:(int64_t*)result lessThanOrEqualTo:(int64_t)integer {
+	CHIntegerBTreePosition position = CHIntegerBTreeFind(tree, integer, NO);
+	position = CHIntegerBTreePrevious(tree, position);
+	if (position.leaf == NULL)
+		return NO;
+	*result = position.leaf->keys[position.index];
+	return YES;
+}
+
+- (NSUInteger) getIntegers:(int64_t*)buffer
+                  maxCount:(NSUInteger)maxCount
+         startingAtInteger:(int64_t)start
+{
+	return CHIntegerBTreeCopy(CHIntegerBTreeFind(tree, start, YES), buffer, NULL, maxCount);
+}
+
+- (BOOL) getLastInteger:(int64_t*)integer {
+	if (tree->count == 0)
+		return NO;
+	*integer = tree->lastLeaf->keys[tree->lastLeaf->count - 1];
+	return YES;
+}
+
+- (NSUInteger) hash {
+	int64_t first = 0, last = 0;
+	[self getFirstInteger:&first];
+	[self getLastInteger:&last];
+	return (NSUInteger) (tree->count * 31 + (uint64_t)first * 17 + (uint64_t)last);
+}
+
+- (BOOL) isEqual:(id)otherObject {
+	if ([otherObject isKindOfClass:[CHIntegerSortedSet class]])
+		return [self isEqualToIntegerSortedSet:otherObject];
+	else
+		return NO;
+}
+
+- (BOOL) isEqualToIntegerSortedSet:(CHIntegerSortedSet*)otherSet {
+	return CHIntegerBTreesAreEqual(tree, otherSet->tree);
+}
+
+- (CHIntegerSortedSet*) subsetFromInteger:(int64_t)start
+                                toInteger:(int64_t)end
+                                  options:(CHSubsetConstructionOptions)options
+{
+	CHIntegerSortedSet *subset = [[[[self class] alloc] init] autorelease];
+	CHIntegerBTreeBuildSubset(subset->tree, tree, start, end, options);
+	return subset;
+}
+
+#pragma mark Modifying Contents
+
+- (void) addInteger:(int64_t)integer {
+	++mutations;
+	CHIntegerBTreeInsert(tree, integer, nil);
+}
+
+/*
+ If the receiver is empty and the integers are in strictly ascending order (as they are when decoding an archive), the tree is built directly in O(n) time. Otherwise, the integers are added one at a time.
+ */
+- (void) addIntegers:(const int64_t*)integers count:(NSUInteger)count {
+	if (count == 0)
+		return;
+	++mutations;
+	if (tree->count == 0) {
+		NSUInteger i;
+		for (i = 1; i < count; i++)
+			if (integers[i-1] >= integers[i])
+				break;
+		if (i == count) {
+			CHIntegerBTreeBuild(tree, integers, NULL, count);
+			return;
+		}
+	}
+	for (NSUInteger i = 0; i < count; i++)
+		CHIntegerBTreeInsert(tree, integers[i], nil);
+}
+
+- (void) removeAllIntegers {
+	if (tree->count == 0)
+		return;
+	++mutations;
+	CHIntegerBTreeRemoveAll(tree);
+}
+
+- (void) removeFirstInteger {
+	int64_t integer;
+	if ([self getFirstInteger:&integer])
+		[self removeInteger:integer];
+}
+
+- (void) removeInteger:(int64_t)integer {
+	if (CHIntegerBTreeRemove(tree, integer))
+		++mutations;
+}
+
+- (void) removeLastInteger {
+	int64_t integer;
+	if ([self getLastInteger:&integer])
+		[self removeInteger:integer];
+}
+
+@end
@@ -0,0 +1,162 @@
+/*
+ CHDataStructures.framework -- CHIntegerSortedSet_Internal.h
+ 
+ Copyright (c) 2010, Quinn Taylor <http://homepage.mac.com/quinntaylor>
+ 
+ This source code is released under the ISC License. <http://www.opensource.org/licenses/isc-license>
+ 
+ Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted, provided that the above copyright notice and this permission notice appear in all copies.
+ 
+ The software is  provided "as is", without warranty of any kind, including all implied warranties of merchantability and fitness. In no event shall the authors or copyright holders be liable for any claim, damages, or other liability, whether in an action of contract, tort, or otherwise, arising from, out of, or in connection with the software or the use or other dealings in the software.
+ */
+
+#import "CHIntegerSortedSet.h"
+
+/**
+ @file CHIntegerSortedSet_Internal.h
+ The B+ tree of integer keys shared by CHIntegerSortedSet and CHIntegerSortedDictionary. A tree either has no values (for a set), or an object for each key (for a dictionary); the functions are implemented in CHIntegerSortedSet.m, with the B+ tree algorithms it shares with CHBTree (see CHBTree_Internal.h).
+ */
+
+/** The most keys (or children) a node can hold. */
+#define kCHIntegerBTreeNodeCapacity 64
+
+/**
+ A node in a CHIntegerBTree. As in CHBTree, leaves and branches use the same struct, and a branch holds @c count children and the <code>count-1</code> separators between them in @a keys. In a set, leaves are allocated without @a slots; in a dictionary, @a slots holds the object for each key of a leaf.
+ */
+typedef struct CHIntegerBTreeNode {
+	NSUInteger count;                             ///< The number of keys or children.
+	__strong struct CHIntegerBTreeNode *previous; ///< The preceding leaf (leaves only).
+	__strong struct CHIntegerBTreeNode *next;     ///< The following leaf (leaves only).
+	int64_t keys[kCHIntegerBTreeNodeCapacity];    ///< Keys, or separators in a branch.
+	__strong void *slots[kCHIntegerBTreeNodeCapacity]; ///< Children, or objects in a dictionary leaf.
+} CHIntegerBTreeNode;
+
+/**
+ A B+ tree of integer keys, which may also hold an object for each key.
+ */
+typedef struct CHIntegerBTree {
+	__strong CHIntegerBTreeNode *root;      ///< The root, or @c NULL if the tree is empty.
+	__strong CHIntegerBTreeNode *firstLeaf; ///< The leaf with the least keys.
+	__strong CHIntegerBTreeNode *lastLeaf;  ///< The leaf with the greatest keys.
+	NSUInteger height;                      ///< The number of levels (0 if empty).
+	NSUInteger count;                       ///< The number of keys.
+	BOOL hasValues;                         ///< Whether leaves hold an object for each key.
+} CHIntegerBTree;
+
+/**
+ The position of a key in a tree. A position just past the last key (or in an empty tree) has a @c NULL leaf.
+ */
+typedef struct CHIntegerBTreePosition {
+	CHIntegerBTreeNode *leaf;
+	NSUInteger index;
+} CHIntegerBTreePosition;
+
+/**
+ Allocates an empty tree.
+ 
+ @param hasValues Whether the tree holds an object for each key.
+ @return A struct allocated with @c NSAllocateCollectable() and @c NSScannedOption.
+ */
+HIDDEN CHIntegerBTree* CHIntegerBTreeCreate(BOOL hasValues);
+
+/**
+ Releases the objects in a tree (if any), and frees its nodes and the struct itself.
+ */
+HIDDEN void CHIntegerBTreeFree(CHIntegerBTree *tree);
+
+/**
+ Removes every key from a tree, releasing the objects (if any).
+ */
+HIDDEN void CHIntegerBTreeRemoveAll(CHIntegerBTree *tree);
+
+/**
+ Adds a key to a tree, or replaces the object for a key which is already present.
+ 
+ @param tree The tree to modify.
+ @param key The key to add.
+ @param value The object for @a key (which is retained), or @c nil if the tree has no values.
+ @return @c YES if @a key was added, or @c NO if it was already in the tree.
+ */
+HIDDEN BOOL CHIntegerBTreeInsert(CHIntegerBTree *tree, int64_t key, id value);
+
+/**
+ Removes a key from a tree, releasing its object (if any).
+ 
+ @return @c YES if @a key was removed, or @c NO if it was not in the tree.
+ */
+HIDDEN BOOL CHIntegerBTreeRemove(CHIntegerBTree *tree, int64_t key);
+
+/**
+ Finds the position of the least key in a tree which is greater than (or equal to) a given key.
+ 
+ @param tree The tree to search.
+ @param key The key to search for.
+ @param orEqual Whether a key equal to @a key is a match.
+ @return The position of the matching key, or a position with a @c NULL leaf if there is none.
+ */
+HIDDEN CHIntegerBTreePosition CHIntegerBTreeFind(CHIntegerBTree *tree, int64_t key, BOOL orEqual);
+
+/**
+ Fills an empty tree from keys in strictly ascending order in O(n) time, leaving every node at least half full.
+ 
+ @param tree The tree to fill, which must be empty.
+ @param keys The keys, in strictly ascending order.
+ @param values The object for each key (each is retained), or @c NULL if the tree has no values.
+ @param count The number of keys.
+ */
+HIDDEN void CHIntegerBTreeBuild(CHIntegerBTree *tree, const int64_t *keys, id *values, NSUInteger count);
+
+/**
+ Fills an empty tree with the keys (and objects) from part of another tree, as described for \link CHIntegerSortedSet#subsetFromInteger:toInteger:options: -[CHIntegerSortedSet subsetFromInteger:toInteger:options:]\endlink.
+ */
+HIDDEN void CHIntegerBTreeBuildSubset(CHIntegerBTree *tree, CHIntegerBTree *source,
+                                      int64_t start, int64_t end,
+                                      CHSubsetConstructionOptions options);
+
+/**
+ Copies the keys (and objects, if @a values is not @c NULL) from consecutive positions, and returns the number copied, which is less than @a maxCount only at the end of the tree.
+ */
+HIDDEN NSUInteger CHIntegerBTreeCopy(CHIntegerBTreePosition position, int64_t *keys, id *values, NSUInteger maxCount);
+
+/**
+ Determines whether two trees have the same keys, and (if they have values) equal objects for each key.
+ */
+HIDDEN BOOL CHIntegerBTreesAreEqual(CHIntegerBTree *tree1, CHIntegerBTree *tree2);
+
+// Returns the position of the least key in a tree.
+static inline CHIntegerBTreePosition CHIntegerBTreeFirst(CHIntegerBTree *tree) {
+	CHIntegerBTreePosition position = {tree->firstLeaf, 0};
+	return position;
+}
+
+// Returns the position of the greatest key in a tree; the tree must not be empty.
+static inline CHIntegerBTreePosition CHIntegerBTreeLast(CHIntegerBTree *tree) {
+	CHIntegerBTreePosition position = {tree->lastLeaf, tree->lastLeaf->count - 1};
+	return position;
+}
+
+// Returns the position after a position which is in the tree.
+static inline CHIntegerBTreePosition CHIntegerBTreeNext(CHIntegerBTreePosition position) {
+	if (++position.index == position.leaf->count) {
+		position.leaf = position.leaf->next;
+		position.index = 0;
+	}
+	return position;
+}
+
+// Returns the position before a position, which may be just past the end of the tree. The result has a NULL leaf if the position is at the start.
+static inline CHIntegerBTreePosition CHIntegerBTreePrevious(CHIntegerBTree *tree,
+                                                            CHIntegerBTreePosition position)
+{
+	if (position.leaf == NULL) {
+		position.leaf = tree->lastLeaf;
+		position.index = (position.leaf != NULL) ? position.leaf->count : 0;
+	}
+	if (position.leaf != NULL && position.index == 0) {
+		position.leaf = position.leaf->previous;
+		position.index = (position.leaf != NULL) ? position.leaf->count : 0;
+	}
+	if (position.leaf != NULL)
+		position.index--;
+	return position;
+}
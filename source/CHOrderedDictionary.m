@@ -136,6 +136,7 @@
 	[keyOrdering removeObjectAtIndex:index];
 }
 
+// The key ordering removes all the keys in one pass; the array keeps them alive until then.
 - (void) removeObjectsForKeysAtIndexes:(NSIndexSet*)indexes {
 	NSArray* keysToRemove = [keyOrdering objectsAtIndexes:indexes];
 	[keyOrdering removeObjectsAtIndexes:indexes];
@@ -140,9 +140,12 @@
 	[ordering removeObjectAtIndex:index];
 }
 
+// The ordering removes all the objects in one pass; the array keeps them alive until then.
 - (void) removeObjectsAtIndexes:(NSIndexSet*)indexes {
-	[(NSMutableSet*)set minusSet:[NSSet setWithArray:[self objectsAtIndexes:indexes]]];
+	NSArray *objectsToRemove = [ordering objectsAtIndexes:indexes];
 	[ordering removeObjectsAtIndexes:indexes];
+	for (id anObject in objectsToRemove)
+		[(NSMutableSet*)set removeObject:anObject];
 }
 
 #pragma mark <NSFastEnumeration>
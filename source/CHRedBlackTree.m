@@ -16,40 +16,8 @@
 
 #pragma mark C Functions for Optimized Operations
 
-static inline CHBinaryTreeNode* rotateNodeWithLeftChild(CHBinaryTreeNode *node) {
-	CHBinaryTreeNode *leftChild = node->left;
-	node->left = leftChild->right;
-	leftChild->right = node;
-	node->color = kRED;
-	leftChild->color = kBLACK;
-	return leftChild;
-}
-
-static inline CHBinaryTreeNode* rotateNodeWithRightChild(CHBinaryTreeNode *node) {
-	CHBinaryTreeNode *rightChild = node->right;
-	node->right = rightChild->left;
-	rightChild->left = node;
-	node->color = kRED;
-	rightChild->color = kBLACK;
-	return rightChild;
-}
-
-HIDDEN CHBinaryTreeNode* rotateObjectOnAncestor(id anObject, CHBinaryTreeNode *ancestor) {
-	if ([ancestor->object compare:anObject] == NSOrderedDescending) {
-		if ([ancestor->left->object compare:anObject] == NSOrderedDescending)
-			ancestor->left = rotateNodeWithLeftChild(ancestor->left);
-		else
-			ancestor->left = rotateNodeWithRightChild(ancestor->left);
-		return ancestor->left;
-	}
-	else {
-		if ([ancestor->right->object compare:anObject] == NSOrderedDescending)
-			ancestor->right = rotateNodeWithLeftChild(ancestor->right);
-		else
-			ancestor->right = rotateNodeWithRightChild(ancestor->right);
-		return ancestor->right;
-	}
-}
+// Red-black trees are never more than 2*log2(n+1) levels deep, so the path to any node (plus the header) fits easily in a fixed-size array on the stack.
+#define kCHRedBlackTreeMaxDepth (sizeof(NSUInteger) * 16 + 1)
 
 static inline CHBinaryTreeNode* singleRotation(CHBinaryTreeNode *node, BOOL goingRight) {
 	CHBinaryTreeNode *save = node->link[!goingRight];
@@ -57,6 +25,8 @@ static inline CHBinaryTreeNode* singleRotation(CHBinaryTreeNode *node, BOOL goin
 	save->link[goingRight] = node;
 	node->color = kRED;
 	save->color = kBLACK;
+	save->size = node->size;
+	CHUpdateSubtreeSize(node);
 	return save;
 }
 
@@ -72,43 +42,25 @@ static inline CHBinaryTreeNode* doubleRotation(CHBinaryTreeNode *node, BOOL goin
 // NOTE: The header and sentinel nodes are initialized to black (0) by default.
 
 /*
- Basically, as you walk down the tree to insert, if the present node has two red children, color it red and change the two children to black. If its parent is red, the tree must be rotated. (Just change the root's color back to black if you changed it). Returns without incrementing the count if the object already exists in the tree.
+ Walks down the tree to find where the object belongs, recording the path. A new node is colored red and linked in as a leaf; if its parent is also red, walk back up the path, doing color flips as long as the parent's sibling is also red. At most two rotations are needed to restore the red-black properties. Returns without incrementing the count if the object already exists in the tree.
  */
 - (void) addObject:(id)anObject {
 	if (anObject == nil)
 		CHNilArgumentException([self class], _cmd);
 	++mutations;
 
-	CHBinaryTreeNode *current, *parent, *grandparent, *greatgrandparent;
-	grandparent = parent = current = header;
+	CHBinaryTreeNode *path[kCHRedBlackTreeMaxDepth], *current = header;
+	NSUInteger depth = 0;
+	BOOL isGoingRight = YES;
 	
+	// Every node on the path changes (if only its size), so none may be shared.
 	sentinel->object = anObject;
 	NSComparisonResult comparison;
-	while (comparison = [current->object compare:anObject]) {
-		greatgrandparent = grandparent, grandparent = parent, parent = current;
-		current = current->link[comparison == NSOrderedAscending];
-		
-		// Check for the bad case of red parent and red sibling of parent
-		if (current->left->color == kRED && current->right->color == kRED) {
-			// Simple red violation: resolve with color flip
-			current->color = kRED;
-			current->left->color = kBLACK;
-			current->right->color = kBLACK;
-			
-			// Hard red violation: rotations necessary
-			if (parent->color == kRED) {
-//				BOOL lastWentRight = (grandparent->right == parent);
-//				greatgrandparent->link[greatgrandparent->right == grandparent]
-//					= (parent->link[lastWentRight])
-//						? singleRotation(grandparent, !lastWentRight)
-//						: doubleRotation(grandparent, !lastWentRight);
-				grandparent->color = kRED;
-				if ([grandparent->object compare:anObject] != [parent->object compare:anObject])
-					parent = rotateObjectOnAncestor(anObject, grandparent);
-				current = rotateObjectOnAncestor(anObject, greatgrandparent);
-				current->color = kBLACK;
-			}
-		}
+	while (comparison = CHSearchTreeCompare(comparator, current->object, anObject)) {
+		path[depth++] = current;
+		++(current->size); // Assume the object is new; undo below if not.
+		isGoingRight = (comparison == NSOrderedAscending);
+		current = CHUnshareBinaryTreeNode(nodePool, &current->link[isGoingRight], sentinel);
 	}
 	
 	[anObject retain];
@@ -116,108 +68,160 @@ static inline CHBinaryTreeNode* doubleRotation(CHBinaryTreeNode *node, BOOL goin
 		// If an existing node matched, simply replace the existing value.
 		[current->object release];
 		current->object = anObject;
-	} else {
-		++count;
-		current = CHCreateBinaryTreeNodeWithObject(anObject);
-		current->left = sentinel;
-		current->right = sentinel;
-		
-		parent->link[([parent->object compare:anObject] == NSOrderedAscending)] = current;
-		
-		// one last reorientation check...
-		
-		// Color flip
-		current->color = kRED;
-		current->left->color = kBLACK;
-		current->right->color = kBLACK;
-		// Fix red violation
-		if (parent->color == kRED) 	{
+		while (depth > 0)
+			--(path[--depth]->size);
+		return;
+	}
+	
+	++count;
+	current = CHCreateBinaryTreeNodeFromPool(nodePool, anObject);
+	current->left = sentinel;
+	current->right = sentinel;
+	current->color = kRED;
+	CHBinaryTreeNode *parent = path[--depth];
+	parent->link[isGoingRight] = current;
+	
+	// Fix red violations; the header is black, so the loop stops at the root.
+	CHBinaryTreeNode *grandparent, *uncle, *ancestor;
+	BOOL parentIsRight;
+	while (parent->color == kRED) {
+		grandparent = path[depth-1]; // A red parent is never the root.
+		parentIsRight = (grandparent->right == parent);
+		uncle = grandparent->link[!parentIsRight];
+		if (uncle->color == kRED) {
+			// Color flip, which may cause a red violation further up the tree
+			uncle = CHUnshareBinaryTreeNode(nodePool, &grandparent->link[!parentIsRight], sentinel);
+			parent->color = uncle->color = kBLACK;
 			grandparent->color = kRED;
-			if ([grandparent->object compare:anObject] != [parent->object compare:anObject])
-				rotateObjectOnAncestor(anObject, grandparent);
-			current = rotateObjectOnAncestor(anObject, greatgrandparent);
-			current->color = kBLACK;
+			current = grandparent;
+			depth -= 2;
+			parent = path[depth];
+		}
+		else {
+			// Rotate at the grandparent (twice if current is an inner child), which only moves nodes on the path
+			ancestor = path[depth-2];
+			ancestor->link[ancestor->right == grandparent]
+				= ((parent->right == current) == parentIsRight)
+				? singleRotation(grandparent, !parentIsRight)
+				: doubleRotation(grandparent, !parentIsRight);
+			break;
 		}
-		header->right->color = kBLACK;  // Always reset root to black
 	}
+	header->right->color = kBLACK;  // Always reset root to black
 }
 
-/**
- @param anObject The object to be removed from the tree.
+/*
+ Walks down the tree to find the object, recording the path, and returns without modifying (or copying) anything if it is not found. A node with two children takes the object from its successor, which is removed instead. Removing a red node (or a black node with a red child) needs only a recoloring; otherwise, walk back up the path to restore the black height, recoloring as long as the sibling and its children are black. At most three rotations are needed, and only O(1) work is done at each level on average.
  
- @bug Performance decays exponentially (not linearly) when removing objects.
- @todo Speed up red-black removal. The EternallyConfuzzled.com tutorial opts to push a red node down the tree using rotations and flips to avoid a nasty case of deleting a black node. This is almost certainly what causes the performance problems.
-
  @see http://www.stanford.edu/~blp/avl/libavl.html/Deleting-from-an-RB-Tree.html
- @see http://eternallyconfuzzled.com/tuts/datastructures/jsw_tut_rbtree.aspx
  */
 - (void) removeObject:(id)anObject {
 	if (count == 0 || anObject == nil)
 		return;
-	++mutations;
 	
-	CHBinaryTreeNode *current, *parent, *grandparent;
-	parent = current = header;
+	CHBinaryTreeNode *path[kCHRedBlackTreeMaxDepth], *current = header;
+	NSUInteger depth = 0;
 	
-	CHBinaryTreeNode *found = NULL, *sibling;
 	sentinel->object = anObject;
 	NSComparisonResult comparison;
-	BOOL isGoingRight = YES, prevWentRight = YES;
-	while (current->link[isGoingRight] != sentinel) {
-		grandparent = parent;
-		parent = current;
-		current = current->link[isGoingRight];
-		comparison = [current->object compare:anObject];
-		prevWentRight = isGoingRight;
-		isGoingRight = (comparison != NSOrderedDescending);
-		if (comparison == NSOrderedSame)
-			found = current; // Save a pointer; removal happens outside the loop
-		
-		// There are only potential violations when removing a black node.
-		// If so, push the child red node down using rotations and color flips.
-		if (current->color != kRED && current->link[isGoingRight]->color != kRED) {
-			if (current->link[!isGoingRight]->color == kRED) {
-				parent->link[prevWentRight] = singleRotation(current, isGoingRight);
-				parent = parent->link[prevWentRight];
-			}
-			else {
-				sibling = parent->link[prevWentRight];
-				if (sibling != sentinel) {
-					if (sibling->left->color == kBLACK && sibling->right->color == kBLACK) {
-						// If sibling's children are both black, do a color flip
-						parent->color = kBLACK;
-						sibling->color = kRED;
-						current->color = kRED;
-					}
-					else {
-						CHBinaryTreeNode *tempNode = grandparent->link[(grandparent->right == parent)];
-						if (sibling->link[prevWentRight]->color == kRED)
-							tempNode = doubleRotation(parent, prevWentRight);
-						else if (sibling->link[!prevWentRight]->color == kRED)
-							tempNode = singleRotation(parent, prevWentRight);
-						/* Ensure correct coloring */
-						current->color = tempNode->color = kRED;
-						tempNode->left->color = kBLACK;
-						tempNode->right->color = kBLACK;
-					}
-				} // if (sibling != sentinel)
-			}
-		}
+	while (comparison = CHSearchTreeCompare(comparator, current->object, anObject)) {
+		path[depth++] = current;
+		current = current->link[comparison == NSOrderedAscending];
 	}
+	if (current == sentinel)
+		return;
+	++mutations;
+	
+	// Copy the nodes on the path which are shared with a snapshot, from the top down.
+	for (NSUInteger i = 1; i < depth; i++)
+		path[i] = CHUnshareBinaryTreeNode(nodePool, &path[i-1]->link[path[i-1]->right == path[i]], sentinel);
+	current = CHUnshareBinaryTreeNode(nodePool, &path[depth-1]->link[path[depth-1]->right == current], sentinel);
 	
-	// Transfer replacement value up to outgoing node, remove the "donor" node.
-    if (found != NULL) {
-		[found->object release];
+	[current->object release];
+	--count;
+	if (current->left != sentinel && current->right != sentinel) {
+		// Replace the object with its successor, and remove that node instead.
+		CHBinaryTreeNode *found = current;
+		path[depth++] = current;
+		current = CHUnshareBinaryTreeNode(nodePool, &current->right, sentinel);
+		while (current->left != sentinel) {
+			path[depth++] = current;
+			current = CHUnshareBinaryTreeNode(nodePool, &current->left, sentinel);
+		}
 		found->object = current->object;
-		parent->link[(parent->right == current)]
-			= current->link[(current->left == sentinel)];
-		if (kCHGarbageCollectionNotEnabled)
-			free(current);
-		--count;
-    }
+	}
+	for (NSUInteger i = 1; i < depth; i++)
+		--(path[i]->size); // Skip the header, which has no meaningful size.
+	
+	// Splice out the node, which has at most one child.
+	CHBinaryTreeNode *parent = path[--depth];
+	BOOL isRightChild = (parent->right == current);
+	CHBinaryTreeNode *child = current->link[current->left == sentinel];
+	parent->link[isRightChild] = child;
+	u_int32_t removedColor = current->color;
+	CHRecycleBinaryTreeNode(nodePool, current);
+	if (removedColor == kRED)
+		return;
+	if (child->color == kRED) {
+		child = CHUnshareBinaryTreeNode(nodePool, &parent->link[isRightChild], sentinel);
+		child->color = kBLACK;
+		return;
+	}
+	
+	// The subtree at parent->link[isRightChild] is now one black node short.
+	// (The sentinel is shared, so track the position rather than the child.)
+	// Throughout the loop, parent == path[depth].
+	CHBinaryTreeNode *sibling, *grandparent;
+	while (parent != header) {
+		grandparent = path[depth-1];
+		// The sibling is always recolored or rotated, so it can't be shared.
+		sibling = CHUnshareBinaryTreeNode(nodePool, &parent->link[!isRightChild], sentinel);
+		if (sibling->color == kRED) {
+			// Rotate the red sibling above the parent, which becomes red; the new sibling is black, so one of the cases below will finish the job.
+			grandparent->link[grandparent->right == parent]
+				= singleRotation(parent, isRightChild);
+			path[depth] = grandparent = sibling;
+			path[++depth] = parent;
+			sibling = CHUnshareBinaryTreeNode(nodePool, &parent->link[!isRightChild], sentinel);
+		}
+		if (sibling->left->color == kBLACK && sibling->right->color == kBLACK) {
+			// Shorten the sibling's subtree, and push the problem up a level.
+			sibling->color = kRED;
+			if (parent->color == kRED) {
+				parent->color = kBLACK;
+				break;
+			}
+			current = parent;
+			parent = path[--depth];
+			isRightChild = (parent->right == current);
+		}
+		else {
+			// Rotate a red nephew (or the sibling) into the parent's place; either nephew may be rotated or recolored.
+			CHUnshareBinaryTreeNode(nodePool, &sibling->left, sentinel);
+			CHUnshareBinaryTreeNode(nodePool, &sibling->right, sentinel);
+			u_int32_t parentColor = parent->color;
+			current = (sibling->link[!isRightChild]->color == kRED)
+				? singleRotation(parent, isRightChild)
+				: doubleRotation(parent, isRightChild);
+			current->color = parentColor;
+			current->left->color = kBLACK;
+			current->right->color = kBLACK;
+			grandparent->link[grandparent->right == parent] = current;
+			break;
+		}
+	}
 	header->right->color = kBLACK; // Make the root black for simplified logic
 }
 
+// All sentinel leaves of a bulk-loaded tree are at one of the two lowest levels, so coloring only the deepest nodes red keeps the black height uniform.
+- (void) prepareBulkLoadedNode:(CHBinaryTreeNode*)node
+                          size:(NSUInteger)size
+                         depth:(NSUInteger)depth
+                      maxDepth:(NSUInteger)maxDepth
+{
+	node->color = (depth == maxDepth && depth > 0) ? kRED : kBLACK;
+}
+
 - (NSString*) debugDescriptionForNode:(CHBinaryTreeNode*)node {
 	return [NSString stringWithFormat:@"[%s]\t\"%@\"",
 			(node->color == kRED) ? " RED " : "BLACK", node->object];
@@ -0,0 +1,156 @@
+/*
+ CHDataStructures.framework -- CHSPSCQueue.h
+ 
+ Copyright (c) 2010, Quinn Taylor <http://homepage.mac.com/quinntaylor>
+ 
+ This source code is released under the ISC License. <http://www.opensource.org/licenses/isc-license>
+ 
+ Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted, provided that the above copyright notice and this permission notice appear in all copies.
+ 
+ The software is  provided "as is", without warranty of any kind, including all implied warranties of merchantability and fitness. In no event shall the authors or copyright holders be liable for any claim, damages, or other liability, whether in an action of contract, tort, or otherwise, arising from, out of, or in connection with the software or the use or other dealings in the software.
+ */
+
+#import "Util.h"
+
+/**
+ @file CHSPSCQueue.h
+ A bounded lock-free queue for passing objects from one thread to another.
+ */
+
+/**
+ The number of bytes assumed to share a cache line. Indexes which are written by different threads are kept at least this far apart, so a write by one thread doesn't evict the line the other thread is using.
+ */
+#define kCHCacheLineSize 64
+
+/**
+ A bounded, lock-free FIFO queue for handing objects from exactly one producer thread to exactly one consumer thread. A CHCircularBufferQueue shared between two threads must be guarded by its lock, so every operation pays for acquiring and releasing an NSLock; with this class, neither thread ever waits for the other.
+ 
+ The objects are kept in a ring of slots whose capacity is fixed when the queue is created (and rounded up to a power of 2, so indexes wrap with a mask). The producer advances the tail index, and the consumer advances the head index; since each index is written by only one thread, no compare-and-swap is needed. Each thread publishes its index with a <em>release</em> store after it has finished with the slots it covers, and reads the other thread's index with an <em>acquire</em> load before it touches those slots, so an object is always completely stored before the consumer can see it, and a slot is always emptied before the producer can reuse it. Each thread also keeps its own copy of the other's index, and only reloads it when the copy says the queue is full (or empty), so the two threads rarely read each other's cache lines. The indexes are padded to lie in separate cache lines (see kCHCacheLineSize).
+ 
+ The batch methods, #enqueueObjects:count: and #dequeueObjects:maxCount:, publish the index once for the whole batch, which is considerably faster than moving one object at a time.
+ 
+ The rules for using the queue are:
+ - Only one thread (the producer) may call #enqueueObject: or #enqueueObjects:count: at a time, and only one thread (the consumer) may call #dequeueObject, #dequeueObjects:maxCount:, #firstObject, #removeFirstObject, or #removeAllObjects at a time. The producer and consumer may be the same thread. (A thread may hand off either role to another thread, as long as the handoff itself synchronizes the two threads, as a lock or NSOperationQueue does.)
+ - A full queue does not grow: enqueueing into a full queue adds nothing and returns immediately, so the producer decides whether to wait, retry, or drop objects.
+ - Enqueued objects are retained; dequeued objects are returned retained and autoreleased, so the consumer thread needs an autorelease pool.
+ - #count may be called from any thread, but while either thread is active it is only a snapshot.
+ 
+ Since the queue can't be indexed, enumerated, copied, or archived safely while both threads are using it, it does not adopt the CHQueue protocol; #firstObject, #removeFirstObject, #removeAllObjects, and #count behave like their CHQueue counterparts, but only on the consumer's side.
+ */
+@interface CHSPSCQueue : NSObject
+{
+	__strong id *array; // Ring of slots for objects; never changes size.
+	NSUInteger mask; // One less than the capacity of @a array.
+	char producerPadding[kCHCacheLineSize];
+	volatile NSUInteger tailIndex; // Total objects enqueued; written only by the producer.
+	NSUInteger cachedHeadIndex; // The producer's last reading of @a headIndex.
+	char consumerPadding[kCHCacheLineSize];
+	volatile NSUInteger headIndex; // Total objects dequeued; written only by the consumer.
+	NSUInteger cachedTailIndex; // The consumer's last reading of @a tailIndex.
+	char trailingPadding[kCHCacheLineSize];
+}
+
+/**
+ Initializes a queue which can hold a default number of objects (1024).
+ 
+ @return An initialized, empty queue.
+ */
+- (id) init;
+
+/**
+ Initializes a queue which can hold a given number of objects.
+ 
+ @param capacity The number of objects the queue can hold at once. It is rounded up to a power of 2; 0 is treated as 1.
+ @return An initialized, empty queue.
+ */
+- (id) initWithCapacity:(NSUInteger)capacity;
+
+/**
+ Returns the number of objects the receiver can hold at once.
+ 
+ @return The number of objects the receiver can hold at once, which is a power of 2.
+ */
+- (NSUInteger) capacity;
+
+/**
+ Returns the number of objects currently in the queue. This may be called from any thread, but when the producer or consumer is active, the count may have changed by the time it is returned.
+ 
+ @return The number of objects currently in the queue.
+ */
+- (NSUInteger) count;
+
+#pragma mark Producer
+/** @name Producer */
+// @{
+
+/**
+ Adds an object to the back of the queue, unless the queue is full. Call only from the producer thread.
+ 
+ @param anObject The object to add to the queue.
+ @return @c YES if the object was added, or @c NO if the queue was full.
+ 
+ @throw NSInvalidArgumentException if @a anObject is @c nil.
+ 
+ @see enqueueObjects:count:
+ */
+- (BOOL) enqueueObject:(id)anObject;
+
+/**
+ Adds objects from a C array to the back of the queue, as many as there is room for. Call only from the producer thread.
+ 
+ @param objects A C array of objects to add to the queue, in order.
+ @param count The number of objects in @a objects.
+ @return The number of objects which were added, starting from the beginning of @a objects. This is less than @a count if the queue became full.
+ 
+ @throw NSInvalidArgumentException if @a objects is @c NULL (and @a count is not 0) or contains @c nil, in which case no objects are added.
+ 
+ @see enqueueObject:
+ */
+- (NSUInteger) enqueueObjects:(id*)objects count:(NSUInteger)count;
+
+// @}
+#pragma mark Consumer
+/** @name Consumer */
+// @{
+
+/**
+ Removes and returns the object at the front of the queue. Call only from the consumer thread.
+ 
+ @return The first object in the queue (retained and autoreleased), or @c nil if the queue is empty.
+ 
+ @see dequeueObjects:maxCount:
+ */
+- (id) dequeueObject;
+
+/**
+ Removes objects from the front of the queue into a C array, as many as are available up to a limit. Call only from the consumer thread.
+ 
+ @param objects A C array with room for at least @a maxCount objects. The removed objects are stored in it in order, retained and autoreleased.
+ @param maxCount The largest number of objects to remove.
+ @return The number of objects which were removed and stored in @a objects, which is 0 if the queue is empty.
+ 
+ @throw NSInvalidArgumentException if @a objects is @c NULL and @a maxCount is not 0.
+ 
+ @see dequeueObject
+ */
+- (NSUInteger) dequeueObjects:(id*)objects maxCount:(NSUInteger)maxCount;
+
+/**
+ Returns the object at the front of the queue without removing it. Call only from the consumer thread.
+ 
+ @return The first object in the queue, or @c nil if the queue is empty.
+ */
+- (id) firstObject;
+
+/**
+ Removes the object at the front of the queue, if there is one. Call only from the consumer thread. This is faster than #dequeueObject, since the object is released rather than autoreleased.
+ */
+- (void) removeFirstObject;
+
+/**
+ Removes all the objects the producer has enqueued so far. Call only from the consumer thread.
+ */
+- (void) removeAllObjects;
+
+// @}
+@end
@@ -0,0 +1,188 @@
+/*
+ CHDataStructures.framework -- CHSPSCQueue.m
+ 
+ Copyright (c) 2010, Quinn Taylor <http://homepage.mac.com/quinntaylor>
+ 
+ This source code is released under the ISC License. <http://www.opensource.org/licenses/isc-license>
+ 
+ Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted, provided that the above copyright notice and this permission notice appear in all copies.
+ 
+ The software is  provided "as is", without warranty of any kind, including all implied warranties of merchantability and fitness. In no event shall the authors or copyright holders be liable for any claim, damages, or other liability, whether in an action of contract, tort, or otherwise, arising from, out of, or in connection with the software or the use or other dealings in the software.
+ */
+
+#import "CHSPSCQueue.h"
+#import <libkern/OSAtomic.h>
+
+#define DEFAULT_QUEUE_CAPACITY 1024u
+
+// Indexes are published with release stores and read with acquire loads. Where
+// the compiler lacks the builtins, a full barrier gives (more than) the same order.
+#if defined(__ATOMIC_ACQUIRE)
+#define loadAcquire(index)           __atomic_load_n(&(index), __ATOMIC_ACQUIRE)
+#define storeRelease(index, value)   __atomic_store_n(&(index), (value), __ATOMIC_RELEASE)
+#else
+static inline NSUInteger loadAcquireBarrier(volatile NSUInteger *index) {
+	NSUInteger value = *index;
+	OSMemoryBarrier();
+	return value;
+}
+#define loadAcquire(index)           loadAcquireBarrier(&(index))
+#define storeRelease(index, value)   do { OSMemoryBarrier(); (index) = (value); } while(0)
+#endif
+
+// The indexes count every object ever enqueued or dequeued, and are wrapped into
+// the array with the mask only when a slot is accessed, so all the slots can be
+// used: the queue is empty when the indexes are equal, and full when they differ
+// by the capacity. (Overflow is harmless, since the difference is still correct.)
+#define slot(index) array[(index) & mask]
+
+@implementation CHSPSCQueue
+
+- (void) dealloc {
+	[self removeAllObjects];
+	free(array);
+	[super dealloc];
+}
+
+- (id) init {
+	return [self initWithCapacity:DEFAULT_QUEUE_CAPACITY];
+}
+
+// This is the designated initializer for CHSPSCQueue.
+- (id) initWithCapacity:(NSUInteger)capacity {
+	if ((self = [super init]) == nil) return nil;
+	NSUInteger arrayCapacity = 1;
+	while (arrayCapacity < capacity)
+		arrayCapacity *= 2;
+	array = NSAllocateCollectable(kCHPointerSize*arrayCapacity, NSScannedOption);
+	bzero(array, kCHPointerSize*arrayCapacity);
+	mask = arrayCapacity - 1;
+	headIndex = tailIndex = cachedHeadIndex = cachedTailIndex = 0;
+	return self;
+}
+
+- (NSUInteger) capacity {
+	return mask + 1;
+}
+
+// The head is read first; since neither index moves backward, the tail read
+// afterward is never behind it, though it may be more than a capacity ahead.
+- (NSUInteger) count {
+	NSUInteger head = loadAcquire(headIndex);
+	NSUInteger tail = loadAcquire(tailIndex);
+	return MIN(tail - head, mask + 1);
+}
+
+- (NSString*) description {
+	return [NSString stringWithFormat:@"<%@: %p> count=%lu capacity=%lu",
+	        [self class], self, (unsigned long)[self count], (unsigned long)[self capacity]];
+}
+
+#pragma mark Producer
+
+- (BOOL) enqueueObject:(id)anObject {
+	if (anObject == nil)
+		CHNilArgumentException([self class], _cmd);
+	NSUInteger tail = tailIndex; // Only this thread writes the tail.
+	if (tail - cachedHeadIndex > mask) {
+		cachedHeadIndex = loadAcquire(headIndex);
+		if (tail - cachedHeadIndex > mask)
+			return NO;
+	}
+	slot(tail) = [anObject retain];
+	storeRelease(tailIndex, tail + 1);
+	return YES;
+}
+
+- (NSUInteger) enqueueObjects:(id*)objects count:(NSUInteger)count {
+	if (objects == NULL && count > 0)
+		CHNilArgumentException([self class], _cmd);
+	// Check every object first, so nothing is enqueued if an exception is raised.
+	for (NSUInteger i = 0; i < count; i++)
+		if (objects[i] == nil)
+			CHNilArgumentException([self class], _cmd);
+	NSUInteger tail = tailIndex;
+	NSUInteger space = mask + 1 - (tail - cachedHeadIndex);
+	if (space < count) {
+		cachedHeadIndex = loadAcquire(headIndex);
+		space = mask + 1 - (tail - cachedHeadIndex);
+		count = MIN(count, space);
+	}
+	for (NSUInteger i = 0; i < count; i++)
+		slot(tail + i) = [objects[i] retain];
+	if (count > 0)
+		storeRelease(tailIndex, tail + count);
+	return count;
+}
+
+#pragma mark Consumer
+
+- (id) dequeueObject {
+	NSUInteger head = headIndex; // Only this thread writes the head.
+	if (head == cachedTailIndex) {
+		cachedTailIndex = loadAcquire(tailIndex);
+		if (head == cachedTailIndex)
+			return nil;
+	}
+	id anObject = slot(head);
+	slot(head) = nil; // Let GC do its thing
+	storeRelease(headIndex, head + 1);
+	return [anObject autorelease];
+}
+
+- (NSUInteger) dequeueObjects:(id*)objects maxCount:(NSUInteger)maxCount {
+	if (objects == NULL && maxCount > 0)
+		CHNilArgumentException([self class], _cmd);
+	NSUInteger head = headIndex;
+	NSUInteger available = cachedTailIndex - head;
+	if (available < maxCount) {
+		cachedTailIndex = loadAcquire(tailIndex);
+		available = cachedTailIndex - head;
+	}
+	NSUInteger count = MIN(maxCount, available);
+	for (NSUInteger i = 0; i < count; i++) {
+		objects[i] = [slot(head + i) autorelease];
+		slot(head + i) = nil;
+	}
+	if (count > 0)
+		storeRelease(headIndex, head + count);
+	return count;
+}
+
+- (id) firstObject {
+	NSUInteger head = headIndex;
+	if (head == cachedTailIndex) {
+		cachedTailIndex = loadAcquire(tailIndex);
+		if (head == cachedTailIndex)
+			return nil;
+	}
+	// The object can't be removed by another thread, so it needn't be retained.
+	return slot(head);
+}
+
+- (void) removeFirstObject {
+	NSUInteger head = headIndex;
+	if (head == cachedTailIndex) {
+		cachedTailIndex = loadAcquire(tailIndex);
+		if (head == cachedTailIndex)
+			return;
+	}
+	[slot(head) release];
+	slot(head) = nil;
+	storeRelease(headIndex, head + 1);
+}
+
+- (void) removeAllObjects {
+	NSUInteger head = headIndex;
+	cachedTailIndex = loadAcquire(tailIndex);
+	if (head == cachedTailIndex)
+		return;
+	while (head != cachedTailIndex) {
+		[slot(head) release];
+		slot(head) = nil;
+		head++;
+	}
+	storeRelease(headIndex, head);
+}
+
+@end
@@ -0,0 +1,36 @@
+/*
+ CHDataStructures.framework -- CHScapegoatTree.h
+ 
+ Copyright (c) 2010, Quinn Taylor <http://homepage.mac.com/quinntaylor>
+ 
+ This source code is released under the ISC License. <http://www.opensource.org/licenses/isc-license>
+ 
+ Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted, provided that the above copyright notice and this permission notice appear in all copies.
+ 
+ The software is  provided "as is", without warranty of any kind, including all implied warranties of merchantability and fitness. In no event shall the authors or copyright holders be liable for any claim, damages, or other liability, whether in an action of contract, tort, or otherwise, arising from, out of, or in connection with the software or the use or other dealings in the software.
+ */
+
+#import "CHAbstractBinarySearchTree.h"
+
+/**
+ @file CHScapegoatTree.h
+ A <a href="http://en.wikipedia.org/wiki/Scapegoat_tree">Scapegoat tree</a> implementation of CHSearchTree.
+ */
+
+/**
+ A <a href="http://en.wikipedia.org/wiki/Scapegoat_tree">Scapegoat tree</a>, a balanced binary tree which keeps no balancing information in its nodes and performs no rotations. Objects are inserted and removed just as in an unbalanced binary tree, but whenever an insertion leaves a node deeper than log<sub>3/2</sub>(n), the tree finds a "scapegoat" — an ancestor of the new node with one subtree more than twice as large as the other — and rebuilds the subtree rooted there into a perfectly balanced one. Similarly, once removals have shrunk the tree to 2/3 of its largest size since it was last rebuilt, the whole tree is rebuilt.
+ 
+ Searches take O(log n) time in the worst case, since the height is always bounded, and never change the tree, so (unlike a splay tree) any number of threads can search one at once. Insertion and removal take O(log n) amortized time: rebuilding a subtree of k nodes takes O(k) time, but a subtree can only become that unbalanced after many insertions into it. Since there are no rotations, searches are slightly faster than in trees which balance more eagerly, at the cost of occasional pauses while a subtree is rebuilt. Rebuilding reuses the existing nodes, so no memory is allocated.
+ 
+ The number of nodes in each subtree, which every CHAbstractBinarySearchTree keeps for order statistics, is all this tree needs to find a scapegoat; the extra field in each node is unused. Scapegoat trees were originally described in the following paper:
+ 
+ <div style="margin: 0 25px; font-weight: bold;">
+ I. Galperin and R. L. Rivest. "Scapegoat Trees." <em>Proceedings of the Fourth Annual ACM-SIAM Symposium on Discrete Algorithms</em>, 165-174, 1993.
+ </div>
+ */
+@interface CHScapegoatTree : CHAbstractBinarySearchTree
+{
+	NSUInteger maxCount; // The largest count since the whole tree was last rebuilt.
+}
+
+@end
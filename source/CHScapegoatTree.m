@@ -0,0 +1,201 @@
+/*
+ CHDataStructures.framework -- CHScapegoatTree.m
+ 
+ Copyright (c) 2010, Quinn Taylor <http://homepage.mac.com/quinntaylor>
+ 
+ This source code is released under the ISC License. <http://www.opensource.org/licenses/isc-license>
+ 
+ Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted, provided that the above copyright notice and this permission notice appear in all copies.
+ 
+ The software is  provided "as is", without warranty of any kind, including all implied warranties of merchantability and fitness. In no event shall the authors or copyright holders be liable for any claim, damages, or other liability, whether in an action of contract, tort, or otherwise, arising from, out of, or in connection with the software or the use or other dealings in the software.
+ */
+
+#import "CHScapegoatTree.h"
+#import "CHAbstractBinarySearchTree_Internal.h"
+
+// Determines whether a node at a given depth (the root is at depth 0) is deeper than log base 3/2 of the number of nodes, which is the most a scapegoat tree allows.
+static inline BOOL isTooDeep(NSUInteger depth, NSUInteger nodeCount) {
+	double limit = 1.0;
+	while (depth-- > 0) {
+		limit *= 1.5;
+		if (limit > nodeCount)
+			return YES;
+	}
+	return NO;
+}
+
+// Determines whether a child holds more than 2/3 of the nodes in its parent's subtree, which makes the parent a scapegoat.
+static inline BOOL isTooHeavy(CHBinaryTreeNode *child, CHBinaryTreeNode *node) {
+	return (3 * (NSUInteger)child->size > 2 * (NSUInteger)node->size);
+}
+
+// Links nodes in ascending order into a perfectly balanced subtree, just as the abstract parent class bulk loads objects.
+static CHBinaryTreeNode* linkBalancedSubtree(CHBinaryTreeNode **nodes, NSUInteger size,
+                                             CHBinaryTreeNode *sentinel)
+{
+	if (size == 0)
+		return sentinel;
+	NSUInteger leftSize = (size - 1) / 2;
+	CHBinaryTreeNode *node = nodes[leftSize];
+	node->left  = linkBalancedSubtree(nodes, leftSize, sentinel);
+	node->right = linkBalancedSubtree(nodes + leftSize + 1, size - leftSize - 1, sentinel);
+	node->size = (u_int32_t) size;
+	return node;
+}
+
+// Rearranges the nodes of the subtree at a link into a perfectly balanced one and returns its new root. No nodes are allocated, unless some are shared with a snapshot, in which case they are copied (from the top down) on the way.
+static CHBinaryTreeNode* rebuildSubtree(CHBinaryTreeNodePool *pool, CHBinaryTreeNode **link,
+                                        CHBinaryTreeNode *sentinel)
+{
+	CHBinaryTreeNode *current = CHUnshareBinaryTreeNode(pool, link, sentinel);
+	NSUInteger size = current->size, index = 0;
+	// The nodes are reachable from the tree throughout, so the array need not be scanned.
+	CHBinaryTreeNode **nodes = malloc(size * sizeof(CHBinaryTreeNode*));
+	CHEnumerationStack stack;
+	CHEnumerationStackInit(&stack);
+	while (current != sentinel || stack.size > 0) {
+		while (current != sentinel) {
+			CHEnumerationStackPush(&stack, current);
+			current = CHUnshareBinaryTreeNode(pool, &current->left, sentinel);
+		}
+		current = stack.nodes[--stack.size];
+		nodes[index++] = current;
+		current = CHUnshareBinaryTreeNode(pool, &current->right, sentinel);
+	}
+	CHEnumerationStackFree(&stack);
+	CHBinaryTreeNode *newRoot = linkBalancedSubtree(nodes, size, sentinel);
+	free(nodes);
+	return newRoot;
+}
+
+@implementation CHScapegoatTree
+
+- (void) addObject:(id)anObject {
+	if (anObject == nil)
+		CHNilArgumentException([self class], _cmd);
+	++mutations;
+
+	// Record the path, which is needed to adjust sizes and to find a scapegoat.
+	// Every node on it changes (if only its size), so none may be shared.
+	CHEnumerationStack path;
+	CHEnumerationStackInit(&path);
+	CHBinaryTreeNode *parent = header;
+	CHBinaryTreeNode *current = CHUnshareBinaryTreeNode(nodePool, &header->right, sentinel);
+	NSComparisonResult comparison = NSOrderedAscending; // The root is the right child of the header.
+	while (current != sentinel &&
+	       (comparison = CHSearchTreeCompare(comparator, current->object, anObject))) // while not equal
+	{
+		CHEnumerationStackPush(&path, current);
+		parent = current;
+		current = CHUnshareBinaryTreeNode(nodePool, &current->link[comparison == NSOrderedAscending], sentinel); // R on YES
+	}
+
+	[anObject retain]; // Must retain whether replacing value or adding new node
+	if (current != sentinel) {
+		// Replace the existing object with the new object.
+		[current->object release];
+		current->object = anObject;
+		CHEnumerationStackFree(&path);
+		return;
+	}
+	current = CHCreateBinaryTreeNodeFromPool(nodePool, anObject);
+	current->left  = sentinel;
+	current->right = sentinel;
+	parent->link[comparison == NSOrderedAscending] = current;
+	for (NSUInteger i = 0; i < path.size; i++)
+		++(path.nodes[i]->size);
+	if (++count > maxCount)
+		maxCount = count;
+
+	// The depth of the new node is the number of its ancestors. If it is too deep, some ancestor must have a subtree which is too heavy.
+	if (isTooDeep(path.size, count)) {
+		CHBinaryTreeNode *child = current, *node;
+		NSUInteger i = path.size;
+		while (i > 0) {
+			node = path.nodes[--i];
+			if (isTooHeavy(child, node)) {
+				parent = (i > 0) ? path.nodes[i-1] : header;
+				CHBinaryTreeNode **link = &(parent->link[parent->right == node]);
+				*link = rebuildSubtree(nodePool, link, sentinel);
+				break;
+			}
+			child = node;
+		}
+	}
+	CHEnumerationStackFree(&path);
+}
+
+- (void) buildTreeFromSortedObjects:(id*)objects count:(NSUInteger)objectCount {
+	[super buildTreeFromSortedObjects:objects count:objectCount];
+	maxCount = count;
+}
+
+- (id) copyWithZone:(NSZone*)zone {
+	CHScapegoatTree *newTree = [super copyWithZone:zone];
+	newTree->maxCount = maxCount;
+	return newTree;
+}
+
+- (void) removeAllObjects {
+	[super removeAllObjects];
+	maxCount = 0;
+}
+
+// Removal is the same as in an unbalanced tree, with a complete rebuild when the tree has shrunk enough.
+- (void) removeObject:(id)anObject {
+	if (count == 0 || anObject == nil)
+		return;
+	++mutations;
+	// Don't copy any nodes shared with a snapshot unless the object is there to remove.
+	if (CHSearchTreeMayShareNodes() && [self member:anObject] == nil)
+		return;
+
+	CHBinaryTreeNode *parent = nil, *current = header;
+
+	sentinel->object = anObject; // Assure that we find a spot to insert
+	NSComparisonResult comparison;
+	while (comparison = CHSearchTreeCompare(comparator, current->object, anObject)) {
+		parent = current;
+		--(current->size); // Assume the object is present; undo below if not.
+		current = CHUnshareBinaryTreeNode(nodePool, &current->link[comparison == NSOrderedAscending], sentinel); // R on YES
+	}
+	NSAssert(parent != nil, @"Illegal state, parent should never be nil!");
+	// Exit if the specified node was not found in the tree.
+	if (current == sentinel) {
+		for (current = header; current != sentinel;
+		     current = current->link[CHSearchTreeCompare(comparator, current->object, anObject) == NSOrderedAscending])
+			++(current->size);
+		return;
+	}
+
+	[current->object release]; // Object must be released in any case
+	--count;
+	if (current->left == sentinel || current->right == sentinel) {
+		// One or both of the child pointers are null, so removal is simpler
+		parent->link[parent->right == current]
+			= current->link[current->left == sentinel];
+		CHRecycleBinaryTreeNode(nodePool, current);
+	} else {
+		// The most complex case: removing a node with 2 non-null children
+		// (Replace object with the leftmost object in the right subtree.)
+		parent = current;
+		--(current->size);
+		CHBinaryTreeNode *replacement = CHUnshareBinaryTreeNode(nodePool, &current->right, sentinel);
+		while (replacement->left != sentinel) {
+			parent = replacement;
+			--(replacement->size);
+			replacement = CHUnshareBinaryTreeNode(nodePool, &replacement->left, sentinel);
+		}
+		current->object = replacement->object;
+		parent->link[parent->right == replacement] = replacement->right;
+		CHRecycleBinaryTreeNode(nodePool, replacement);
+	}
+
+	if (3 * count < 2 * maxCount) {
+		if (count > 0)
+			header->right = rebuildSubtree(nodePool, &header->right, sentinel);
+		maxCount = count;
+	}
+}
+
+@end
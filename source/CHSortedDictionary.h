@@ -23,6 +23,8 @@
  A dictionary which enumerates keys according to their natural sorted order. The following additional operations are provided to take advantage of the ordering:
    - \link #firstKey\endlink
    - \link #lastKey\endlink
+   - \link #floorKey:\endlink
+   - \link #ceilingKey:\endlink
    - \link #subsetFromKey:toKey:options:\endlink
  
  Key-value entries are inserted just as in a normal dictionary, including replacement of values for existing keys, as detailed in \link NSMutableDictionary#setObject:forKey: -[NSMutableDictionary setObject:forKey:]\endlink. However, an additional CHSortedSet structure is used in parallel to sort the keys, and keys are enumerated in that order.
@@ -62,6 +64,26 @@
  */
 - (id) lastKey;
 
+/**
+ Returns the greatest key in the receiver which is less than or equal to a given object, according to natural sorted order.
+ 
+ @param anObject The object to compare against the keys in the receiver; need not be a key in the receiver.
+ @return The key in the receiver which is equal to @a anObject if there is one, otherwise the greatest key which is less than @a anObject, or @c nil if there is no such key.
+ 
+ @see ceilingKey:
+ */
+- (id) floorKey:(id)anObject;
+
+/**
+ Returns the least key in the receiver which is greater than or equal to a given object, according to natural sorted order.
+ 
+ @param anObject The object to compare against the keys in the receiver; need not be a key in the receiver.
+ @return The key in the receiver which is equal to @a anObject if there is one, otherwise the least key which is greater than @a anObject, or @c nil if there is no such key.
+ 
+ @see floorKey:
+ */
+- (id) ceilingKey:(id)anObject;
+
 /**
  Returns a new dictionary containing the entries for keys delineated by two given objects. The subset is a shallow copy (new memory is allocated for the structure, but the copy points to the same objects) so any changes to the objects in the subset affect the receiver as well. The subset is an instance of the same class as the receiver.
  
@@ -72,7 +94,7 @@
  - If both @a start and @a end are @c nil, all keys in the receiver are included. (Equivalent to calling @c -copy.)
  - If only @a start is @c nil, keys that match or follow @a start are included.
  - If only @a end is @c nil, keys that match or preceed @a start are included.
- - If @a start comes before @a end in an ordered set, keys between @a start and @a end (or which match either object) are included.
+ - If @a start comes before (or is equal to) @a end in an ordered set, keys between @a start and @a end (or which match either object) are included.
  - Otherwise, all keys @b except those that fall between @a start and @a end are included.
  */
 - (NSMutableDictionary*) subsetFromKey:(id)start
@@ -11,7 +11,7 @@
  */
 
 #import "CHSortedDictionary.h"
-#import "CHAVLTree.h"
+#import "CHBTree.h"
 
 @implementation CHSortedDictionary
 
@@ -22,7 +22,7 @@
 
 - (id) initWithCapacity:(NSUInteger)numItems {
 	if ((self = [super initWithCapacity:numItems]) == nil) return nil;
-	sortedKeys = [[CHAVLTree alloc] init];
+	sortedKeys = [[CHBTree alloc] init];
 	return self;
 }
 
@@ -43,10 +43,18 @@
 	return [super allKeys];
 }
 
+- (id) ceilingKey:(id)anObject {
+	return [sortedKeys objectGreaterThanOrEqualTo:anObject];
+}
+
 - (id) firstKey {
 	return [sortedKeys firstObject];
 }
 
+- (id) floorKey:(id)anObject {
+	return [sortedKeys objectLessThanOrEqualTo:anObject];
+}
+
 - (NSUInteger) hash {
 	return hashOfCountAndObjects([sortedKeys count],
 	                             [sortedKeys firstObject],
@@ -65,14 +73,20 @@
 	return [sortedKeys reverseObjectEnumerator];
 }
 
+// Rather than inserting each entry (and a copy of each key) one at a time, this adopts the subset of sorted keys (which the sorted set can construct efficiently) and only needs to look up the value for each key in the subset.
 - (NSMutableDictionary*) subsetFromKey:(id)start
                                  toKey:(id)end
                                options:(CHSubsetConstructionOptions)options
 {
-	id<CHSortedSet> keySubset = [sortedKeys subsetFromObject:start toObject:end options:options];
-	NSMutableDictionary* subset = [[[[self class] alloc] init] autorelease];
-	for (id aKey in keySubset) {
-		[subset setObject:[self objectForKey:aKey] forKey:aKey];
+	CHSortedDictionary *subset = [[[[self class] alloc] init] autorelease];
+	[subset->sortedKeys release];
+	subset->sortedKeys = [[sortedKeys subsetFromObject:start
+	                                          toObject:end
+	                                           options:options] retain];
+	// The keys are immutable copies owned by the receiver, so they can be shared.
+	for (id aKey in subset->sortedKeys) {
+		CFDictionarySetValue(subset->dictionary, aKey,
+		                     CFDictionaryGetValue(dictionary, aKey));
 	}
 	return subset;
 }
@@ -13,6 +13,8 @@
 
 #import "Util.h"
 
+@class CHFrozenSortedSet;
+
 /**
  @file CHSortedSet.h
  
@@ -212,7 +214,7 @@ typedef enum {
  - If both @a start and @a end are @c nil, all objects in the receiver are included. (Equivalent to calling @c -copy.)
  - If only @a start is @c nil, objects that match or follow @a start are included.
  - If only @a end is @c nil, objects that match or preceed @a start are included.
- - If @a start comes before @a end in an ordered set, objects between @a start and @a end (or which match either object) are included.
+ - If @a start comes before (or is equal to) @a end in an ordered set, objects between @a start and @a end (or which match either object) are included.
  - Otherwise, all objects @b except those that fall between @a start and @a end are included.
  */
 - (id<CHSortedSet>) subsetFromObject:(id)start
@@ -289,5 +291,65 @@ typedef enum {
  */
 - (void) removeObject:(id)anObject;
 
+// @}
+#pragma mark Optional Methods
+/** @name Optional Methods */
+// @{
+@optional
+// Every sorted set in this framework implements these, but other classes which adopt the protocol need not, so check with -respondsToSelector: before sending them to a sorted set from elsewhere.
+
+/**
+ Returns an immutable sorted set with the same objects and ordering as the receiver, which is laid out for fast searching. This is worthwhile when a set is built once and then searched many times.
+ 
+ @return An (autoreleased) CHFrozenSortedSet containing the objects in the receiver. If the receiver is already frozen, it is returned itself.
+ 
+ @see CHFrozenSortedSet
+ */
+- (CHFrozenSortedSet*) freeze;
+
+/**
+ Returns the smallest object in the receiver which is greater than a given object.
+ 
+ @param anObject The object to compare against the objects in the receiver; need not be in the receiver.
+ @return The least object in the receiver which is strictly greater than @a anObject, or @c nil if there is no such object (or if @a anObject is @c nil).
+ 
+ @see objectGreaterThanOrEqualTo:
+ @see objectLessThan:
+ */
+- (id) objectGreaterThan:(id)anObject;
+
+/**
+ Returns the smallest object in the receiver which is greater than or equal to a given object. (This is sometimes called the "ceiling" of @a anObject.)
+ 
+ @param anObject The object to compare against the objects in the receiver; need not be in the receiver.
+ @return The object in the receiver which is equal to @a anObject if there is one, otherwise the least object in the receiver which is greater than @a anObject, or @c nil if there is no such object (or if @a anObject is @c nil).
+ 
+ @see objectGreaterThan:
+ @see objectLessThanOrEqualTo:
+ */
+- (id) objectGreaterThanOrEqualTo:(id)anObject;
+
+/**
+ Returns the largest object in the receiver which is less than a given object.
+ 
+ @param anObject The object to compare against the objects in the receiver; need not be in the receiver.
+ @return The greatest object in the receiver which is strictly less than @a anObject, or @c nil if there is no such object (or if @a anObject is @c nil).
+ 
+ @see objectGreaterThan:
+ @see objectLessThanOrEqualTo:
+ */
+- (id) objectLessThan:(id)anObject;
+
+/**
+ Returns the largest object in the receiver which is less than or equal to a given object. (This is sometimes called the "floor" of @a anObject.)
+ 
+ @param anObject The object to compare against the objects in the receiver; need not be in the receiver.
+ @return The object in the receiver which is equal to @a anObject if there is one, otherwise the greatest object in the receiver which is less than @a anObject, or @c nil if there is no such object (or if @a anObject is @c nil).
+ 
+ @see objectGreaterThanOrEqualTo:
+ @see objectLessThan:
+ */
+- (id) objectLessThanOrEqualTo:(id)anObject;
+
 // @}
 @end
@@ -0,0 +1,43 @@
+/*
+ CHDataStructures.framework -- CHSplayTree.h
+ 
+ Copyright (c) 2010, Quinn Taylor <http://homepage.mac.com/quinntaylor>
+ 
+ This source code is released under the ISC License. <http://www.opensource.org/licenses/isc-license>
+ 
+ Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted, provided that the above copyright notice and this permission notice appear in all copies.
+ 
+ The software is  provided "as is", without warranty of any kind, including all implied warranties of merchantability and fitness. In no event shall the authors or copyright holders be liable for any claim, damages, or other liability, whether in an action of contract, tort, or otherwise, arising from, out of, or in connection with the software or the use or other dealings in the software.
+ */
+
+#import "CHAbstractBinarySearchTree.h"
+
+/**
+ @file CHSplayTree.h
+ A <a href="http://en.wikipedia.org/wiki/Splay_tree">Splay tree</a> implementation of CHSearchTree.
+ */
+
+/**
+ A <a href="http://en.wikipedia.org/wiki/Splay_tree">Splay tree</a>, a self-adjusting binary search tree which moves each object it finds to the root. No balancing information is stored in the nodes; instead, each search, insertion and removal "splays" the tree, using rotations which move the node at the end of the search path to the root while roughly halving the depth of every node along the path.
+ 
+ A single operation may take O(n) time, but any sequence of m operations takes O(m log n) time in total, so the amortized cost of each operation is O(log n), just as in a balanced tree. More importantly, objects which are accessed often stay near the root, so when searches are concentrated on a small set of objects (such as a Zipfian or other skewed distribution, or repeated searches for the same object) a splay tree can be much faster than a balanced tree, whose shape does not depend on which objects are searched for. Sequential access (searching for every object in ascending order) also takes only O(n) time in total. When searches are uniformly random, however, the cost of the rotations makes a splay tree slower than a balanced tree.
+ 
+ This implementation uses the top-down splaying algorithm from the original paper, which splays while descending the tree, so no stack of ancestors is needed:
+ 
+ <div style="margin: 0 25px; font-weight: bold;">
+ D. D. Sleator and R. E. Tarjan. "Self-Adjusting Binary Search Trees." <em>Journal of the ACM</em>, 32(3):652-686, 1985.
+ </div>
+ 
+ Since \link #member: -member:\endlink and \link #containsObject: -containsObject:\endlink change the shape of the tree, they count as modifications: they invalidate any enumerators and cursors on the receiver (and cannot be called inside a fast enumeration loop over it), and a tree which is shared between threads must be locked while they are called. Other searches, such as \link #objectGreaterThan: -objectGreaterThan:\endlink or \link #rankOfObject: -rankOfObject:\endlink, leave the tree unchanged. A \link #snapshot snapshot\endlink of a splay tree is never splayed, so it may be searched from any thread; while the receiver shares nodes with a snapshot, splaying copies those on the search path, just as other modifications do.
+ */
+@interface CHSplayTree : CHAbstractBinarySearchTree
+
+/**
+ Returns the object in the receiver which is equal to a given object, and splays the tree so the object is at the root. If there is no such object, the last object compared with @a anObject is moved to the root instead.
+ 
+ @param anObject The object to search for in the receiver.
+ @return The object in the receiver which is equal to @a anObject, or @c nil if there is none.
+ */
+- (id) member:(id)anObject;
+
+@end
@@ -0,0 +1,174 @@
+/*
+ CHDataStructures.framework -- CHSplayTree.m
+ 
+ Copyright (c) 2010, Quinn Taylor <http://homepage.mac.com/quinntaylor>
+ 
+ This source code is released under the ISC License. <http://www.opensource.org/licenses/isc-license>
+ 
+ Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby granted, provided that the above copyright notice and this permission notice appear in all copies.
+ 
+ The software is  provided "as is", without warranty of any kind, including all implied warranties of merchantability and fitness. In no event shall the authors or copyright holders be liable for any claim, damages, or other liability, whether in an action of contract, tort, or otherwise, arising from, out of, or in connection with the software or the use or other dealings in the software.
+ */
+
+#import "CHSplayTree.h"
+#import "CHAbstractBinarySearchTree_Internal.h"
+
+/*
+ Top-down splay, adapted from Sleator's public domain "top-down-size-splay.c". Splays the subtree at 'link' so that the object equal to 'anObject' (or else the last node on the search path) becomes the root, and returns the new root. Sets 'found' to whether the new root is equal to 'anObject'.
+ 
+ Nodes which end up to the left of the search path are linked into a "left tree" (through its rightmost node, 'l') and those to the right into a "right tree" (through its leftmost node, 'r'); the children of 'assembly' hold the roots of the right and left trees respectively. Subtree sizes are fixed up afterwards along the spines of the two trees, since only those nodes have new descendants.
+ 
+ Every node on the search path (and each node rotated up in a zig-zig) is modified, so any of them which are shared with a snapshot are copied as they are reached.
+ */
+static CHBinaryTreeNode* splay(CHBinaryTreeNodePool *pool, CHSearchTreeComparator *comparator,
+                               CHBinaryTreeNode **link, CHBinaryTreeNode *sentinel,
+                               id anObject, BOOL *found)
+{
+	CHBinaryTreeNode assembly, *l, *r, *node;
+	CHBinaryTreeNode *current = CHUnshareBinaryTreeNode(pool, link, sentinel);
+	assembly.left = assembly.right = sentinel;
+	l = r = &assembly;
+	NSUInteger leftSize = 0, rightSize = 0;
+	NSComparisonResult comparison;
+	while (1) {
+		comparison = CHSearchTreeCompare(comparator, current->object, anObject);
+		if (comparison == NSOrderedDescending) {
+			if (current->left == sentinel)
+				break;
+			comparison = CHSearchTreeCompare(comparator, current->left->object, anObject);
+			if (comparison == NSOrderedDescending) {
+				// Zig-zig: rotate right before linking.
+				node = CHUnshareBinaryTreeNode(pool, &current->left, sentinel);
+				current->left = node->right;
+				node->right = current;
+				CHUpdateSubtreeSize(current);
+				current = node;
+				if (current->left == sentinel)
+					break;
+			}
+			r->left = current; // Link right.
+			r = current;
+			current = CHUnshareBinaryTreeNode(pool, &current->left, sentinel);
+			rightSize += r->right->size + 1;
+		}
+		else if (comparison == NSOrderedAscending) {
+			if (current->right == sentinel)
+				break;
+			comparison = CHSearchTreeCompare(comparator, current->right->object, anObject);
+			if (comparison == NSOrderedAscending) {
+				// Zig-zig: rotate left before linking.
+				node = CHUnshareBinaryTreeNode(pool, &current->right, sentinel);
+				current->right = node->left;
+				node->left = current;
+				CHUpdateSubtreeSize(current);
+				current = node;
+				if (current->right == sentinel)
+					break;
+			}
+			l->right = current; // Link left.
+			l = current;
+			current = CHUnshareBinaryTreeNode(pool, &current->right, sentinel);
+			leftSize += l->left->size + 1;
+		}
+		else
+			break;
+	}
+	*found = (comparison == NSOrderedSame);
+	// Count the subtrees of 'current', which will be attached to the left and right trees.
+	leftSize += current->left->size;
+	rightSize += current->right->size;
+	current->size = (u_int32_t) (leftSize + rightSize + 1);
+	l->right = r->left = sentinel;
+	// Each node on the spine of a tree loses the nodes above it on the spine.
+	for (node = assembly.right; node != sentinel; node = node->right) {
+		node->size = (u_int32_t) leftSize;
+		leftSize -= node->left->size + 1;
+	}
+	for (node = assembly.left; node != sentinel; node = node->left) {
+		node->size = (u_int32_t) rightSize;
+		rightSize -= node->right->size + 1;
+	}
+	// Assemble the left tree, 'current', and the right tree.
+	l->right = current->left;
+	r->left = current->right;
+	current->left = assembly.right;
+	current->right = assembly.left;
+	return current;
+}
+
+@implementation CHSplayTree
+
+- (void) addObject:(id)anObject {
+	if (anObject == nil)
+		CHNilArgumentException([self class], _cmd);
+	++mutations;
+
+	[anObject retain]; // Must retain whether replacing value or adding new node
+	CHBinaryTreeNode *root = header->right, *node;
+	if (root == sentinel) {
+		node = CHCreateBinaryTreeNodeFromPool(nodePool, anObject);
+		node->left = node->right = sentinel;
+		header->right = node;
+		++count;
+		return;
+	}
+	BOOL found;
+	root = splay(nodePool, comparator, &header->right, sentinel, anObject, &found);
+	if (found) {
+		// Replace the existing object with the new object.
+		[root->object release];
+		root->object = anObject;
+		header->right = root;
+		return;
+	}
+	// The new node becomes the root, splitting the old root from one of its subtrees.
+	node = CHCreateBinaryTreeNodeFromPool(nodePool, anObject);
+	int dir = (CHSearchTreeCompare(comparator, root->object, anObject) == NSOrderedAscending);
+	node->link[!dir] = root;
+	node->link[dir] = root->link[dir];
+	root->link[dir] = sentinel;
+	CHUpdateSubtreeSize(root);
+	CHUpdateSubtreeSize(node);
+	header->right = node;
+	++count;
+}
+
+- (id) member:(id)anObject {
+	if (count == 0 || anObject == nil)
+		return nil;
+	++mutations;
+	BOOL found;
+	header->right = splay(nodePool, comparator, &header->right, sentinel, anObject, &found);
+	return found ? header->right->object : nil;
+}
+
+- (void) removeObject:(id)anObject {
+	if (count == 0 || anObject == nil)
+		return;
+	++mutations;
+	// Don't copy any nodes shared with a snapshot unless the object is there to remove.
+	// (The search in the superclass doesn't splay, since that would copy nodes too.)
+	if (CHSearchTreeMayShareNodes() && [super member:anObject] == nil)
+		return;
+
+	BOOL found;
+	CHBinaryTreeNode *root = splay(nodePool, comparator, &header->right, sentinel, anObject, &found);
+	if (!found) {
+		header->right = root;
+		return;
+	}
+	[root->object release];
+	--count;
+	if (root->left == sentinel)
+		header->right = root->right;
+	else {
+		// Every object on the left is less than anObject, so splaying for it brings the greatest to the top, with no right child.
+		CHBinaryTreeNode *newRoot = splay(nodePool, comparator, &root->left, sentinel, anObject, &found);
+		newRoot->right = root->right;
+		CHUpdateSubtreeSize(newRoot);
+		header->right = newRoot;
+	}
+	CHRecycleBinaryTreeNode(nodePool, root);
+}
+
+@end
@@ -34,9 +34,16 @@
  
  Insertion is a cross between standard BST insertion and heap insertion: a new leaf node is created in the appropriate sorted location, and a random value is assigned. The path back to the root is then retraced, rotating the node upward as necessary until the new node's priority is greater than both its children's. Deletion is generally implemented by rotating the node to be removed down the tree until it becomes a leaf and can be clipped. At each rotation, the child whose priority is higher is rotated to become the root, and the node to delete descends the opposite subtree. (It is also possible to swap with the successor node as is common in BST deletion, but in order to preserve the tree's balance, the priorities should also be swapped, and the successor be bubbled up until the heap property is again satisfied, an approach quite similar to insertion.)
  
- This treap implementation adds two methods to those in the CHSearchTree protocol:
+ This treap implementation adds several methods to those in the CHSearchTree protocol:
  - \link #addObject:withPriority: -addObject:withPriority:\endlink
  - \link #priorityForObject: -priorityForObject:\endlink
+ - \link #setRandomSeed: -setRandomSeed:\endlink
+ - \link #splitAtObject: -splitAtObject:\endlink
+ - \link #mergeWithTreap: -mergeWithTreap:\endlink
+ 
+ Random priorities come from a fast xorshift generator in each treap, rather than a shared system generator, so adding an object doesn't require a system call or a lock. The generator is seeded randomly, but may be given a seed to make the shape of a treap reproducible, which is useful for testing and benchmarking.
+ 
+ Since the heap property determines the shape of a treap, a treap can be split in two (or two treaps merged into one) by rearranging only the nodes along a single path, in O(log n) expected time regardless of the number of objects moved. This makes treaps useful for partitioning a sorted collection, such as dividing objects into windows of time.
  
  Treaps were originally described in the following paper:
  
@@ -50,12 +57,15 @@
  @todo Examine performance issues (treaps are often the slowest balanced tree).
  */
 @interface CHTreap : CHAbstractBinarySearchTree
+{
+	u_int64_t randomState; // The state of the generator for random priorities.
+}
 
 /** Priority when an object is not found in a treap (max value for u_int32_t). */
 #define CHTreapNotFound UINT32_MAX
 
 /**
- Add an object to the tree with a randomly-generated priority value. This encourages (but doesn't necessarily guarantee) well-balanced treaps. Random numbers are generated using @c arc4random and cast as an NSUInteger.
+ Add an object to the tree with a randomly-generated priority value. This encourages (but doesn't necessarily guarantee) well-balanced treaps. Random numbers are generated by the receiver's own generator (see #setRandomSeed:).
  
  @param anObject The object to add to the treap.
  
@@ -86,4 +96,38 @@
  */
 - (NSUInteger) priorityForObject:(id)anObject;
 
+/**
+ Seeds the generator for the random priorities assigned by #addObject: (and when building a treap directly from sorted objects). Two treaps with the same seed which have the same objects added in the same order will have the same shape. A new treap is seeded randomly.
+ 
+ @param seed The seed for the generator. Any value is allowed.
+ */
+- (void) setRandomSeed:(unsigned long long)seed;
+
+/**
+ Removes every object which is greater than or equal to a given object from the receiver, and returns them in a new treap. The receiver keeps the objects which are less than @a anObject. Only the nodes along a single path are rearranged, and no objects are copied or retained, so this takes O(log n) expected time no matter how many objects are moved.
+ 
+ However, if the receiver shares its nodes with a \link CHAbstractBinarySearchTree#snapshot snapshot\endlink, it is first compacted (see \link CHAbstractBinarySearchTree#compact -compact\endlink) so the two halves don't share nodes with the snapshot, which copies every node in O(n) time. Once compacted, the receiver no longer shares its nodes, so later splits take O(log n) time again until the next snapshot.
+ 
+ @param anObject The object at which to split the receiver; need not be in the receiver.
+ @return A new autoreleased treap of the same class and ordering as the receiver, containing the objects removed from the receiver. Its generator is seeded from the receiver's, so splitting a treap with a known seed gives reproducible results.
+ 
+ @throw NSInvalidArgumentException if @a anObject is @c nil.
+ 
+ @attention The receiver and the returned treap share storage for their nodes, which is what allows objects to be moved between them so cheaply. They may be used independently, but must not be modified (or deallocated) at the same time on different threads, even if each has its own lock. Calling \link CHAbstractBinarySearchTree#compact -compact\endlink on a treap (or copying it) gives it storage of its own.
+ 
+ @see #mergeWithTreap:
+ */
+- (CHTreap*) splitAtObject:(id)anObject;
+
+/**
+ Moves every object from another treap into the receiver, leaving the other treap empty. Every object in one treap must be less than every object in the other (as when they were produced by #splitAtObject:), but either may hold the lesser objects. If the two treaps share storage because one was split from the other (or both from a common treap), or if the receiver is empty, only the nodes along the right spine of one and the left spine of the other are rearranged, and no objects are copied or retained, so this takes O(log n) expected time. Otherwise, the nodes of @a otherTreap are copied, which takes O(m) time for m objects.
+ 
+ @param otherTreap The treap whose objects are to be moved into the receiver. It must be sorted in the same order as the receiver, using the same comparison function and context (or block), or both using @c -compare:.
+ 
+ @throw NSInvalidArgumentException if @a otherTreap is @c nil, if it is not sorted the same way as the receiver (even if either treap is empty), or if the objects in the two treaps overlap.
+ 
+ @see #splitAtObject:
+ */
+- (void) mergeWithTreap:(CHTreap*)otherTreap;
+
 @end
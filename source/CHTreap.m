@@ -13,6 +13,86 @@
 #import "CHTreap.h"
 #import "CHAbstractBinarySearchTree_Internal.h"
 
+// Advances an xorshift64* generator, which needs only a few instructions and passes common statistical tests. The state must never be 0.
+static inline u_int64_t nextRandom(u_int64_t *state) {
+	u_int64_t x = *state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * 2685821657736338717ULL;
+}
+
+// The high bits of an xorshift64* result are the most random.
+static inline u_int32_t nextRandomPriority(u_int64_t *state) {
+	return (u_int32_t) (nextRandom(state) >> 32);
+}
+
+// Fixes the sizes of nodes whose children were changed, given in the order they were reached from the top. Each node's new children are either unchanged subtrees or nodes which come later, so the sizes are fixed from the bottom up.
+static void updateSizes(CHEnumerationStack *path) {
+	while (path->size > 0)
+		CHUpdateSubtreeSize(path->nodes[--(path->size)]);
+}
+
+// Splits a subtree into one with the objects less than 'anObject' and one with the rest. Each node along the search path goes to one side or the other, taking the subtree on its far side with it, so the heap property is maintained. None of the nodes may be shared with a snapshot.
+static void splitSubtree(CHSearchTreeComparator *comparator,
+                         CHBinaryTreeNode *root, CHBinaryTreeNode *sentinel, id anObject,
+                         CHBinaryTreeNode **lesser, CHBinaryTreeNode **greater)
+{
+	// The lesser tree is attached to the right of 'assembly', the greater to the left.
+	CHBinaryTreeNode assembly, *l = &assembly, *r = &assembly, *current = root;
+	CHEnumerationStack path;
+	CHEnumerationStackInit(&path);
+	while (current != sentinel) {
+		CHEnumerationStackPush(&path, current);
+		if (CHSearchTreeCompare(comparator, current->object, anObject) == NSOrderedAscending) {
+			l->right = current;
+			l = current;
+			current = current->right;
+		} else {
+			r->left = current;
+			r = current;
+			current = current->left;
+		}
+	}
+	l->right = r->left = sentinel;
+	updateSizes(&path);
+	CHEnumerationStackFree(&path);
+	*lesser = assembly.right;
+	*greater = assembly.left;
+}
+
+// Joins two subtrees, where every object in 'lesser' is less than every object in 'greater', by merging the right spine of one with the left spine of the other in order of priority. Nodes on the spines which are shared with a snapshot are copied before they are relinked.
+static CHBinaryTreeNode* joinSubtrees(CHBinaryTreeNodePool *pool,
+                                      CHBinaryTreeNode *lesser, CHBinaryTreeNode *greater,
+                                      CHBinaryTreeNode *sentinel)
+{
+	CHBinaryTreeNode *root, **link = &root;
+	CHEnumerationStack path;
+	CHEnumerationStackInit(&path);
+	while (lesser != sentinel && greater != sentinel) {
+		if (lesser->priority >= greater->priority) {
+			if (CHBinaryTreeNodeIsShared(pool, lesser))
+				lesser = CHCopySharedBinaryTreeNode(pool, lesser, sentinel);
+			CHEnumerationStackPush(&path, lesser);
+			*link = lesser;
+			link = &(lesser->right);
+			lesser = lesser->right;
+		} else {
+			if (CHBinaryTreeNodeIsShared(pool, greater))
+				greater = CHCopySharedBinaryTreeNode(pool, greater, sentinel);
+			CHEnumerationStackPush(&path, greater);
+			*link = greater;
+			link = &(greater->left);
+			greater = greater->left;
+		}
+	}
+	*link = (lesser != sentinel) ? lesser : greater;
+	updateSizes(&path);
+	CHEnumerationStackFree(&path);
+	return root;
+}
+
 @implementation CHTreap
 
 // Two-way single rotation; 'dir' is the side to which the root should rotate.
@@ -21,16 +101,19 @@
 	node->link[!dir] = save->link[dir];           \
 	save->link[dir] = node;                       \
 	parent->link[(parent->right == node)] = save; \
+	save->size = node->size;                      \
+	CHUpdateSubtreeSize(node);                    \
 }
 
 - (id) init {
 	if ((self = [super init]) == nil) return nil;
 	header->priority = CHTreapNotFound; // This is the highest possible priority
+	[self setRandomSeed:((unsigned long long)arc4random() << 32) | arc4random()];
 	return self;
 }
 
 - (void) addObject:(id)anObject {
-	[self addObject:anObject withPriority:arc4random()];
+	[self addObject:anObject withPriority:nextRandomPriority(&randomState)];
 }
 
 - (void) addObject:(id)anObject withPriority:(NSUInteger)priority {
@@ -42,11 +125,13 @@
 	CHBinaryTreeStack * stack;
 	stack = [[CHBinaryTreeStack alloc] init];
 	
+	// Every node on the path changes (if only its size), so none may be shared.
 	sentinel->object = anObject; // Assure that we find a spot to insert
 	NSComparisonResult comparison;
-	while (comparison = [current->object compare:anObject]) {
+	while (comparison = CHSearchTreeCompare(comparator, current->object, anObject)) {
 		[stack push:current];
-		current = current->link[comparison == NSOrderedAscending]; // R on YES
+		++(current->size); // Assume the object is new; undo below if not.
+		current = CHUnshareBinaryTreeNode(nodePool, &current->link[comparison == NSOrderedAscending], sentinel); // R on YES
 	}
 	parent = [stack pop];
 	NSAssert(parent != nil, @"Illegal state, parent should never be nil!");
@@ -57,6 +142,11 @@
 		// Replace the existing object with the new object.
 		[current->object release];
 		current->object = anObject;
+		// Retrace the path (without touching the node itself) to undo the sizes.
+		CHBinaryTreeNode *node;
+		for (node = header->right; node != current;
+		     node = node->link[CHSearchTreeCompare(comparator, node->object, anObject) == NSOrderedAscending])
+			--(node->size);
 		// Assign new priority; bubble down if needed, or just wait to bubble up
 		current->priority = (u_int32_t) (priority % CHTreapNotFound);
 		while (current->left != current->right) { // sentinel check
@@ -64,18 +154,19 @@
 			if (current->priority >= current->link[direction]->priority)
 				break;
 			NSAssert(parent != nil, @"Illegal state, parent should never be nil!");
+			// The child rotates up and becomes the parent of the current node.
+			node = CHUnshareBinaryTreeNode(nodePool, &current->link[direction], sentinel);
 			singleRotation(current, !direction, parent);
-			parent = current;
-			current = current->link[!direction];
+			parent = node;
 		}
 	} else {
-		current = CHCreateBinaryTreeNodeWithObject(anObject);
+		current = CHCreateBinaryTreeNodeFromPool(nodePool, anObject);
 		current->left   = sentinel;
 		current->right  = sentinel;
 		current->priority = (u_int32_t) (priority % CHTreapNotFound);
 		++count;
 		// Link from parent as the correct child, based on the last comparison
-		comparison = [parent->object compare:anObject];
+		comparison = CHSearchTreeCompare(comparator, parent->object, anObject);
 		parent->link[comparison == NSOrderedAscending] = current; // R if YES
 	}
 	
@@ -96,6 +187,9 @@
 	if (count == 0 || anObject == nil)
 		return;
 	++mutations;
+	// Don't copy any nodes shared with a snapshot unless the object is there to remove.
+	if (CHSearchTreeMayShareNodes() && [self member:anObject] == nil)
+		return;
 	
 	CHBinaryTreeNode *parent = nil, *current = header;
 	NSComparisonResult comparison;
@@ -103,27 +197,35 @@
 	
 	// First, we must locate the object to be removed, or we exit if not found
 	sentinel->object = anObject; // Assure that we stop at a sentinel leaf node
-	while (comparison = [current->object compare:anObject]) {
+	while (comparison = CHSearchTreeCompare(comparator, current->object, anObject)) {
 		parent = current;
-		current = current->link[comparison == NSOrderedAscending]; // R on YES
+		--(current->size); // Assume the object is present; undo below if not.
+		current = CHUnshareBinaryTreeNode(nodePool, &current->link[comparison == NSOrderedAscending], sentinel); // R on YES
 	}
 	NSAssert(parent != nil, @"Illegal state, parent should never be nil!");
 	
-	if (current != sentinel) {
+	if (current == sentinel) {
+		for (current = header; current != sentinel;
+		     current = current->link[CHSearchTreeCompare(comparator, current->object, anObject) == NSOrderedAscending])
+			++(current->size);
+	}
+	else {
 		// Percolate node down the tree, always rotating towards lower priority
+		// (The node's size excludes itself, so subtrees rotated above it don't.)
 		BOOL isRightChild;
+		--(current->size);
 		while (current->left != current->right) { // sentinel check
 			direction = (current->right->priority > current->left->priority);
 			isRightChild = (parent->right == current);
+			CHUnshareBinaryTreeNode(nodePool, &current->link[direction], sentinel);
 			singleRotation(current, !direction, parent);
+			--(current->size);
 			parent = parent->link[isRightChild];
 		}
 //		NSAssert(parent != nil, @"Illegal state, parent should never be nil!");
 		parent->link[parent->right == current] = sentinel;
-		if (kCHGarbageCollectionNotEnabled) {
-			[current->object release];
-			free(current);
-		}
+		[current->object release];
+		CHRecycleBinaryTreeNode(nodePool, current);
 		--count;
 	}
 }
@@ -131,14 +233,89 @@
 - (NSUInteger) priorityForObject:(id)anObject {
 	if (anObject == nil)
 		return CHTreapNotFound;
-	sentinel->object = anObject; // Make sure the target value is always "found"
+	CHSearchTreeComparator localComparator = *comparator; // See -member:
 	CHBinaryTreeNode *current = header->right;
 	NSComparisonResult comparison;
-	while (comparison = [current->object compare:anObject]) // while not equal
+	while (current != sentinel &&
+	       (comparison = CHSearchTreeCompare(&localComparator, current->object, anObject))) // while not equal
 		current = current->link[comparison == NSOrderedAscending]; // R on YES
 	return (current != sentinel) ? current->priority : CHTreapNotFound;
 }
 
+// Splitting the priority range into one band per level (highest at the root) satisfies the heap property, while priorities within a level remain random.
+- (void) prepareBulkLoadedNode:(CHBinaryTreeNode*)node
+                          size:(NSUInteger)size
+                         depth:(NSUInteger)depth
+                      maxDepth:(NSUInteger)maxDepth
+{
+	u_int32_t band = (u_int32_t) (CHTreapNotFound / (maxDepth + 1));
+	node->priority = (u_int32_t) (maxDepth - depth) * band + nextRandomPriority(&randomState) % band;
+}
+
+// The seed is scrambled with the SplitMix64 finalizer, so similar seeds (such as 1 and 2) give unrelated sequences, and no seed leaves the generator stuck at 0.
+- (void) setRandomSeed:(unsigned long long)seed {
+	u_int64_t z = seed + 0x9E3779B97F4A7C15ULL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z ^= z >> 31;
+	randomState = (z != 0) ? z : 0x9E3779B97F4A7C15ULL;
+}
+
+- (CHTreap*) splitAtObject:(id)anObject {
+	if (anObject == nil)
+		CHNilArgumentException([self class], _cmd);
+	CHTreap *tail = [[[[self class] alloc] init] autorelease];
+	CHSearchTreeComparatorCopy(tail->comparator, comparator);
+	[tail setRandomSeed:nextRandom(&randomState)];
+	if (count == 0)
+		return tail;
+	++mutations;
+	// The two treaps will partition the pool, so it can't be shared with snapshots.
+	if (CHSearchTreeMayShareNodes())
+		[self compact];
+
+	CHBinaryTreeNode *lesser, *greater;
+	splitSubtree(comparator, header->right, sentinel, anObject, &lesser, &greater);
+	header->right = lesser;
+	if (greater != sentinel) {
+		[tail partitionNodesWithTree:self];
+		tail->header->right = greater;
+		tail->count = greater->size;
+		count -= greater->size;
+	}
+	return tail;
+}
+
+- (void) mergeWithTreap:(CHTreap*)otherTreap {
+	if (otherTreap == nil)
+		CHNilArgumentException([self class], _cmd);
+	// Check even if either treap is empty, since the order is what the treaps promise.
+	if (!CHSearchTreeComparatorsMatch(comparator, otherTreap->comparator))
+		CHInvalidArgumentException([self class], _cmd, @"The treaps are not sorted in the same order.");
+	if (otherTreap->count == 0)
+		return;
+	BOOL otherIsGreater = YES;
+	if (count > 0) {
+		if (CHSearchTreeCompare(comparator, [self lastObject], [otherTreap firstObject]) == NSOrderedAscending)
+			otherIsGreater = YES;
+		else if (CHSearchTreeCompare(comparator, [otherTreap lastObject], [self firstObject]) == NSOrderedAscending)
+			otherIsGreater = NO;
+		else
+			CHInvalidArgumentException([self class], _cmd, @"The objects in the treaps overlap.");
+	}
+	++mutations;
+	if (count == 0 && otherTreap->nodePool != nodePool)
+		[self partitionNodesWithTree:otherTreap]; // Adopt the storage so no nodes are copied.
+
+	NSUInteger otherCount = otherTreap->count;
+	CHBinaryTreeNode *otherRoot = [self takeNodesOfTree:otherTreap];
+	if (otherIsGreater)
+		header->right = joinSubtrees(nodePool, header->right, otherRoot, sentinel);
+	else
+		header->right = joinSubtrees(nodePool, otherRoot, header->right, sentinel);
+	count += otherCount;
+}
+
 - (NSString*) debugDescriptionForNode:(CHBinaryTreeNode*)node {
 	return [NSString stringWithFormat:@"[%11d]\t\"%@\"",
 			node->priority, node->object];
@@ -21,27 +21,34 @@
 		CHNilArgumentException([self class], _cmd);
 	++mutations;
 	
-	CHBinaryTreeNode *parent = header, *current = header->right;
+	// Every node on the path changes (if only its size), so none may be shared.
+	CHBinaryTreeNode *parent = header;
+	CHBinaryTreeNode *current = CHUnshareBinaryTreeNode(nodePool, &header->right, sentinel);
 	sentinel->object = anObject; // Assure that we find a spot to insert
 	NSComparisonResult comparison;
-	while (comparison = [current->object compare:anObject]) {
+	while (comparison = CHSearchTreeCompare(comparator, current->object, anObject)) {
 		parent = current;
-		current = current->link[comparison == NSOrderedAscending]; // R on YES
+		++(current->size); // Assume the object is new; undo below if not.
+		current = CHUnshareBinaryTreeNode(nodePool, &current->link[comparison == NSOrderedAscending], sentinel); // R on YES
 	}
 	
 	[anObject retain]; // Must retain whether replacing value or adding new node
 	if (current != sentinel) {
 		// Replace the existing object with the new object.
 		[current->object release];
-		current->object = anObject;		
+		current->object = anObject;
+		// Retrace the path (without touching the node itself) to undo the sizes.
+		for (parent = header->right; parent != current;
+		     parent = parent->link[CHSearchTreeCompare(comparator, parent->object, anObject) == NSOrderedAscending])
+			--(parent->size);
 	} else {
 		// Create a new node to hold the value being inserted
-		current = CHCreateBinaryTreeNodeWithObject(anObject);
+		current = CHCreateBinaryTreeNodeFromPool(nodePool, anObject);
 		current->left   = sentinel;
 		current->right  = sentinel;
 		++count;
 		// Link from parent as the proper child, based on last comparison
-		comparison = [parent->object compare:anObject]; // restore prior compare
+		comparison = CHSearchTreeCompare(comparator, parent->object, anObject); // restore prior compare
 		parent->link[comparison == NSOrderedAscending] = current;
 	}
 }
@@ -53,19 +60,27 @@
 	if (count == 0 || anObject == nil)
 		return;
 	++mutations;
+	// Don't copy any nodes shared with a snapshot unless the object is there to remove.
+	if (CHSearchTreeMayShareNodes() && [self member:anObject] == nil)
+		return;
 	
 	CHBinaryTreeNode *parent = nil, *current = header;
 	
 	sentinel->object = anObject; // Assure that we find a spot to insert
 	NSComparisonResult comparison;
-	while (comparison = [current->object compare:anObject]) {
+	while (comparison = CHSearchTreeCompare(comparator, current->object, anObject)) {
 		parent = current;
-		current = current->link[comparison == NSOrderedAscending]; // R on YES
+		--(current->size); // Assume the object is present; undo below if not.
+		current = CHUnshareBinaryTreeNode(nodePool, &current->link[comparison == NSOrderedAscending], sentinel); // R on YES
 	}
 	NSAssert(parent != nil, @"Illegal state, parent should never be nil!");
 	// Exit if the specified node was not found in the tree.
-	if (current == sentinel)
+	if (current == sentinel) {
+		for (current = header; current != sentinel;
+		     current = current->link[CHSearchTreeCompare(comparator, current->object, anObject) == NSOrderedAscending])
+			++(current->size);
 		return;
+	}
 
 	[current->object release]; // Object must be released in any case
 	--count;
@@ -73,21 +88,21 @@
 		// One or both of the child pointers are null, so removal is simpler
 		parent->link[parent->right == current]
 			= current->link[current->left == sentinel];
-		if (kCHGarbageCollectionNotEnabled)
-			free(current);
+		CHRecycleBinaryTreeNode(nodePool, current);
 	} else {
 		// The most complex case: removing a node with 2 non-null children
 		// (Replace object with the leftmost object in the right subtree.)
 		parent = current;
-		CHBinaryTreeNode *replacement = current->right;
+		--(current->size);
+		CHBinaryTreeNode *replacement = CHUnshareBinaryTreeNode(nodePool, &current->right, sentinel);
 		while (replacement->left != sentinel) {
 			parent = replacement;
-			replacement = replacement->left;
+			--(replacement->size);
+			replacement = CHUnshareBinaryTreeNode(nodePool, &replacement->left, sentinel);
 		}
 		current->object = replacement->object;
 		parent->link[parent->right == replacement] = replacement->right;
-		if (kCHGarbageCollectionNotEnabled)
-			free(replacement);
+		CHRecycleBinaryTreeNode(nodePool, replacement);
 	}
 }
 
@@ -10,6 +10,12 @@
 #import "BenchmarkUtils.h"
 #import <CHDataStructures/CHDataStructures.h>
 
+// The number of insertions (then removals) at each index in the middle of a deque.
+#define kIndexedEditCount 1000
+
+@interface BenchmarkDeque ()
+- (void) benchmarkIndexedEditsOfClass:(Class)testClass;
+@end
 
 @implementation BenchmarkDeque
 
@@ -68,6 +74,36 @@
 		[deque release];
 	}
 	
+	// Cycles objects through the buffer many times, so indexes wrap constantly.
+	printf("\nappendObject:/removeFirstObject");
+	for (NSArray * array in objects) {
+		deque = [[testClass alloc] init];
+		[deque appendObjectsFromArray:array];
+		startTime = timestamp();
+		for (NSUInteger item = 1; item <= 1000000; item++) {
+			[deque appendObject:[deque firstObject]];
+			[deque removeFirstObject];
+		}
+		printf("\t%f", timestamp() - startTime);
+		[deque release];
+	}
+	
+	// Only a circular buffer can access by index in constant time.
+	printf("\nobjectAtIndex:     ");
+	for (NSArray * array in objects) {
+		if (![testClass isSubclassOfClass:[CHCircularBuffer class]] && [array count] > 10000) {
+			printf("\t(skipped)");
+			continue;
+		}
+		deque = [[testClass alloc] init];
+		[deque appendObjectsFromArray:array];
+		startTime = timestamp();
+		for (NSUInteger index = 0; index < [array count]; index++)
+			[deque objectAtIndex:index];
+		printf("\t%f", timestamp() - startTime);
+		[deque release];
+	}
+	
 	printf("\nremoveAllObjects:  ");
 	for (NSArray * array in objects) {
 		deque = [[testClass alloc] init];
@@ -115,6 +151,50 @@
 	[self testClass:[CHListDeque class]];
 	
 	[objects release], objects = nil;
+	
+	[self benchmarkIndexedEditsOfClass:[CHCircularBufferDeque class]];
+	[self benchmarkIndexedEditsOfClass:[NSMutableArray class]];
+}
+
+// Inserts and then removes objects at fixed positions in a large deque. Half of the deque is prepended, so the circular buffer wraps around the end of its array. Since a circular buffer shifts whichever side of the index is shorter, edits near either end should be fast at any size, while those in the middle move up to half of the objects.
+- (void) benchmarkIndexedEditsOfClass:(Class)testClass {
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	CHQuietLog(@"\n* %@ (%u edits at each index, seconds)", testClass, kIndexedEditCount);
+	
+	NSUInteger sizes[] = {1000, 10000, 100000, 1000000}, sizeCount = 4;
+	double fractions[] = {0.0, 0.25, 0.5, 0.75, 1.0};
+	NSString *labels[] = {@"index 1", @"count/4", @"count/2", @"3*count/4", @"count-1"};
+	id anObject = [NSNull null];
+	NSMutableArray *deque;
+	double startTime, insertTime;
+	NSUInteger index, item;
+	
+	printf("(Index)              ");
+	for (NSUInteger s = 0; s < sizeCount; s++)
+		printf("\t%-8lu         ", (unsigned long)sizes[s]);
+	for (NSUInteger f = 0; f < 5; f++) {
+		printf("\n%-20s", [labels[f] UTF8String]);
+		for (NSUInteger s = 0; s < sizeCount; s++) {
+			deque = [[testClass alloc] init];
+			for (item = 0; item < sizes[s] / 2; item++)
+				[deque insertObject:anObject atIndex:0];
+			for (; item < sizes[s]; item++)
+				[deque addObject:anObject];
+			// Stay one slot inside each end, so neither end is simply moved.
+			index = 1 + (NSUInteger)(fractions[f] * (sizes[s] - 2));
+			startTime = timestamp();
+			for (item = 0; item < kIndexedEditCount; item++)
+				[deque insertObject:anObject atIndex:index];
+			insertTime = timestamp() - startTime;
+			startTime = timestamp();
+			for (item = 0; item < kIndexedEditCount; item++)
+				[deque removeObjectAtIndex:index];
+			printf("\t%f / %f", insertTime, timestamp() - startTime);
+			[deque release];
+		}
+	}
+	CHQuietLog(@"");
+	[pool drain];
 }
 
 + (NSUInteger) executionOrder { return 1; }
@@ -9,6 +9,141 @@
 #import "BenchmarkQueue.h"
 #import "BenchmarkUtils.h"
 #import <CHDataStructures/CHDataStructures.h>
+#import <pthread.h>
+#import <sched.h>
+
+@interface BenchmarkQueue ()
+- (void) benchmarkMiddleRemovalOfClass:(Class)testClass;
+- (void) benchmarkProducerConsumer;
+@end
+
+#pragma mark Producer/consumer workload
+
+// Shared by the producer and consumer threads of one run of the handoff benchmark.
+// The queue is either a CHSPSCQueue, or a CHCircularBufferQueue guarded by its
+// lock and kept to the same capacity, so neither queue grows without limit.
+typedef struct {
+	id queue;
+	id *objects; // The objects to send, in order.
+	NSUInteger count; // The number of objects to send.
+	NSUInteger capacity; // The most objects which may be in the queue at once.
+	NSUInteger batchSize; // The most objects to move with one call (or one lock).
+	volatile BOOL started; // Set once both threads are ready.
+} HandoffWorkload;
+
+// Sends every object in the workload, waiting whenever the queue is full.
+static void* runHandoffProducer(void *argument) {
+	HandoffWorkload *workload = argument;
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	NSUInteger sent = 0, sending;
+	while (!workload->started)
+		sched_yield();
+	if ([workload->queue isKindOfClass:[CHSPSCQueue class]]) {
+		CHSPSCQueue *queue = workload->queue;
+		while (sent < workload->count) {
+			sending = MIN(workload->batchSize, workload->count - sent);
+			sending = (sending == 1) ? [queue enqueueObject:workload->objects[sent]]
+			                         : [queue enqueueObjects:workload->objects + sent count:sending];
+			if (sending == 0)
+				sched_yield();
+			sent += sending;
+		}
+	}
+	else {
+		CHCircularBufferQueue *queue = workload->queue;
+		while (sent < workload->count) {
+			[queue lock];
+			sending = MIN(workload->batchSize, workload->count - sent);
+			sending = MIN(sending, workload->capacity - [queue count]);
+			for (NSUInteger i = 0; i < sending; i++)
+				[queue addObject:workload->objects[sent + i]];
+			[queue unlock];
+			if (sending == 0)
+				sched_yield();
+			sent += sending;
+		}
+	}
+	[pool drain];
+	return NULL;
+}
+
+// Receives every object in the workload, waiting whenever the queue is empty.
+static void runHandoffConsumer(HandoffWorkload *workload) {
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	NSUInteger received = 0, receiving, attempts = 0;
+	id *batch = malloc(workload->batchSize * sizeof(id));
+	if ([workload->queue isKindOfClass:[CHSPSCQueue class]]) {
+		CHSPSCQueue *queue = workload->queue;
+		while (received < workload->count) {
+			if (workload->batchSize == 1)
+				receiving = ([queue dequeueObject] != nil);
+			else
+				receiving = [queue dequeueObjects:batch maxCount:workload->batchSize];
+			if (receiving == 0)
+				sched_yield();
+			received += receiving;
+			if (++attempts % 1024 == 0) {
+				[pool drain];
+				pool = [[NSAutoreleasePool alloc] init];
+			}
+		}
+	}
+	else {
+		CHCircularBufferQueue *queue = workload->queue;
+		while (received < workload->count) {
+			[queue lock];
+			receiving = MIN(workload->batchSize, [queue count]);
+			for (NSUInteger i = 0; i < receiving; i++) {
+				batch[i] = [queue firstObject];
+				[queue removeFirstObject];
+			}
+			[queue unlock];
+			if (receiving == 0)
+				sched_yield();
+			received += receiving;
+		}
+	}
+	free(batch);
+	[pool drain];
+}
+
+// Shared by the two threads of one run of the round trip benchmark.
+typedef struct {
+	id requests; // Objects sent by the main thread to the echo thread.
+	id replies; // The same objects, sent back.
+	NSUInteger roundTrips;
+} RoundTripWorkload;
+
+// Sends each object which arrives in the requests queue back through the replies queue.
+static void* runEchoThread(void *argument) {
+	RoundTripWorkload *workload = argument;
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	id anObject;
+	for (NSUInteger i = 0; i < workload->roundTrips; i++) {
+		if ([workload->requests isKindOfClass:[CHSPSCQueue class]]) {
+			while ((anObject = [workload->requests dequeueObject]) == nil)
+				;
+			[workload->replies enqueueObject:anObject];
+		}
+		else {
+			do {
+				[workload->requests lock];
+				anObject = [[[workload->requests firstObject] retain] autorelease];
+				[workload->requests removeFirstObject];
+				[workload->requests unlock];
+			} while (anObject == nil);
+			[workload->replies lock];
+			[workload->replies addObject:anObject];
+			[workload->replies unlock];
+		}
+		if (i % 1024 == 0) {
+			[pool drain];
+			pool = [[NSAutoreleasePool alloc] init];
+		}
+	}
+	[pool drain];
+	return NULL;
+}
 
 @implementation BenchmarkQueue
 
@@ -46,6 +181,38 @@
 		[queue release];
 	}
 	
+	// Cycles objects through the buffer many times, so indexes wrap constantly.
+	printf("\naddObject:/removeFirstObject");
+	for (NSArray * array in objects) {
+		queue = [[testClass alloc] init];
+		for (id anObject in array)
+			[queue addObject:anObject];
+		startTime = timestamp();
+		for (NSUInteger item = 1; item <= 1000000; item++) {
+			[queue addObject:[queue firstObject]];
+			[queue removeFirstObject];
+		}
+		printf("\t%f", timestamp() - startTime);
+		[queue release];
+	}
+	
+	// Only a circular buffer can access by index in constant time.
+	printf("\nobjectAtIndex:     ");
+	for (NSArray * array in objects) {
+		if (![testClass isSubclassOfClass:[CHCircularBuffer class]] && [array count] > 10000) {
+			printf("\t(skipped)");
+			continue;
+		}
+		queue = [[testClass alloc] init];
+		for (id anObject in array)
+			[queue addObject:anObject];
+		startTime = timestamp();
+		for (NSUInteger index = 0; index < [array count]; index++)
+			[queue objectAtIndex:index];
+		printf("\t%f", timestamp() - startTime);
+		[queue release];
+	}
+	
 	printf("\nremoveAllObjects:  ");
 	for (NSArray * array in objects) {
 		queue = [[testClass alloc] init];
@@ -93,6 +260,128 @@
 	[self testClass:[CHCircularBufferQueue class]];
 	[self testClass:[CHListQueue class]];
 	[objects release], objects = nil;
+	
+	[self benchmarkMiddleRemovalOfClass:[CHCircularBufferQueue class]];
+	[self benchmarkMiddleRemovalOfClass:[NSMutableArray class]];
+	[self benchmarkProducerConsumer];
+}
+
+// Compares handing objects from one thread to another through a lock-free CHSPSCQueue against a CHCircularBufferQueue guarded by its lock. Throughput is measured with the producer sending as fast as it can, one object at a time and in batches; latency is measured by bouncing an object between two threads through a pair of queues, with both threads polling (so it needs at least 2 processors).
+- (void) benchmarkProducerConsumer {
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	CHQuietLog(@"\n<CHQueue> Producer/consumer handoff between 2 threads");
+	NSUInteger count = 1000000, capacity = 1024, roundTrips = 100000;
+	NSUInteger batchSizes[] = {1, 16, 256}, batchSizeCount = 3;
+	id *objects = malloc(count * sizeof(id));
+	for (NSUInteger i = 0; i < count; i++)
+		objects[i] = [[NSNumber alloc] initWithUnsignedInteger:i];
+	
+	printf("(Objects per second)\tbatch of 1\tbatch of 16\tbatch of 256");
+	for (NSUInteger useLock = 0; useLock <= 1; useLock++) {
+		printf("\n%-20s", useLock ? "CHCircularBufferQueue" : "CHSPSCQueue");
+		for (NSUInteger b = 0; b < batchSizeCount; b++) {
+			id queue = useLock ? [[CHCircularBufferQueue alloc] init]
+			                   : [[CHSPSCQueue alloc] initWithCapacity:capacity];
+			HandoffWorkload workload = {queue, objects, count, capacity, batchSizes[b], NO};
+			pthread_t producer;
+			pthread_create(&producer, NULL, runHandoffProducer, &workload);
+			double startTime = timestamp();
+			workload.started = YES;
+			runHandoffConsumer(&workload);
+			pthread_join(producer, NULL);
+			printf("\t%12.0f", count / (timestamp() - startTime));
+			[queue release];
+		}
+	}
+	
+	printf("\n(Round trip, microseconds)");
+	if ([[NSProcessInfo processInfo] activeProcessorCount] < 2) {
+		printf("\t(skipped; needs 2 processors)");
+	}
+	else {
+		for (NSUInteger useLock = 0; useLock <= 1; useLock++) {
+			printf("\n%-20s", useLock ? "CHCircularBufferQueue" : "CHSPSCQueue");
+			RoundTripWorkload workload;
+			workload.requests = useLock ? [[CHCircularBufferQueue alloc] init] : [[CHSPSCQueue alloc] init];
+			workload.replies  = useLock ? [[CHCircularBufferQueue alloc] init] : [[CHSPSCQueue alloc] init];
+			workload.roundTrips = roundTrips;
+			pthread_t echo;
+			pthread_create(&echo, NULL, runEchoThread, &workload);
+			NSAutoreleasePool *roundTripPool = [[NSAutoreleasePool alloc] init];
+			double startTime = timestamp();
+			for (NSUInteger i = 0; i < roundTrips; i++) {
+				id anObject = objects[i];
+				if (useLock) {
+					[workload.requests lock];
+					[workload.requests addObject:anObject];
+					[workload.requests unlock];
+					do {
+						[workload.replies lock];
+						anObject = [workload.replies firstObject];
+						[workload.replies removeFirstObject];
+						[workload.replies unlock];
+					} while (anObject == nil);
+				}
+				else {
+					[workload.requests enqueueObject:anObject];
+					while ([workload.replies dequeueObject] == nil)
+						;
+				}
+				if (i % 1024 == 0) {
+					[roundTripPool drain];
+					roundTripPool = [[NSAutoreleasePool alloc] init];
+				}
+			}
+			printf("\t%f", (timestamp() - startTime) * 1000000.0 / roundTrips);
+			[roundTripPool drain];
+			pthread_join(echo, NULL);
+			[workload.requests release];
+			[workload.replies release];
+		}
+	}
+	
+	for (NSUInteger i = 0; i < count; i++)
+		[objects[i] release];
+	free(objects);
+	CHQuietLog(@"");
+	[pool drain];
+}
+
+// Simulates cancelling queued work: objects are removed from (and reinserted into) a large queue at random positions, while the queue wraps around the end of its array as it would after steady traffic. A circular buffer shifts whichever side of each position is shorter, so on average it moves a quarter of the objects rather than half.
+- (void) benchmarkMiddleRemovalOfClass:(Class)testClass {
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	CHQuietLog(@"\n* %@ (1000 random removals / insertions, seconds)", testClass);
+	
+	NSUInteger sizes[] = {1000, 10000, 100000, 1000000}, sizeCount = 4;
+	id anObject = [NSNull null];
+	NSMutableArray *queue;
+	NSUInteger indexes[1000], item;
+	double startTime, removeTime;
+	
+	printf("(Size)    \tremoveObjectAtIndex: / insertObject:atIndex:");
+	for (NSUInteger s = 0; s < sizeCount; s++) {
+		printf("\n%-10lu", (unsigned long)sizes[s]);
+		queue = [[testClass alloc] init];
+		for (item = 0; item < sizes[s]; item++)
+			[queue addObject:anObject];
+		for (item = 0; item < sizes[s] / 2; item++) {
+			[queue removeObjectAtIndex:0];
+			[queue addObject:anObject];
+		}
+		for (item = 0; item < 1000; item++)
+			indexes[item] = arc4random() % (sizes[s] - 1000);
+		startTime = timestamp();
+		for (item = 0; item < 1000; item++)
+			[queue removeObjectAtIndex:indexes[item]];
+		removeTime = timestamp() - startTime;
+		startTime = timestamp();
+		for (item = 0; item < 1000; item++)
+			[queue insertObject:anObject atIndex:indexes[item]];
+		printf("\t%f / %f", removeTime, timestamp() - startTime);
+		[queue release];
+	}
+	CHQuietLog(@"");
+	[pool drain];
 }
 
 + (NSUInteger) executionOrder { return 2; }
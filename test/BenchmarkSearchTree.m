@@ -9,7 +9,11 @@
 #import "BenchmarkSearchTree.h"
 #import "BenchmarkUtils.h"
 #import <CHDataStructures/CHDataStructures.h>
+#import "CHAbstractBinarySearchTree_Internal.h"
 #import <objc/runtime.h>
+#import <malloc/malloc.h>
+#import <pthread.h>
+#import <sched.h>
 
 @interface CHAbstractBinarySearchTree (Height)
 - (NSUInteger) height;
@@ -34,6 +38,130 @@
 
 @end
 
+@interface CHBTree (Height)
+- (NSUInteger) height;
+@end
+
+@implementation CHBTree (Height)
+
+- (NSUInteger) height {
+	return height;
+}
+
+@end
+
+@interface CHAbstractBinarySearchTree (NodeSlabs)
+- (void) setUsesNodeSlabs:(BOOL)flag;
+@end
+
+@implementation CHAbstractBinarySearchTree (NodeSlabs)
+
+// Only valid while the tree is empty, since nodes must be freed the same way.
+- (void) setUsesNodeSlabs:(BOOL)flag {
+	NSAssert(count == 0, @"Can only switch node allocation for an empty tree.");
+	CHBinaryTreeNodePoolDrain(nodePool);
+	nodePool->slabCapacity = flag ? kCHBinaryTreeNodeSlabMinimum : 0;
+}
+
+@end
+
+@interface BenchmarkSearchTree ()
+- (void) benchmarkNodeSlabsWithClasses:(NSArray*)testClasses;
+- (void) benchmarkSetOperationsWithClasses:(NSArray*)testClasses;
+- (void) benchmarkComparatorsWithClasses:(NSArray*)testClasses;
+- (void) benchmarkRemovalWithClasses:(NSArray*)testClasses;
+- (void) benchmarkCursorsWithClasses:(NSArray*)testClasses;
+- (void) benchmarkCopyingWithClasses:(NSArray*)testClasses;
+- (void) benchmarkLargeTreesWithClasses:(NSArray*)testClasses;
+- (void) benchmarkConcurrentSets;
+- (void) benchmarkFrozenSetsWithClasses:(NSArray*)testClasses;
+- (void) benchmarkIntegerSets;
+- (void) benchmarkMemoryFootprintWithClasses:(NSArray*)testClasses;
+- (void) benchmarkCompactionWithClasses:(NSArray*)testClasses;
+- (void) benchmarkKeyDistributionsWithClasses:(NSArray*)testClasses;
+@end
+
+// Comparison functions which call Core Foundation directly, without messaging.
+static NSInteger compareNumbers(id number1, id number2, void *context) {
+	return CFNumberCompare((CFNumberRef)number1, (CFNumberRef)number2, NULL);
+}
+
+static NSInteger compareStrings(id string1, id string2, void *context) {
+	return CFStringCompare((CFStringRef)string1, (CFStringRef)string2, 0);
+}
+
+#pragma mark Concurrent workload
+
+// Shared by the threads of one run of the concurrent benchmark.
+typedef struct {
+	id<CHSortedSet> set;
+	NSArray *objects; // The objects to add, remove, and search for.
+	BOOL usesLock; // Whether each operation must lock the set.
+	NSUInteger operations; // The number of operations for each thread.
+	volatile BOOL started; // Set once every thread has been created.
+} ConcurrentWorkload;
+
+typedef struct {
+	ConcurrentWorkload *workload;
+	uint32_t seed;
+} ConcurrentWorker;
+
+// Performs a mix of 80% member, 10% add, and 10% remove operations on random objects.
+static void* runConcurrentWorker(void *argument) {
+	ConcurrentWorker *worker = argument;
+	ConcurrentWorkload *workload = worker->workload;
+	id<CHSortedSet> set = workload->set;
+	id<CHLockable> lockable = (id<CHLockable>)set;
+	NSUInteger size = [workload->objects count];
+	uint32_t random = worker->seed;
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	while (!workload->started)
+		sched_yield();
+	for (NSUInteger i = 0; i < workload->operations; i++) {
+		// xorshift, so threads don't contend for the state of a shared generator
+		random ^= random << 13;
+		random ^= random >> 17;
+		random ^= random << 5;
+		id anObject = [workload->objects objectAtIndex:random % size];
+		NSUInteger operation = (random >> 24) % 10;
+		if (workload->usesLock)
+			[lockable lock];
+		if (operation == 0)
+			[set addObject:anObject];
+		else if (operation == 1)
+			[set removeObject:anObject];
+		else
+			[set member:anObject];
+		if (workload->usesLock)
+			[lockable unlock];
+		if (i % 1024 == 0) {
+			[pool drain];
+			pool = [[NSAutoreleasePool alloc] init];
+		}
+	}
+	[pool drain];
+	return NULL;
+}
+
+// Fills an array with indexes in [0, size) drawn from a Zipfian distribution with exponent 's', so index 0 is the most frequent, index 1 is half as frequent (for s = 1), and so on.
+static void fillZipfianIndexes(NSUInteger *indexes, NSUInteger count, NSUInteger size, double s) {
+	double *cumulative = malloc(size * sizeof(double)), total = 0.0;
+	for (NSUInteger i = 0; i < size; i++)
+		cumulative[i] = (total += 1.0 / pow(i + 1, s));
+	for (NSUInteger i = 0; i < count; i++) {
+		double target = total * arc4random() / 4294967296.0;
+		NSUInteger low = 0, high = size - 1, middle;
+		while (low < high) {
+			middle = (low + high) / 2;
+			if (cumulative[middle] <= target)
+				low = middle + 1;
+			else
+				high = middle;
+		}
+		indexes[i] = low;
+	}
+	free(cumulative);
+}
 
 @implementation BenchmarkSearchTree
 
@@ -54,7 +182,10 @@
 	NSArray *testClasses = [NSArray arrayWithObjects:
 							[CHAnderssonTree class],
 							[CHAVLTree class],
+							[CHBTree class],
 							[CHRedBlackTree class],
+							[CHScapegoatTree class],
+							[CHSplayTree class],
 							[CHTreap class],
 							[CHUnbalancedTree class],
 							nil];
@@ -154,6 +285,672 @@
 								 error:NULL];
 		}
 	}
+	
+	// Node slabs, bulk set operations, and cursors only exist for binary trees.
+	NSMutableArray *binaryTreeClasses = [NSMutableArray array];
+	for (Class aClass in testClasses)
+		if ([aClass isSubclassOfClass:[CHAbstractBinarySearchTree class]])
+			[binaryTreeClasses addObject:aClass];
+	
+	[self benchmarkNodeSlabsWithClasses:binaryTreeClasses];
+	[self benchmarkSetOperationsWithClasses:binaryTreeClasses];
+	[self benchmarkComparatorsWithClasses:testClasses];
+	[self benchmarkRemovalWithClasses:testClasses];
+	[self benchmarkCursorsWithClasses:binaryTreeClasses];
+	[self benchmarkCopyingWithClasses:testClasses];
+	[self benchmarkLargeTreesWithClasses:
+	 [NSArray arrayWithObjects:[CHRedBlackTree class], [CHAVLTree class], [CHBTree class], nil]];
+	[self benchmarkConcurrentSets];
+	[self benchmarkFrozenSetsWithClasses:
+	 [NSArray arrayWithObjects:[CHAnderssonTree class], [CHRedBlackTree class], nil]];
+	[self benchmarkIntegerSets];
+	[self benchmarkMemoryFootprintWithClasses:
+	 [testClasses arrayByAddingObject:[CHConcurrentSkipListSet class]]];
+	[self benchmarkCompactionWithClasses:binaryTreeClasses];
+	[self benchmarkKeyDistributionsWithClasses:testClasses];
+}
+
+// Compares allocating nodes from per-tree slabs against one malloc() per node.
+- (void) benchmarkNodeSlabsWithClasses:(NSArray*)testClasses {
+	CHQuietLog(@"\n<CHSearchTree> Node slabs (seconds, slabs off / on)");
+	NSMutableArray *arrays = [NSMutableArray array];
+	for (NSUInteger size = 1000; size <= 1000000; size *= 10)
+		[arrays addObject:[self randomNumberArrayOfSize:size]];
+	
+	CHAbstractBinarySearchTree *tree;
+	double startTime, addTime, churnTime, clearTime;
+	for (Class aClass in testClasses) {
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		CHQuietLog(@"\n* %@", aClass);
+		printf("(Objects)\t[slabs] addObject: remove+add removeAllObjects: (x2)");
+		for (NSArray *array in arrays) {
+			printf("\n%-8lu", (unsigned long)[array count]);
+			for (int slabs = 0; slabs <= 1; slabs++) {
+				tree = [[aClass alloc] init];
+				[tree setUsesNodeSlabs:slabs];
+				
+				startTime = timestamp();
+				for (id anObject in array)
+					[tree addObject:anObject];
+				addTime = timestamp() - startTime;
+				
+				// Remove and re-add every other object, which reuses freed nodes.
+				startTime = timestamp();
+				NSUInteger index = 0;
+				for (id anObject in array)
+					if (index++ % 2 == 0)
+						[tree removeObject:anObject];
+				index = 0;
+				for (id anObject in array)
+					if (index++ % 2 == 0)
+						[tree addObject:anObject];
+				churnTime = timestamp() - startTime;
+				
+				startTime = timestamp();
+				[tree removeAllObjects];
+				clearTime = timestamp() - startTime;
+				
+				printf("\t%s %f %f %f", (slabs ? "on " : "off"), addTime, churnTime, clearTime);
+				[tree release];
+			}
+		}
+		CHQuietLog(@"");
+		[pool drain];
+	}
+}
+
+// Compares the bulk set operations against adding, removing, or testing one object at a time, for sets of equal size and of very different sizes.
+- (void) benchmarkSetOperationsWithClasses:(NSArray*)testClasses {
+	CHQuietLog(@"\n<CHSearchTree> Set operations (seconds, one at a time / bulk)");
+	NSUInteger sizes[][2] = {{1000,1000}, {1000000,1000000}, {1000,1000000}, {1000000,1000}};
+	
+	CHAbstractBinarySearchTree *tree, *other;
+	double startTime, naiveTime, bulkTime;
+	for (Class aClass in testClasses) {
+		CHQuietLog(@"\n* %@", aClass);
+		printf("(Objects)\t\tunion intersect minus (x2)");
+		for (NSUInteger i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+			NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+			NSUInteger size = sizes[i][0], otherSize = sizes[i][1];
+			// The other set starts halfway through the receiver, so they overlap.
+			NSArray *randomNumbers = [self randomNumberArrayOfSize:size + otherSize];
+			NSArray *array = [randomNumbers subarrayWithRange:NSMakeRange(0, size)];
+			NSArray *otherArray = [randomNumbers subarrayWithRange:
+			                       NSMakeRange(size / 2, otherSize)];
+			other = [[aClass alloc] initWithArray:otherArray];
+			printf("\n%-7lu %-7lu", (unsigned long)size, (unsigned long)otherSize);
+			
+			for (int operation = 0; operation < 3; operation++) {
+				// One object at a time, the way it had to be done before.
+				tree = [[aClass alloc] initWithArray:array];
+				startTime = timestamp();
+				if (operation == 0) {
+					for (id anObject in other)
+						[tree addObject:anObject];
+				}
+				else if (operation == 1) {
+					NSMutableArray *doomed = [NSMutableArray array];
+					for (id anObject in tree)
+						if (![other containsObject:anObject])
+							[doomed addObject:anObject];
+					for (id anObject in doomed)
+						[tree removeObject:anObject];
+				}
+				else {
+					for (id anObject in other)
+						[tree removeObject:anObject];
+				}
+				naiveTime = timestamp() - startTime;
+				[tree release];
+				
+				tree = [[aClass alloc] initWithArray:array];
+				startTime = timestamp();
+				if (operation == 0)
+					[tree unionWithSortedSet:other];
+				else if (operation == 1)
+					[tree intersectWithSortedSet:other];
+				else
+					[tree minusSortedSet:other];
+				bulkTime = timestamp() - startTime;
+				[tree release];
+				
+				printf("\t%f %f", naiveTime, bulkTime);
+			}
+			[other release];
+			[pool drain];
+		}
+		CHQuietLog(@"");
+	}
+}
+
+// Measures lookups per second with -compare: (using the cached implementation) and with a comparison function, for NSNumber and NSString keys.
+- (void) benchmarkComparatorsWithClasses:(NSArray*)testClasses {
+	CHQuietLog(@"\n<CHSearchTree> Lookups per second (-compare: / function)");
+	NSUInteger size = 1000000;
+	NSArray *numbers = [self randomNumberArrayOfSize:size];
+	NSMutableArray *strings = [NSMutableArray arrayWithCapacity:size];
+	for (NSNumber *number in numbers)
+		[strings addObject:[number stringValue]];
+	NSArray *keySets[] = {numbers, strings};
+	CHComparisonFunction functions[] = {compareNumbers, compareStrings};
+	
+	CHAbstractBinarySearchTree *tree;
+	double startTime, duration;
+	for (Class aClass in testClasses) {
+		printf("\n%-16s", class_getName(aClass));
+		for (int keyType = 0; keyType <= 1; keyType++) {
+			printf(keyType ? "\tNSString " : "\tNSNumber ");
+			for (int useFunction = 0; useFunction <= 1; useFunction++) {
+				NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+				if (useFunction)
+					tree = [[aClass alloc] initWithComparisonFunction:functions[keyType]
+					                                          context:NULL];
+				else
+					tree = [[aClass alloc] init];
+				for (id anObject in keySets[keyType])
+					[tree addObject:anObject];
+				startTime = timestamp();
+				for (id anObject in keySets[keyType])
+					[tree member:anObject];
+				duration = timestamp() - startTime;
+				printf(" %10.0f", size / duration);
+				[tree release];
+				[pool drain];
+			}
+		}
+	}
+	CHQuietLog(@"");
+}
+
+// Measures removals per second from trees of 1M objects: first for objects which are absent (which should not modify the tree at all), then for every object in the tree, in random order.
+- (void) benchmarkRemovalWithClasses:(NSArray*)testClasses {
+	CHQuietLog(@"\n<CHSearchTree> Removals per second from 1M objects (absent / present)");
+	NSUInteger size = 1000000;
+	NSArray *randomNumbers = [self randomNumberArrayOfSize:size * 2];
+	NSArray *present = [randomNumbers subarrayWithRange:NSMakeRange(0, size)];
+	NSArray *absent = [randomNumbers subarrayWithRange:NSMakeRange(size, size)];
+	
+	CHAbstractBinarySearchTree *tree;
+	double startTime, absentTime, presentTime;
+	for (Class aClass in testClasses) {
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		tree = [[aClass alloc] init];
+		for (id anObject in present)
+			[tree addObject:anObject];
+		
+		startTime = timestamp();
+		for (id anObject in absent)
+			[tree removeObject:anObject];
+		absentTime = timestamp() - startTime;
+		
+		startTime = timestamp();
+		for (id anObject in present)
+			[tree removeObject:anObject];
+		presentTime = timestamp() - startTime;
+		
+		printf("\n%-16s %10.0f %10.0f", class_getName(aClass),
+		       size / absentTime, size / presentTime);
+		[tree release];
+		[pool drain];
+	}
+	CHQuietLog(@"");
+}
+
+// Measures seek-then-scan queries per second (finding a random object, then visiting the 32 objects from there on) in trees of 1M objects, using a subset and using a cursor.
+- (void) benchmarkCursorsWithClasses:(NSArray*)testClasses {
+	CHQuietLog(@"\n<CHSearchTree> Seek and scan 32 per second from 1M objects (subset / cursor)");
+	NSUInteger size = 1000000, queries = 100000, scanLength = 32;
+	NSArray *objects = [self randomNumberArrayOfSize:size];
+	NSArray *starts = [objects subarrayWithRange:NSMakeRange(0, queries)];
+	
+	CHAbstractBinarySearchTree *tree;
+	double startTime, subsetTime, cursorTime;
+	for (Class aClass in testClasses) {
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		tree = [[aClass alloc] init];
+		for (id anObject in objects)
+			[tree addObject:anObject];
+		
+		startTime = timestamp();
+		for (id start in starts) {
+			NSAutoreleasePool *queryPool = [[NSAutoreleasePool alloc] init];
+			NSUInteger scanned = 0;
+			for (id anObject in [tree subsetFromObject:start toObject:nil options:0])
+				if (++scanned == scanLength)
+					break;
+			[queryPool drain];
+		}
+		subsetTime = timestamp() - startTime;
+		
+		startTime = timestamp();
+		for (id start in starts) {
+			NSAutoreleasePool *queryPool = [[NSAutoreleasePool alloc] init];
+			CHSearchTreeCursor *cursor = [tree cursorAtFirstGreaterOrEqual:start];
+			for (NSUInteger scanned = 1; scanned < scanLength && [cursor next]; scanned++)
+				;
+			[queryPool drain];
+		}
+		cursorTime = timestamp() - startTime;
+		
+		printf("\n%-16s %10.0f %10.0f", class_getName(aClass),
+		       queries / subsetTime, queries / cursorTime);
+		[tree release];
+		[pool drain];
+	}
+	CHQuietLog(@"");
+}
+
+// Measures the time to copy a tree of 1M objects, and to archive and unarchive it.
+- (void) benchmarkCopyingWithClasses:(NSArray*)testClasses {
+	CHQuietLog(@"\n<CHSearchTree> Copying 1M objects (seconds, copy / archive / unarchive)");
+	NSArray *objects = [self randomNumberArrayOfSize:1000000];
+	
+	CHAbstractBinarySearchTree *tree, *copy;
+	double startTime, copyTime, archiveTime, unarchiveTime;
+	for (Class aClass in testClasses) {
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		tree = [[aClass alloc] init];
+		for (id anObject in objects)
+			[tree addObject:anObject];
+		
+		startTime = timestamp();
+		copy = [tree copy];
+		copyTime = timestamp() - startTime;
+		[copy release];
+		
+		startTime = timestamp();
+		NSData *data = [NSKeyedArchiver archivedDataWithRootObject:tree];
+		archiveTime = timestamp() - startTime;
+		
+		startTime = timestamp();
+		copy = [NSKeyedUnarchiver unarchiveObjectWithData:data];
+		unarchiveTime = timestamp() - startTime;
+		
+		printf("\n%-16s %8.3f %8.3f %8.3f", class_getName(aClass),
+		       copyTime, archiveTime, unarchiveTime);
+		[tree release];
+		[pool drain];
+	}
+	CHQuietLog(@"");
+}
+
+// Measures operations per second on trees of 100K to 10M objects, where cache misses dominate: adding objects in random order, finding objects, enumerating every object, and enumerating ranges of 100 consecutive objects.
+- (void) benchmarkLargeTreesWithClasses:(NSArray*)testClasses {
+	CHQuietLog(@"\n<CHSearchTree> Large trees (per second: add / member / scan / range of 100)");
+	NSUInteger queries = 100000, rangeLength = 100;
+	
+	id<CHSearchTree> tree;
+	double startTime, addTime, memberTime, scanTime, rangeTime;
+	for (NSUInteger size = 100000; size <= 10000000; size *= 10) {
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		NSArray *objects = [self randomNumberArrayOfSize:size];
+		NSArray *sorted = [objects sortedArrayUsingSelector:@selector(compare:)];
+		// Random ranges, each spanning rangeLength objects which are in the tree.
+		NSUInteger *rangeStarts = malloc(queries * sizeof(NSUInteger));
+		for (NSUInteger i = 0; i < queries; i++)
+			rangeStarts[i] = arc4random() % (size - rangeLength);
+		printf("\n%lu objects", (unsigned long)size);
+		
+		for (Class aClass in testClasses) {
+			tree = [[aClass alloc] init];
+			startTime = timestamp();
+			for (id anObject in objects)
+				[tree addObject:anObject];
+			addTime = timestamp() - startTime;
+			
+			startTime = timestamp();
+			for (NSUInteger i = 0; i < queries; i++)
+				[tree member:[objects objectAtIndex:rangeStarts[i]]];
+			memberTime = timestamp() - startTime;
+			
+			NSUInteger scanned = 0;
+			startTime = timestamp();
+			for (id anObject in tree)
+				scanned++;
+			scanTime = timestamp() - startTime;
+			
+			startTime = timestamp();
+			for (NSUInteger i = 0; i < queries; i++) {
+				NSAutoreleasePool *queryPool = [[NSAutoreleasePool alloc] init];
+				id<CHSortedSet> subset =
+					[tree subsetFromObject:[sorted objectAtIndex:rangeStarts[i]]
+					              toObject:[sorted objectAtIndex:rangeStarts[i] + rangeLength - 1]
+					               options:0];
+				for (id anObject in subset)
+					scanned++;
+				[queryPool drain];
+			}
+			rangeTime = timestamp() - startTime;
+			
+			printf("\n  %-16s %10.0f %10.0f %10.0f %10.0f", class_getName(aClass),
+			       size / addTime, queries / memberTime, size / scanTime, queries / rangeTime);
+			[tree release];
+		}
+		free(rangeStarts);
+		[pool drain];
+	}
+	CHQuietLog(@"");
+}
+
+// Compares a lock-free skip list against a red-black tree guarded by its lock as the number of threads grows.
+- (void) benchmarkConcurrentSets {
+	CHQuietLog(@"\n<CHSortedSet> Concurrent access (operations per second: 80%% member / 10%% add / 10%% remove)");
+	NSUInteger size = 100000, operations = 1000000;
+	NSUInteger processors = [[NSProcessInfo processInfo] activeProcessorCount];
+	NSArray *objects = [self randomNumberArrayOfSize:size];
+	NSArray *testClasses = [NSArray arrayWithObjects:[CHConcurrentSkipListSet class], [CHRedBlackTree class], nil];
+	
+	for (NSUInteger threadCount = 1; threadCount <= processors; threadCount *= 2) {
+		printf("\n%lu threads", (unsigned long)threadCount);
+		for (Class aClass in testClasses) {
+			NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+			id<CHSortedSet> set = [[aClass alloc] init];
+			// Start half full, so adds and removes both change the set.
+			for (NSUInteger i = 0; i < size; i += 2)
+				[set addObject:[objects objectAtIndex:i]];
+			
+			ConcurrentWorkload workload = {
+				set, objects, ![set isKindOfClass:[CHConcurrentSkipListSet class]],
+				operations / threadCount, NO
+			};
+			pthread_t *threads = malloc(threadCount * sizeof(pthread_t));
+			ConcurrentWorker *workers = malloc(threadCount * sizeof(ConcurrentWorker));
+			for (NSUInteger i = 0; i < threadCount; i++) {
+				workers[i].workload = &workload;
+				workers[i].seed = (uint32_t)(2463534242u + i * 7919);
+				pthread_create(&threads[i], NULL, runConcurrentWorker, &workers[i]);
+			}
+			double startTime = timestamp();
+			workload.started = YES;
+			for (NSUInteger i = 0; i < threadCount; i++)
+				pthread_join(threads[i], NULL);
+			double duration = timestamp() - startTime;
+			free(workers);
+			free(threads);
+			
+			printf("\n  %-24s %12.0f", class_getName(aClass),
+			       workload.operations * threadCount / duration);
+			[set release];
+			[pool drain];
+		}
+	}
+	CHQuietLog(@"");
+}
+
+// Compares member lookups in each tree against lookups in a frozen copy of it.
+- (void) benchmarkFrozenSetsWithClasses:(NSArray*)testClasses {
+	CHQuietLog(@"\n<CHSortedSet> Frozen sets (member lookups per second: tree / frozen)");
+	NSUInteger queries = 1000000;
+	
+	for (NSUInteger size = 1000; size <= 10000000; size *= 10) {
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		NSArray *objects = [self randomNumberArrayOfSize:size];
+		// Look up objects in random order, so consecutive searches don't share a path.
+		id *probes = malloc(queries * sizeof(id));
+		for (NSUInteger i = 0; i < queries; i++)
+			probes[i] = [objects objectAtIndex:arc4random() % size];
+		printf("\n%lu objects", (unsigned long)size);
+		
+		for (Class aClass in testClasses) {
+			id<CHSortedSet> tree = [[aClass alloc] initWithArray:objects];
+			CHFrozenSortedSet *frozen = [[tree freeze] retain];
+			double startTime, treeTime, frozenTime;
+			
+			startTime = timestamp();
+			for (NSUInteger i = 0; i < queries; i++)
+				[tree member:probes[i]];
+			treeTime = timestamp() - startTime;
+			
+			startTime = timestamp();
+			for (NSUInteger i = 0; i < queries; i++)
+				[frozen member:probes[i]];
+			frozenTime = timestamp() - startTime;
+			
+			printf("\n  %-16s %12.0f %12.0f", class_getName(aClass),
+			       queries / treeTime, queries / frozenTime);
+			[frozen release];
+			[tree release];
+		}
+		free(probes);
+		[pool drain];
+	}
+	CHQuietLog(@"");
+}
+
+// Compares a red-black tree of NSNumber objects against a set which stores the integers themselves.
+- (void) benchmarkIntegerSets {
+	CHQuietLog(@"\n<CHSortedSet> Integer keys (per second: add / member / scan / remove)");
+	NSUInteger size = 10000000, queries = 1000000, i;
+	int64_t *keys = malloc(size * sizeof(int64_t));
+	for (i = 0; i < size; i++)
+		keys[i] = ((int64_t)arc4random() << 32) | arc4random();
+	int64_t *probes = malloc(queries * sizeof(int64_t));
+	for (i = 0; i < queries; i++)
+		probes[i] = keys[arc4random() % size];
+	double startTime, addTime, memberTime, scanTime, removeTime;
+	NSUInteger scanned = 0;
+	printf("\n%lu integers", (unsigned long)size);
+	
+	// Boxing each key is part of the cost of using a CHSortedSet, so it is timed too.
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	CHRedBlackTree *tree = [[CHRedBlackTree alloc] init];
+	startTime = timestamp();
+	for (i = 0; i < size; i++) {
+		[tree addObject:[NSNumber numberWithLongLong:keys[i]]];
+		if (i % 100000 == 0) {
+			[pool drain];
+			pool = [[NSAutoreleasePool alloc] init];
+		}
+	}
+	addTime = timestamp() - startTime;
+	NSMutableArray *boxedProbes = [NSMutableArray arrayWithCapacity:queries];
+	for (i = 0; i < queries; i++)
+		[boxedProbes addObject:[NSNumber numberWithLongLong:probes[i]]];
+	startTime = timestamp();
+	for (id probe in boxedProbes)
+		[tree member:probe];
+	memberTime = timestamp() - startTime;
+	startTime = timestamp();
+	for (id anObject in tree)
+		scanned++;
+	scanTime = timestamp() - startTime;
+	startTime = timestamp();
+	for (i = 0; i < size; i++) {
+		[tree removeObject:[NSNumber numberWithLongLong:keys[i]]];
+		if (i % 100000 == 0) {
+			[pool drain];
+			pool = [[NSAutoreleasePool alloc] init];
+		}
+	}
+	removeTime = timestamp() - startTime;
+	printf("\n  %-20s %10.0f %10.0f %10.0f %10.0f", "CHRedBlackTree",
+	       size / addTime, queries / memberTime, size / scanTime, size / removeTime);
+	[tree release];
+	[pool drain];
+	
+	CHIntegerSortedSet *set = [[CHIntegerSortedSet alloc] init];
+	startTime = timestamp();
+	for (i = 0; i < size; i++)
+		[set addInteger:keys[i]];
+	addTime = timestamp() - startTime;
+	startTime = timestamp();
+	for (i = 0; i < queries; i++)
+		[set containsInteger:probes[i]];
+	memberTime = timestamp() - startTime;
+	int64_t buffer[256], start = INT64_MIN;
+	NSUInteger copied;
+	startTime = timestamp();
+	do {
+		copied = [set getIntegers:buffer maxCount:256 startingAtInteger:start];
+		scanned += copied;
+		if (copied > 0)
+			start = buffer[copied - 1] + 1;
+	} while (copied == 256);
+	scanTime = timestamp() - startTime;
+	startTime = timestamp();
+	for (i = 0; i < size; i++)
+		[set removeInteger:keys[i]];
+	removeTime = timestamp() - startTime;
+	printf("\n  %-20s %10.0f %10.0f %10.0f %10.0f", "CHIntegerSortedSet",
+	       size / addTime, queries / memberTime, size / scanTime, size / removeTime);
+	[set release];
+	
+	free(probes);
+	free(keys);
+	CHQuietLog(@"");
+}
+
+// Reports the heap memory each tree uses per object, not counting the objects themselves. For binary trees, also reports the memory added by taking a snapshot and then removing 1% of the objects, which copies the paths to them and counts the links to the nodes they share.
+- (void) benchmarkMemoryFootprintWithClasses:(NSArray*)testClasses {
+	CHQuietLog(@"\n<CHSortedSet> Memory footprint (bytes per object; nodes are %lu bytes)"
+	           @"\n  and bytes per object added by a snapshot and removing 1%% of the objects",
+	           (unsigned long)sizeof(CHBinaryTreeNode));
+	malloc_statistics_t before, after;
+	
+	for (NSUInteger size = 1000; size <= 1000000; size *= 10) {
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		NSArray *objects = [self randomNumberArrayOfSize:size];
+		printf("\n%lu objects", (unsigned long)size);
+		
+		for (Class aClass in testClasses) {
+			malloc_zone_statistics(NULL, &before);
+			id<CHSortedSet> tree = [[aClass alloc] init];
+			for (id anObject in objects)
+				[tree addObject:anObject];
+			malloc_zone_statistics(NULL, &after);
+			printf("\n  %-24s %8.1f", class_getName(aClass),
+			       (double)(after.size_in_use - before.size_in_use) / size);
+			
+			if ([aClass isSubclassOfClass:[CHAbstractBinarySearchTree class]]) {
+				malloc_zone_statistics(NULL, &before);
+				CHAbstractBinarySearchTree *snapshot = [[(id)tree snapshot] retain];
+				for (NSUInteger i = 0; i < size; i += 100)
+					[tree removeObject:[objects objectAtIndex:i]];
+				malloc_zone_statistics(NULL, &after);
+				printf(" %8.1f", (double)(after.size_in_use - before.size_in_use) / size);
+				[snapshot release];
+			}
+			
+			// A frozen copy is a single array, whichever class it came from.
+			if (aClass == [testClasses lastObject]) {
+				malloc_zone_statistics(NULL, &before);
+				CHFrozenSortedSet *frozen = [[tree freeze] retain];
+				malloc_zone_statistics(NULL, &after);
+				printf("\n  %-24s %8.1f", "CHFrozenSortedSet",
+				       (double)(after.size_in_use - before.size_in_use) / size);
+				[frozen release];
+			}
+			[tree release];
+		}
+		[pool drain];
+	}
+	CHQuietLog(@"");
+}
+
+// Compares searching a tree whose nodes have been scattered by insertions and removals against searching it after compacting the nodes.
+- (void) benchmarkCompactionWithClasses:(NSArray*)testClasses {
+	CHQuietLog(@"\n<CHSearchTree> Compaction (member lookups per second: scattered / compacted; compact time)");
+	NSUInteger queries = 1000000;
+	
+	for (NSUInteger size = 10000; size <= 1000000; size *= 10) {
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		NSArray *objects = [self randomNumberArrayOfSize:2 * size];
+		id *probes = malloc(queries * sizeof(id));
+		for (NSUInteger i = 0; i < queries; i++)
+			probes[i] = [objects objectAtIndex:size + arc4random() % size];
+		printf("\n%lu objects", (unsigned long)size);
+		
+		for (Class aClass in testClasses) {
+			CHAbstractBinarySearchTree *tree = [[aClass alloc] init];
+			double startTime, scatteredTime, compactTime, compactedTime;
+			// Interleave adding the second half with removing the first half, so the surviving nodes are spread thinly across the slabs.
+			for (NSUInteger i = 0; i < size; i++)
+				[tree addObject:[objects objectAtIndex:i]];
+			for (NSUInteger i = 0; i < size; i++) {
+				[tree addObject:[objects objectAtIndex:size + i]];
+				[tree removeObject:[objects objectAtIndex:i]];
+			}
+			
+			startTime = timestamp();
+			for (NSUInteger i = 0; i < queries; i++)
+				[tree member:probes[i]];
+			scatteredTime = timestamp() - startTime;
+			
+			startTime = timestamp();
+			[tree compact];
+			compactTime = timestamp() - startTime;
+			
+			startTime = timestamp();
+			for (NSUInteger i = 0; i < queries; i++)
+				[tree member:probes[i]];
+			compactedTime = timestamp() - startTime;
+			
+			printf("\n  %-16s %12.0f %12.0f %10.4f", class_getName(aClass),
+			       queries / scatteredTime, queries / compactedTime, compactTime);
+			[tree release];
+		}
+		free(probes);
+		[pool drain];
+	}
+	CHQuietLog(@"");
+}
+
+// Compares lookups with uniform, Zipfian and sequential keys, as well as adding keys in ascending order, to show which trees adapt to skewed or ordered access.
+- (void) benchmarkKeyDistributionsWithClasses:(NSArray*)testClasses {
+	CHQuietLog(@"\n<CHSearchTree> Key distributions (per second: uniform / Zipfian / sequential member, sequential add)");
+	NSUInteger size = 1000000, queries = 1000000;
+	NSArray *objects = [self randomNumberArrayOfSize:size]; // In no particular order.
+	NSArray *sorted = [objects sortedArrayUsingSelector:@selector(compare:)];
+	// The most popular objects are scattered throughout the tree, not clustered together.
+	NSUInteger *indexes = malloc(queries * sizeof(NSUInteger));
+	id *uniform = malloc(queries * sizeof(id)), *zipfian = malloc(queries * sizeof(id));
+	fillZipfianIndexes(indexes, queries, size, 1.2);
+	for (NSUInteger i = 0; i < queries; i++) {
+		uniform[i] = [objects objectAtIndex:arc4random() % size];
+		zipfian[i] = [objects objectAtIndex:indexes[i]];
+	}
+	free(indexes);
+	printf("\n%lu objects", (unsigned long)size);
+	
+	for (Class aClass in testClasses) {
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		double startTime, uniformTime, zipfianTime, sequentialTime, addTime;
+		id<CHSearchTree> tree = [[aClass alloc] init];
+		for (id anObject in objects)
+			[tree addObject:anObject];
+		
+		startTime = timestamp();
+		for (NSUInteger i = 0; i < queries; i++)
+			[tree member:uniform[i]];
+		uniformTime = timestamp() - startTime;
+		
+		startTime = timestamp();
+		for (NSUInteger i = 0; i < queries; i++)
+			[tree member:zipfian[i]];
+		zipfianTime = timestamp() - startTime;
+		
+		startTime = timestamp();
+		for (id anObject in sorted)
+			[tree member:anObject];
+		sequentialTime = timestamp() - startTime;
+		[tree release];
+		
+		// An unbalanced tree degenerates into a list when objects are added in order.
+		NSUInteger addCount = [aClass isSubclassOfClass:[CHUnbalancedTree class]] ? size / 100 : size;
+		tree = [[aClass alloc] init];
+		startTime = timestamp();
+		for (NSUInteger i = 0; i < addCount; i++)
+			[tree addObject:[sorted objectAtIndex:i]];
+		addTime = timestamp() - startTime;
+		[tree release];
+		
+		printf("\n  %-16s %10.0f %10.0f %10.0f %10.0f", class_getName(aClass),
+		       queries / uniformTime, queries / zipfianTime, size / sequentialTime, addCount / addTime);
+		[pool drain];
+	}
+	free(uniform);
+	free(zipfian);
+	CHQuietLog(@"");
 }
 
 + (NSUInteger) executionOrder { return 5; }
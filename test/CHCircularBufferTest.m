@@ -101,6 +101,14 @@ do { \
 	buffer = [[[CHCircularBuffer alloc] initWithCapacity:0] autorelease];
 	STAssertTrue([buffer capacity] != 0, nil);
 	checkCountAndDistanceFromHeadToTail(0);
+	// Capacity is rounded up to a power of 2
+	buffer = [[[CHCircularBuffer alloc] initWithCapacity:10] autorelease];
+	STAssertEquals([buffer capacity], (NSUInteger)16, nil);
+	buffer = [[[CHCircularBuffer alloc] initWithCapacity:1] autorelease];
+	STAssertEquals([buffer capacity], (NSUInteger)1, nil);
+	[buffer addObjectsFromArray:abc];
+	STAssertEqualObjects(buffer, abc, nil);
+	STAssertEquals([buffer capacity], (NSUInteger)4, nil);
 }
 
 #pragma mark Insertion
@@ -452,7 +460,8 @@ do { \
 	STAssertEquals([buffer count], expected, nil);
 	// Test removing the last object when the tail index is at slot 0
 	// The last object must be in the final slot, with 1+ slots still open.
-	buffer = [[[CHCircularBuffer alloc] initWithCapacity:3] autorelease];
+	buffer = [[[CHCircularBuffer alloc] initWithCapacity:4] autorelease];
+	[buffer addObject:@"bogus"]; [buffer removeFirstObject];
 	[buffer addObject:@"bogus"]; [buffer removeFirstObject];
 	[buffer addObject:@"bogus"]; [buffer removeFirstObject];
 	[buffer addObject:@"A"];
@@ -649,6 +658,37 @@ do { \
 	STAssertEquals([buffer count], [buffer distanceFromHeadToTail], nil);
 }
 
+// Edits at every index with the head at every position in the array, so each side is shifted across the end of the array in both directions.
+- (void) testInsertAndRemoveAcrossWrap {
+	NSArray *seven = [fifteen subarrayWithRange:NSMakeRange(0, 7)];
+	NSMutableArray *correct;
+	for (NSUInteger offset = 0; offset < 8; offset++) {
+		for (NSUInteger index = 0; index <= [seven count]; index++) {
+			buffer = [[[CHCircularBuffer alloc] initWithCapacity:16] autorelease];
+			for (NSUInteger i = 0; i < offset + 8; i++) {
+				[buffer addObject:[NSNull null]];
+				[buffer removeFirstObject];
+			}
+			[buffer addObjectsFromArray:seven];
+			correct = [NSMutableArray arrayWithArray:seven];
+			[buffer  insertObject:@"X" atIndex:index];
+			[correct insertObject:@"X" atIndex:index];
+			STAssertEqualObjects(buffer, correct, nil);
+			checkCountAndDistanceFromHeadToTail([correct count]);
+			if (index < [seven count]) {
+				[buffer  removeObjectAtIndex:index + 1];
+				[correct removeObjectAtIndex:index + 1];
+				STAssertEqualObjects(buffer, correct, nil);
+				checkCountAndDistanceFromHeadToTail([correct count]);
+			}
+			[buffer  removeObjectAtIndex:index];
+			[correct removeObjectAtIndex:index];
+			STAssertEqualObjects(buffer, correct, nil);
+			checkCountAndDistanceFromHeadToTail([correct count]);
+		}
+	}
+}
+
 - (void) testRemoveObjectsAtIndexes {
 	// Test nil and invalid indexes
 	STAssertThrows([buffer removeObjectsAtIndexes:nil], nil);
@@ -674,6 +714,127 @@ do { \
 	STAssertThrows([buffer removeObjectsAtIndexes:nil], nil);
 }
 
+// Removes every combination of indexes with the head at every position in the array.
+- (void) testRemoveScatteredObjectsAtIndexes {
+	NSArray *seven = [fifteen subarrayWithRange:NSMakeRange(0, 7)];
+	NSMutableArray *correct;
+	NSMutableIndexSet *indexes = [NSMutableIndexSet indexSet];
+	for (NSUInteger offset = 0; offset < 8; offset++) {
+		for (NSUInteger mask = 1; mask < (1 << [seven count]); mask++) {
+			buffer = [[[CHCircularBuffer alloc] initWithCapacity:8] autorelease];
+			for (NSUInteger i = 0; i < offset; i++) {
+				[buffer addObject:[NSNull null]];
+				[buffer removeFirstObject];
+			}
+			[buffer addObjectsFromArray:seven];
+			[indexes removeAllIndexes];
+			for (NSUInteger i = 0; i < [seven count]; i++)
+				if (mask & (1 << i))
+					[indexes addIndex:i];
+			correct = [NSMutableArray arrayWithArray:seven];
+			[buffer  removeObjectsAtIndexes:indexes];
+			[correct removeObjectsAtIndexes:indexes];
+			STAssertEqualObjects(buffer, correct, nil);
+			checkCountAndDistanceFromHeadToTail([correct count]);
+		}
+	}
+}
+
+- (void) testShrinkAfterRemoval {
+	NSMutableArray *objects = [NSMutableArray array];
+	for (int i = 1; i <= 64; i++)
+		[objects addObject:[NSNumber numberWithInt:i]];
+	// Move the head so the objects wrap around the end of the array.
+	for (int i = 0; i < 10; i++) {
+		[buffer addObject:[NSNull null]];
+		[buffer removeFirstObject];
+	}
+	[buffer addObjectsFromArray:objects];
+	STAssertEquals([buffer capacity], (NSUInteger)128, nil);
+	// Capacity is halved once the buffer is less than 1/4 full
+	while ([buffer count] > 32) {
+		[buffer removeFirstObject];
+		[objects removeObjectAtIndex:0];
+	}
+	STAssertEquals([buffer capacity], (NSUInteger)128, nil);
+	[buffer removeFirstObject];
+	[objects removeObjectAtIndex:0];
+	STAssertEquals([buffer capacity], (NSUInteger)64, nil);
+	STAssertEqualObjects(buffer, objects, nil);
+	checkCountAndDistanceFromHeadToTail([objects count]);
+	// Capacity is never reduced below the default
+	while ([buffer count] > 1) {
+		[buffer removeLastObject];
+		[objects removeLastObject];
+	}
+	STAssertEquals([buffer capacity], (NSUInteger)16, nil);
+	STAssertEqualObjects(buffer, objects, nil);
+	
+	// Removing many objects at once shrinks more than once
+	[buffer addObjectsFromArray:fifteen];
+	[buffer addObjectsFromArray:fifteen];
+	[buffer addObjectsFromArray:fifteen];
+	[buffer addObjectsFromArray:fifteen];
+	STAssertEquals([buffer capacity], (NSUInteger)64, nil);
+	[buffer removeObjectsAtIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(1, 58)]];
+	STAssertEquals([buffer capacity], (NSUInteger)16, nil);
+	STAssertEquals([buffer count], (NSUInteger)3, nil);
+	
+	// A threshold of 0 disables automatic shrinking
+	STAssertThrows([buffer setShrinkThreshold:1], nil);
+	STAssertThrows([buffer setShrinkThreshold:2], nil);
+	STAssertEquals([buffer shrinkThreshold], (NSUInteger)4, nil);
+	[buffer setShrinkThreshold:0];
+	[buffer addObjectsFromArray:objects];
+	[buffer addObjectsFromArray:fifteen];
+	[buffer addObjectsFromArray:fifteen];
+	STAssertEquals([buffer capacity], (NSUInteger)64, nil);
+	while ([buffer count] > 1)
+		[buffer removeLastObject];
+	STAssertEquals([buffer capacity], (NSUInteger)64, nil);
+	// Restoring a threshold shrinks the buffer immediately if needed
+	[buffer setShrinkThreshold:8];
+	STAssertEquals([buffer capacity], (NSUInteger)16, nil);
+	
+	// A capacity given to -initWithCapacity: is kept
+	buffer = [[[CHCircularBuffer alloc] initWithCapacity:32] autorelease];
+	[buffer addObjectsFromArray:fifteen];
+	[buffer addObjectsFromArray:fifteen];
+	[buffer addObjectsFromArray:fifteen];
+	STAssertEquals([buffer capacity], (NSUInteger)64, nil);
+	while ([buffer count] > 0)
+		[buffer removeFirstObject];
+	STAssertEquals([buffer capacity], (NSUInteger)32, nil);
+}
+
+- (void) testReserveCapacityAndTrimToSize {
+	[buffer reserveCapacity:100];
+	STAssertEquals([buffer capacity], (NSUInteger)128, nil);
+	[buffer addObjectsFromArray:abc];
+	[buffer removeLastObject];
+	STAssertEquals([buffer capacity], (NSUInteger)128, nil);
+	// Reserving less than the current capacity has no effect
+	[buffer reserveCapacity:10];
+	STAssertEquals([buffer capacity], (NSUInteger)128, nil);
+	[buffer trimToSize];
+	STAssertEquals([buffer capacity], (NSUInteger)16, nil);
+	STAssertEqualObjects(buffer, [abc subarrayWithRange:NSMakeRange(0, 2)], nil);
+	checkCountAndDistanceFromHeadToTail(2);
+	// Trimming keeps room for one more object, and forgets reserved capacity
+	[buffer addObjectsFromArray:fifteen];
+	[buffer addObjectsFromArray:fifteen];
+	STAssertEquals([buffer capacity], (NSUInteger)64, nil);
+	[buffer trimToSize];
+	STAssertEquals([buffer capacity], (NSUInteger)64, nil);
+	[buffer removeObjectsAtIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, 16)]];
+	[buffer trimToSize];
+	STAssertEquals([buffer capacity], (NSUInteger)32, nil);
+	STAssertEquals([buffer count], (NSUInteger)16, nil);
+	STAssertEqualObjects([buffer lastObject], [fifteen lastObject], nil);
+	[buffer removeAllObjects];
+	STAssertEquals([buffer capacity], (NSUInteger)16, nil);
+}
+
 - (void) testReplaceObjectAtIndexWithObject {
 	STAssertThrows([buffer replaceObjectAtIndex:0 withObject:nil], nil);
 	STAssertThrows([buffer replaceObjectAtIndex:1 withObject:nil], nil);
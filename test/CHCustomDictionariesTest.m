@@ -13,6 +13,7 @@
 #import <SenTestingKit/SenTestingKit.h>
 
 #import "CHBidirectionalDictionary.h"
+#import "CHIntegerSortedDictionary.h"
 #import "CHLockableDictionary.h"
 #import "CHMultiDictionary.h"
 #import "CHOrderedDictionary.h"
@@ -646,6 +647,23 @@ static NSArray* keyArray;
 	expectedKeyOrder = [keyArray sortedArrayUsingSelector:@selector(compare:)];
 }
 
+- (void) testFloorKeyAndCeilingKey {
+	STAssertNil([dictionary floorKey:@"foo"], nil);
+	STAssertNil([dictionary ceilingKey:@"foo"], nil);
+	[self populateDictionary];
+	// The sorted keys are: bar, baz, foo, hoo, yoo
+	STAssertNil([dictionary floorKey:@"a"], nil);
+	STAssertEqualObjects([dictionary floorKey:@"bar"], @"bar", nil);
+	STAssertEqualObjects([dictionary floorKey:@"bb"],  @"baz", nil);
+	STAssertEqualObjects([dictionary floorKey:@"goo"], @"foo", nil);
+	STAssertEqualObjects([dictionary floorKey:@"zoo"], @"yoo", nil);
+	STAssertEqualObjects([dictionary ceilingKey:@"a"],   @"bar", nil);
+	STAssertEqualObjects([dictionary ceilingKey:@"foo"], @"foo", nil);
+	STAssertEqualObjects([dictionary ceilingKey:@"fop"], @"hoo", nil);
+	STAssertEqualObjects([dictionary ceilingKey:@"yoo"], @"yoo", nil);
+	STAssertNil([dictionary ceilingKey:@"zoo"], nil);
+}
+
 - (void) testSubsetFromKeyToKeyOptions {
 	STAssertNoThrow([dictionary subsetFromKey:nil toKey:nil options:0],
 					nil);
@@ -664,6 +682,17 @@ static NSArray* keyArray;
 												 toKey:[expectedKeyOrder objectAtIndex:3]
 											   options:0], nil);
 	STAssertEquals([subset count], (NSUInteger)3, nil);
+	for (NSUInteger i = 1; i <= 3; i++) {
+		id aKey = [expectedKeyOrder objectAtIndex:i];
+		STAssertEqualObjects([subset objectForKey:aKey], [dictionary objectForKey:aKey], nil);
+	}
+	STAssertEqualObjects([subset allKeys],
+	                     [expectedKeyOrder subarrayWithRange:NSMakeRange(1, 3)], nil);
+	
+	// The subset should be independent of the receiver
+	[subset removeObjectForKey:[expectedKeyOrder objectAtIndex:2]];
+	STAssertEquals([subset count], (NSUInteger)2, nil);
+	STAssertEquals([dictionary count], [expectedKeyOrder count], nil);
 }
 
 @end
@@ -856,3 +885,121 @@ static NSArray* keyArray;
 }
 
 @end
+
+#pragma mark -
+
+@interface CHIntegerSortedDictionaryTest : SenTestCase {
+	CHIntegerSortedDictionary *dictionary;
+}
+@end
+
+@implementation CHIntegerSortedDictionaryTest
+
+- (void) setUp {
+	dictionary = [[[CHIntegerSortedDictionary alloc] init] autorelease];
+	// Keys are the multiples of 10 from -500 to 490, added in a scrambled order.
+	for (NSUInteger i = 0; i < 100; i++) {
+		int64_t key = (int64_t)((i * 37) % 100) * 10 - 500;
+		[dictionary setObject:[NSString stringWithFormat:@"%lld", (long long)key]
+		        forIntegerKey:key];
+	}
+}
+
+- (void) testSetObjectForIntegerKey {
+	STAssertEquals([dictionary count], (NSUInteger)100, nil);
+	STAssertEqualObjects([dictionary objectForIntegerKey:-500], @"-500", nil);
+	STAssertEqualObjects([dictionary objectForIntegerKey:490], @"490", nil);
+	STAssertNil([dictionary objectForIntegerKey:5], nil);
+	[dictionary setObject:@"zero" forIntegerKey:0];
+	STAssertEquals([dictionary count], (NSUInteger)100, nil);
+	STAssertEqualObjects([dictionary objectForIntegerKey:0], @"zero", nil);
+	STAssertThrows([dictionary setObject:nil forIntegerKey:0], nil);
+}
+
+- (void) testRemoveObjectForIntegerKey {
+	[dictionary removeObjectForIntegerKey:5];
+	STAssertEquals([dictionary count], (NSUInteger)100, nil);
+	for (int64_t key = -500; key < 500; key += 20)
+		[dictionary removeObjectForIntegerKey:key];
+	STAssertEquals([dictionary count], (NSUInteger)50, nil);
+	STAssertNil([dictionary objectForIntegerKey:-500], nil);
+	STAssertEqualObjects([dictionary objectForIntegerKey:-490], @"-490", nil);
+	[dictionary removeAllObjects];
+	STAssertEquals([dictionary count], (NSUInteger)0, nil);
+	int64_t key;
+	STAssertFalse([dictionary getFirstKey:&key], nil);
+	STAssertEqualObjects([dictionary description], @"{\n}", nil);
+}
+
+- (void) testFloorAndCeilingKeys {
+	int64_t key;
+	STAssertTrue([dictionary getFirstKey:&key], nil);
+	STAssertEquals(key, (int64_t)-500, nil);
+	STAssertTrue([dictionary getLastKey:&key], nil);
+	STAssertEquals(key, (int64_t)490, nil);
+	STAssertTrue([dictionary getFloorKey:&key forKey:25], nil);
+	STAssertEquals(key, (int64_t)20, nil);
+	STAssertTrue([dictionary getFloorKey:&key forKey:30], nil);
+	STAssertEquals(key, (int64_t)30, nil);
+	STAssertTrue([dictionary getCeilingKey:&key forKey:25], nil);
+	STAssertEquals(key, (int64_t)30, nil);
+	STAssertTrue([dictionary getCeilingKey:&key forKey:-500], nil);
+	STAssertEquals(key, (int64_t)-500, nil);
+	STAssertFalse([dictionary getFloorKey:&key forKey:-501], nil);
+	STAssertFalse([dictionary getCeilingKey:&key forKey:491], nil);
+}
+
+- (void) testGetKeysObjectsMaxCountStartingAtKey {
+	int64_t keys[8];
+	id objects[8];
+	NSUInteger copied = [dictionary getKeys:keys objects:objects maxCount:8 startingAtKey:-5];
+	STAssertEquals(copied, (NSUInteger)8, nil);
+	for (NSUInteger i = 0; i < copied; i++) {
+		STAssertEquals(keys[i], (int64_t)(10 * i), nil);
+		STAssertEqualObjects(objects[i], [NSString stringWithFormat:@"%d", (int)(10 * i)], nil);
+	}
+	copied = [dictionary getKeys:keys objects:NULL maxCount:8 startingAtKey:450];
+	STAssertEquals(copied, (NSUInteger)5, nil);
+	STAssertEquals(keys[4], (int64_t)490, nil);
+}
+
+- (void) testSubsetFromIntegerKeyToIntegerKeyOptions {
+	CHIntegerSortedDictionary *subset;
+	subset = [dictionary subsetFromIntegerKey:0 toIntegerKey:100 options:0];
+	STAssertEquals([subset count], (NSUInteger)11, nil);
+	STAssertEqualObjects([subset objectForIntegerKey:100], @"100", nil);
+	subset = [dictionary subsetFromIntegerKey:0 toIntegerKey:100
+	                                  options:CHSubsetExcludeHighEndpoint];
+	STAssertEquals([subset count], (NSUInteger)10, nil);
+	STAssertNil([subset objectForIntegerKey:100], nil);
+	subset = [dictionary subsetFromIntegerKey:400 toIntegerKey:-400 options:0];
+	STAssertEquals([subset count], (NSUInteger)21, nil);
+}
+
+#if NS_BLOCKS_AVAILABLE
+- (void) testEnumerateKeysAndObjects {
+	__block int64_t expected = -500;
+	[dictionary enumerateKeysAndObjectsUsingBlock:^(int64_t key, id obj, BOOL *stop) {
+		STAssertEquals(key, expected, nil);
+		STAssertEqualObjects(obj, [NSString stringWithFormat:@"%lld", (long long)key], nil);
+		expected += 10;
+	}];
+	STAssertEquals(expected, (int64_t)500, nil);
+	STAssertThrows([dictionary enumerateKeysAndObjectsUsingBlock:^(int64_t key, id obj, BOOL *stop) {
+		[dictionary setObject:obj forIntegerKey:key + 1];
+	}], nil);
+}
+#endif
+
+- (void) testNSCodingAndNSCopying {
+	id clone = replicateWithNSCoding(dictionary);
+	STAssertEqualObjects(clone, dictionary, nil);
+	STAssertEquals([clone hash], [dictionary hash], nil);
+	CHIntegerSortedDictionary *copy = [[dictionary copy] autorelease];
+	STAssertEqualObjects(copy, dictionary, nil);
+	[copy setObject:@"changed" forIntegerKey:0];
+	STAssertFalse([copy isEqual:dictionary], nil);
+	STAssertEqualObjects([dictionary objectForIntegerKey:0], @"0", nil);
+}
+
+@end
@@ -13,6 +13,7 @@
 #import <SenTestingKit/SenTestingKit.h>
 #import "CHCircularBufferQueue.h"
 #import "CHListQueue.h"
+#import "CHSPSCQueue.h"
 
 @interface CHQueueTest : SenTestCase {
 	id<CHQueue> queue;
@@ -142,3 +143,130 @@
 }
 
 @end
+
+#pragma mark -
+
+// The number of objects passed from the producer to the consumer in the threaded test.
+#define kHandoffObjectCount 100000
+
+@interface CHSPSCQueueTest : SenTestCase {
+	CHSPSCQueue *queue;
+	NSArray *objects;
+	int32_t failures;
+}
+@end
+
+@implementation CHSPSCQueueTest
+
+- (void) setUp {
+	queue = [[[CHSPSCQueue alloc] initWithCapacity:4] autorelease];
+	objects = [NSArray arrayWithObjects:@"A",@"B",@"C",nil];
+}
+
+- (void) testInitWithCapacity {
+	STAssertEquals([queue capacity], (NSUInteger)4, nil);
+	STAssertEquals([[[[CHSPSCQueue alloc] initWithCapacity:5] autorelease] capacity], (NSUInteger)8, nil);
+	STAssertEquals([[[[CHSPSCQueue alloc] initWithCapacity:0] autorelease] capacity], (NSUInteger)1, nil);
+	STAssertEquals([[[[CHSPSCQueue alloc] init] autorelease] capacity], (NSUInteger)1024, nil);
+	STAssertEquals([queue count], (NSUInteger)0, nil);
+}
+
+- (void) testEnqueueAndDequeue {
+	STAssertThrows([queue enqueueObject:nil], nil);
+	STAssertNil([queue dequeueObject], nil);
+	STAssertNil([queue firstObject], nil);
+	STAssertNoThrow([queue removeFirstObject], nil);
+	// The indexes wrap around the end of the array several times.
+	for (NSUInteger round = 0; round < 5; round++) {
+		for (id anObject in objects)
+			STAssertTrue([queue enqueueObject:anObject], nil);
+		STAssertEquals([queue count], [objects count], nil);
+		STAssertEqualObjects([queue firstObject], @"A", nil);
+		for (id anObject in objects)
+			STAssertEqualObjects([queue dequeueObject], anObject, nil);
+		STAssertEquals([queue count], (NSUInteger)0, nil);
+	}
+	// A full queue refuses more objects until one is removed.
+	for (NSUInteger i = 0; i < 4; i++)
+		STAssertTrue([queue enqueueObject:[objects objectAtIndex:i % 3]], nil);
+	STAssertFalse([queue enqueueObject:@"D"], nil);
+	STAssertEquals([queue count], (NSUInteger)4, nil);
+	[queue removeFirstObject];
+	STAssertEqualObjects([queue firstObject], @"B", nil);
+	STAssertTrue([queue enqueueObject:@"D"], nil);
+	[queue removeAllObjects];
+	STAssertEquals([queue count], (NSUInteger)0, nil);
+	STAssertNil([queue dequeueObject], nil);
+}
+
+- (void) testBatches {
+	id batch[6] = {@"A",@"B",@"C",@"D",@"E",@"F"}, results[6];
+	STAssertThrows([queue enqueueObjects:NULL count:1], nil);
+	STAssertThrows([queue dequeueObjects:NULL maxCount:1], nil);
+	STAssertEquals([queue enqueueObjects:NULL count:0], (NSUInteger)0, nil);
+	STAssertEquals([queue dequeueObjects:results maxCount:6], (NSUInteger)0, nil);
+	// Only as many objects as fit are enqueued, from the start of the array.
+	STAssertEquals([queue enqueueObjects:batch count:6], (NSUInteger)4, nil);
+	STAssertEquals([queue enqueueObjects:batch count:6], (NSUInteger)0, nil);
+	STAssertEquals([queue dequeueObjects:results maxCount:3], (NSUInteger)3, nil);
+	STAssertEqualObjects(results[0], @"A", nil);
+	STAssertEqualObjects(results[2], @"C", nil);
+	// This batch wraps around the end of the array.
+	STAssertEquals([queue enqueueObjects:batch+4 count:2], (NSUInteger)2, nil);
+	STAssertEquals([queue dequeueObjects:results maxCount:6], (NSUInteger)3, nil);
+	STAssertEqualObjects(results[0], @"D", nil);
+	STAssertEqualObjects(results[1], @"E", nil);
+	STAssertEqualObjects(results[2], @"F", nil);
+	// A nil object prevents the whole batch from being enqueued.
+	batch[1] = nil;
+	STAssertThrows([queue enqueueObjects:batch count:3], nil);
+	STAssertEquals([queue count], (NSUInteger)0, nil);
+}
+
+// Enqueues numbers in order, alternating single objects with batches.
+- (void) producer:(id)unused {
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	id batch[16];
+	NSUInteger next = 0, count, attempts = 0;
+	while (next < kHandoffObjectCount) {
+		count = MIN(next % 16 + 1, kHandoffObjectCount - next);
+		for (NSUInteger i = 0; i < count; i++)
+			batch[i] = [NSNumber numberWithUnsignedInteger:next + i];
+		next += (count == 1) ? [queue enqueueObject:batch[0]]
+		                     : [queue enqueueObjects:batch count:count];
+		if (++attempts % 1024 == 0) {
+			[pool drain];
+			pool = [[NSAutoreleasePool alloc] init];
+		}
+	}
+	[pool drain];
+}
+
+- (void) testProducerAndConsumerThreads {
+	queue = [[[CHSPSCQueue alloc] initWithCapacity:64] autorelease];
+	[NSThread detachNewThreadSelector:@selector(producer:) toTarget:self withObject:nil];
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	id batch[10];
+	NSUInteger expected = 0, count, attempts = 0;
+	while (expected < kHandoffObjectCount) {
+		if (expected % 3 == 0) {
+			id anObject = [queue dequeueObject];
+			if (anObject != nil && [anObject unsignedIntegerValue] != expected++)
+				failures++;
+		} else {
+			count = [queue dequeueObjects:batch maxCount:10];
+			for (NSUInteger i = 0; i < count; i++)
+				if ([batch[i] unsignedIntegerValue] != expected++)
+					failures++;
+		}
+		if (++attempts % 1024 == 0) {
+			[pool drain];
+			pool = [[NSAutoreleasePool alloc] init];
+		}
+	}
+	[pool drain];
+	STAssertEquals(failures, (int32_t)0, nil);
+	STAssertEquals([queue count], (NSUInteger)0, nil);
+}
+
+@end
@@ -16,7 +16,13 @@
 #import "CHAbstractBinarySearchTree_Internal.h"
 #import "CHAnderssonTree.h"
 #import "CHAVLTree.h"
+#import "CHBTree.h"
+#import "CHConcurrentSkipListSet.h"
+#import "CHFrozenSortedSet.h"
+#import "CHIntegerSortedSet.h"
 #import "CHRedBlackTree.h"
+#import "CHScapegoatTree.h"
+#import "CHSplayTree.h"
 #import "CHTreap.h"
 #import "CHUnbalancedTree.h"
 
@@ -187,6 +193,40 @@ static NSArray *abcde;
 // Shortcut macro for determining whether garbage collection is not enabled
 #define if_rr if(kCHGarbageCollectionNotEnabled)
 
+- (void) testObjectGreaterThanAndLessThan {
+	if (NonConcreteClass())
+		return;
+	STAssertNil([set objectGreaterThan:@"A"], nil);
+	STAssertNil([set objectLessThanOrEqualTo:@"A"], nil);
+	NSArray *acdeg = [NSArray arrayWithObjects:@"A",@"C",@"D",@"E",@"G",nil];
+	e = [acdeg objectEnumerator];
+	while (anObject = [e nextObject])
+		[set addObject:anObject];
+	STAssertNil([set objectGreaterThan:nil], nil);
+	STAssertNil([set objectLessThan:nil], nil);
+	// Compare each query against a linear scan of the sorted objects
+	NSArray *probes = [NSArray arrayWithObjects:@"",@"A",@"B",@"C",@"D",@"E",@"F",@"G",@"H",nil];
+	e = [probes objectEnumerator];
+	while (anObject = [e nextObject]) {
+		id greater = nil, greaterOrEqual = nil, less = nil, lessOrEqual = nil;
+		for (id object in acdeg) {
+			NSComparisonResult comparison = [object compare:anObject];
+			if (comparison != NSOrderedAscending && greaterOrEqual == nil)
+				greaterOrEqual = object;
+			if (comparison == NSOrderedDescending && greater == nil)
+				greater = object;
+			if (comparison != NSOrderedDescending)
+				lessOrEqual = object;
+			if (comparison == NSOrderedAscending)
+				less = object;
+		}
+		STAssertEqualObjects([set objectGreaterThan:anObject], greater, @"%@", anObject);
+		STAssertEqualObjects([set objectGreaterThanOrEqualTo:anObject], greaterOrEqual, @"%@", anObject);
+		STAssertEqualObjects([set objectLessThan:anObject], less, @"%@", anObject);
+		STAssertEqualObjects([set objectLessThanOrEqualTo:anObject], lessOrEqual, @"%@", anObject);
+	}
+}
+
 - (void) testObjectEnumerator {
 	if (NonConcreteClass())
 		return;
@@ -245,6 +285,16 @@ static NSArray *abcde;
 	STAssertEquals([set count], [abcde count], nil);
 	STAssertNoThrow([set removeAllObjects], nil);
 	STAssertEquals([set count], (NSUInteger)0, nil);
+	// Try after some objects were removed, then make sure the set is reusable
+	[set addObjectsFromArray:abcde];
+	[set removeObject:@"B"];
+	[set removeObject:@"D"];
+	[set addObject:@"Z"];
+	STAssertNoThrow([set removeAllObjects], nil);
+	STAssertEquals([set count], (NSUInteger)0, nil);
+	STAssertNil([set firstObject], nil);
+	[set addObjectsFromArray:abcde];
+	STAssertEqualObjects([set allObjects], abcde, nil);
 }
 
 - (void) testRemoveFirstObject {
@@ -350,6 +400,17 @@ static NSArray *abcde;
 	subset = [[set subsetFromObject:@"F" toObject:@"B" options:0] allObjects];
 	STAssertEqualObjects(subset, ag, nil);
 	
+	subset = [[set subsetFromObject:@"Z" toObject:@"B" options:0] allObjects];
+	STAssertEqualObjects(subset, [NSArray arrayWithObject:@"A"], nil);
+	
+	// Test a range which includes only one object, or none at all
+	subset = [[set subsetFromObject:@"D" toObject:@"D" options:0] allObjects];
+	STAssertEqualObjects(subset, [NSArray arrayWithObject:@"D"], nil);
+	subset = [[set subsetFromObject:@"F" toObject:@"F" options:0] allObjects];
+	STAssertEqualObjects(subset, [NSArray array], nil);
+	subset = [[set subsetFromObject:@"H" toObject:@"Z" options:0] allObjects];
+	STAssertEqualObjects(subset, [NSArray array], nil);
+	
 	// Test using options to exclude zero, one, or both endpoints.
 	CHSubsetConstructionOptions o;
 	
@@ -367,6 +428,20 @@ static NSArray *abcde;
 	
 	subset = [[set subsetFromObject:nil toObject:nil options:o] allObjects];
 	STAssertEqualObjects(subset, acdeg, nil);
+	
+	subset = [[set subsetFromObject:@"E" toObject:@"C" options:o] allObjects];
+	STAssertEqualObjects(subset, ag, nil);
+	
+	subset = [[set subsetFromObject:@"D" toObject:@"D" options:o] allObjects];
+	STAssertEqualObjects(subset, [NSArray array], nil);
+	
+	// Test that a subset can be modified independently of the receiver
+	id<CHSortedSet> mutableSubset = [set subsetFromObject:@"B" toObject:@"F" options:0];
+	[mutableSubset addObject:@"F"];
+	[mutableSubset removeObject:@"C"];
+	STAssertEqualObjects([mutableSubset allObjects],
+	                     ([NSArray arrayWithObjects:@"D",@"E",@"F",nil]), nil);
+	STAssertEqualObjects([set allObjects], acdeg, nil);
 }
 
 - (void) testNSCoding {
@@ -376,21 +451,19 @@ static NSArray *abcde;
 	NSArray *before, *after;
 	[set addObjectsFromArray:order];
 	STAssertEquals([set count], [order count], nil);
-	if ([set conformsToProtocol:@protocol(CHSearchTree)])
-		before = [set allObjectsWithTraversalOrder:CHTraverseLevelOrder];
-	else
-		before = [set allObjects];
+	before = [set allObjects];
 	
 	NSData *data = [NSKeyedArchiver archivedDataWithRootObject:set];
 	set = [[NSKeyedUnarchiver unarchiveObjectWithData:data] retain];
 	
+	// Search trees are rebuilt from sorted objects, so only the order is preserved
 	STAssertEquals([set count], [order count], nil);
-	if ([set conformsToProtocol:@protocol(CHSearchTree)])
-		after = [set allObjectsWithTraversalOrder:CHTraverseLevelOrder];
-	else
-		after = [set allObjects];
-	if ([self classUnderTest] != [CHTreap class])
-		STAssertEqualObjects(before, after, nil);
+	after = [set allObjects];
+	STAssertEqualObjects(before, after, nil);
+	[set removeObject:@"A"];
+	[set addObject:@"O"];
+	STAssertEqualObjects([set firstObject], @"B", nil);
+	STAssertEqualObjects([set lastObject], @"O", nil);
 }
 
 - (void) testNSCopying {
@@ -407,12 +480,28 @@ static NSArray *abcde;
 	STAssertNotNil(copy, nil);
 	STAssertEquals([copy count], [abcde count], nil);
 	STAssertEquals([set hash], [copy hash], nil);
-	if ([set conformsToProtocol:@protocol(CHSearchTree)] && [self classUnderTest] != [CHTreap class]) {
+	if ([set conformsToProtocol:@protocol(CHSearchTree)]) {
 		STAssertEqualObjects([set allObjectsWithTraversalOrder:CHTraverseLevelOrder],
 							 [copy allObjectsWithTraversalOrder:CHTraverseLevelOrder], nil);
 	} else {
 		STAssertEqualObjects([set allObjects], [copy allObjects], nil);
 	}
+	// Binary search trees copy their structure, including any balancing info
+	if ([set isKindOfClass:[CHAbstractBinarySearchTree class]]) {
+		for (int number = 1; number <= 100; number++)
+			[set addObject:[NSString stringWithFormat:@"%03d", number]];
+		copy = [[set copy] autorelease];
+		STAssertEqualObjects([set dotGraphString], [copy dotGraphString], nil);
+		// The copy must remain a valid tree as it is modified independently
+		[copy removeObject:@"C"];
+		[copy addObject:@"F"];
+		for (int number = 1; number <= 100; number += 3)
+			[copy removeObject:[NSString stringWithFormat:@"%03d", number]];
+		STAssertEquals([copy count], [set count] - 34, nil);
+		STAssertEqualObjects([copy objectAtRank:0], @"002", nil);
+		STAssertTrue([set containsObject:@"C"], nil);
+		STAssertFalse([set containsObject:@"F"], nil);
+	}
 }
 
 - (void) testNSFastEnumeration {
@@ -439,6 +528,31 @@ static NSArray *abcde;
 	STAssertTrue(raisedException, nil);
 }
 
+- (void) testNSFastEnumerationBreak {
+	if (NonConcreteClass())
+		return;
+	// Add in ascending order, so an unbalanced tree is deeper than the inline stack
+	NSUInteger limit = 200;
+	for (NSUInteger number = 1; number <= limit; number++)
+		[set addObject:[NSNumber numberWithUnsignedInteger:number]];
+	// Stopping early and starting over must begin again at the first object
+	for (NSUInteger stop = 1; stop <= 40; stop += 13) {
+		NSUInteger expected = 1;
+		for (NSNumber *object in set) {
+			STAssertEquals([object unsignedIntegerValue], expected, nil);
+			if (expected++ == stop)
+				break;
+		}
+		STAssertEquals(expected, stop + 1, nil);
+	}
+	NSUInteger expected = 1, count = 0;
+	for (NSNumber *object in set) {
+		STAssertEquals([object unsignedIntegerValue], expected++, nil);
+		count++;
+	}
+	STAssertEquals(count, limit, nil);
+}
+
 @end
 
 #pragma mark -
@@ -446,6 +560,8 @@ static NSArray *abcde;
 @interface CHAbstractBinarySearchTree (Test)
 
 - (id) headerObject;
+- (CHBinaryTreeNode*) rootNode;
+- (CFIndex) linkCountOfNode:(CHBinaryTreeNode*)node;
 
 @end
 
@@ -455,6 +571,14 @@ static NSArray *abcde;
 	return header->object;
 }
 
+- (CHBinaryTreeNode*) rootNode {
+	return header->right;
+}
+
+- (CFIndex) linkCountOfNode:(CHBinaryTreeNode*)node {
+	return CHBinaryTreeNodeLinkCount(nodePool, node);
+}
+
 @end
 
 @interface CHAbstractBinarySearchTreeTest : CHSortedSetTest
@@ -482,10 +606,513 @@ static NSArray *abcde;
 	// NOTE: Individual subclasses should test pre/post/level-order traversals
 }
 
+- (void) testAddObjectsFromSortedArray {
+	if ([self class] == [CHAbstractBinarySearchTreeTest class])
+		return;
+	NSMutableArray *sorted = [NSMutableArray array];
+	for (NSUInteger i = 1; i <= 100; i++)
+		[sorted addObject:[NSNumber numberWithUnsignedInteger:i]];
+	
+	// Sorted input should produce a valid tree with the median at the root
+	[set addObjectsFromArray:sorted];
+	STAssertEquals([set count], [sorted count], nil);
+	STAssertEqualObjects([set allObjects], sorted, nil);
+	STAssertEqualObjects([[set allObjectsWithTraversalOrder:CHTraverseLevelOrder] objectAtIndex:0],
+	                     [NSNumber numberWithUnsignedInteger:50], nil);
+	if ([set respondsToSelector:@selector(verify)])
+		STAssertNoThrow([set verify], nil);
+	
+	// Descending input with duplicates should also be detected
+	[set removeAllObjects];
+	NSMutableArray *reversed = [NSMutableArray arrayWithArray:
+	                            [[sorted reverseObjectEnumerator] allObjects]];
+	[reversed insertObject:[NSNumber numberWithUnsignedInteger:100] atIndex:0];
+	[reversed addObject:[NSNumber numberWithUnsignedInteger:1]];
+	[set addObjectsFromArray:reversed];
+	STAssertEquals([set count], [sorted count], nil);
+	STAssertEqualObjects([set allObjects], sorted, nil);
+	if ([set respondsToSelector:@selector(verify)])
+		STAssertNoThrow([set verify], nil);
+	
+	// The balancing information must support later insertions and removals
+	for (NSUInteger i = 101; i <= 150; i++)
+		[set addObject:[NSNumber numberWithUnsignedInteger:i]];
+	for (NSUInteger i = 1; i <= 150; i += 2)
+		[set removeObject:[NSNumber numberWithUnsignedInteger:i]];
+	STAssertEquals([set count], (NSUInteger)75, nil);
+	STAssertEqualObjects([set firstObject], [NSNumber numberWithUnsignedInteger:2], nil);
+	if ([set respondsToSelector:@selector(verify)])
+		STAssertNoThrow([set verify], nil);
+}
+
+// Orders objects in reverse, to make sure a tree never sends -compare: instead.
+static NSInteger compareReversed(id object1, id object2, void *context) {
+	++*(NSUInteger*)context;
+	return [object2 compare:object1];
+}
+
+- (void) testInitWithComparisonFunction {
+	if ([self class] == [CHAbstractBinarySearchTreeTest class])
+		return;
+	NSUInteger comparisons = 0;
+	STAssertThrows([[[[self classUnderTest] alloc] initWithComparisonFunction:NULL
+	                                                                  context:NULL] release], nil);
+	set = [[[[self classUnderTest] alloc] initWithComparisonFunction:compareReversed
+	                                                         context:&comparisons] autorelease];
+	NSArray *edcba = [[abcde reverseObjectEnumerator] allObjects];
+	e = [abcde objectEnumerator];
+	while (anObject = [e nextObject])
+		[set addObject:anObject];
+	STAssertTrue(comparisons > 0, nil);
+	STAssertEqualObjects([set allObjects], edcba, nil);
+	STAssertEqualObjects([set firstObject], @"E", nil);
+	STAssertEqualObjects([set member:@"C"], @"C", nil);
+	STAssertNil([set member:@"Z"], nil);
+	STAssertEquals([set rankOfObject:@"D"], (NSUInteger)1, nil);
+	
+	// Copies and subsets must use the same ordering.
+	STAssertEqualObjects([[[set copy] autorelease] allObjects], edcba, nil);
+	STAssertEqualObjects([[set subsetFromObject:@"D" toObject:@"B" options:0] allObjects],
+	                     ([NSArray arrayWithObjects:@"D",@"C",@"B",nil]), nil);
+	
+	// Sorted input (according to the function) can still be loaded in bulk.
+	[set removeAllObjects];
+	[set addObjectsFromArray:abcde];
+	STAssertEqualObjects([set allObjects], edcba, nil);
+	[set removeObject:@"A"];
+	[set removeObject:@"E"];
+	STAssertEqualObjects([set allObjects], ([NSArray arrayWithObjects:@"D",@"C",@"B",nil]), nil);
+}
+
+#if NS_BLOCKS_AVAILABLE
+- (void) testInitWithComparator {
+	if ([self class] == [CHAbstractBinarySearchTreeTest class])
+		return;
+	STAssertThrows([[[[self classUnderTest] alloc] initWithComparator:nil] release], nil);
+	set = [[[[self classUnderTest] alloc] initWithComparator:^(id object1, id object2) {
+		return [object2 compare:object1];
+	}] autorelease];
+	[set addObjectsFromArray:abcde];
+	STAssertEqualObjects([set allObjects], [[abcde reverseObjectEnumerator] allObjects], nil);
+	id copy = [[set copy] autorelease];
+	[copy addObject:@"F"];
+	STAssertEqualObjects([copy firstObject], @"F", nil);
+}
+#endif
+
+- (NSArray*) numbersFrom:(NSUInteger)first to:(NSUInteger)last step:(NSUInteger)step {
+	NSMutableArray *numbers = [NSMutableArray array];
+	for (NSUInteger i = first; i <= last; i += step)
+		[numbers addObject:[NSNumber numberWithUnsignedInteger:i]];
+	return numbers;
+}
+
+// Checks each operation against NSMutableSet, with sets of similar sizes (which are merged) and very different sizes (where one set is probed).
+- (void) testSetOperations {
+	if ([self class] == [CHAbstractBinarySearchTreeTest class])
+		return;
+	NSArray *pairs = [NSArray arrayWithObjects:
+	                  [self numbersFrom:2 to:100 step:2],
+	                  [self numbersFrom:3 to:100 step:3],
+	                  [self numbersFrom:1 to:500 step:1],
+	                  [NSArray arrayWithObjects:[NSNumber numberWithInt:7],
+	                   [NSNumber numberWithInt:250], [NSNumber numberWithInt:999], nil],
+	                  [NSArray arrayWithObjects:[NSNumber numberWithInt:4],
+	                   [NSNumber numberWithInt:9], [NSNumber numberWithInt:600], nil],
+	                  [self numbersFrom:2 to:400 step:2],
+	                  [NSArray array],
+	                  [self numbersFrom:1 to:10 step:1],
+	                  nil];
+	SEL operations[] = {@selector(unionWithSortedSet:),
+	                    @selector(intersectWithSortedSet:),
+	                    @selector(minusSortedSet:)};
+	SEL expected[] = {@selector(unionSet:), @selector(intersectSet:), @selector(minusSet:)};
+	id<CHSortedSet> other;
+	NSMutableSet *expectedSet;
+	for (NSUInteger pair = 0; pair < [pairs count]; pair += 2) {
+		for (NSUInteger swap = 0; swap <= 1; swap++) {
+			NSArray *mine = [pairs objectAtIndex:pair + swap];
+			NSArray *theirs = [pairs objectAtIndex:pair + 1 - swap];
+			for (NSUInteger op = 0; op < 3; op++) {
+				[set removeAllObjects];
+				[set addObjectsFromArray:mine];
+				other = [[[[self classUnderTest] alloc] initWithArray:theirs] autorelease];
+				[set performSelector:operations[op] withObject:other];
+				expectedSet = [NSMutableSet setWithArray:mine];
+				[expectedSet performSelector:expected[op] withObject:[NSSet setWithArray:theirs]];
+				STAssertEqualObjects([set allObjects],
+				                     [[expectedSet allObjects] sortedArrayUsingSelector:@selector(compare:)],
+				                     @"%@ (%@ and %@)", NSStringFromSelector(operations[op]),
+				                     [mine lastObject], [theirs lastObject]);
+				STAssertEquals([set count], [expectedSet count], nil);
+				if ([set count] > 0)
+					STAssertEqualObjects([set objectAtRank:[set count] - 1], [set lastObject], nil);
+				STAssertEquals([other count], [theirs count], nil);
+				if ([set respondsToSelector:@selector(verify)])
+					STAssertNoThrow([set verify], nil);
+			}
+		}
+	}
+	
+	// Operations with the receiver itself
+	[set removeAllObjects];
+	[set addObjectsFromArray:abcde];
+	[set unionWithSortedSet:set];
+	STAssertEquals([set count], [abcde count], nil);
+	[set intersectWithSortedSet:set];
+	STAssertEquals([set count], [abcde count], nil);
+	[set minusSortedSet:set];
+	STAssertEquals([set count], (NSUInteger)0, nil);
+}
+
+// Operations with a set in a different order must not merge the two sets' objects as if they were in the same order.
+- (void) testSetOperationsWithDifferentOrderings {
+	if ([self class] == [CHAbstractBinarySearchTreeTest class])
+		return;
+	NSArray *pairs = [NSArray arrayWithObjects:
+	                  [self numbersFrom:2 to:100 step:2],
+	                  [self numbersFrom:3 to:100 step:3],
+	                  [self numbersFrom:1 to:500 step:1],
+	                  [NSArray arrayWithObjects:[NSNumber numberWithInt:7],
+	                   [NSNumber numberWithInt:250], [NSNumber numberWithInt:999], nil],
+	                  nil];
+	SEL operations[] = {@selector(unionWithSortedSet:),
+	                    @selector(intersectWithSortedSet:),
+	                    @selector(minusSortedSet:)};
+	SEL expected[] = {@selector(unionSet:), @selector(intersectSet:), @selector(minusSet:)};
+	NSArray *otherClasses = [NSArray arrayWithObjects:[self classUnderTest],
+	                         [CHBTree class], [CHConcurrentSkipListSet class], nil];
+	NSUInteger comparisons = 0, otherComparisons = 0;
+	id<CHSortedSet> other;
+	NSMutableSet *expectedSet;
+	NSArray *expectedObjects;
+	for (NSUInteger pair = 0; pair < [pairs count]; pair += 2) {
+		for (NSUInteger swap = 0; swap <= 1; swap++) {
+			NSArray *mine = [pairs objectAtIndex:pair + swap];
+			NSArray *theirs = [pairs objectAtIndex:pair + 1 - swap];
+			for (Class otherClass in otherClasses) {
+				// 0: only the other set is reversed; 1: only the receiver; 2: both, but with different contexts.
+				for (NSUInteger reversed = 0; reversed <= 2; reversed++) {
+					for (NSUInteger op = 0; op < 3; op++) {
+						if (reversed == 0)
+							set = [[[[self classUnderTest] alloc] init] autorelease];
+						else
+							set = [[[[self classUnderTest] alloc] initWithComparisonFunction:compareReversed
+							                                                         context:&comparisons] autorelease];
+						[set addObjectsFromArray:mine];
+						if (reversed == 1)
+							other = [[[otherClass alloc] init] autorelease];
+						else
+							other = [[[otherClass alloc] initWithComparisonFunction:compareReversed
+							                                                context:&otherComparisons] autorelease];
+						[other addObjectsFromArray:theirs];
+						[set performSelector:operations[op] withObject:other];
+						expectedSet = [NSMutableSet setWithArray:mine];
+						[expectedSet performSelector:expected[op] withObject:[NSSet setWithArray:theirs]];
+						expectedObjects = [[expectedSet allObjects] sortedArrayUsingSelector:@selector(compare:)];
+						if (reversed != 0)
+							expectedObjects = [[expectedObjects reverseObjectEnumerator] allObjects];
+						STAssertEqualObjects([set allObjects], expectedObjects,
+						                     @"%@ with %@ (%@ and %@)", NSStringFromSelector(operations[op]),
+						                     otherClass, [mine lastObject], [theirs lastObject]);
+						STAssertEquals([set count], [expectedSet count], nil);
+						if ([set respondsToSelector:@selector(verify)])
+							STAssertNoThrow([set verify], nil);
+					}
+				}
+			}
+		}
+	}
+}
+
+- (void) testCountOfObjectsFromObjectToObject {
+	if ([self class] == [CHAbstractBinarySearchTreeTest class])
+		return;
+	STAssertEquals([set countOfObjectsFromObject:nil toObject:nil], (NSUInteger)0, nil);
+	NSArray *acdeg = [NSArray arrayWithObjects:@"A",@"C",@"D",@"E",@"G",nil];
+	e = [acdeg objectEnumerator];
+	while (anObject = [e nextObject])
+		[set addObject:anObject];
+	// Each count should match the size of the equivalent subset
+	NSArray *endpoints = [NSArray arrayWithObjects:@"",@"A",@"B",@"C",@"E",@"F",@"G",@"H",nil];
+	id start, end;
+	for (NSUInteger i = 0; i < [endpoints count]; i++) {
+		for (NSUInteger j = 0; j < [endpoints count]; j++) {
+			start = (i == 0) ? nil : [endpoints objectAtIndex:i];
+			end   = (j == 0) ? nil : [endpoints objectAtIndex:j];
+			STAssertEquals([set countOfObjectsFromObject:start toObject:end],
+			               [[set subsetFromObject:start toObject:end options:0] count],
+			               @"From %@ to %@", start, end);
+		}
+	}
+}
+
+- (void) testCursors {
+	if ([self class] == [CHAbstractBinarySearchTreeTest class])
+		return;
+	STAssertNil([set cursorAtObject:@"A"], nil);
+	CHSearchTreeCursor *cursor = [set cursorAtFirstGreaterOrEqual:nil];
+	STAssertNil([cursor object], nil);
+	STAssertNil([cursor previous], nil);
+	STAssertNil([cursor next], nil);
+
+	NSArray *acdeg = [NSArray arrayWithObjects:@"A",@"C",@"D",@"E",@"G",nil];
+	e = [acdeg objectEnumerator];
+	while (anObject = [e nextObject])
+		[set addObject:anObject];
+	STAssertNil([set cursorAtObject:nil], nil);
+	STAssertNil([set cursorAtObject:@"B"], nil);
+	cursor = [set cursorAtObject:@"D"];
+	STAssertEqualObjects([cursor object], @"D", nil);
+	STAssertEqualObjects([cursor next], @"E", nil);
+	STAssertEqualObjects([cursor next], @"G", nil);
+	STAssertNil([cursor next], nil);
+	STAssertNil([cursor next], nil);
+	STAssertEqualObjects([cursor previous], @"G", nil);
+
+	cursor = [set cursorAtFirstGreaterOrEqual:@"B"];
+	STAssertEqualObjects([cursor object], @"C", nil);
+	STAssertEqualObjects([cursor previous], @"A", nil);
+	STAssertNil([cursor previous], nil);
+	STAssertNil([cursor object], nil);
+	STAssertEqualObjects([cursor next], @"A", nil);
+	STAssertEqualObjects([[set cursorAtFirstGreaterOrEqual:nil] object], @"A", nil);
+	STAssertNil([[set cursorAtFirstGreaterOrEqual:@"H"] object], nil);
+	STAssertEqualObjects([[set cursorAtFirstGreaterOrEqual:@"H"] previous], @"G", nil);
+
+	// Visiting every object in either direction should match the sorted order
+	cursor = [set cursorAtFirstGreaterOrEqual:nil];
+	NSMutableArray *visited = [NSMutableArray array];
+	for (anObject = [cursor object]; anObject != nil; anObject = [cursor next])
+		[visited addObject:anObject];
+	STAssertEqualObjects(visited, acdeg, nil);
+	[visited removeAllObjects];
+	for (anObject = [cursor previous]; anObject != nil; anObject = [cursor previous])
+		[visited insertObject:anObject atIndex:0];
+	STAssertEqualObjects(visited, acdeg, nil);
+
+	// After the tree is modified, a cursor resumes from its current object
+	cursor = [set cursorAtObject:@"C"];
+	[set removeObject:@"C"];
+	[set removeObject:@"D"];
+	STAssertEqualObjects([cursor object], @"C", nil);
+	STAssertEqualObjects([cursor next], @"E", nil);
+	[set addObject:@"B"];
+	[set addObject:@"D"];
+	STAssertEqualObjects([cursor previous], @"D", nil);
+	STAssertEqualObjects([cursor previous], @"B", nil);
+	STAssertEqualObjects([cursor previous], @"A", nil);
+}
+
+- (void) testSnapshot {
+	if ([self class] == [CHAbstractBinarySearchTreeTest class])
+		return;
+	CHAbstractBinarySearchTree *snapshot = [set snapshot];
+	STAssertEquals([snapshot count], (NSUInteger)0, nil);
+	[set addObjectsFromArray:abcde];
+	STAssertEquals([snapshot count], (NSUInteger)0, nil);
+
+	snapshot = [set snapshot];
+	STAssertEqualObjects([snapshot allObjects], abcde, nil);
+	STAssertEquals([snapshot copy], snapshot, nil);
+	[snapshot release];
+	STAssertThrows([snapshot addObject:@"F"], nil);
+	STAssertThrows([snapshot removeObject:@"A"], nil);
+	STAssertThrows([snapshot removeFirstObject], nil);
+	STAssertThrows([snapshot removeAllObjects], nil);
+	STAssertThrows([snapshot compact], nil);
+	STAssertThrows([snapshot unionWithSortedSet:set], nil);
+
+	// Modifying the tree must not affect the snapshot, and vice versa
+	CHAbstractBinarySearchTree *snapshot2 = [set snapshot];
+	[set removeObject:@"C"];
+	[set addObject:@"F"];
+	STAssertEqualObjects([snapshot allObjects], abcde, nil);
+	STAssertEqualObjects([snapshot2 allObjects], abcde, nil);
+	STAssertEqualObjects([set allObjects],
+	                     ([NSArray arrayWithObjects:@"A",@"B",@"D",@"E",@"F",nil]), nil);
+	STAssertEqualObjects([snapshot member:@"C"], @"C", nil);
+	STAssertNil([set member:@"C"], nil);
+	STAssertEquals([snapshot rankOfObject:@"E"], (NSUInteger)4, nil);
+	STAssertEqualObjects([[snapshot cursorAtObject:@"B"] next], @"C", nil);
+	[set removeAllObjects];
+	STAssertEquals([snapshot count], [abcde count], nil);
+
+	// A snapshot archives as the kind of tree it came from
+	NSData *data = [NSKeyedArchiver archivedDataWithRootObject:snapshot];
+	id decoded = [NSKeyedUnarchiver unarchiveObjectWithData:data];
+	STAssertEqualObjects([decoded class], [set class], nil);
+	STAssertEqualObjects([decoded allObjects], abcde, nil);
+	[decoded addObject:@"F"];
+	STAssertEquals([decoded count], [abcde count] + 1, nil);
+
+	// Subsets of a snapshot are ordinary trees of the same kind, so they can be modified and archived
+	NSArray *bcdf = [NSArray arrayWithObjects:@"B",@"C",@"D",@"F",nil];
+	id subset = [snapshot subsetFromObject:@"B" toObject:@"D" options:0];
+	STAssertEqualObjects([subset class], [set class], nil);
+	[subset addObject:@"F"];
+	STAssertEqualObjects([subset allObjects], bcdf, nil);
+	if ([subset respondsToSelector:@selector(verify)])
+		STAssertNoThrow([subset verify], nil);
+	data = [NSKeyedArchiver archivedDataWithRootObject:subset];
+	decoded = [NSKeyedUnarchiver unarchiveObjectWithData:data];
+	STAssertEqualObjects([decoded class], [set class], nil);
+	STAssertEqualObjects([decoded allObjects], bcdf, nil);
+	subset = [snapshot subsetFromObject:nil toObject:nil options:0];
+	STAssertEqualObjects([subset class], [set class], nil);
+	STAssertEqualObjects([subset allObjects], abcde, nil);
+	[subset removeObject:@"A"];
+	STAssertEqualObjects([snapshot allObjects], abcde, nil);
+
+	// Removing everything from a shared tree must leave the snapshot intact
+	[set addObjectsFromArray:abcde];
+	snapshot = [set snapshot];
+	[set removeAllObjects];
+	[set addObject:@"Z"];
+	STAssertEqualObjects([snapshot allObjects], abcde, nil);
+	STAssertEqualObjects([set allObjects], [NSArray arrayWithObject:@"Z"], nil);
+}
+
+- (void) testSnapshotPathCopying {
+	if ([self class] == [CHAbstractBinarySearchTreeTest class])
+		return;
+	NSMutableArray *numbers = [NSMutableArray array];
+	for (int i = 0; i < 200; i++)
+		[numbers addObject:[NSNumber numberWithInt:(i * 7919) % 200 * 2]];
+	[set addObjectsFromArray:numbers];
+	NSArray *original = [set allObjects];
+	CHAbstractBinarySearchTree *snapshot = [set snapshot];
+	CHBinaryTreeNode *root = [set rootNode];
+	STAssertEquals([snapshot rootNode], root, nil);
+	STAssertEquals([set linkCountOfNode:root], (CFIndex)2, nil);
+	
+	// Removing an object which isn't there doesn't copy anything.
+	[set removeObject:[NSNumber numberWithInt:7]];
+	STAssertEquals([set rootNode], root, nil);
+	STAssertEquals([set linkCountOfNode:root], (CFIndex)2, nil);
+	
+	// A modification copies the root (which is on every path), leaving the original to the snapshot.
+	[set addObject:[NSNumber numberWithInt:7]];
+	STAssertTrue([set rootNode] != root, nil);
+	STAssertEquals([snapshot rootNode], root, nil);
+	STAssertEquals([snapshot linkCountOfNode:root], (CFIndex)1, nil);
+	
+	// Mix additions, replacements and removals (present or not), checking every size along the way.
+	NSMutableSet *expected = [NSMutableSet setWithArray:original];
+	[expected addObject:[NSNumber numberWithInt:7]];
+	NSNumber *number;
+	for (int i = 0; i < 600; i++) {
+		number = [NSNumber numberWithInt:(i * 104729) % 450];
+		if (i % 3 == 0) {
+			[set removeObject:number];
+			[expected removeObject:number];
+		} else {
+			[set addObject:number];
+			[expected addObject:number];
+		}
+		if (i % 100 == 99) {
+			NSArray *sorted = [[expected allObjects] sortedArrayUsingSelector:@selector(compare:)];
+			STAssertEqualObjects([set allObjects], sorted, nil);
+			for (NSUInteger rank = 0; rank < [sorted count]; rank++)
+				STAssertEquals([set rankOfObject:[sorted objectAtIndex:rank]], rank, nil);
+			if ([set respondsToSelector:@selector(verify)])
+				STAssertNoThrow([set verify], nil);
+			STAssertEqualObjects([snapshot allObjects], original, nil);
+			// Let go of the old snapshot, and take a new one to diverge from.
+			snapshot = [set snapshot];
+			original = sorted;
+		}
+	}
+	STAssertEquals([snapshot count], [original count], nil);
+	for (NSUInteger rank = 0; rank < [original count]; rank++)
+		STAssertEquals([snapshot rankOfObject:[original objectAtIndex:rank]], rank, nil);
+}
+
+- (void) testCompact {
+	if ([self class] == [CHAbstractBinarySearchTreeTest class])
+		return;
+	STAssertNoThrow([set compact], nil);
+	// Leave gaps among the nodes by removing every third object
+	NSMutableArray *numbers = [NSMutableArray array];
+	for (int i = 0; i < 500; i++)
+		[numbers addObject:[NSNumber numberWithInt:(i * 7919) % 500]];
+	[set addObjectsFromArray:numbers];
+	for (int i = 0; i < 500; i += 3)
+		[set removeObject:[NSNumber numberWithInt:i]];
+	NSArray *levelOrder = [set allObjectsWithTraversalOrder:CHTraverseLevelOrder];
+	NSArray *ascending = [set allObjects];
+	CHAbstractBinarySearchTree *snapshot = [set snapshot];
+
+	// The shape of the tree (and the balancing info) must be preserved
+	[set compact];
+	STAssertEqualObjects([set allObjectsWithTraversalOrder:CHTraverseLevelOrder], levelOrder, nil);
+	STAssertEqualObjects([set allObjects], ascending, nil);
+	STAssertEqualObjects([snapshot allObjects], ascending, nil);
+	STAssertEqualObjects([set objectAtRank:100], [ascending objectAtIndex:100], nil);
+	STAssertEquals([set rankOfObject:[ascending lastObject]], [ascending count] - 1, nil);
+
+	// The tree must remain usable, and enumerators must notice the change
+	NSEnumerator *enumerator = [set objectEnumerator];
+	[set compact];
+	STAssertThrows([enumerator nextObject], nil);
+	for (int i = 0; i < 500; i += 3)
+		[set addObject:[NSNumber numberWithInt:i]];
+	STAssertEquals([set count], (NSUInteger)500, nil);
+	STAssertEqualObjects([set allObjects],
+	                     [numbers sortedArrayUsingSelector:@selector(compare:)], nil);
+}
+
 - (void) testDescription {
 	STAssertEqualObjects([set description], [[set allObjects] description], nil);
 }
 
+- (void) testObjectAtRank {
+	if ([self class] == [CHAbstractBinarySearchTreeTest class])
+		return;
+	STAssertThrows([set objectAtRank:0], nil);
+	objects = [NSArray arrayWithObjects:@"B",@"M",@"C",@"K",@"D",@"I",@"E",@"G",
+			   @"J",@"L",@"N",@"F",@"A",@"H",nil];
+	e = [objects objectEnumerator];
+	while (anObject = [e nextObject])
+		[set addObject:anObject];
+	NSArray *sorted = [objects sortedArrayUsingSelector:@selector(compare:)];
+	for (NSUInteger rank = 0; rank < [sorted count]; rank++)
+		STAssertEqualObjects([set objectAtRank:rank], [sorted objectAtIndex:rank], nil);
+	STAssertThrows([set objectAtRank:[sorted count]], nil);
+	// Ranks must remain correct after removals (and the rebalancing they cause)
+	[set removeObject:@"A"];
+	[set removeObject:@"H"];
+	[set removeObject:@"N"];
+	STAssertEqualObjects([set objectAtRank:0], @"B", nil);
+	STAssertEqualObjects([set objectAtRank:6], @"I", nil);
+	STAssertEqualObjects([set objectAtRank:10], @"M", nil);
+	STAssertThrows([set objectAtRank:11], nil);
+}
+
+- (void) testRankOfObject {
+	if ([self class] == [CHAbstractBinarySearchTreeTest class])
+		return;
+	STAssertEquals([set rankOfObject:nil], (NSUInteger)NSNotFound, nil);
+	STAssertEquals([set rankOfObject:@"A"], (NSUInteger)NSNotFound, nil);
+	objects = [NSArray arrayWithObjects:@"B",@"M",@"C",@"K",@"D",@"I",@"E",@"G",
+			   @"J",@"L",@"N",@"F",@"A",@"H",nil];
+	e = [objects objectEnumerator];
+	while (anObject = [e nextObject])
+		[set addObject:anObject];
+	NSArray *sorted = [objects sortedArrayUsingSelector:@selector(compare:)];
+	for (NSUInteger rank = 0; rank < [sorted count]; rank++)
+		STAssertEquals([set rankOfObject:[sorted objectAtIndex:rank]], rank, nil);
+	STAssertEquals([set rankOfObject:@"Z"], (NSUInteger)NSNotFound, nil);
+	// Replacing an existing object must not change any ranks
+	[set addObject:@"D"];
+	STAssertEquals([set rankOfObject:@"D"], (NSUInteger)3, nil);
+	STAssertEquals([set rankOfObject:@"N"], (NSUInteger)13, nil);
+	[set removeObject:@"C"];
+	[set removeObject:@"bogus"];
+	STAssertEquals([set rankOfObject:@"D"], (NSUInteger)2, nil);
+	STAssertEquals([set rankOfObject:@"N"], (NSUInteger)12, nil);
+}
+
 - (void) testHeaderObject {
 	id headerObject = [set headerObject];
 	STAssertNotNil(headerObject, nil);
@@ -503,7 +1130,10 @@ static NSArray *abcde;
 	NSArray *treeClasses = [NSArray arrayWithObjects:
 							[CHAnderssonTree class],
 							[CHAVLTree class],
+							[CHBTree class],
 							[CHRedBlackTree class],
+							[CHScapegoatTree class],
+							[CHSplayTree class],
 							[CHTreap class],
 							[CHUnbalancedTree class],
 							nil];
@@ -518,7 +1148,10 @@ static NSArray *abcde;
 	NSArray *sortedSetClasses = [[NSArray alloc] initWithObjects:
 								 [CHAnderssonTree class],
 								 [CHAVLTree class],
+								 [CHBTree class],
 								 [CHRedBlackTree class],
+								 [CHScapegoatTree class],
+								 [CHSplayTree class],
 								 [CHTreap class],
 								 [CHUnbalancedTree class],
 								 nil];
@@ -876,7 +1509,7 @@ static NSArray *abcde;
 		}
 	}
 	NSUInteger leftBlackHeight  = [self verifySubtreeAtNode:node->left];
-	NSUInteger rightBlackHeight = [self verifySubtreeAtNode:node->left];
+	NSUInteger rightBlackHeight = [self verifySubtreeAtNode:node->right];
 	/* Test for invalid binary search tree */
 	if ([node->left->object compare:(node->object)] == NSOrderedDescending ||
 		[node->right->object compare:(node->object)] == NSOrderedAscending)
@@ -990,7 +1623,10 @@ static NSArray *abcde;
 - (void) testAddObjectsAscending {
 	objects = [NSArray arrayWithObjects:@"A",@"B",@"C",@"D",@"E",@"F",@"G",@"H",
 			   @"I",@"J",@"K",@"L",@"M",@"N",@"O",@"P",@"Q",@"R",nil];
-	[set addObjectsFromArray:objects];
+	// Add one at a time, since -addObjectsFromArray: bulk loads sorted input
+	e = [objects objectEnumerator];
+	while (anObject = [e nextObject])
+		[set addObject:anObject];
 	STAssertEquals([set count], [objects count], nil);
 	STAssertNoThrow([set verify], nil);
 	STAssertEqualObjects([set allObjectsWithTraversalOrder:CHTraverseLevelOrder],
@@ -1289,6 +1925,136 @@ static NSArray *abcde;
 	STAssertEquals([set count], (NSUInteger)0, nil);
 }
 
+- (void) testSetRandomSeed {
+	CHTreap *other = [[[CHTreap alloc] init] autorelease];
+	[set setRandomSeed:42];
+	[other setRandomSeed:42];
+	[set addObjectsFromArray:objects];
+	[other addObjectsFromArray:objects];
+	// The same seed and the same insertions produce the same shape.
+	STAssertEqualObjects([set allObjectsWithTraversalOrder:CHTraversePreOrder],
+	                     [other allObjectsWithTraversalOrder:CHTraversePreOrder], nil);
+	e = [objects objectEnumerator];
+	while (anObject = [e nextObject])
+		STAssertEquals([set priorityForObject:anObject], [other priorityForObject:anObject], nil);
+	// Reseeding changes the priorities assigned after it.
+	[other removeAllObjects];
+	[other setRandomSeed:43];
+	[other addObjectsFromArray:objects];
+	BOOL samePriorities = YES;
+	e = [objects objectEnumerator];
+	while (anObject = [e nextObject])
+		if ([set priorityForObject:anObject] != [other priorityForObject:anObject])
+			samePriorities = NO;
+	STAssertFalse(samePriorities, nil);
+}
+
+- (void) testSplitAtObject {
+	STAssertThrows([set splitAtObject:nil], nil);
+	CHTreap *tail = [set splitAtObject:@"A"];
+	STAssertEquals([tail count], (NSUInteger)0, nil);
+	
+	[set addObjectsFromArray:objects];
+	tail = [set splitAtObject:@"F"];
+	STAssertEquals([set count], (NSUInteger)5, nil);
+	STAssertEquals([tail count], (NSUInteger)8, nil);
+	STAssertNoThrow([set verify], nil);
+	STAssertNoThrow([tail verify], nil);
+	STAssertEqualObjects([set allObjects],
+	                     ([NSArray arrayWithObjects:@"A",@"B",@"C",@"D",@"E",nil]), nil);
+	STAssertEqualObjects([tail allObjects],
+	                     ([NSArray arrayWithObjects:@"F",@"G",@"H",@"I",@"J",@"K",@"L",@"M",nil]), nil);
+	STAssertEquals([tail rankOfObject:@"K"], (NSUInteger)5, nil);
+	
+	// Split at an object which is absent, then at the ends.
+	CHTreap *last = [tail splitAtObject:@"Jx"];
+	STAssertEqualObjects([last allObjects],
+	                     ([NSArray arrayWithObjects:@"K",@"L",@"M",nil]), nil);
+	STAssertEquals([[tail splitAtObject:@"Z"] count], (NSUInteger)0, nil);
+	STAssertEquals([tail count], (NSUInteger)5, nil);
+	CHTreap *all = [last splitAtObject:@"A"];
+	STAssertEquals([last count], (NSUInteger)0, nil);
+	STAssertEquals([all count], (NSUInteger)3, nil);
+	
+	// The treaps which share storage can still be modified independently.
+	[set addObject:@"Ax"];
+	[set removeObject:@"B"];
+	[tail removeObject:@"G"];
+	[all addObject:@"N"];
+	[all removeAllObjects];
+	STAssertNoThrow([set verify], nil);
+	STAssertNoThrow([tail verify], nil);
+	STAssertEqualObjects([set allObjects],
+	                     ([NSArray arrayWithObjects:@"A",@"Ax",@"C",@"D",@"E",nil]), nil);
+	STAssertEqualObjects([tail allObjects],
+	                     ([NSArray arrayWithObjects:@"F",@"H",@"I",@"J",nil]), nil);
+	
+	// A snapshot of a split treap is unaffected by later changes to either half.
+	CHAbstractBinarySearchTree *snapshot = [tail snapshot];
+	[tail removeObject:@"F"];
+	[[set splitAtObject:@"D"] addObject:@"Dx"];
+	STAssertEqualObjects([snapshot allObjects],
+	                     ([NSArray arrayWithObjects:@"F",@"H",@"I",@"J",nil]), nil);
+	STAssertEqualObjects([set allObjects],
+	                     ([NSArray arrayWithObjects:@"A",@"Ax",@"C",nil]), nil);
+}
+
+- (void) testMergeWithTreap {
+	STAssertThrows([set mergeWithTreap:nil], nil);
+	[set addObjectsFromArray:objects];
+	CHTreap *tail = [set splitAtObject:@"F"];
+	CHTreap *middle = [set splitAtObject:@"C"];
+	
+	// Objects which overlap can't be merged.
+	[middle addObject:@"Fx"];
+	STAssertThrows([tail mergeWithTreap:middle], nil);
+	STAssertThrows([set mergeWithTreap:set], nil);
+	[middle removeObject:@"Fx"];
+	
+	// Treaps sorted in different orders can't be merged, even if either is empty.
+	NSUInteger comparisons = 0, middleCount = [middle count];
+	CHTreap *reversed = [[[CHTreap alloc] initWithComparisonFunction:compareReversed
+	                                                         context:&comparisons] autorelease];
+	STAssertThrows([reversed mergeWithTreap:middle], nil);
+	STAssertThrows([middle mergeWithTreap:reversed], nil);
+	STAssertEquals([middle count], middleCount, nil);
+	STAssertEquals([reversed count], (NSUInteger)0, nil);
+	
+	// Merge treaps which share storage, with the greater objects on either side.
+	[middle mergeWithTreap:tail];
+	STAssertEquals([tail count], (NSUInteger)0, nil);
+	STAssertEquals([middle count], (NSUInteger)11, nil);
+	[middle mergeWithTreap:set];
+	STAssertEquals([set count], (NSUInteger)0, nil);
+	STAssertNoThrow([middle verify], nil);
+	STAssertEqualObjects([middle allObjects],
+	                     [objects sortedArrayUsingSelector:@selector(compare:)], nil);
+	
+	// Merge treaps which don't share storage, including into an empty treap.
+	CHTreap *other = [[[CHTreap alloc] initWithArray:
+	                   [NSArray arrayWithObjects:@"X",@"Y",@"Z",nil]] autorelease];
+	[middle mergeWithTreap:other];
+	STAssertEquals([other count], (NSUInteger)0, nil);
+	STAssertEquals([middle count], (NSUInteger)16, nil);
+	STAssertNoThrow([middle verify], nil);
+	[other mergeWithTreap:middle];
+	STAssertEquals([other count], (NSUInteger)16, nil);
+	STAssertEquals([other rankOfObject:@"Y"], (NSUInteger)14, nil);
+	STAssertNoThrow([other verify], nil);
+	
+	// Merging into a treap which shares its nodes with a snapshot leaves the snapshot intact.
+	NSArray *merged = [other allObjects];
+	CHAbstractBinarySearchTree *snapshot = [other snapshot];
+	CHTreap *greater = [[[CHTreap alloc] initWithArray:
+	                     [NSArray arrayWithObjects:@"ZA",@"ZB",nil]] autorelease];
+	[other mergeWithTreap:greater];
+	STAssertEquals([other count], (NSUInteger)18, nil);
+	STAssertEquals([other rankOfObject:@"ZB"], (NSUInteger)17, nil);
+	STAssertNoThrow([other verify], nil);
+	STAssertEqualObjects([snapshot allObjects], merged, nil);
+	STAssertEquals([snapshot rankOfObject:@"Z"], (NSUInteger)15, nil);
+}
+
 @end
 
 #pragma mark -
@@ -1463,3 +2229,853 @@ static NSArray *abcde;
 }
 
 @end
+
+#pragma mark -
+
+@interface CHScapegoatTree (Test)
+
+- (void) verify;
+
+@end
+
+@implementation CHScapegoatTree (Test)
+
+- (NSUInteger) heightOfSubtreeAtNode:(CHBinaryTreeNode*)node {
+	if (node == sentinel)
+		return 0;
+	return MAX([self heightOfSubtreeAtNode:node->left],
+	           [self heightOfSubtreeAtNode:node->right]) + 1;
+}
+
+- (void) verify {
+	// Every node must be within log base 3/2 of the largest count since the last rebuild.
+	NSUInteger height = [self heightOfSubtreeAtNode:header->right], limit = 0;
+	for (double power = 1.5; power <= MAX(maxCount, count); power *= 1.5)
+		limit++;
+	if (height > limit + 1) {
+		[NSException raise:NSInternalInconsistencyException
+		            format:@"Height %lu of %lu nodes exceeds the limit of %lu",
+		                   (unsigned long)height, (unsigned long)count, (unsigned long)(limit + 1)];
+	}
+}
+
+@end
+
+@interface CHScapegoatTreeTest : CHAbstractBinarySearchTreeTest
+@end
+
+@implementation CHScapegoatTreeTest
+
+- (Class) classUnderTest {
+	return [CHScapegoatTree class];
+}
+
+- (void) testAddObjectInSequence {
+	// Adding objects in order would make an unbalanced tree into a linked list.
+	for (int i = 1; i <= 1000; i++) {
+		[set addObject:[NSNumber numberWithInt:i]];
+		STAssertNoThrow([set verify], nil);
+	}
+	STAssertEquals([set count], (NSUInteger)1000, nil);
+	STAssertEqualObjects([set objectAtRank:499], [NSNumber numberWithInt:500], nil);
+	STAssertEquals([set rankOfObject:[NSNumber numberWithInt:1000]], (NSUInteger)999, nil);
+}
+
+- (void) testRemoveObjectRebuildsTree {
+	for (int i = 1; i <= 1000; i++)
+		[set addObject:[NSNumber numberWithInt:i]];
+	// Removing the smallest objects unbalances the tree until it is rebuilt.
+	for (int i = 1; i <= 900; i++) {
+		[set removeObject:[NSNumber numberWithInt:i]];
+		STAssertNoThrow([set verify], nil);
+	}
+	STAssertEquals([set count], (NSUInteger)100, nil);
+	STAssertEqualObjects([set firstObject], [NSNumber numberWithInt:901], nil);
+	STAssertEqualObjects([set objectAtRank:50], [NSNumber numberWithInt:951], nil);
+	[set removeAllObjects];
+	[set addObjectsFromArray:abcde];
+	STAssertEqualObjects([set allObjects], abcde, nil);
+}
+
+@end
+
+#pragma mark -
+
+@interface CHSplayTreeTest : CHAbstractBinarySearchTreeTest
+@end
+
+@implementation CHSplayTreeTest
+
+- (Class) classUnderTest {
+	return [CHSplayTree class];
+}
+
+- (void) testMemberSplaysToRoot {
+	[set addObjectsFromArray:abcde];
+	// Each object found (or the last one compared) is moved to the root.
+	e = [abcde objectEnumerator];
+	while (anObject = [e nextObject]) {
+		STAssertEqualObjects([set member:anObject], anObject, nil);
+		STAssertEqualObjects([set anyObject], anObject, nil);
+		STAssertEqualObjects([set allObjects], abcde, nil);
+	}
+	STAssertNil([set member:@"Z"], nil);
+	STAssertEqualObjects([set anyObject], @"E", nil);
+	STAssertFalse([set containsObject:@"0"], nil);
+	STAssertEqualObjects([set anyObject], @"A", nil);
+
+	[set addObject:@"C"];
+	STAssertEqualObjects([set anyObject], @"C", nil);
+	[set removeObject:@"C"];
+	STAssertEqualObjects([set anyObject], @"B", nil);
+	STAssertEqualObjects([set allObjects],
+	                     ([NSArray arrayWithObjects:@"A",@"B",@"D",@"E",nil]), nil);
+}
+
+- (void) testMemberInvalidatesEnumerators {
+	[set addObjectsFromArray:abcde];
+	NSEnumerator *enumerator = [set objectEnumerator];
+	[set member:@"C"];
+	STAssertThrows([enumerator nextObject], nil);
+	// A snapshot is not splayed, so it can be searched while enumerating it.
+	CHAbstractBinarySearchTree *snapshot = [set snapshot];
+	NSUInteger found = 0;
+	for (id object in snapshot) {
+		if ([snapshot member:object] != nil)
+			found++;
+	}
+	STAssertEquals(found, [abcde count], nil);
+}
+
+- (void) testOrderStatistics {
+	NSMutableArray *numbers = [NSMutableArray array];
+	for (int i = 0; i < 500; i++)
+		[numbers addObject:[NSNumber numberWithInt:(i * 7919) % 500]];
+	[set addObjectsFromArray:numbers];
+	// Subtree sizes must stay correct as searches restructure the tree.
+	for (int i = 0; i < 500; i += 7)
+		[set member:[NSNumber numberWithInt:i]];
+	[set member:[NSNumber numberWithInt:-1]];
+	for (int i = 0; i < 500; i += 3)
+		[set removeObject:[NSNumber numberWithInt:i]];
+	NSArray *sorted = [set allObjects];
+	STAssertEquals([sorted count], [set count], nil);
+	for (NSUInteger rank = 0; rank < [sorted count]; rank++) {
+		STAssertEqualObjects([set objectAtRank:rank], [sorted objectAtIndex:rank], nil);
+		STAssertEquals([set rankOfObject:[sorted objectAtIndex:rank]], rank, nil);
+	}
+}
+
+@end
+
+#pragma mark -
+
+/*
+ CHBTree and CHIntegerSortedSet share their B+ tree algorithms (see CHBTree_Internal.h), so both are put through the same additions and removals, which reach each edge of a node of 64 keys: splitting a leaf with the new key on either side, splitting the root branch, borrowing from and merging with siblings on either side, and shrinking back to an empty tree.
+ */
+typedef struct CHBTreeEdgeCase {
+	BOOL add;        // Whether the keys are added or removed.
+	NSInteger first; // The first key.
+	NSInteger last;  // The last key, which is less than the first if the step is negative.
+	NSInteger step;  // The difference between each key and the next.
+} CHBTreeEdgeCase;
+
+static const CHBTreeEdgeCase bTreeEdgeCases[] = {
+	{YES,     0,  126,  2}, // Fill the root leaf exactly.
+	{YES,     1,    1,  1}, // Split it, with the new key in the left half.
+	{YES,   127,  253,  2}, // Split the last leaf, with each new key at its end.
+	{YES,     3,  125,  2}, // Split leaves in the middle.
+	{YES,  1000, 5999,  1}, // Split the root branch, so the tree has three levels.
+	{NO,   1001, 5999,  2}, // Leave many leaves underfull, borrowing and merging throughout.
+	{NO,   5998, 3000, -2}, // Merge the last child of each branch with its left sibling.
+	{NO,      0,  200,  1}, // Borrow from and merge with the right sibling of each first child.
+	{YES,   -64,   -1,  1}, // Insert each key at the start of the first leaf.
+	{NO,    -64, 6000,  1}, // Remove everything, shrinking the root back down to an empty leaf.
+	{YES,    42,   42,  1}, // The emptied tree is still usable.
+};
+
+#define kCHBTreeEdgeCaseCount (sizeof(bTreeEdgeCases) / sizeof(CHBTreeEdgeCase))
+
+#pragma mark -
+
+@interface CHBTreeTest : CHSortedSetTest
+@end
+
+@implementation CHBTreeTest
+
+- (Class) classUnderTest {
+	return [CHBTree class];
+}
+
+- (NSArray*) numbersFrom:(NSUInteger)first to:(NSUInteger)last step:(NSUInteger)step {
+	NSMutableArray *numbers = [NSMutableArray array];
+	for (NSUInteger i = first; i <= last; i += step)
+		[numbers addObject:[NSNumber numberWithUnsignedInteger:i]];
+	return numbers;
+}
+
+// Checks the contents of the tree in both directions, which walks the leaf links.
+- (void) checkContents:(NSArray*)expected {
+	STAssertEquals([set count], [expected count], nil);
+	STAssertEqualObjects([set allObjects], expected, nil);
+	STAssertEqualObjects([[set reverseObjectEnumerator] allObjects],
+	                     [[expected reverseObjectEnumerator] allObjects], nil);
+	NSUInteger index = 0;
+	for (id object in set)
+		STAssertEqualObjects(object, [expected objectAtIndex:index++], nil);
+	STAssertEquals(index, [expected count], nil);
+}
+
+- (void) testAllObjectsWithTraversalOrder {
+	// Every object is in a leaf, so every order except descending is ascending.
+	[set addObjectsFromArray:[NSArray arrayWithObjects:@"C",@"A",@"E",@"B",@"D",nil]];
+	STAssertEqualObjects([set allObjectsWithTraversalOrder:CHTraverseAscending], abcde, nil);
+	STAssertEqualObjects([set allObjectsWithTraversalOrder:CHTraverseDescending],
+	                     [[abcde reverseObjectEnumerator] allObjects], nil);
+	STAssertEqualObjects([set allObjectsWithTraversalOrder:CHTraversePreOrder], abcde, nil);
+	STAssertEqualObjects([set allObjectsWithTraversalOrder:CHTraversePostOrder], abcde, nil);
+	STAssertEqualObjects([set allObjectsWithTraversalOrder:CHTraverseLevelOrder], abcde, nil);
+}
+
+// Adds and removes enough objects (in scrambled order) to split and merge nodes at several levels.
+- (void) testAddAndRemoveManyObjects {
+	NSUInteger size = 10000;
+	NSArray *sorted = [self numbersFrom:0 to:size - 1 step:1];
+	// Visit the numbers in a scrambled order; 7919 is prime, so each is visited once.
+	NSMutableArray *scrambled = [NSMutableArray arrayWithCapacity:size];
+	for (NSUInteger i = 0; i < size; i++)
+		[scrambled addObject:[sorted objectAtIndex:(i * 7919) % size]];
+	
+	for (id object in scrambled)
+		[set addObject:object];
+	[self checkContents:sorted];
+	// Adding objects which are already present should not change anything.
+	for (id object in scrambled)
+		[set addObject:object];
+	[self checkContents:sorted];
+	
+	// Remove the odd numbers, in scrambled order.
+	for (id object in scrambled)
+		if ([object unsignedIntegerValue] % 2 == 1)
+			[set removeObject:object];
+	[self checkContents:[self numbersFrom:0 to:size - 2 step:2]];
+	
+	// Remove from both ends, then everything else.
+	for (NSUInteger i = 0; i < 1000; i++) {
+		[set removeFirstObject];
+		[set removeLastObject];
+	}
+	[self checkContents:[self numbersFrom:2000 to:size - 2002 step:2]];
+	for (id object in scrambled)
+		[set removeObject:object];
+	[self checkContents:[NSArray array]];
+	STAssertNil([set firstObject], nil);
+	STAssertNil([set lastObject], nil);
+	
+	// The emptied tree should still be usable.
+	[set addObjectsFromArray:[self numbersFrom:1 to:3 step:1]];
+	[self checkContents:[self numbersFrom:1 to:3 step:1]];
+}
+
+- (void) testSplitAndMergeEdgeCases {
+	NSMutableSet *expected = [NSMutableSet set];
+	for (NSUInteger c = 0; c < kCHBTreeEdgeCaseCount; c++) {
+		CHBTreeEdgeCase edgeCase = bTreeEdgeCases[c];
+		for (NSInteger key = edgeCase.first;
+		     (edgeCase.step > 0) ? (key <= edgeCase.last) : (key >= edgeCase.last);
+		     key += edgeCase.step)
+		{
+			NSNumber *number = [NSNumber numberWithInteger:key];
+			if (edgeCase.add) {
+				[set addObject:number];
+				[expected addObject:number];
+			}
+			else {
+				[set removeObject:number];
+				[expected removeObject:number];
+			}
+		}
+		[self checkContents:[[expected allObjects] sortedArrayUsingSelector:@selector(compare:)]];
+	}
+}
+
+- (void) testAddObjectsFromSortedArray {
+	// Sorted input is built directly; the packed nodes must still split and merge.
+	NSArray *sorted = [self numbersFrom:1 to:5000 step:1];
+	[set addObjectsFromArray:sorted];
+	[self checkContents:sorted];
+	for (NSUInteger i = 5001; i <= 6000; i++)
+		[set addObject:[NSNumber numberWithUnsignedInteger:i]];
+	for (NSUInteger i = 1; i <= 6000; i += 2)
+		[set removeObject:[NSNumber numberWithUnsignedInteger:i]];
+	[self checkContents:[self numbersFrom:2 to:6000 step:2]];
+	
+	// Copies and subsets are built the same way.
+	id copy = [[set copy] autorelease];
+	STAssertEqualObjects([copy allObjects], [set allObjects], nil);
+	[copy removeObject:[NSNumber numberWithUnsignedInteger:2]];
+	STAssertEquals([copy count], [set count] - 1, nil);
+	id subset = [set subsetFromObject:[NSNumber numberWithUnsignedInteger:1000]
+	                         toObject:[NSNumber numberWithUnsignedInteger:3001]
+	                          options:0];
+	STAssertEqualObjects([subset allObjects], [self numbersFrom:1000 to:3000 step:2], nil);
+	
+	// Unsorted input is added one object at a time.
+	[set removeAllObjects];
+	[set addObjectsFromArray:[NSArray arrayWithObjects:@"C",@"A",@"E",@"B",@"D",@"A",nil]];
+	[self checkContents:abcde];
+}
+
+- (void) testNeighborsAcrossLeaves {
+	// With only even numbers, every odd number falls between two objects, including between adjacent leaves.
+	NSUInteger size = 2000;
+	for (id object in [self numbersFrom:0 to:size step:2])
+		[set addObject:object];
+	for (NSUInteger i = 1; i < size; i += 2) {
+		NSNumber *number = [NSNumber numberWithUnsignedInteger:i];
+		NSNumber *below = [NSNumber numberWithUnsignedInteger:i - 1];
+		NSNumber *above = [NSNumber numberWithUnsignedInteger:i + 1];
+		STAssertEqualObjects([set objectLessThan:number], below, nil);
+		STAssertEqualObjects([set objectLessThanOrEqualTo:number], below, nil);
+		STAssertEqualObjects([set objectGreaterThan:number], above, nil);
+		STAssertEqualObjects([set objectGreaterThanOrEqualTo:number], above, nil);
+		STAssertEqualObjects([set objectLessThan:above], below, nil);
+		STAssertEqualObjects([set objectGreaterThan:below], above, nil);
+		STAssertEqualObjects([set objectLessThanOrEqualTo:above], above, nil);
+		STAssertNil([set member:number], nil);
+	}
+	STAssertNil([set objectLessThan:[NSNumber numberWithUnsignedInteger:0]], nil);
+	STAssertNil([set objectGreaterThan:[NSNumber numberWithUnsignedInteger:size]], nil);
+}
+
+@end
+
+#pragma mark -
+
+// The number of threads used by the stress tests, and the objects each one owns.
+#define kStressThreads 8
+#define kStressObjectsPerThread 2000
+
+@interface CHConcurrentSkipListSetTest : CHSortedSetTest {
+	NSConditionLock *finishedThreads; // The condition counts the threads that are done.
+	volatile int32_t failures; // Checks which failed on other threads.
+}
+@end
+
+@implementation CHConcurrentSkipListSetTest
+
+- (Class) classUnderTest {
+	return [CHConcurrentSkipListSet class];
+}
+
+// Enumerators never raise exceptions for mutations; they continue from the last object returned.
+- (void) testObjectEnumerator {
+	[set addObjectsFromArray:abcde];
+	e = [set objectEnumerator];
+	STAssertEqualObjects([e nextObject], @"A", nil);
+	[set removeObject:@"B"];
+	[set addObject:@"BB"];
+	[set removeObject:@"E"];
+	STAssertNoThrow(anObject = [e nextObject], nil);
+	STAssertEqualObjects(anObject, @"BB", nil);
+	STAssertEqualObjects([e allObjects], ([NSArray arrayWithObjects:@"C",@"D",nil]), nil);
+	STAssertNil([e nextObject], nil);
+	
+	e = [set reverseObjectEnumerator];
+	STAssertEqualObjects([e nextObject], @"D", nil);
+	[set removeObject:@"C"];
+	STAssertEqualObjects([e allObjects], ([NSArray arrayWithObjects:@"BB",@"A",nil]), nil);
+}
+
+- (void) testNSFastEnumeration {
+	NSUInteger limit = 32; // NSFastEnumeration asks for 16 objects at a time
+	for (NSUInteger number = 1; number <= limit; number++)
+		[set addObject:[NSNumber numberWithUnsignedInteger:number]];
+	NSUInteger expected = 1, count = 0;
+	for (NSNumber *object in set) {
+		STAssertEquals([object unsignedIntegerValue], expected++, nil);
+		count++;
+	}
+	STAssertEquals(count, limit, nil);
+	
+	// Removing objects during enumeration is allowed; objects removed before they are reached (and not already in the current batch) are skipped.
+	count = 0;
+	for (NSNumber *object in set) {
+		if ([object unsignedIntegerValue] == 1)
+			for (NSUInteger number = 20; number <= limit; number++)
+				[set removeObject:[NSNumber numberWithUnsignedInteger:number]];
+		count++;
+	}
+	STAssertEquals(count, (NSUInteger)19, nil);
+	STAssertEquals([set count], (NSUInteger)19, nil);
+}
+
+- (void) testAddObjectKeepsExistingObject {
+	NSString *original = [NSString stringWithFormat:@"%@", @"A"];
+	NSString *duplicate = [NSString stringWithFormat:@"%@", @"A"];
+	[set addObject:original];
+	[set addObject:duplicate];
+	STAssertEquals([set count], (NSUInteger)1, nil);
+	STAssertTrue([set member:@"A"] == original, nil);
+}
+
+// Each thread adds its own objects, checks for them, removes half of them, and checks the order of the whole set, while all the other threads do the same.
+- (void) ownedObjectsWorker:(NSNumber*)threadIndex {
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	NSUInteger offset = [threadIndex unsignedIntegerValue], i;
+	NSMutableArray *owned = [NSMutableArray array];
+	for (i = 0; i < kStressObjectsPerThread; i++)
+		[owned addObject:[NSNumber numberWithUnsignedInteger:i * kStressThreads + offset]];
+	for (NSUInteger round = 0; round < 4; round++) {
+		for (NSNumber *number in owned)
+			[set addObject:number];
+		for (NSNumber *number in owned)
+			if (![set containsObject:number])
+				OSAtomicIncrement32Barrier(&failures);
+		i = 0;
+		for (NSNumber *number in owned)
+			if (i++ % 2 == 1)
+				[set removeObject:number];
+		i = 0;
+		for (NSNumber *number in owned)
+			if ([set containsObject:number] != (i++ % 2 == 0))
+				OSAtomicIncrement32Barrier(&failures);
+		NSNumber *previous = nil;
+		for (NSNumber *number in set) {
+			if (previous != nil && [previous compare:number] != NSOrderedAscending)
+				OSAtomicIncrement32Barrier(&failures);
+			previous = number;
+		}
+	}
+	[pool drain];
+	[finishedThreads lock];
+	[finishedThreads unlockWithCondition:[finishedThreads condition] + 1];
+}
+
+- (void) testConcurrentAddAndRemove {
+	finishedThreads = [[NSConditionLock alloc] initWithCondition:0];
+	failures = 0;
+	for (NSUInteger thread = 0; thread < kStressThreads; thread++)
+		[NSThread detachNewThreadSelector:@selector(ownedObjectsWorker:)
+		                         toTarget:self
+		                       withObject:[NSNumber numberWithUnsignedInteger:thread]];
+	[finishedThreads lockWhenCondition:kStressThreads];
+	[finishedThreads unlock];
+	[finishedThreads release];
+	STAssertEquals(failures, (int32_t)0, nil);
+	
+	// Each thread left the even-numbered objects it owns, so every other multiple of the thread count remains.
+	NSUInteger expected = kStressThreads * kStressObjectsPerThread / 2;
+	STAssertEquals([set count], expected, nil);
+	NSUInteger index = 0;
+	for (NSNumber *number in set) {
+		NSUInteger value = [number unsignedIntegerValue];
+		STAssertEquals(value / kStressThreads % 2, (NSUInteger)0, nil);
+		index++;
+	}
+	STAssertEquals(index, expected, nil);
+}
+
+// Each thread removes the first and last objects repeatedly; every object must be removed exactly once.
+- (void) removeEndsWorker:(id)unused {
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	for (NSUInteger i = 0; i < kStressObjectsPerThread / 2; i++) {
+		[set removeFirstObject];
+		[set removeLastObject];
+	}
+	[pool drain];
+	[finishedThreads lock];
+	[finishedThreads unlockWithCondition:[finishedThreads condition] + 1];
+}
+
+- (void) testConcurrentRemoveFirstAndLast {
+	for (NSUInteger i = 0; i < kStressThreads * kStressObjectsPerThread + 10; i++)
+		[set addObject:[NSNumber numberWithUnsignedInteger:i]];
+	finishedThreads = [[NSConditionLock alloc] initWithCondition:0];
+	for (NSUInteger thread = 0; thread < kStressThreads; thread++)
+		[NSThread detachNewThreadSelector:@selector(removeEndsWorker:)
+		                         toTarget:self
+		                       withObject:nil];
+	[finishedThreads lockWhenCondition:kStressThreads];
+	[finishedThreads unlock];
+	[finishedThreads release];
+	// The 10 objects in the middle are the only ones left.
+	STAssertEquals([set count], (NSUInteger)10, nil);
+	NSUInteger first = kStressThreads * kStressObjectsPerThread / 2 - 5;
+	STAssertEqualObjects([set firstObject], [NSNumber numberWithUnsignedInteger:first], nil);
+	STAssertEqualObjects([set lastObject], [NSNumber numberWithUnsignedInteger:first + 9], nil);
+}
+
+@end
+
+#pragma mark -
+
+/*
+ A frozen set cannot be modified, so it can't run the tests for other sorted sets. Instead, each test freezes a red-black tree, and checks that every query gives the same result for both.
+ */
+@interface CHFrozenSortedSetTest : SenTestCase {
+	CHRedBlackTree *tree;
+	CHFrozenSortedSet *frozen;
+}
+@end
+
+@implementation CHFrozenSortedSetTest
+
+// Builds a tree of the even numbers from 0 to 2*(size-1), and freezes it.
+- (void) freezeTreeOfSize:(NSUInteger)size {
+	tree = [[[CHRedBlackTree alloc] init] autorelease];
+	for (NSUInteger i = 0; i < size; i++)
+		[tree addObject:[NSNumber numberWithUnsignedInteger:2 * i]];
+	frozen = [tree freeze];
+}
+
+// Returns the numbers from -1 to 2*size, which include every object in the set, the numbers between them, and a number past each end.
+- (NSArray*) probesForSize:(NSUInteger)size {
+	NSMutableArray *probes = [NSMutableArray array];
+	for (NSInteger i = -1; i <= (NSInteger) (2 * size); i++)
+		[probes addObject:[NSNumber numberWithInteger:i]];
+	return probes;
+}
+
+- (void) testEmptySet {
+	frozen = [[[CHFrozenSortedSet alloc] init] autorelease];
+	STAssertEquals([frozen count], (NSUInteger)0, nil);
+	STAssertNil([frozen anyObject], nil);
+	STAssertNil([frozen firstObject], nil);
+	STAssertNil([frozen lastObject], nil);
+	STAssertNil([frozen member:@"A"], nil);
+	STAssertNil([frozen objectGreaterThan:@"A"], nil);
+	STAssertNil([frozen objectLessThan:@"A"], nil);
+	STAssertNil([[frozen objectEnumerator] nextObject], nil);
+	STAssertNil([[frozen reverseObjectEnumerator] nextObject], nil);
+	STAssertEquals([[frozen allObjects] count], (NSUInteger)0, nil);
+	STAssertEquals([[frozen subsetFromObject:@"A" toObject:@"Z" options:0] count], (NSUInteger)0, nil);
+	for (id anObject in frozen)
+		STFail(@"An empty set should not enumerate any objects.");
+}
+
+- (void) testInitWithArray {
+	frozen = [[[CHFrozenSortedSet alloc] initWithArray:
+	           [NSArray arrayWithObjects:@"D",@"B",@"E",@"A",@"C",@"B",nil]] autorelease];
+	STAssertEquals([frozen count], (NSUInteger)5, nil);
+	STAssertEqualObjects([frozen allObjects],
+	                     ([NSArray arrayWithObjects:@"A",@"B",@"C",@"D",@"E",nil]), nil);
+	STAssertEqualObjects([frozen member:@"C"], @"C", nil);
+	STAssertNil([frozen member:@"F"], nil);
+}
+
+- (void) testQueriesMatchTree {
+	// Sizes around powers of two, since those change the shape of the last level.
+	NSUInteger sizes[] = {1,2,3,4,5,6,7,8,9,15,16,17,31,32,33,100,255,256,1000};
+	for (NSUInteger s = 0; s < sizeof(sizes)/sizeof(NSUInteger); s++) {
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		NSUInteger size = sizes[s];
+		[self freezeTreeOfSize:size];
+		STAssertEquals([frozen count], size, nil);
+		STAssertEqualObjects([frozen allObjects], [tree allObjects], nil);
+		STAssertEqualObjects([[frozen reverseObjectEnumerator] allObjects],
+		                     [[tree reverseObjectEnumerator] allObjects], nil);
+		STAssertEqualObjects([frozen set], [tree set], nil);
+		STAssertEqualObjects([frozen firstObject], [tree firstObject], nil);
+		STAssertEqualObjects([frozen lastObject], [tree lastObject], nil);
+		STAssertTrue([tree containsObject:[frozen anyObject]], nil);
+		STAssertTrue([frozen isEqualToSortedSet:tree], nil);
+		STAssertEquals([frozen hash], [tree hash], nil);
+		
+		NSMutableArray *enumerated = [NSMutableArray array];
+		for (id anObject in frozen)
+			[enumerated addObject:anObject];
+		STAssertEqualObjects(enumerated, [tree allObjects], nil);
+		
+		for (id probe in [self probesForSize:size]) {
+			STAssertEqualObjects([frozen member:probe], [tree member:probe], nil);
+			STAssertEquals([frozen containsObject:probe], [tree containsObject:probe], nil);
+			STAssertEqualObjects([frozen objectGreaterThan:probe],
+			                     [tree objectGreaterThan:probe], nil);
+			STAssertEqualObjects([frozen objectGreaterThanOrEqualTo:probe],
+			                     [tree objectGreaterThanOrEqualTo:probe], nil);
+			STAssertEqualObjects([frozen objectLessThan:probe],
+			                     [tree objectLessThan:probe], nil);
+			STAssertEqualObjects([frozen objectLessThanOrEqualTo:probe],
+			                     [tree objectLessThanOrEqualTo:probe], nil);
+		}
+		[pool drain];
+	}
+}
+
+- (void) testSubsetsMatchTree {
+	[self freezeTreeOfSize:20];
+	NSMutableArray *endpoints = [NSMutableArray arrayWithObject:[NSNull null]];
+	[endpoints addObjectsFromArray:[self probesForSize:20]];
+	for (id start in endpoints) {
+		if (start == [NSNull null])
+			start = nil;
+		for (id end in endpoints) {
+			if (end == [NSNull null])
+				end = nil;
+			for (NSUInteger options = 0; options <= 3; options++) {
+				id<CHSortedSet> subset = [frozen subsetFromObject:start toObject:end options:options];
+				STAssertTrue([subset isKindOfClass:[CHFrozenSortedSet class]], nil);
+				STAssertEqualObjects([subset allObjects],
+				                     [[tree subsetFromObject:start toObject:end options:options] allObjects], nil);
+			}
+		}
+	}
+}
+
+- (void) testFreezeKeepsOrdering {
+	NSUInteger comparisons = 0;
+	tree = [[[CHRedBlackTree alloc] initWithComparisonFunction:compareReversed
+	                                                   context:&comparisons] autorelease];
+	NSArray *letters = [NSArray arrayWithObjects:@"A",@"B",@"C",@"D",@"E",nil];
+	[tree addObjectsFromArray:letters];
+	frozen = [tree freeze];
+	STAssertEqualObjects([frozen allObjects],
+	                     ([NSArray arrayWithObjects:@"E",@"D",@"C",@"B",@"A",nil]), nil);
+	comparisons = 0;
+	STAssertEqualObjects([frozen member:@"B"], @"B", nil);
+	STAssertEqualObjects([frozen objectGreaterThan:@"C"], @"B", nil);
+	STAssertTrue(comparisons > 0, nil);
+	
+	// Every kind of sorted set can be frozen, and a frozen set freezes to itself.
+	NSArray *classes = [NSArray arrayWithObjects:[CHAnderssonTree class], [CHBTree class],
+	                    [CHConcurrentSkipListSet class], [CHTreap class], nil];
+	for (Class aClass in classes) {
+		id<CHSortedSet> sortedSet = [[[aClass alloc] initWithArray:letters] autorelease];
+		STAssertEqualObjects([[sortedSet freeze] allObjects], letters, nil);
+	}
+	STAssertTrue([frozen freeze] == frozen, nil);
+}
+
+- (void) testImmutable {
+	[self freezeTreeOfSize:5];
+	STAssertThrows([frozen addObject:@"A"], nil);
+	STAssertThrows([frozen addObjectsFromArray:[NSArray arrayWithObject:@"A"]], nil);
+	STAssertThrows([frozen removeAllObjects], nil);
+	STAssertThrows([frozen removeFirstObject], nil);
+	STAssertThrows([frozen removeLastObject], nil);
+	STAssertThrows([frozen removeObject:[NSNumber numberWithInt:0]], nil);
+	STAssertEquals([frozen count], (NSUInteger)5, nil);
+}
+
+- (void) testCopyingAndCoding {
+	[self freezeTreeOfSize:50];
+	id copy = [frozen copy];
+	STAssertTrue(copy == frozen, nil);
+	[copy release];
+	id decoded = [NSKeyedUnarchiver unarchiveObjectWithData:
+	              [NSKeyedArchiver archivedDataWithRootObject:frozen]];
+	STAssertTrue([decoded isKindOfClass:[CHFrozenSortedSet class]], nil);
+	STAssertEqualObjects([decoded allObjects], [frozen allObjects], nil);
+}
+
+@end
+
+#pragma mark -
+
+@interface CHIntegerSortedSetTest : SenTestCase {
+	CHIntegerSortedSet *set;
+}
+@end
+
+@implementation CHIntegerSortedSetTest
+
+- (void) setUp {
+	set = [[[CHIntegerSortedSet alloc] init] autorelease];
+}
+
+// Returns the integers in a set, in ascending order, by copying them in small batches.
+- (NSArray*) contentsOfSet:(CHIntegerSortedSet*)aSet {
+	NSMutableArray *contents = [NSMutableArray array];
+	int64_t buffer[7], start = INT64_MIN;
+	NSUInteger copied;
+	do {
+		copied = [aSet getIntegers:buffer maxCount:7 startingAtInteger:start];
+		for (NSUInteger i = 0; i < copied; i++)
+			[contents addObject:[NSNumber numberWithLongLong:buffer[i]]];
+		if (copied > 0)
+			start = buffer[copied - 1] + 1;
+	} while (copied == 7);
+	return contents;
+}
+
+- (void) testEmptySet {
+	int64_t integer = 42;
+	STAssertEquals([set count], (NSUInteger)0, nil);
+	STAssertFalse([set containsInteger:0], nil);
+	STAssertFalse([set getFirstInteger:&integer], nil);
+	STAssertFalse([set getLastInteger:&integer], nil);
+	STAssertFalse([set getInteger:&integer greaterThan:0], nil);
+	STAssertFalse([set getInteger:&integer lessThan:0], nil);
+	STAssertEquals(integer, (int64_t)42, nil);
+	STAssertEquals([[self contentsOfSet:set] count], (NSUInteger)0, nil);
+	STAssertNoThrow([set removeInteger:0], nil);
+	STAssertNoThrow([set removeFirstInteger], nil);
+	STAssertNoThrow([set removeLastInteger], nil);
+	STAssertEqualObjects([set description], @"()", nil);
+}
+
+- (void) testAddAndRemoveManyIntegers {
+	// Enough integers to split and merge nodes at several levels, in a scrambled order.
+	NSUInteger limit = 20000, i;
+	NSMutableSet *expected = [NSMutableSet set];
+	for (i = 0; i < limit; i++) {
+		int64_t integer = (int64_t)((i * 7919) % limit) - 10000;
+		[set addInteger:integer];
+		[expected addObject:[NSNumber numberWithLongLong:integer]];
+	}
+	[set addInteger:0]; // Adding a member again has no effect.
+	STAssertEquals([set count], limit, nil);
+	NSArray *sorted = [[expected allObjects] sortedArrayUsingSelector:@selector(compare:)];
+	STAssertEqualObjects([self contentsOfSet:set], sorted, nil);
+
+	// Remove the odd integers, also in a scrambled order.
+	for (i = 0; i < limit; i++) {
+		int64_t integer = (int64_t)((i * 104729) % limit) - 10000;
+		if (integer % 2 != 0) {
+			[set removeInteger:integer];
+			[expected removeObject:[NSNumber numberWithLongLong:integer]];
+		}
+	}
+	[set removeInteger:1]; // Removing a non-member has no effect.
+	STAssertEquals([set count], limit / 2, nil);
+	sorted = [[expected allObjects] sortedArrayUsingSelector:@selector(compare:)];
+	STAssertEqualObjects([self contentsOfSet:set], sorted, nil);
+	for (i = 0; i < 100; i++) {
+		STAssertTrue([set containsInteger:(int64_t)(2 * i)], nil);
+		STAssertFalse([set containsInteger:(int64_t)(2 * i + 1)], nil);
+	}
+
+	while ([set count] > 0)
+		[set removeFirstInteger];
+	STAssertEquals([[self contentsOfSet:set] count], (NSUInteger)0, nil);
+}
+
+// The same edge cases as for CHBTree, which shares the algorithms of the underlying tree.
+- (void) testSplitAndMergeEdgeCases {
+	NSMutableSet *expected = [NSMutableSet set];
+	for (NSUInteger c = 0; c < kCHBTreeEdgeCaseCount; c++) {
+		CHBTreeEdgeCase edgeCase = bTreeEdgeCases[c];
+		for (NSInteger key = edgeCase.first;
+		     (edgeCase.step > 0) ? (key <= edgeCase.last) : (key >= edgeCase.last);
+		     key += edgeCase.step)
+		{
+			if (edgeCase.add) {
+				[set addInteger:key];
+				[expected addObject:[NSNumber numberWithLongLong:key]];
+			}
+			else {
+				[set removeInteger:key];
+				[expected removeObject:[NSNumber numberWithLongLong:key]];
+			}
+		}
+		NSArray *sorted = [[expected allObjects] sortedArrayUsingSelector:@selector(compare:)];
+		STAssertEquals([set count], [sorted count], nil);
+		STAssertEqualObjects([self contentsOfSet:set], sorted, nil);
+		// Walk backward as well, which follows the links between leaves the other way.
+		NSMutableArray *reversed = [NSMutableArray array];
+		int64_t integer;
+		BOOL more = [set getLastInteger:&integer];
+		while (more) {
+			[reversed addObject:[NSNumber numberWithLongLong:integer]];
+			more = [set getInteger:&integer lessThan:integer];
+		}
+		STAssertEqualObjects(reversed, [[sorted reverseObjectEnumerator] allObjects], nil);
+	}
+}
+
+- (void) testNeighbors {
+	int64_t evens[] = {-4, -2, 0, 2, 4};
+	set = [[[CHIntegerSortedSet alloc] initWithIntegers:evens count:5] autorelease];
+	int64_t result;
+	STAssertTrue([set getFirstInteger:&result], nil);
+	STAssertEquals(result, (int64_t)-4, nil);
+	STAssertTrue([set getLastInteger:&result], nil);
+	STAssertEquals(result, (int64_t)4, nil);
+	// Compare each query against the definition, for probes in and around the set.
+	for (int64_t probe = -6; probe <= 6; probe++) {
+		int64_t greater = MAX((probe + 2) & ~1, -4);
+		int64_t greaterOrEqual = MAX((probe + 1) & ~1, -4);
+		int64_t less = MIN((probe - 1) & ~1, 4);
+		int64_t lessOrEqual = MIN(probe & ~1, 4);
+		STAssertEquals([set getInteger:&result greaterThan:probe], (BOOL)(probe < 4), nil);
+		if (probe < 4)
+			STAssertEquals(result, greater, nil);
+		STAssertEquals([set getInteger:&result greaterThanOrEqualTo:probe], (BOOL)(probe <= 4), nil);
+		if (probe <= 4)
+			STAssertEquals(result, greaterOrEqual, nil);
+		STAssertEquals([set getInteger:&result lessThan:probe], (BOOL)(probe > -4), nil);
+		if (probe > -4)
+			STAssertEquals(result, less, nil);
+		STAssertEquals([set getInteger:&result lessThanOrEqualTo:probe], (BOOL)(probe >= -4), nil);
+		if (probe >= -4)
+			STAssertEquals(result, lessOrEqual, nil);
+	}
+	[set addInteger:INT64_MIN];
+	[set addInteger:INT64_MAX];
+	STAssertFalse([set getInteger:&result lessThan:INT64_MIN], nil);
+	STAssertFalse([set getInteger:&result greaterThan:INT64_MAX], nil);
+	STAssertEqualObjects([set description],
+	                     @"(-9223372036854775808, -4, -2, 0, 2, 4, 9223372036854775807)", nil);
+}
+
+- (void) testSubsetFromIntegerToIntegerOptions {
+	int64_t integers[100];
+	for (NSUInteger i = 0; i < 100; i++)
+		integers[i] = 10 * i;
+	[set addIntegers:integers count:100];
+	CHIntegerSortedSet *subset;
+	subset = [set subsetFromInteger:100 toInteger:200 options:0];
+	STAssertEquals([subset count], (NSUInteger)11, nil);
+	subset = [set subsetFromInteger:100 toInteger:200
+	                        options:CHSubsetExcludeLowEndpoint|CHSubsetExcludeHighEndpoint];
+	STAssertEquals([subset count], (NSUInteger)9, nil);
+	subset = [set subsetFromInteger:95 toInteger:205 options:0];
+	STAssertEquals([subset count], (NSUInteger)11, nil);
+	subset = [set subsetFromInteger:INT64_MIN toInteger:INT64_MAX options:0];
+	STAssertEqualObjects(subset, set, nil);
+	subset = [set subsetFromInteger:100 toInteger:100 options:CHSubsetExcludeLowEndpoint];
+	STAssertEquals([subset count], (NSUInteger)0, nil);
+	// When start is greater than end, the subset is everything outside them.
+	subset = [set subsetFromInteger:900 toInteger:50 options:0];
+	STAssertEquals([subset count], (NSUInteger)(6 + 10), nil);
+	int64_t result;
+	STAssertTrue([subset getInteger:&result greaterThan:50], nil);
+	STAssertEquals(result, (int64_t)900, nil);
+}
+
+#if NS_BLOCKS_AVAILABLE
+- (void) testEnumerateIntegers {
+	for (int64_t i = 0; i < 200; i++)
+		[set addInteger:i];
+	__block int64_t expected = 0;
+	[set enumerateIntegersUsingBlock:^(int64_t integer, BOOL *stop) {
+		STAssertEquals(integer, expected++, nil);
+	}];
+	STAssertEquals(expected, (int64_t)200, nil);
+	[set enumerateIntegersWithOptions:NSEnumerationReverse usingBlock:^(int64_t integer, BOOL *stop) {
+		STAssertEquals(integer, --expected, nil);
+		*stop = (integer == 150);
+	}];
+	STAssertEquals(expected, (int64_t)150, nil);
+	STAssertThrows([set enumerateIntegersUsingBlock:^(int64_t integer, BOOL *stop) {
+		[set removeInteger:integer];
+	}], nil);
+}
+#endif
+
+- (void) testNSCodingAndNSCopying {
+	for (int64_t i = -1000; i < 1000; i += 3)
+		[set addInteger:i * 1000003];
+	id decoded = [NSKeyedUnarchiver unarchiveObjectWithData:
+	              [NSKeyedArchiver archivedDataWithRootObject:set]];
+	STAssertEqualObjects(decoded, set, nil);
+	STAssertEquals([decoded hash], [set hash], nil);
+	CHIntegerSortedSet *copy = [[set copy] autorelease];
+	STAssertEqualObjects(copy, set, nil);
+	[copy removeFirstInteger];
+	STAssertFalse([copy isEqual:set], nil);
+	STAssertEquals([set count], [copy count] + 1, nil);
+}
+
+@end